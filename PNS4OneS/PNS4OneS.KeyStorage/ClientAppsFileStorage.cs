@@ -7,10 +7,41 @@ namespace PNS4OneS.KeyStorage
 {
     public class ClientAppsFileStorage : IClientAppsStorage
     {
+        // Снимок приложений с индексами по идентификатору, ключу сервера и access token. Снимок не изменяется
+        // после создания и заменяется целиком при изменении приложений, поэтому потоки отправки и обработки
+        // запросов читают его без блокировок. Объекты приложений изменяются на месте (например, при выдаче
+        // access token), поэтому после изменения приложения вызывается SaveApp, который перестраивает индексы.
+        private sealed class AppsSnapshot
+        {
+            public static readonly AppsSnapshot Empty = new(new Dictionary<string, ClientApplication>());
+
+            public IReadOnlyList<ClientApplication> Apps { get; }
+            public Dictionary<string, ClientApplication> ById { get; } = new();
+            public Dictionary<string, ClientApplication> ByServerKey { get; } = new();
+            public Dictionary<string, ClientApplication> ByAccessToken { get; } = new();
+
+            public AppsSnapshot(Dictionary<string, ClientApplication> apps)
+            {
+                Apps = new List<ClientApplication>(apps.Values).AsReadOnly();
+
+                foreach (ClientApplication app in Apps)
+                {
+                    ById[app.Id] = app;
+                    if (!string.IsNullOrEmpty(app.ServerKey))
+                        ByServerKey[app.ServerKey] = app;
+                    if (!string.IsNullOrEmpty(app.AccessToken?.Token))
+                        ByAccessToken[app.AccessToken.Token] = app;
+                }
+            }
+        }
+
         private readonly string filePath;
         private readonly ILogger logger;
 
+        // Изменяется только под блокировкой writeLock, после изменения публикуется новый снимок.
         private readonly Dictionary<string, ClientApplication> apps = new();
+        private readonly object writeLock = new();
+        private volatile AppsSnapshot snapshot = AppsSnapshot.Empty;
 
         public ClientAppsFileStorage(string filePath, ILogger logger)
         {
@@ -20,57 +51,97 @@ namespace PNS4OneS.KeyStorage
 
         public void Init()
         {
-            ReadAppsFromFile();
+            lock (writeLock)
+            {
+                ReadAppsFromFile();
+                PublishSnapshot();
+            }
         }
 
         public ClientApplication CreateApp(string appName)
         {
             var app = ClientApplication.NewApp(appName);
-            apps.Add(app.Id, app);
 
-            SaveAppsToFile();
+            lock (writeLock)
+            {
+                apps.Add(app.Id, app);
+                PublishSnapshot();
+                SaveAppsToFile();
+            }
 
             return app;
         }
 
         public bool DeleteApp(string appId)
         {
-            if (!apps.TryGetValue(appId, out ClientApplication app))
-                return false;
+            lock (writeLock)
+            {
+                if (!apps.Remove(appId))
+                    return false;
 
-            apps.Remove(app.Id);
-            SaveAppsToFile();
+                PublishSnapshot();
+                SaveAppsToFile();
+            }
 
             return true;
         }
 
         public ClientApplication GetApp(string appId)
         {
-            if (!apps.TryGetValue(appId, out ClientApplication app))
+            if (appId == null || !snapshot.ById.TryGetValue(appId, out ClientApplication app))
                 return null;
             return app;
         }
 
-        public IEnumerable<ClientApplication> GetApps()
+        // Индекс снимка мог устареть, если access token приложения уже заменен, но SaveApp ещё не вызван,
+        // поэтому token найденного приложения сравнивается повторно.
+        public ClientApplication GetAppByAccessToken(string accessToken)
         {
-            List<ClientApplication> list = new();
-            foreach (var app in apps.Values)
-                list.Add(app);
+            if (string.IsNullOrEmpty(accessToken)
+                || !snapshot.ByAccessToken.TryGetValue(accessToken, out ClientApplication app)
+                || app.AccessToken?.Token != accessToken)
+            {
+                return null;
+            }
+            return app;
+        }
+
+        public ClientApplication GetAppByServerKey(string serverKey)
+        {
+            if (string.IsNullOrEmpty(serverKey)
+                || !snapshot.ByServerKey.TryGetValue(serverKey, out ClientApplication app)
+                || app.ServerKey != serverKey)
+            {
+                return null;
+            }
+            return app;
+        }
 
-            return list;
+        public IEnumerable<ClientApplication> GetApps()
+        {
+            return snapshot.Apps;
         }
 
         public bool SaveApp(ClientApplication app)
         {
-            if (!apps.ContainsKey(app.Id))
-                return false;
+            lock (writeLock)
+            {
+                if (!apps.ContainsKey(app.Id))
+                    return false;
 
-            apps[app.Id] = app;
-            SaveAppsToFile();
+                apps[app.Id] = app;
+                PublishSnapshot();
+                SaveAppsToFile();
+            }
 
             return true;
         }
 
+        private void PublishSnapshot()
+        {
+            snapshot = new AppsSnapshot(apps);
+        }
+
         private void ReadAppsFromFile()
         {
             apps.Clear();
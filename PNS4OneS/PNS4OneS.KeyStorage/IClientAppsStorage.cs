@@ -9,6 +9,8 @@ namespace PNS4OneS.KeyStorage
         bool DeleteApp(string appId);
         IEnumerable<ClientApplication> GetApps();
         ClientApplication GetApp(string appId);
+        ClientApplication GetAppByAccessToken(string accessToken);
+        ClientApplication GetAppByServerKey(string serverKey);
         bool SaveApp(ClientApplication app);
     }
 }
@@ -0,0 +1,48 @@
+﻿using Microsoft.Extensions.Logging.Abstractions;
+using Xunit;
+
+namespace PNS4OneS.Tests
+{
+    public class ClientConnectionTests
+    {
+        private const long SEND_QUEUE_LIMIT = 1024;
+
+        [Fact]
+        public void FrameLargerThanLimitIsQueuedForIdleConnection()
+        {
+            var conn = new ClientConnection(null, SEND_QUEUE_LIMIT, NullLogger.Instance);
+
+            bool queued = conn.EnqueueFrame(new byte[SEND_QUEUE_LIMIT * 4], -1, out bool startSending);
+
+            Assert.True(queued);
+            Assert.True(startSending);
+            Assert.False(conn.OutboundClosed);
+            Assert.Equal(SEND_QUEUE_LIMIT * 4, conn.OutboundBytes);
+        }
+
+        [Fact]
+        public void BackloggedConnectionIsEvicted()
+        {
+            var conn = new ClientConnection(null, SEND_QUEUE_LIMIT, NullLogger.Instance);
+
+            Assert.True(conn.EnqueueFrame(new byte[SEND_QUEUE_LIMIT - 16], -1, out _));
+            Assert.False(conn.EnqueueFrame(new byte[32], -1, out bool startSending));
+
+            Assert.False(startSending);
+            Assert.True(conn.OutboundClosed);
+        }
+
+        [Fact]
+        public void QueueWithinLimitIsNotEvicted()
+        {
+            var conn = new ClientConnection(null, SEND_QUEUE_LIMIT, NullLogger.Instance);
+
+            Assert.True(conn.EnqueueFrame(new byte[SEND_QUEUE_LIMIT / 2], -1, out bool first));
+            Assert.True(conn.EnqueueFrame(new byte[SEND_QUEUE_LIMIT / 2], -1, out bool second));
+
+            Assert.True(first);
+            Assert.False(second);
+            Assert.Equal(SEND_QUEUE_LIMIT, conn.OutboundBytes);
+        }
+    }
+}
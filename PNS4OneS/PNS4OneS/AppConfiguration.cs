@@ -34,6 +34,12 @@ namespace PNS4OneS
                     case "service":
                         serviceConfigurationBuiler.SetServiceAddress(param.Value);
                         break;
+                    case "send_queue_limit":
+                        serviceConfigurationBuiler.SetSendQueueLimit(param.Value);
+                        break;
+                    case "send_timeout":
+                        serviceConfigurationBuiler.SetSendTimeout(param.Value);
+                        break;
                     case "log_level":
                         listeningConfigurationBuilder.SetLogLevel(param.Value);
                         serviceConfigurationBuiler.SetLogLevel(param.Value);
@@ -1,5 +1,4 @@
-﻿using System.Linq;
-using System.Threading.Tasks;
+﻿using System.Threading.Tasks;
 using Microsoft.AspNetCore.Http;
 using PNS4OneS.KeyStorage;
 
@@ -16,7 +15,7 @@ namespace PNS4OneS
                 return;
             }
 
-            ClientApplication clientApp = GetClientAppByServerKey(serverKey);
+            ClientApplication clientApp = Program.ClientAppsStorage.GetAppByServerKey(serverKey);
             if (clientApp == null)
             {
                 response.StatusCode = 400;
@@ -38,11 +37,5 @@ namespace PNS4OneS
 
             await response.Body.WriteAsync(System.Text.Encoding.UTF8.GetBytes(body));
         }
-
-        private static ClientApplication GetClientAppByServerKey(string serverKey)
-        {
-            var apps = Program.ClientAppsStorage.GetApps();
-            return apps.FirstOrDefault(x => x.ServerKey == serverKey);
-        }
     }
 }
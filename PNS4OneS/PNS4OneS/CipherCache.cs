@@ -0,0 +1,56 @@
+﻿using System;
+using System.Collections.Concurrent;
+using System.Security.Cryptography;
+using PNS4OneS.KeyStorage;
+
+namespace PNS4OneS
+{
+    // Объекты Aes с ключами приложений для шифрования сообщений. Объект создается и получает ключ один раз,
+    // а не для каждого сообщения. Объект Aes не потокобезопасен, поэтому потоки отправки берут объекты из пула
+    // приложения. При смене ключа клиента (ключ заменяется новым массивом) пул приложения создается заново.
+    class CipherCache
+    {
+        private const int AES_BLOCK_SIZE = 16;
+
+        private class AppCiphers
+        {
+            public byte[] Key { get; init; }
+            public ConcurrentBag<Aes> Pool { get; } = new();
+        }
+
+        private readonly ConcurrentDictionary<string, AppCiphers> apps = new();
+
+        // Размер данных, зашифрованных в режиме CBC с дополнением PKCS7.
+        public static int EncryptedSize(int size)
+        {
+            return (size / AES_BLOCK_SIZE + 1) * AES_BLOCK_SIZE;
+        }
+
+        // Шифрует данные ключом и вектором инициализации приложения в destination, размер которого
+        // не меньше EncryptedSize(data.Length).
+        public void Encrypt(ClientApplication clientApp, ReadOnlySpan<byte> data, Span<byte> destination)
+        {
+            byte[] key = clientApp.ClientKey;
+            AppCiphers ciphers = apps.AddOrUpdate(
+                clientApp.Id,
+                _ => new AppCiphers() { Key = key },
+                (_, current) => ReferenceEquals(current.Key, key) ? current : new AppCiphers() { Key = key });
+
+            if (!ciphers.Pool.TryTake(out Aes aes))
+            {
+                aes = Aes.Create();
+                aes.Key = key;
+            }
+
+            try
+            {
+                if (!aes.TryEncryptCbc(data, clientApp.ClientIV, destination, out _))
+                    throw new ArgumentException("Недостаточный размер буфера для зашифрованных данных", nameof(destination));
+            }
+            finally
+            {
+                ciphers.Pool.Add(aes);
+            }
+        }
+    }
+}
@@ -1,10 +1,16 @@
 ﻿using System;
+using System.Buffers;
+using System.Buffers.Binary;
+using System.Collections.Concurrent;
 using System.Collections.Generic;
 using System.IO;
 using System.Security.Cryptography;
 using System.Text;
+using System.Text.Json;
 using System.Net.Sockets;
+using System.Threading.Tasks;
 using Microsoft.Extensions.Logging;
+using PNS4OneS.KeyStorage;
 
 namespace PNS4OneS
 {
@@ -12,20 +18,47 @@ namespace PNS4OneS
     {
         private const ushort RECV_DATA_MAX_SIZE = 1024;
 
+        // Типы управляющих кадров, передаваемых клиентом после регистрации.
+        private const byte CONTROL_FRAME_SET_TOPICS = 1;
+        private const byte CONTROL_FRAME_ADD_TOPICS = 2;
+        private const byte CONTROL_FRAME_REMOVE_TOPICS = 3;
+        private const byte CONTROL_FRAME_RESET_TOPICS = 4;
+        private const byte CONTROL_FRAME_PUBLISH = 5;
+
+        // Размер подписи HMAC-SHA256 в конце кадра публикации.
+        private const int PUBLISH_FRAME_HASH_SIZE = 32;
+
+        // Кадры из очереди отправки объединяются в одну передачу до этого размера.
+        private const int SEND_BATCH_MAX_SIZE = 64 * 1024;
+
         public Socket Socket { get; }
+        public string AppId { get; set; }
         public string IbId { get; set;  }
         public string UserId { get; set; }
         public string UserGroup { get; set; }
+        // Версия протокола клиента. Клиенты версии 2 и выше получают открытый заголовок кадра.
+        public int ProtocolVersion { get; set; } = 1;
+
+        // Темы, на которые подписан клиент. null - фильтр не установлен, клиент получает сообщения по всем темам.
+        // Набор не изменяется после присваивания, поэтому потоки отправки сообщений читают его без блокировок.
+        private volatile HashSet<string> subscribedTopics = null;
 
-        private byte[] receiveBuf = new byte[RECV_DATA_MAX_SIZE];
+        // Версии документов состояния, которые уже переданы клиенту (ключ - см. DocumentStore.DocumentKey).
+        public ConcurrentDictionary<string, long> DocumentVersions { get; } = new();
+
+        // Буфер приема берется из общего пула: при массовом переподключении клиентов не создаются тысячи буферов.
+        private byte[] receiveBuf = ArrayPool<byte>.Shared.Rent(RECV_DATA_MAX_SIZE);
         private int receiveBufPos = 0;
-        private int dataSize = -1;
+        private bool registerDataReceived = false;
+        private uint lastPublishSequence = 0;
 
         private readonly ILogger logger;
 
         public enum ReceivedDataType
         {
             RegisterClient,
+            Control,
+            Publish,
             CloseConnestion
         }
 
@@ -37,23 +70,147 @@ namespace PNS4OneS
 
         public Queue<ReceivedData> ReceivedDataQueue { get; } = new();
 
-        public ClientConnection(Socket socket, ILogger logger)
+        // Кадр, ожидающий передачи клиенту. Один массив кадра передается всем получателям сообщения, поэтому
+        // время отправки записывается не в кадр, а в копию кадра в буфере передачи (SentAtOffset, -1 - поля нет).
+        private struct OutboundFrame
+        {
+            public byte[] Data { get; init; }
+            public int SentAtOffset { get; init; }
+        }
+
+        // Очередь отправки ограничена объемом sendQueueLimit и разбирается одним циклом отправки соединения,
+        // поэтому медленный клиент не задерживает потоки отправки и других клиентов.
+        private readonly Queue<OutboundFrame> outboundFrames = new();
+        private readonly long sendQueueLimit;
+        private long outboundBytes = 0;
+        private bool sending = false;
+        private bool outboundClosed = false;
+
+        public ClientConnection(Socket socket, long sendQueueLimit, ILogger logger)
         {
             Socket = socket;
+            AppId = "";
             IbId = "";
             UserId = "";
             UserGroup = "";
+            this.sendQueueLimit = sendQueueLimit;
             this.logger = logger;
         }
 
-        public bool ReceiveData()
+        // Объем кадров, ожидающих передачи.
+        public long OutboundBytes
+        {
+            get
+            {
+                lock (outboundFrames)
+                    return outboundBytes;
+            }
+        }
+
+        // Очередь отправки закрыта: соединение закрывается или клиент отключен из-за переполнения очереди.
+        public bool OutboundClosed
+        {
+            get
+            {
+                lock (outboundFrames)
+                    return outboundClosed;
+            }
+        }
+
+        // Добавляет кадр в очередь отправки. Возвращает false, если очередь переполнена (клиент не успевает
+        // принимать сообщения) - только одному из потоков отправки, после этого очередь закрывается и кадры
+        // отбрасываются. В пустую очередь кадр добавляется независимо от размера: сообщение больше ограничения
+        // (например, с большим вложением) не должно отключать клиентов, которые успевают принимать сообщения.
+        // startSending - true, если очередь была пуста и нужно запустить цикл отправки.
+        public bool EnqueueFrame(byte[] frame, int sentAtOffset, out bool startSending)
+        {
+            startSending = false;
+
+            lock (outboundFrames)
+            {
+                if (outboundClosed)
+                    return true;
+
+                if (outboundBytes > 0 && outboundBytes + frame.Length > sendQueueLimit)
+                {
+                    outboundClosed = true;
+                    return false;
+                }
+
+                outboundFrames.Enqueue(new() { Data = frame, SentAtOffset = sentAtOffset });
+                outboundBytes += frame.Length;
+
+                if (!sending)
+                {
+                    sending = true;
+                    startSending = true;
+                }
+            }
+
+            return true;
+        }
+
+        // Забирает из очереди кадры для одной передачи и копирует их в буфер из общего пула, который
+        // вызывающий возвращает в пул после передачи. Возвращает false и завершает цикл отправки, если очередь пуста.
+        public bool TryTakeOutboundBatch(out byte[] batch, out int size)
+        {
+            batch = null;
+            size = 0;
+
+            lock (outboundFrames)
+            {
+                if (outboundClosed || outboundFrames.Count == 0)
+                {
+                    sending = false;
+                    return false;
+                }
+
+                int batchSize = 0;
+                foreach (OutboundFrame frame in outboundFrames)
+                {
+                    if (batchSize > 0 && batchSize + frame.Data.Length > SEND_BATCH_MAX_SIZE)
+                        break;
+                    batchSize += frame.Data.Length;
+                }
+
+                batch = ArrayPool<byte>.Shared.Rent(batchSize);
+                long sentAt = DateTimeOffset.UtcNow.ToUnixTimeMilliseconds();
+
+                while (size < batchSize)
+                {
+                    OutboundFrame frame = outboundFrames.Dequeue();
+                    Buffer.BlockCopy(frame.Data, 0, batch, size, frame.Data.Length);
+                    if (frame.SentAtOffset >= 0)
+                        BinaryPrimitives.WriteInt64LittleEndian(batch.AsSpan(size + frame.SentAtOffset), sentAt);
+
+                    size += frame.Data.Length;
+                }
+                outboundBytes -= size;
+            }
+
+            return true;
+        }
+
+        // Очищает очередь отправки закрываемого соединения. Новые кадры в очередь не добавляются.
+        public void CloseOutbound()
+        {
+            lock (outboundFrames)
+            {
+                outboundClosed = true;
+                outboundFrames.Clear();
+                outboundBytes = 0;
+            }
+        }
+
+        // Принимает очередную порцию данных и разбирает полученные кадры в ReceivedDataQueue. Возвращает false,
+        // если соединение прервано. Вызывается только циклом приема соединения, поэтому буфер не блокируется.
+        public async ValueTask<bool> ReceiveDataAsync()
         {
-            int maxSize = RECV_DATA_MAX_SIZE - receiveBufPos;
             int count;
 
             try
             {
-                count = Socket.Receive(receiveBuf, receiveBufPos, maxSize, SocketFlags.None);
+                count = await Socket.ReceiveAsync(receiveBuf.AsMemory(receiveBufPos), SocketFlags.None);
             }
             catch
             {
@@ -72,50 +229,72 @@ namespace PNS4OneS
             }
 
             receiveBufPos += count;
-            if (receiveBufPos >= RECV_DATA_MAX_SIZE)
-                return false;
 
-            do
+            int frameStart = 0;
+            while (receiveBufPos - frameStart >= sizeof(ushort))
             {
-                bool getDataSize = receiveBufPos < sizeof(ushort);
-                if (getDataSize)
+                int dataSize = receiveBuf[frameStart] + receiveBuf[frameStart + 1] * 256;
+                if (receiveBufPos - frameStart < dataSize + sizeof(ushort))
                 {
-                    // Ещё получены не все байты, определяющие размер принимаемых данных.
-                    return true;
+                    // Ещё получены не все данные кадра.
+                    break;
                 }
 
-                if (dataSize == -1)
-                    dataSize = receiveBuf[0] + receiveBuf[1] * 256;
+                byte[] data = receiveBuf.AsSpan(frameStart + sizeof(ushort), dataSize).ToArray();
 
-                bool allDataReceived = receiveBufPos >= dataSize + sizeof(ushort);
-                if (!allDataReceived)
+                // Первым кадром клиент всегда передает данные регистрации, все последующие кадры - управляющие.
+                ReceivedDataType dataType = ReceivedDataType.RegisterClient;
+                if (registerDataReceived)
                 {
-                    // Ещё получены не все данные. Возврат для ожидания новой порции.
-                    return true;
+                    dataType = data.Length > 0 && data[0] == CONTROL_FRAME_PUBLISH
+                        ? ReceivedDataType.Publish
+                        : ReceivedDataType.Control;
                 }
 
-                byte[] data = new byte[dataSize];
-                Buffer.BlockCopy(receiveBuf, sizeof(ushort), data, 0, dataSize);
-
                 ReceivedDataQueue.Enqueue(new()
                 {
-                    DataType = ReceivedDataType.RegisterClient,
+                    DataType = dataType,
                     Data = data
                 });
+                registerDataReceived = true;
 
-                byte[] newReciveBuf = new byte[RECV_DATA_MAX_SIZE];
+                frameStart += dataSize + sizeof(ushort);
+            }
 
-                int copyBytes = receiveBufPos - dataSize - sizeof(ushort);
-                if (copyBytes > 0)
-                    Buffer.BlockCopy(receiveBuf, dataSize + sizeof(ushort), newReciveBuf, 0, copyBytes);
+            // Начало неполного кадра переносится в начало буфера.
+            if (frameStart > 0)
+            {
+                receiveBufPos -= frameStart;
+                if (receiveBufPos > 0)
+                    Buffer.BlockCopy(receiveBuf, frameStart, receiveBuf, 0, receiveBufPos);
+            }
 
-                receiveBuf = newReciveBuf;
-                receiveBufPos = copyBytes;
-            } while (receiveBufPos > 0);
+            // Список тем подписки может не поместиться в буфер по умолчанию.
+            if (receiveBufPos >= sizeof(ushort))
+            {
+                int frameSize = receiveBuf[0] + receiveBuf[1] * 256 + sizeof(ushort);
+                if (frameSize > receiveBuf.Length)
+                {
+                    byte[] largeReceiveBuf = ArrayPool<byte>.Shared.Rent(frameSize);
+                    Buffer.BlockCopy(receiveBuf, 0, largeReceiveBuf, 0, receiveBufPos);
+                    ArrayPool<byte>.Shared.Return(receiveBuf);
+                    receiveBuf = largeReceiveBuf;
+                }
+            }
 
             return true;
         }
 
+        // Возвращает буфер приема в пул. Вызывается после завершения цикла приема соединения.
+        public void ReleaseReceiveBuffer()
+        {
+            if (receiveBuf == null)
+                return;
+
+            ArrayPool<byte>.Shared.Return(receiveBuf);
+            receiveBuf = null;
+        }
+
         public bool RegisterClient(byte[] registerData)
         {
             if (registerData == null)
@@ -139,9 +318,14 @@ namespace PNS4OneS
                 if (!CheckConnectDataHash(appId, verifiedHash, registerData, dataOffset, dataSize))
                     return false;
 
+                AppId = appId;
                 IbId = ReadStringFromBuf(reader);
                 UserId = ReadStringFromBuf(reader);
                 UserGroup = ReadStringFromBuf(reader);
+
+                // Клиенты первой версии не передают версию протокола.
+                if (stream.Position < stream.Length && int.TryParse(ReadStringFromBuf(reader), out int protocolVersion))
+                    ProtocolVersion = protocolVersion;
             }
             catch (Exception e)
             {
@@ -152,6 +336,119 @@ namespace PNS4OneS
             return true;
         }
 
+        public bool ProcessControlFrame(byte[] frameData)
+        {
+            if (frameData == null || frameData.Length == 0)
+                return false;
+
+            List<string> topics = new();
+            int pos = 1;
+            while (pos < frameData.Length)
+            {
+                int end = Array.IndexOf(frameData, (byte)0, pos);
+                if (end == -1)
+                    return false;
+
+                topics.Add(Encoding.UTF8.GetString(frameData, pos, end - pos));
+                pos = end + 1;
+            }
+
+            HashSet<string> currentTopics = subscribedTopics;
+            switch (frameData[0])
+            {
+                case CONTROL_FRAME_SET_TOPICS:
+                    subscribedTopics = new HashSet<string>(topics);
+                    break;
+                case CONTROL_FRAME_ADD_TOPICS:
+                    HashSet<string> extendedTopics = currentTopics == null ? new() : new(currentTopics);
+                    extendedTopics.UnionWith(topics);
+                    subscribedTopics = extendedTopics;
+                    break;
+                case CONTROL_FRAME_REMOVE_TOPICS:
+                    if (currentTopics != null)
+                    {
+                        HashSet<string> reducedTopics = new(currentTopics);
+                        reducedTopics.ExceptWith(topics);
+                        subscribedTopics = reducedTopics;
+                    }
+                    break;
+                case CONTROL_FRAME_RESET_TOPICS:
+                    subscribedTopics = null;
+                    break;
+                default:
+                    logger.LogWarning("Получен управляющий кадр неизвестного типа {frameType} от клиента {userId}", frameData[0], UserId);
+                    return false;
+            }
+
+            return true;
+        }
+
+        // Проверяет подпись кадра публикации и расшифровывает публикуемое сообщение. Клиент может публиковать
+        // сообщения только в своей информационной базе. Возвращает null, если кадр не прошел проверку.
+        public IncomingMessage ReadPublishFrame(byte[] frameData)
+        {
+            ClientApplication clientApp = Program.ClientAppsStorage.GetApp(AppId);
+            if (clientApp == null)
+                return null;
+
+            // тип кадра + номер публикации + размер данных + подпись
+            int headerSize = 1 + sizeof(uint) + sizeof(int);
+            if (frameData.Length < headerSize + PUBLISH_FRAME_HASH_SIZE)
+                return null;
+
+            int signedSize = frameData.Length - PUBLISH_FRAME_HASH_SIZE;
+            using (HMACSHA256 hmac = new(clientApp.ClientKey))
+            {
+                byte[] computedHash = hmac.ComputeHash(frameData, 0, signedSize);
+                if (!CryptographicOperations.FixedTimeEquals(computedHash, frameData.AsSpan(signedSize)))
+                {
+                    logger.LogWarning("Неверная подпись публикации от клиента {userId}", UserId);
+                    return null;
+                }
+            }
+
+            uint sequence = BitConverter.ToUInt32(frameData, 1);
+            if (sequence <= lastPublishSequence)
+            {
+                logger.LogWarning("Повторная публикация от клиента {userId} отклонена", UserId);
+                return null;
+            }
+            lastPublishSequence = sequence;
+
+            int dataSize = BitConverter.ToInt32(frameData, 1 + sizeof(uint));
+
+            try
+            {
+                using Aes aes = Aes.Create();
+                aes.Key = clientApp.ClientKey;
+
+                byte[] data = aes.DecryptCbc(frameData.AsSpan(headerSize, signedSize - headerSize), clientApp.ClientIV);
+                if (data.Length != dataSize)
+                    return null;
+
+                IncomingMessage message = JsonSerializer.Deserialize<IncomingMessage>(data);
+                if (message?.Recipient == null || message.Recipient.IbId != IbId)
+                    return null;
+
+                return message;
+            }
+            catch (Exception e)
+            {
+                logger.LogWarning("Получена некорректная публикация от клиента {userId}: {message}", UserId, e.Message);
+                return null;
+            }
+        }
+
+        public bool AcceptsTopic(string topic)
+        {
+            // Сообщения без темы передаются всем клиентам независимо от подписки.
+            if (string.IsNullOrEmpty(topic))
+                return true;
+
+            HashSet<string> topics = subscribedTopics;
+            return topics == null || topics.Contains(topic);
+        }
+
         private static bool CheckConnectDataHash(string appId, byte[] verifiedHash, byte[] data, int offset, int count)
         {
             var clientKey = Program.ClientAppsStorage.GetApp(appId)?.ClientKey;
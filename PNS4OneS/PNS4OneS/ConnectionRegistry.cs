@@ -0,0 +1,120 @@
+﻿using System;
+using System.Collections.Concurrent;
+using System.Collections.Generic;
+
+namespace PNS4OneS
+{
+    // Зарегистрированные соединения клиентов, индексированные по информационной базе, пользователю и группе.
+    // Поиск получателей выполняется за время, пропорциональное количеству получателей, а не всех соединений.
+    // Соединения добавляет цикл приема соединения после регистрации клиента, удаляют циклы приема и потоки
+    // отправки при закрытии соединения, ищут получателей потоки обработки запросов отправки.
+    class ConnectionRegistry
+    {
+        private class InfobaseConnections
+        {
+            public HashSet<ClientConnection> All { get; } = new();
+            public Dictionary<string, HashSet<ClientConnection>> ByUserId { get; } = new();
+            public Dictionary<string, HashSet<ClientConnection>> ByUserGroup { get; } = new();
+        }
+
+        // Записи информационных баз не удаляются: их немного, а удаление записи пришлось бы согласовывать
+        // с одновременным добавлением соединения в эту же запись.
+        private readonly ConcurrentDictionary<string, InfobaseConnections> infobases = new();
+
+        public void Add(ClientConnection conn)
+        {
+            InfobaseConnections ib = infobases.GetOrAdd(conn.IbId, _ => new InfobaseConnections());
+            lock (ib)
+            {
+                if (!ib.All.Add(conn))
+                    return;
+
+                AddToIndex(ib.ByUserId, conn.UserId, conn);
+                AddToIndex(ib.ByUserGroup, conn.UserGroup, conn);
+            }
+        }
+
+        public bool Remove(ClientConnection conn)
+        {
+            if (!infobases.TryGetValue(conn.IbId, out InfobaseConnections ib))
+                return false;
+
+            lock (ib)
+            {
+                if (!ib.All.Remove(conn))
+                    return false;
+
+                RemoveFromIndex(ib.ByUserId, conn.UserId, conn);
+                RemoveFromIndex(ib.ByUserGroup, conn.UserGroup, conn);
+            }
+            return true;
+        }
+
+        public List<ClientConnection> GetByUserId(string ibId, string userId)
+        {
+            return Select(ibId, ib => ib.ByUserId.GetValueOrDefault(userId), null);
+        }
+
+        // Широковещательные сообщения передаются только клиентам, подписанным на тему сообщения.
+        public List<ClientConnection> GetByUserGroup(string ibId, string userGroup, string topic)
+        {
+            return Select(ibId, ib => ib.ByUserGroup.GetValueOrDefault(userGroup), topic);
+        }
+
+        public List<ClientConnection> GetAll(string ibId, string topic)
+        {
+            return Select(ibId, ib => ib.All, topic);
+        }
+
+        private List<ClientConnection> Select(
+            string ibId,
+            Func<InfobaseConnections, HashSet<ClientConnection>> index,
+            string topic)
+        {
+            List<ClientConnection> recepients = new();
+            if (ibId == null || !infobases.TryGetValue(ibId, out InfobaseConnections ib))
+                return recepients;
+
+            lock (ib)
+            {
+                HashSet<ClientConnection> connections = index(ib);
+                if (connections == null)
+                    return recepients;
+
+                recepients.Capacity = connections.Count;
+                foreach (ClientConnection conn in connections)
+                {
+                    if (conn.AcceptsTopic(topic))
+                        recepients.Add(conn);
+                }
+            }
+            return recepients;
+        }
+
+        private static void AddToIndex(
+            Dictionary<string, HashSet<ClientConnection>> index,
+            string key,
+            ClientConnection conn)
+        {
+            if (!index.TryGetValue(key, out HashSet<ClientConnection> connections))
+            {
+                connections = new();
+                index.Add(key, connections);
+            }
+            connections.Add(conn);
+        }
+
+        private static void RemoveFromIndex(
+            Dictionary<string, HashSet<ClientConnection>> index,
+            string key,
+            ClientConnection conn)
+        {
+            if (index.TryGetValue(key, out HashSet<ClientConnection> connections)
+                && connections.Remove(conn)
+                && connections.Count == 0)
+            {
+                index.Remove(key);
+            }
+        }
+    }
+}
@@ -0,0 +1,63 @@
+﻿using System.Collections.Concurrent;
+using System.Text.Json.Nodes;
+
+namespace PNS4OneS
+{
+    class DocumentStore
+    {
+        public class Document
+        {
+            public string Key { get; init; }
+            public JsonNode State { get; set; }
+            public long Version { get; set; }
+        }
+
+        private readonly ConcurrentDictionary<string, Document> documents = new();
+
+        public static string DocumentKey(string appId, string ibId, string documentId)
+        {
+            return appId + "\n" + ibId + "\n" + documentId;
+        }
+
+        // Возвращает документ, который необходимо заблокировать на время изменения и рассылки,
+        // чтобы клиенты получали изменения документа строго в порядке версий.
+        public Document GetOrAdd(string appId, string ibId, string documentId)
+        {
+            string key = DocumentKey(appId, ibId, documentId);
+            return documents.GetOrAdd(key, k => new Document() { Key = k, State = null, Version = 0 });
+        }
+
+        // Применяет изменения к документу по правилам JSON merge patch (RFC 7386).
+        public static JsonNode ApplyMergePatch(JsonNode target, JsonNode patch)
+        {
+            if (patch is not JsonObject patchObject)
+                return CloneNode(patch);
+
+            if (target is not JsonObject targetObject)
+                targetObject = new JsonObject();
+
+            foreach (var (name, value) in patchObject)
+            {
+                if (value == null)
+                {
+                    targetObject.Remove(name);
+                    continue;
+                }
+
+                targetObject.TryGetPropertyValue(name, out JsonNode targetValue);
+                JsonNode merged = ApplyMergePatch(targetValue, value);
+
+                // Узел JSON может принадлежать только одному родителю.
+                targetObject.Remove(name);
+                targetObject[name] = merged;
+            }
+
+            return targetObject;
+        }
+
+        public static JsonNode CloneNode(JsonNode node)
+        {
+            return node == null ? null : JsonNode.Parse(node.ToJsonString());
+        }
+    }
+}
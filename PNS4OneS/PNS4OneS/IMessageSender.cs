@@ -1,4 +1,5 @@
-﻿using System.Threading.Tasks;
+﻿using System.Collections.Generic;
+using System.Threading.Tasks;
 
 namespace PNS4OneS
 {
@@ -7,5 +8,6 @@ namespace PNS4OneS
         Task SendMessageToUserAsync(string appId, string ibId, string userId, Message message);
         Task SendMessageToGroupAsync(string appId, string ibId, string userGroup, Message message);
         Task SendMessageToAllAsync(string appId, string ibId, Message message);
+        Task SendMessagesAsync(string appId, IReadOnlyList<IncomingMessage> incomingMessages);
     }
 }
@@ -0,0 +1,12 @@
+﻿using System.Collections.Generic;
+
+namespace PNS4OneS
+{
+    // Одно сообщение для нескольких получателей. Передается в /sendmessages вместо массива
+    // пар получатель-сообщение.
+    public class IncomingMessageBatch
+    {
+        public List<MessageRecipient> Recipients { get; set; }
+        public Message Message { get; set; }
+    }
+}
@@ -1,11 +1,28 @@
-﻿using System.Collections.Generic;
+﻿using System;
+using System.Collections.Generic;
+using System.Text.Json.Serialization;
 
 namespace PNS4OneS
 {
     public class Message
     {
+        // Идентификатор сообщения, по которому клиент отбрасывает повторно доставленные сообщения.
+        public string Id { get; set; }
+        // Срок жизни сообщения в секундах. Клиент не обрабатывает сообщение, полученное после истечения срока.
+        public int? Ttl { get; set; }
         public string Topic { get; set; }
         public Notification Notification { get; set; }
         public Dictionary<string, string> Data { get; set; }
+        public MessageDocument Document { get; set; }
+        public List<MessageAttachment> Attachments { get; set; }
+        // Идентификатор трассировки, заданный отправителем. Передается клиенту вместе с отметками времени
+        // приема и отправки сообщения сервисом.
+        public string TraceId { get; set; }
+
+        [JsonIgnore]
+        public DateTimeOffset? ExpiresAt { get; set; }
+        // Время приема сообщения сервисом.
+        [JsonIgnore]
+        public DateTimeOffset? IngestedAt { get; set; }
     }
 }
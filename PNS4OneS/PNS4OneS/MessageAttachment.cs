@@ -0,0 +1,11 @@
+﻿namespace PNS4OneS
+{
+    // Двоичное вложение сообщения. Данные передаются в JSON строкой base64 и декодируются компонентой
+    // при получении сообщения.
+    public class MessageAttachment
+    {
+        public string Name { get; set; }
+        public string ContentType { get; set; }
+        public byte[] Data { get; set; }
+    }
+}
@@ -0,0 +1,13 @@
+﻿using System.Text.Json.Nodes;
+
+namespace PNS4OneS
+{
+    // Документ состояния: сервис хранит последнее состояние документа, передает клиенту полный
+    // снимок один раз, а затем только изменения в формате JSON merge patch (RFC 7386).
+    public class MessageDocument
+    {
+        public string Id { get; set; }
+        public JsonNode State { get; set; }
+        public JsonNode Patch { get; set; }
+    }
+}
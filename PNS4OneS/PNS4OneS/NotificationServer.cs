@@ -1,10 +1,13 @@
 ﻿using System;
-using System.Collections;
+using System.Buffers;
+using System.Buffers.Binary;
 using System.Collections.Generic;
 using System.IO;
-using System.Linq;
 using System.Net.Sockets;
-using System.Security.Cryptography;
+using System.Text.Encodings.Web;
+using System.Text.Json;
+using System.Text.Json.Nodes;
+using System.Threading;
 using System.Threading.Channels;
 using System.Threading.Tasks;
 using System.Text;
@@ -16,10 +19,25 @@ namespace PNS4OneS
     class NotificationServer : IMessageSender
     {
         private const int SENDING_MESSAGE_WORKERS_COUNT = 4;
+        private const int ACCEPT_LOOPS_COUNT = 4;
+        // Пауза перед повторным приемом соединения после ошибки (например, при исчерпании дескрипторов).
+        private const int ACCEPT_RETRY_DELAY_MS = 100;
+
+        // Кадр с открытым заголовком (протокол версии 2) начинается с маркера вместо размера данных.
+        private const int FRAME_HEADER_MARKER = -1;
+        private const byte FRAME_FIELD_MESSAGE_ID = 1;
+        private const byte FRAME_FIELD_EXPIRES_AT = 2;
+        private const byte FRAME_FIELD_INGESTED_AT = 3;
+        private const byte FRAME_FIELD_TRACE_ID = 4;
+        // Время отправки записывается в заголовок перед передачей каждому получателю, поэтому поле всегда последнее.
+        private const byte FRAME_FIELD_SENT_AT = 5;
 
         private class MessageToSend
         {
             public string ClientAppId { get; set; }
+            // Информационная база, которой адресовано сообщение. Определяет документ в хранилище
+            // независимо от того, есть ли у сообщения получатели.
+            public string IbId { get; set; }
             public List<ClientConnection> Recepients { get; set; }
             public Message Message { get; set; }
             public bool Terminate { get; private set; } = false;
@@ -27,24 +45,40 @@ namespace PNS4OneS
             public static MessageToSend TerminatedMessage() => new() { Terminate = true };
         }
 
-        private readonly List<ClientConnection> connections = new();
+        // Все соединения, в том числе незарегистрированные. Изменяются циклами приема и потоками отправки
+        // (при ошибке передачи), поэтому доступ к набору выполняется под блокировкой.
+        private readonly HashSet<ClientConnection> connections = new();
+        private readonly ConnectionRegistry registry = new();
+        private readonly DocumentStore documentStore = new();
+        private readonly CipherCache cipherCache = new();
         private Socket socket = null;
 
         private readonly ILogger logger;
 
+        private long sendQueueLimit;
+        private TimeSpan sendTimeout;
+
+        // У каждого потока отправки своя очередь: обновления одного документа всегда попадают в одну очередь
+        // и применяются в порядке поступления, остальные сообщения распределяются по очередям поочередно.
         private readonly Task[] sendingMessageWorkers = new Task[SENDING_MESSAGE_WORKERS_COUNT];
-        private readonly Channel<MessageToSend> messagesChannel = Channel.CreateUnbounded<MessageToSend>();
+        private readonly Channel<MessageToSend>[] messagesChannels = new Channel<MessageToSend>[SENDING_MESSAGE_WORKERS_COUNT];
+        private int nextMessagesChannel = 0;
 
         private bool stoppedService = false;
 
         public NotificationServer(ILogger logger)
         {
             this.logger = logger;
+
+            for (int i = 0; i < SENDING_MESSAGE_WORKERS_COUNT; i++)
+                messagesChannels[i] = Channel.CreateUnbounded<MessageToSend>();
         }
 
         public void RunAsync(ServiceConfiguration configuration)
         {
             stoppedService = false;
+            sendQueueLimit = configuration.SendQueueLimit;
+            sendTimeout = configuration.SendTimeout;
 
             socket = new(AddressFamily.InterNetwork, SocketType.Stream, ProtocolType.Tcp);
             socket.Bind(configuration.EndPoint);
@@ -54,216 +88,461 @@ namespace PNS4OneS
 
             for (int i = 0; i < SENDING_MESSAGE_WORKERS_COUNT; i++)
             {
-                sendingMessageWorkers[i] = new Task(async () => await SendingMessageWorker());
+                ChannelReader<MessageToSend> reader = messagesChannels[i].Reader;
+                sendingMessageWorkers[i] = new Task(async () => await SendingMessageWorker(reader));
                 sendingMessageWorkers[i].Start();
             }
 
-            Task.Run(() => LoopConnections());
+            for (int i = 0; i < ACCEPT_LOOPS_COUNT; i++)
+                Task.Run(() => AcceptConnectionsLoop());
         }
 
         public void Stop()
         {
             stoppedService = true;
 
-            for (int i = 0; i < SENDING_MESSAGE_WORKERS_COUNT; i++)
-                messagesChannel.Writer.TryWrite(MessageToSend.TerminatedMessage());
+            foreach (Channel<MessageToSend> channel in messagesChannels)
+                channel.Writer.TryWrite(MessageToSend.TerminatedMessage());
             Task.WaitAll(sendingMessageWorkers);
 
             if (socket != null)
             {
-                for (int i = 0; i < connections.Count; i++)
-                {
-                    // При использовании foreach после первой итерации, почему то,
-                    // возникает ошибка о том, что коллекция была модифицирована.
-                    CloseClientConnection(connections[i]);
-                }
-                connections.Clear();
+                List<ClientConnection> openConnections;
+                lock (connections)
+                    openConnections = new(connections);
+
+                foreach (ClientConnection client in openConnections)
+                    CloseClientConnection(client);
                 socket.Close();
             }
         }
 
         public async Task SendMessageToUserAsync(string appId, string ibId, string userId, Message message)
         {
-            var recepients = GetRecipientsByUserId(ibId, userId);
-            await SendMessageAsync(appId, recepients, message);
+            var recepients = registry.GetByUserId(ibId, userId);
+            await SendMessageAsync(appId, ibId, recepients, message);
         }
 
         public async Task SendMessageToGroupAsync(string appId, string ibId, string userGroup, Message message)
         {
-            var recepients = GetRecepientsByGroupNum(ibId, userGroup);
-            await SendMessageAsync(appId, recepients, message);
+            var recepients = registry.GetByUserGroup(ibId, userGroup, message.Topic);
+            await SendMessageAsync(appId, ibId, recepients, message);
         }
 
         public async Task SendMessageToAllAsync(string appId, string ibId, Message message)
         {
-            var recepients = GetAllIbRecepients(ibId);
-            await SendMessageAsync(appId, recepients, message);
+            var recepients = registry.GetAll(ibId, message.Topic);
+            await SendMessageAsync(appId, ibId, recepients, message);
         }
 
-        private async Task SendMessageAsync(string appId, List<ClientConnection> recepients, Message message)
+        // Помещает в очередь отправки пакет проверенных сообщений. Одно сообщение для нескольких получателей
+        // одной информационной базы ставится в очередь одним заданием: оно сериализуется и шифруется один раз,
+        // а соединение, относящееся к нескольким получателям (например, к нескольким группам), получает его однажды.
+        public Task SendMessagesAsync(string appId, IReadOnlyList<IncomingMessage> incomingMessages)
+        {
+            var batch = new List<MessageToSend>();
+            var batchIndex = new Dictionary<(Message, string), (MessageToSend Message, HashSet<ClientConnection> Recepients)>();
+
+            foreach (IncomingMessage incomingMessage in incomingMessages)
+            {
+                Message message = incomingMessage.Message;
+                MessageRecipient recipient = incomingMessage.Recipient;
+
+                var key = (message, recipient.IbId);
+                if (!batchIndex.TryGetValue(key, out var entry))
+                {
+                    entry = (new MessageToSend()
+                    {
+                        ClientAppId = appId,
+                        IbId = recipient.IbId,
+                        Recepients = new List<ClientConnection>(),
+                        Message = message
+                    }, new HashSet<ClientConnection>());
+                    batchIndex.Add(key, entry);
+                    batch.Add(entry.Message);
+                }
+
+                foreach (ClientConnection conn in GetRecepients(recipient, message.Topic))
+                {
+                    if (entry.Recepients.Add(conn))
+                        entry.Message.Recepients.Add(conn);
+                }
+            }
+
+            // Обновление документа ставится в очередь и без получателей: оно должно попасть в хранилище.
+            foreach (MessageToSend messageToSend in batch)
+            {
+                if (messageToSend.Recepients.Count > 0 || messageToSend.Message.Document != null)
+                    EnqueueMessage(messageToSend);
+            }
+
+            return Task.CompletedTask;
+        }
+
+        private List<ClientConnection> GetRecepients(MessageRecipient recipient, string topic)
+        {
+            return recipient.Type switch
+            {
+                "user" => registry.GetByUserId(recipient.IbId, recipient.UserId),
+                "group" => registry.GetByUserGroup(recipient.IbId, recipient.UserGroup, topic),
+                "all" => registry.GetAll(recipient.IbId, topic),
+                _ => new List<ClientConnection>(),
+            };
+        }
+
+        private Task SendMessageAsync(string appId, string ibId, List<ClientConnection> recepients, Message message)
         {
             var messageToSend = new MessageToSend()
             {
                 ClientAppId = appId,
+                IbId = ibId,
                 Recepients = recepients,
                 Message = message
             };
-            await messagesChannel.Writer.WriteAsync(messageToSend);
+            EnqueueMessage(messageToSend);
+            return Task.CompletedTask;
         }
 
-        private void LoopConnections()
+        // Каналы отправки не ограничены, запись в них выполняется сразу.
+        private void EnqueueMessage(MessageToSend messageToSend)
         {
-            ArrayList checkReadList = new();
-            ArrayList checkErrorsList = new();
+            uint index;
+            MessageDocument document = messageToSend.Message.Document;
+            if (document != null)
+                index = (uint)DocumentStore.DocumentKey(messageToSend.ClientAppId, messageToSend.IbId, document.Id).GetHashCode();
+            else
+                index = (uint)Interlocked.Increment(ref nextMessagesChannel);
+
+            messagesChannels[index % SENDING_MESSAGE_WORKERS_COUNT].Writer.TryWrite(messageToSend);
+        }
 
+        // Несколько циклов приема соединений ожидают подключения одновременно, чтобы массовое переподключение
+        // клиентов (например, после перезапуска сервиса) не упиралось в один поток.
+        private async Task AcceptConnectionsLoop()
+        {
             while (true)
             {
-                checkReadList.Clear();
-                checkReadList.Add(socket);
-
-                checkErrorsList.Clear();
-                checkErrorsList.Add(socket);
-
-                foreach (ClientConnection client in connections)
-                {
-                    checkReadList.Add(client.Socket);
-                    checkErrorsList.Add(client.Socket);
-                }
+                Socket handler;
 
                 try
                 {
-                    Socket.Select(checkReadList, null, checkErrorsList, -1);
+                    handler = await socket.AcceptAsync();
                 }
                 catch (Exception e)
                 {
-                    if (!stoppedService)
-                    {
-                        // При остановке сервиса закрывается сокет и так же возникает исключение.
-                        // В этом случае оно просто игнорируется.
-                        logger.LogWarning(
-                            "Произошла ошибка при определении состояния сокетов: {message}. Отправление сообщений прервано.",
-                            e.Message);
-                    }
-                    break;
+                    // При остановке сервиса закрывается сокет и так же возникает исключение.
+                    // В этом случае оно просто игнорируется.
+                    if (stoppedService || e is ObjectDisposedException)
+                        break;
+
+                    logger.LogWarning("Произошла ошибка при приеме соединения: {message}", e.Message);
+                    await Task.Delay(ACCEPT_RETRY_DELAY_MS);
+                    continue;
+                }
+
+                ClientConnection client = AddNewClient(handler);
+                _ = ReceiveLoop(client);
+            }
+        }
+
+        // Цикл приема данных одного соединения. Выполняется до закрытия соединения клиентом или сервисом.
+        private async Task ReceiveLoop(ClientConnection client)
+        {
+            try
+            {
+                while (await client.ReceiveDataAsync())
+                {
+                    if (!ProcessReceivedData(client))
+                        break;
                 }
+            }
+            catch (Exception e)
+            {
+                logger.LogWarning(
+                    "Произошла ошибка при обработке данных клиента {userId}: {message}. Соединение с клиентом прервано.",
+                    client.UserId,
+                    e.Message);
+            }
+            finally
+            {
+                CloseClientConnection(client);
+                client.ReleaseReceiveBuffer();
+            }
+        }
 
-                foreach (Socket checkSocket in checkReadList)
+        // Обрабатывает кадры, полученные от клиента. Возвращает false, если соединение нужно закрыть.
+        private bool ProcessReceivedData(ClientConnection client)
+        {
+            while (client.ReceivedDataQueue.TryDequeue(out var receivedData))
+            {
+                if (receivedData.DataType == ClientConnection.ReceivedDataType.RegisterClient)
                 {
-                    if (checkSocket == socket)
-                    {
-                        Socket handler = checkSocket.Accept();
-                        ClientConnection client = AddNewClient(handler);
-                    }
-                    else
-                    {
-                        ClientConnection client = connections.FirstOrDefault(x => x.Socket == checkSocket);
-                        if (client == null)
-                            continue;
-
-                        if (!client.ReceiveData())
-                        {
-                            CloseClientConnection(client);
-                            continue;
-                        }
-
-                        while (client.ReceivedDataQueue.TryDequeue(out var receivedData))
-                        {
-                            if (receivedData.DataType == ClientConnection.ReceivedDataType.RegisterClient)
-                            {
-                                if (!client.RegisterClient(receivedData.Data))
-                                {
-                                    CloseClientConnection(client);
-                                    continue;
-                                }
-                            }
-                            else if (receivedData.DataType == ClientConnection.ReceivedDataType.CloseConnestion)
-                            {
-                                CloseClientConnection(client);
-                                continue;
-                            }
-                        }
-                    }
+                    if (!client.RegisterClient(receivedData.Data))
+                        return false;
+
+                    registry.Add(client);
                 }
+                else if (receivedData.DataType == ClientConnection.ReceivedDataType.Control)
+                {
+                    if (!client.ProcessControlFrame(receivedData.Data))
+                        return false;
+                }
+                else if (receivedData.DataType == ClientConnection.ReceivedDataType.Publish)
+                {
+                    IncomingMessage incomingMessage = client.ReadPublishFrame(receivedData.Data);
+                    if (incomingMessage == null || !SendMessageHandler.IncomingMessageIsCorrect(incomingMessage))
+                        return false;
 
-                foreach (Socket checkSocket in checkErrorsList)
+                    // Канал отправки не ограничен, поэтому запись в него не блокирует цикл приема.
+                    _ = SendMessageHandler.DispatchMessage(client.AppId, incomingMessage);
+                }
+                else if (receivedData.DataType == ClientConnection.ReceivedDataType.CloseConnestion)
                 {
-                    ClientConnection client = connections.FirstOrDefault(x => x.Socket == checkSocket);
-                    if (client != null)
-                        CloseClientConnection(client);
+                    return false;
                 }
             }
+
+            return true;
         }
 
-        private async Task SendingMessageWorker()
+        private async Task SendingMessageWorker(ChannelReader<MessageToSend> reader)
         {
             while (true)
             {
-                MessageToSend messageToSend = await messagesChannel.Reader.ReadAsync();
+                MessageToSend messageToSend = await reader.ReadAsync();
                 if (messageToSend.Terminate)
                     break;
 
-                ClientApplication clientApp = Program.ClientAppsStorage.GetApp(messageToSend.ClientAppId);
-                if (clientApp == null)
+                if (messageToSend.Message.Document != null)
+                {
+                    SendDocumentMessage(messageToSend);
                     continue;
+                }
 
-                byte[] data = SerializeMessage(messageToSend.Message);
-                byte[] encrypted = EncryptMessage(data, clientApp.ClientKey, clientApp.ClientIV);
+                if (!MessageCanBeSent(messageToSend, out ClientApplication clientApp))
+                    continue;
 
+                ReadOnlyMemory<byte> data = SerializeMessage(messageToSend.Message);
+                SendSerializedMessage(messageToSend.Message, data, clientApp, messageToSend.Recepients);
+            }
+        }
+
+        private static bool MessageCanBeSent(MessageToSend messageToSend, out ClientApplication clientApp)
+        {
+            clientApp = null;
+
+            // Все получатели могли быть отфильтрованы по подписке - тогда нет смысла шифровать сообщение.
+            if (messageToSend.Recepients.Count == 0)
+                return false;
+
+            // Сообщение могло устареть, пока ожидало отправки.
+            if (messageToSend.Message.ExpiresAt < DateTimeOffset.UtcNow)
+                return false;
+
+            clientApp = Program.ClientAppsStorage.GetApp(messageToSend.ClientAppId);
+            return clientApp != null;
+        }
+
+        private void SendDocumentMessage(MessageToSend messageToSend)
+        {
+            Message message = messageToSend.Message;
+            MessageDocument incomingDocument = message.Document;
+
+            DocumentStore.Document document = documentStore.GetOrAdd(messageToSend.ClientAppId, messageToSend.IbId, incomingDocument.Id);
+
+            // Обновления документа обрабатывает один поток отправки (см. EnqueueMessage), поэтому версии
+            // назначаются в порядке поступления. Блокировка сохраняет согласованными состояние, версию
+            // и версии документа у получателей на время рассылки.
+            lock (document)
+            {
+                bool isPatch = incomingDocument.Patch != null;
+                if (isPatch)
+                    document.State = DocumentStore.ApplyMergePatch(document.State, incomingDocument.Patch);
+                else
+                    document.State = DocumentStore.CloneNode(incomingDocument.State);
+                document.Version++;
+
+                // Изменение применяется всегда, даже если сообщение некому или уже поздно отправлять,
+                // иначе состояние в хранилище разойдется с источником.
+                if (!MessageCanBeSent(messageToSend, out ClientApplication clientApp))
+                    return;
+
+                // Изменения получают только клиенты, у которых есть предыдущая версия документа,
+                // остальным передается полный снимок.
+                List<ClientConnection> patchRecepients = new();
+                List<ClientConnection> snapshotRecepients = new();
                 foreach (ClientConnection conn in messageToSend.Recepients)
                 {
-                    try
+                    bool hasPreviousVersion = conn.DocumentVersions.TryGetValue(document.Key, out long version)
+                        && version == document.Version - 1;
+
+                    if (isPatch && hasPreviousVersion)
+                        patchRecepients.Add(conn);
+                    else
+                        snapshotRecepients.Add(conn);
+
+                    conn.DocumentVersions[document.Key] = document.Version;
+                }
+
+                if (patchRecepients.Count > 0)
+                {
+                    ReadOnlyMemory<byte> data = SerializeMessage(message, incomingDocument.Id, document.Version, "patch", incomingDocument.Patch);
+                    SendSerializedMessage(message, data, clientApp, patchRecepients);
+                }
+
+                if (snapshotRecepients.Count > 0)
+                {
+                    ReadOnlyMemory<byte> data = SerializeMessage(message, incomingDocument.Id, document.Version, "state", document.State);
+                    SendSerializedMessage(message, data, clientApp, snapshotRecepients);
+                }
+            }
+        }
+
+        // Кадр сообщения строится один раз для каждой версии протокола и помещается в очереди отправки получателей.
+        // Передачу выполняют циклы отправки соединений, поэтому поток отправки не ожидает медленных клиентов.
+        // Сообщение шифруется один раз сразу в первый построенный кадр, во второй кадр копируется.
+        private void SendSerializedMessage(
+            Message message,
+            ReadOnlyMemory<byte> data,
+            ClientApplication clientApp,
+            List<ClientConnection> recepients)
+        {
+            int encryptedSize = CipherCache.EncryptedSize(data.Length);
+            Memory<byte> encrypted = Memory<byte>.Empty;
+            byte[] frame = null;
+            byte[] frameWithHeader = null;
+            int sentAtOffset = -1;
+
+            void PutEncrypted(byte[] target, int offset)
+            {
+                Memory<byte> destination = target.AsMemory(offset, encryptedSize);
+                if (encrypted.IsEmpty)
+                {
+                    cipherCache.Encrypt(clientApp, data.Span, destination.Span);
+                    encrypted = destination;
+                }
+                else
+                    encrypted.CopyTo(destination);
+            }
+
+            foreach (ClientConnection conn in recepients)
+            {
+                bool queued;
+                bool startSending;
+
+                if (conn.ProtocolVersion >= 2)
+                {
+                    if (frameWithHeader == null)
                     {
-                        using NetworkStream stream = new(conn.Socket);
-                        using BinaryWriter writer = new(stream);
-                        writer.Write(encrypted.Length + sizeof(int)); // + размер данных
-                        writer.Write(data.Length);
-                        writer.Write(encrypted);
+                        byte[] frameHeader = SerializeFrameHeader(message);
+
+                        // размер кадра + маркер + размер заголовка + заголовок + размер данных + данные
+                        frameWithHeader = new byte[sizeof(int) + sizeof(int) + sizeof(ushort) + frameHeader.Length
+                            + sizeof(int) + encryptedSize];
+                        Span<byte> span = frameWithHeader;
+                        BinaryPrimitives.WriteInt32LittleEndian(span, frameWithHeader.Length - sizeof(int));
+                        BinaryPrimitives.WriteInt32LittleEndian(span[sizeof(int)..], FRAME_HEADER_MARKER);
+                        BinaryPrimitives.WriteUInt16LittleEndian(span[(sizeof(int) * 2)..], (ushort)frameHeader.Length);
+                        frameHeader.CopyTo(span[(sizeof(int) * 2 + sizeof(ushort))..]);
+
+                        int dataOffset = sizeof(int) * 2 + sizeof(ushort) + frameHeader.Length;
+                        BinaryPrimitives.WriteInt32LittleEndian(span[dataOffset..], data.Length);
+                        PutEncrypted(frameWithHeader, dataOffset + sizeof(int));
+
+                        // Время отправки - последнее поле заголовка.
+                        sentAtOffset = dataOffset - sizeof(long);
                     }
-                    catch (Exception e)
+
+                    queued = conn.EnqueueFrame(frameWithHeader, sentAtOffset, out startSending);
+                }
+                else
+                {
+                    if (frame == null)
                     {
-                        logger.LogWarning(
-                            "Произошла ошибка при отправке сообщения клиенту {userId}: {message}. Соединение с клиентом прервано.",
-                            conn.UserId,
-                            e.Message);
-                        CloseClientConnection(conn);
-                        continue;
+                        // размер кадра + размер данных + данные
+                        frame = new byte[sizeof(int) + sizeof(int) + encryptedSize];
+                        BinaryPrimitives.WriteInt32LittleEndian(frame, encryptedSize + sizeof(int));
+                        BinaryPrimitives.WriteInt32LittleEndian(frame.AsSpan(sizeof(int)), data.Length);
+                        PutEncrypted(frame, sizeof(int) * 2);
                     }
+
+                    queued = conn.EnqueueFrame(frame, -1, out startSending);
                 }
-            }
-        }
 
-        private ClientConnection AddNewClient(Socket handler)
-        {
-            ClientConnection client = new(handler, logger);
-            connections.Add(client);
-            return client;
-        }
+                if (!queued)
+                {
+                    logger.LogWarning(
+                        "Клиент {userId} ({ibId}) не успевает принимать сообщения: в очереди отправки {bytes} байт. Соединение с клиентом прервано.",
+                        conn.UserId,
+                        conn.IbId,
+                        conn.OutboundBytes);
+                    CloseClientConnection(conn);
+                    continue;
+                }
 
-        private List<ClientConnection> GetRecipientsByUserId(string ibId, string userId)
-        {
-            return (from conn in connections
-                    where conn.IbId == ibId && conn.UserId == userId
-                    select conn).ToList();
+                if (startSending)
+                    _ = SendLoop(conn);
+            }
         }
 
-        private List<ClientConnection> GetRecepientsByGroupNum(string ibId, string userGroup)
+        // Цикл отправки соединения: передает накопленные в очереди кадры, объединяя их в одну передачу.
+        // Завершается, когда очередь опустеет, и запускается снова при добавлении кадра.
+        private async Task SendLoop(ClientConnection client)
         {
-            return (from conn in connections
-                    where conn.IbId == ibId && conn.UserGroup == userGroup
-                    select conn).ToList();
+            while (client.TryTakeOutboundBatch(out byte[] batch, out int size))
+            {
+                using CancellationTokenSource timeout = new(sendTimeout);
+
+                try
+                {
+                    int sent = 0;
+                    while (sent < size)
+                        sent += await client.Socket.SendAsync(batch.AsMemory(sent, size - sent), SocketFlags.None, timeout.Token);
+                }
+                catch (Exception e)
+                {
+                    // Соединение уже закрыто: сервис остановлен или клиент отключен из-за переполнения очереди.
+                    if (client.OutboundClosed)
+                        return;
+
+                    string reason = timeout.IsCancellationRequested
+                        ? $"клиент не принимает данные дольше {sendTimeout.TotalSeconds} сек"
+                        : e.Message;
+                    logger.LogWarning(
+                        "Произошла ошибка при отправке сообщения клиенту {userId}: {message}. Соединение с клиентом прервано.",
+                        client.UserId,
+                        reason);
+                    CloseClientConnection(client);
+                    return;
+                }
+                finally
+                {
+                    ArrayPool<byte>.Shared.Return(batch);
+                }
+            }
         }
 
-        private List<ClientConnection> GetAllIbRecepients(string ibId)
+        private ClientConnection AddNewClient(Socket handler)
         {
-            return (from conn in connections
-                    where conn.IbId == ibId
-                    select conn).ToList();
+            ClientConnection client = new(handler, sendQueueLimit, logger);
+            lock (connections)
+                connections.Add(client);
+            return client;
         }
 
+        // Соединение может закрываться одновременно циклом приема и потоком отправки,
+        // сокет закрывает только первый из них.
         private void CloseClientConnection(ClientConnection client)
         {
+            lock (connections)
+            {
+                if (!connections.Remove(client))
+                    return;
+            }
+
+            registry.Remove(client);
+            client.CloseOutbound();
             CloseClientSocket(client.Socket);
-            connections.Remove(client);
         }
 
         private void CloseClientSocket(Socket clientSocket)
@@ -279,106 +558,169 @@ namespace PNS4OneS
             clientSocket.Close();
         }
 
-        private static byte[] EncryptMessage(byte[] message, byte[] key, byte[] iv)
+        // Открытый заголовок кадра: поля вида "тип (1 байт), длина (2 байта), значение".
+        // Позволяет клиенту отбросить устаревшее или повторное сообщение без расшифровки и измерить время доставки.
+        private static byte[] SerializeFrameHeader(Message message)
         {
-            using Aes aes = Aes.Create();
-            aes.Key = key;
-            aes.IV = iv;
+            using MemoryStream stream = new();
+            using BinaryWriter writer = new(stream);
 
-            ICryptoTransform encryptor = aes.CreateEncryptor(aes.Key, aes.IV);
+            if (!string.IsNullOrEmpty(message.Id))
+            {
+                byte[] id = Encoding.UTF8.GetBytes(message.Id);
+                writer.Write(FRAME_FIELD_MESSAGE_ID);
+                writer.Write((ushort)id.Length);
+                writer.Write(id);
+            }
 
-            using MemoryStream inputStream = new(message);
-            using MemoryStream outputStream = new();
-            using CryptoStream cryptoStream = new(outputStream, encryptor, CryptoStreamMode.Write);
+            if (message.ExpiresAt.HasValue)
+            {
+                writer.Write(FRAME_FIELD_EXPIRES_AT);
+                writer.Write((ushort)sizeof(long));
+                writer.Write(message.ExpiresAt.Value.ToUnixTimeMilliseconds());
+            }
 
-            int blockSize = aes.BlockSize / 8;
-            byte[] data = new byte[blockSize];
-            int count = 0;
+            if (message.IngestedAt.HasValue)
+            {
+                writer.Write(FRAME_FIELD_INGESTED_AT);
+                writer.Write((ushort)sizeof(long));
+                writer.Write(message.IngestedAt.Value.ToUnixTimeMilliseconds());
+            }
 
-            do
+            if (!string.IsNullOrEmpty(message.TraceId))
             {
-                count = inputStream.Read(data, 0, blockSize);
-                cryptoStream.Write(data, 0, count);
-            } while (count > 0);
+                byte[] traceId = Encoding.UTF8.GetBytes(message.TraceId);
+                writer.Write(FRAME_FIELD_TRACE_ID);
+                writer.Write((ushort)traceId.Length);
+                writer.Write(traceId);
+            }
 
-            cryptoStream.FlushFinalBlock();
-            cryptoStream.Close();
+            writer.Write(FRAME_FIELD_SENT_AT);
+            writer.Write((ushort)sizeof(long));
+            writer.Write(0L);
 
-            return outputStream.ToArray();
+            writer.Flush();
+            return stream.ToArray();
         }
 
-        private static byte[] SerializeMessage(Message message)
+        // Сообщение сериализуется в UTF-8 сразу в буфер потока отправки, без промежуточных строк. Буфер и объект
+        // записи создаются один раз для потока, поэтому результат действителен до следующей сериализации в этом
+        // потоке: он шифруется до возврата из SendSerializedMessage, между сериализацией и шифрованием нет await.
+        [ThreadStatic]
+        private static ArrayBufferWriter<byte> serializeBuffer;
+        [ThreadStatic]
+        private static Utf8JsonWriter serializeWriter;
+
+        // Экранируются кавычки, обратная косая черта и управляющие символы; кириллица записывается без экранирования.
+        private static readonly JsonWriterOptions serializeOptions = new()
         {
-            StringBuilder builder = new(512);
-            builder.Append('{');
+            Encoder = JavaScriptEncoder.UnsafeRelaxedJsonEscaping
+        };
+
+        private static ReadOnlyMemory<byte> SerializeMessage(
+            Message message,
+            string documentId = null,
+            long documentVersion = 0,
+            string documentPart = null,
+            JsonNode documentContent = null)
+        {
+            serializeBuffer ??= new ArrayBufferWriter<byte>(512);
+            serializeBuffer.Clear();
+            if (serializeWriter == null)
+                serializeWriter = new Utf8JsonWriter(serializeBuffer, serializeOptions);
+            else
+                serializeWriter.Reset(serializeBuffer);
+
+            Utf8JsonWriter writer = serializeWriter;
+            writer.WriteStartObject();
 
-            SerializeStringValue(builder, "topic", message.Topic, false);
-            bool needSeparator = !string.IsNullOrEmpty(message.Topic);
+            SerializeStringValue(writer, "topic", message.Topic);
 
             if (message.Notification != null
                 && (!string.IsNullOrEmpty(message.Notification.Title)
                     || !string.IsNullOrEmpty(message.Notification.Body)))
             {
-                if (needSeparator)
-                    builder.Append(", ");
-
-                SerializeMessageNotification(builder, message.Notification);
-                needSeparator = true;
+                SerializeMessageNotification(writer, message.Notification);
             }
 
             if (message.Data != null && message.Data.Count > 0)
-            {
-                if (needSeparator)
-                    builder.Append(", ");
+                SerializeMessageData(writer, message.Data);
 
-                SerializeMessageData(builder, message.Data);
-            }
+            if (message.Attachments != null && message.Attachments.Count > 0)
+                SerializeMessageAttachments(writer, message.Attachments);
+
+            if (documentId != null)
+                SerializeMessageDocument(writer, documentId, documentVersion, documentPart, documentContent);
 
-            builder.Append('}');
+            writer.WriteEndObject();
+            writer.Flush();
 
-            return Encoding.UTF8.GetBytes(builder.ToString());
+            return serializeBuffer.WrittenMemory;
         }
 
-        private static void SerializeMessageNotification(StringBuilder builder, Notification notification)
+        private static void SerializeMessageNotification(Utf8JsonWriter writer, Notification notification)
         {
-            builder.Append("\"notification\": {");
+            writer.WriteStartObject("notification");
 
-            SerializeStringValue(builder, "title", notification.Title);
-            SerializeStringValue(builder, "body", notification.Body);
-            SerializeStringValue(builder, "icon", notification.Icon);
-            SerializeStringValue(builder, "action", notification.Action);
+            SerializeStringValue(writer, "title", notification.Title);
+            SerializeStringValue(writer, "body", notification.Body);
+            SerializeStringValue(writer, "icon", notification.Icon);
+            SerializeStringValue(writer, "action", notification.Action);
+            writer.WriteBoolean("important", notification.Important);
 
-            builder.Append("\"important\": " + (notification.Important ? "true" : "false"));
-
-            builder.Append('}');
+            writer.WriteEndObject();
         }
 
-        private static void SerializeMessageData(StringBuilder builder, Dictionary<string, string> data)
+        private static void SerializeMessageData(Utf8JsonWriter writer, Dictionary<string, string> data)
         {
-            builder.Append("\"data\": {");
+            writer.WriteStartObject("data");
 
-            bool first = true;
             foreach (var keyValue in data)
-            {
-                if (first)
-                    first = false;
-                else
-                    builder.Append(", ");
+                writer.WriteString(keyValue.Key, keyValue.Value ?? "");
+
+            writer.WriteEndObject();
+        }
 
-                SerializeStringValue(builder, keyValue.Key, keyValue.Value, false);
+        private static void SerializeMessageAttachments(Utf8JsonWriter writer, List<MessageAttachment> attachments)
+        {
+            writer.WriteStartArray("attachments");
+
+            foreach (MessageAttachment attachment in attachments)
+            {
+                writer.WriteStartObject();
+                SerializeStringValue(writer, "name", attachment.Name);
+                SerializeStringValue(writer, "contentType", attachment.ContentType);
+                writer.WriteBase64String("data", attachment.Data);
+                writer.WriteEndObject();
             }
 
-            builder.Append('}');
+            writer.WriteEndArray();
+        }
+
+        private static void SerializeMessageDocument(
+            Utf8JsonWriter writer,
+            string documentId,
+            long version,
+            string documentPart,
+            JsonNode content)
+        {
+            writer.WriteStartObject("document");
+
+            SerializeStringValue(writer, "id", documentId);
+            writer.WriteNumber("version", version);
+            writer.WritePropertyName(documentPart);
+            if (content == null)
+                writer.WriteNullValue();
+            else
+                content.WriteTo(writer);
+
+            writer.WriteEndObject();
         }
 
-        private static void SerializeStringValue(StringBuilder builder, string name, string value, bool appendSepatator = true)
+        private static void SerializeStringValue(Utf8JsonWriter writer, string name, string value)
         {
             if (!string.IsNullOrEmpty(value))
-            {
-                builder.Append("\"" + name + "\": \"" + value + "\"");
-                if (appendSepatator)
-                    builder.Append(", ");
-            }
+                writer.WriteString(name, value);
         }
     }
 }
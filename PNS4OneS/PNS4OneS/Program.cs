@@ -123,6 +123,8 @@ namespace PNS4OneS
             Console.WriteLine("PNS4OneS [/listen <адрес сервера>[:<номер порта>]]");
             Console.WriteLine("         [/service <адрес сервера>[:<номер порта>]]");
             Console.WriteLine("         [/log_level <Уровень логов]");
+            Console.WriteLine("         [/send_queue_limit <размер очереди отправки клиенту, КБ>]");
+            Console.WriteLine("         [/send_timeout <время ожидания отправки клиенту, сек>]");
             Console.WriteLine("         [/ssl_mode <режим использования SSL сертификата>]");
             Console.WriteLine("         [/ssl_certificate <имя сертификата или путь к файлу>]");
             Console.WriteLine("         [/ssl_certificate_key <путь к приватному ключу сертификата>]");
@@ -137,6 +139,13 @@ namespace PNS4OneS
             Console.WriteLine("                 соединения принимаются со всех сетевых интерфейсов.");
             Console.WriteLine("    log_level    уровень выводимых логов. Возможные значения: Trace, Debug,");
             Console.WriteLine("                 Information, Warning, Error, Critical, None.");
+            Console.WriteLine("    send_queue_limit");
+            Console.WriteLine("                 объем сообщений в килобайтах, ожидающих передачи одному");
+            Console.WriteLine("                 клиенту. Клиент, который не успевает принимать сообщения");
+            Console.WriteLine("                 и превышает этот объем, отключается. По умолчанию 4096.");
+            Console.WriteLine("    send_timeout время в секундах, за которое клиент должен принять");
+            Console.WriteLine("                 очередную порцию сообщений, иначе он отключается.");
+            Console.WriteLine("                 По умолчанию 30.");
             Console.WriteLine("    ssl_mode     режим использования SSL сертификата. Возможные значения:");
             Console.WriteLine("        None - используется незащищенное HTTP соединение.");
             Console.WriteLine("        FromStorage - используется SSL сертификат из хранилища сертификатов ОС.");
@@ -1,5 +1,8 @@
 ﻿using System;
-using System.Linq;
+using System.Buffers;
+using System.Collections.Generic;
+using System.IO.Pipelines;
+using System.Text;
 using System.Text.Json;
 using System.Threading.Tasks;
 using Microsoft.AspNetCore.Http;
@@ -9,6 +12,9 @@ namespace PNS4OneS
 {
     public static class SendMessageHandler
     {
+        private const int MESSAGE_ID_MAX_SIZE = 256;
+        private const int BATCH_MAX_SIZE = 10000;
+
         public enum CheckAccessTokenResult
         {
             Success,
@@ -18,17 +24,10 @@ namespace PNS4OneS
 
         public static async Task SendMessage(HttpRequest request, HttpResponse response)
         {
-            var checkResult = CheckAccessToken(request, out string clientAppId);
-            if (checkResult == CheckAccessTokenResult.InvalidToken)
-            {
-                response.StatusCode = 401;
-                return;
-            }
-            else if (checkResult == CheckAccessTokenResult.TokenExpired)
-            {
-                response.StatusCode = 403;
+            DateTimeOffset ingestedAt = DateTimeOffset.UtcNow;
+
+            if (!Authorize(request, response, out string clientAppId))
                 return;
-            }
 
             IncomingMessage incomingMessage = null;
             bool badRequest;
@@ -49,6 +48,88 @@ namespace PNS4OneS
                 return;
             }
 
+            incomingMessage.Message.IngestedAt = ingestedAt;
+            await DispatchMessage(clientAppId, incomingMessage);
+
+            response.StatusCode = 200;
+        }
+
+        // Пакетная отправка: массив пар получатель-сообщение или одно сообщение для списка получателей.
+        // Все корректные сообщения ставятся в очередь отправки одной операцией, в ответе возвращается
+        // массив результатов [{"status": 200 | 400}, ...] в порядке получателей запроса.
+        public static async Task SendMessages(HttpRequest request, HttpResponse response)
+        {
+            DateTimeOffset ingestedAt = DateTimeOffset.UtcNow;
+
+            if (!Authorize(request, response, out string clientAppId))
+                return;
+
+            List<IncomingMessage> incomingMessages;
+
+            try
+            {
+                incomingMessages = await ReadIncomingMessagesFromRequestBody(request);
+            }
+            catch
+            {
+                incomingMessages = null;
+            }
+
+            if (incomingMessages == null)
+            {
+                response.StatusCode = 400;
+                return;
+            }
+            else if (incomingMessages.Count > BATCH_MAX_SIZE)
+            {
+                response.StatusCode = 413;
+                return;
+            }
+
+            var statuses = new int[incomingMessages.Count];
+            var correctMessages = new List<IncomingMessage>(incomingMessages.Count);
+
+            for (int i = 0; i < incomingMessages.Count; i++)
+            {
+                IncomingMessage incomingMessage = incomingMessages[i];
+                if (!IncomingMessageIsCorrect(incomingMessage))
+                {
+                    statuses[i] = 400;
+                    continue;
+                }
+
+                incomingMessage.Message.IngestedAt = ingestedAt;
+                PrepareMessage(incomingMessage.Message);
+                correctMessages.Add(incomingMessage);
+                statuses[i] = 200;
+            }
+
+            await Program.MessageSender.SendMessagesAsync(clientAppId, correctMessages);
+
+            response.StatusCode = 200;
+            response.Headers.Add("Content-Type", "application/json");
+
+            using (var writer = new Utf8JsonWriter(response.BodyWriter))
+            {
+                writer.WriteStartArray();
+                foreach (int status in statuses)
+                {
+                    writer.WriteStartObject();
+                    writer.WriteNumber("status", status);
+                    writer.WriteEndObject();
+                }
+                writer.WriteEndArray();
+            }
+
+            await response.BodyWriter.FlushAsync();
+        }
+
+        // Передает проверенное сообщение на отправку получателям. Используется как для сообщений, полученных
+        // по HTTP, так и для сообщений, опубликованных клиентами через открытое соединение.
+        public static async Task DispatchMessage(string clientAppId, IncomingMessage incomingMessage)
+        {
+            PrepareMessage(incomingMessage.Message);
+
             string recipientType = incomingMessage.Recipient.Type.ToLower();
             switch (recipientType)
             {
@@ -76,8 +157,13 @@ namespace PNS4OneS
                     );
                     break;
             }
+        }
 
-            response.StatusCode = 200;
+        private static void PrepareMessage(Message message)
+        {
+            message.IngestedAt ??= DateTimeOffset.UtcNow;
+            if (message.Ttl > 0)
+                message.ExpiresAt = DateTimeOffset.UtcNow.AddSeconds(message.Ttl.Value);
         }
 
         private static async Task<IncomingMessage> ReadIncomingMessageFromRequestBody(HttpRequest request)
@@ -86,7 +172,68 @@ namespace PNS4OneS
             return await JsonSerializer.DeserializeAsync<IncomingMessage>(stream);
         }
 
-        private static bool IncomingMessageIsCorrect(IncomingMessage message)
+        // Тело запроса - массив [{"Recipient", "Message"}, ...] или объект {"Recipients": [...], "Message"}.
+        // Элементы массива разбираются по мере получения тела запроса, чтение прекращается, как только
+        // количество сообщений превысит BATCH_MAX_SIZE.
+        private static async Task<List<IncomingMessage>> ReadIncomingMessagesFromRequestBody(HttpRequest request)
+        {
+            byte firstToken = await PeekFirstToken(request.BodyReader);
+
+            using var stream = request.BodyReader.AsStream();
+            var incomingMessages = new List<IncomingMessage>();
+
+            if (firstToken == (byte)'[')
+            {
+                await foreach (IncomingMessage incomingMessage in JsonSerializer.DeserializeAsyncEnumerable<IncomingMessage>(stream))
+                {
+                    incomingMessages.Add(incomingMessage);
+                    if (incomingMessages.Count > BATCH_MAX_SIZE)
+                        break;
+                }
+
+                return incomingMessages;
+            }
+
+            IncomingMessageBatch batch = await JsonSerializer.DeserializeAsync<IncomingMessageBatch>(stream);
+            if (batch == null || batch.Recipients == null)
+                return null;
+
+            // Получатели пакета разделяют один объект сообщения, это позволяет поставить его в очередь
+            // одним заданием для каждой информационной базы.
+            foreach (MessageRecipient recipient in batch.Recipients)
+                incomingMessages.Add(new IncomingMessage() { Recipient = recipient, Message = batch.Message });
+
+            return incomingMessages;
+        }
+
+        // Возвращает первый значащий символ тела запроса, не извлекая данные из канала.
+        private static async Task<byte> PeekFirstToken(PipeReader reader)
+        {
+            while (true)
+            {
+                ReadResult result = await reader.ReadAsync();
+                ReadOnlySequence<byte> buffer = result.Buffer;
+
+                if (TryGetFirstToken(buffer, out byte token))
+                {
+                    reader.AdvanceTo(buffer.Start);
+                    return token;
+                }
+
+                reader.AdvanceTo(buffer.Start, buffer.End);
+                if (result.IsCompleted)
+                    return 0;
+            }
+        }
+
+        private static bool TryGetFirstToken(in ReadOnlySequence<byte> buffer, out byte token)
+        {
+            var sequenceReader = new SequenceReader<byte>(buffer);
+            sequenceReader.AdvancePastAny((byte)' ', (byte)'\t', (byte)'\r', (byte)'\n');
+            return sequenceReader.TryPeek(out token);
+        }
+
+        public static bool IncomingMessageIsCorrect(IncomingMessage message)
         {
             if (message == null
                 || message.Message == null
@@ -97,6 +244,28 @@ namespace PNS4OneS
                 return false;
             }
 
+            // Идентификаторы сообщения и трассировки передаются в открытом заголовке кадра, их длина ограничена.
+            if (message.Message.Ttl < 0
+                || (message.Message.Id != null && Encoding.UTF8.GetByteCount(message.Message.Id) > MESSAGE_ID_MAX_SIZE)
+                || (message.Message.TraceId != null && Encoding.UTF8.GetByteCount(message.Message.TraceId) > MESSAGE_ID_MAX_SIZE))
+            {
+                return false;
+            }
+
+            // Документ передается либо полным состоянием, либо изменениями.
+            MessageDocument document = message.Message.Document;
+            if (document != null
+                && (string.IsNullOrEmpty(document.Id) || (document.State == null) == (document.Patch == null)))
+            {
+                return false;
+            }
+
+            if (message.Message.Attachments != null
+                && message.Message.Attachments.Exists(a => a == null || string.IsNullOrEmpty(a.Name) || a.Data == null))
+            {
+                return false;
+            }
+
             return message.Recipient.Type switch
             {
                 "user" => !string.IsNullOrEmpty(message.Recipient.UserId),
@@ -106,6 +275,24 @@ namespace PNS4OneS
             };
         }
 
+        // Проверяет токен доступа и устанавливает код ответа, если он некорректен или истек.
+        private static bool Authorize(HttpRequest request, HttpResponse response, out string clientAppId)
+        {
+            var checkResult = CheckAccessToken(request, out clientAppId);
+            if (checkResult == CheckAccessTokenResult.InvalidToken)
+            {
+                response.StatusCode = 401;
+                return false;
+            }
+            else if (checkResult == CheckAccessTokenResult.TokenExpired)
+            {
+                response.StatusCode = 403;
+                return false;
+            }
+
+            return true;
+        }
+
         private static CheckAccessTokenResult CheckAccessToken(HttpRequest request, out string clientAppId)
         {
             clientAppId = "";
@@ -114,10 +301,9 @@ namespace PNS4OneS
             if (string.IsNullOrEmpty(accessTokenAuth) || !accessTokenAuth.StartsWith("Bearer "))
                 return CheckAccessTokenResult.InvalidToken;
 
-            string accessTokenStr = accessTokenAuth.Replace("Bearer ", "");
+            string accessTokenStr = accessTokenAuth["Bearer ".Length..];
 
-            var apps = Program.ClientAppsStorage.GetApps();
-            ClientApplication app = apps.FirstOrDefault(x => x.AccessToken?.Token == accessTokenStr);
+            ClientApplication app = Program.ClientAppsStorage.GetAppByAccessToken(accessTokenStr);
 
             if (app == null)
                 return CheckAccessTokenResult.InvalidToken;
@@ -1,13 +1,21 @@
-﻿using System.Net;
+﻿using System;
+using System.Net;
 
 namespace PNS4OneS
 {
     public class ServiceConfiguration
     {
         private const int DEFAUL_PORT = 36695;
+        private const int DEFAULT_SEND_QUEUE_LIMIT_KB = 4096;
+        private const int DEFAULT_SEND_TIMEOUT_SEC = 30;
 
         public IPEndPoint EndPoint { get; private set; }
         public string LogLevel { get; private set; }
+        // Объем сообщений, ожидающих передачи одному клиенту, в байтах. Клиент, который не успевает
+        // принимать сообщения и превышает этот объем, отключается.
+        public long SendQueueLimit { get; private set; }
+        // Время передачи клиенту очередной порции сообщений, после которого клиент отключается.
+        public TimeSpan SendTimeout { get; private set; }
 
         private ServiceConfiguration() { }
 
@@ -20,7 +28,9 @@ namespace PNS4OneS
                 configuration = new()
                 {
                     EndPoint = new IPEndPoint(IPAddress.Any, DEFAUL_PORT),
-                    LogLevel = "Warning"
+                    LogLevel = "Warning",
+                    SendQueueLimit = DEFAULT_SEND_QUEUE_LIMIT_KB * 1024L,
+                    SendTimeout = TimeSpan.FromSeconds(DEFAULT_SEND_TIMEOUT_SEC)
                 };
             }
 
@@ -36,6 +46,24 @@ namespace PNS4OneS
                 return this;
             }
 
+            public Builder SetSendQueueLimit(string limitKb)
+            {
+                if (!int.TryParse(limitKb, out int value) || value <= 0)
+                    throw new AppConfigurationException($"Неверный размер очереди отправки {limitKb}");
+
+                configuration.SendQueueLimit = value * 1024L;
+                return this;
+            }
+
+            public Builder SetSendTimeout(string timeoutSec)
+            {
+                if (!int.TryParse(timeoutSec, out int value) || value <= 0)
+                    throw new AppConfigurationException($"Неверное время ожидания отправки {timeoutSec}");
+
+                configuration.SendTimeout = TimeSpan.FromSeconds(value);
+                return this;
+            }
+
             public ServiceConfiguration Build()
             {
                 return configuration;
@@ -32,6 +32,9 @@ namespace PNS4OneS
                 endpoints.MapPost("/sendmessage", async context =>
                     await SendMessageHandler.SendMessage(context.Request, context.Response)
                 );
+                endpoints.MapPost("/sendmessages", async context =>
+                    await SendMessageHandler.SendMessages(context.Request, context.Response)
+                );
             });
         }
     }
@@ -4,25 +4,103 @@
 #endif
 
 #include <clocale>
+#include <algorithm>
+#include <mutex>
 #include "AddInNative.h"
 #include "ConversionWchar.h"
 #include "ServiceConnector.h"
 
+static const wchar_t* g_PropNames[] =
+{
+    L"PendingCount",
+    L"PullMode",
+    L"PreParse",
+    L"PublishPending",
+    L"Replaying",
+    L"State"
+};
+
 static const wchar_t* g_MethodNames[] =
 {
     L"Connect",
     L"Shutdown",
-    L"GetLastError"
+    L"GetLastError",
+    L"SetSubscription",
+    L"Subscribe",
+    L"Unsubscribe",
+    L"WaitMessages",
+    L"ConfigureCache",
+    L"GetLast",
+    L"GetLastAll",
+    L"SetDocumentMode",
+    L"GetDocument",
+    L"GetTopic",
+    L"GetNotification",
+    L"GetDataField",
+    L"GetMessage",
+    L"ReleaseMessage",
+    L"Publish",
+    L"ConfigurePublisher",
+    L"PublishAsync",
+    L"FlushPublisher",
+    L"GetPublishErrors",
+    L"GetStats",
+    L"StartRecording",
+    L"StopRecording",
+    L"Replay",
+    L"StopReplay",
+    L"GetAttachment",
+    L"GetAttachmentBase64",
+    L"ReleaseAttachment",
+    L"ConfigureReconnect"
 };
 
 // В Visual Studio под Windows для русских букв исходный файл должен быть в кодировке ASCII, а в Linux - в UTF-8.
 // В результате в той или иной системе, в зависимости от кодировки, получаются "кракозябры". Поэтому символы заданы
 // в виде Escape-последовательностей.
+static const wchar_t* g_PropNamesRu[] =
+{
+    L"\x041A\x043E\x043B\x0438\x0447\x0435\x0441\x0442\x0432\x043E\x041E\x0436\x0438\x0434\x0430\x044E\x0449\x0438\x0445\x0421\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x0439", // КоличествоОжидающихСообщений
+    L"\x0420\x0435\x0436\x0438\x043C\x041E\x043F\x0440\x043E\x0441\x0430", // РежимОпроса
+    L"\x041F\x0440\x0435\x0434\x0432\x0430\x0440\x0438\x0442\x0435\x043B\x044C\x043D\x044B\x0439\x0420\x0430\x0437\x0431\x043E\x0440", // ПредварительныйРазбор
+    L"\x041A\x043E\x043B\x0438\x0447\x0435\x0441\x0442\x0432\x043E\x041D\x0435\x043E\x0442\x043F\x0440\x0430\x0432\x043B\x0435\x043D\x043D\x044B\x0445\x0423\x0432\x0435\x0434\x043E\x043C\x043B\x0435\x043D\x0438\x0439", // КоличествоНеотправленныхУведомлений
+    L"\x0418\x0434\x0435\x0442\x0412\x043E\x0441\x043F\x0440\x043E\x0438\x0437\x0432\x0435\x0434\x0435\x043D\x0438\x0435", // ИдетВоспроизведение
+    L"\x0421\x043E\x0441\x0442\x043E\x044F\x043D\x0438\x0435" // Состояние
+};
+
 static const wchar_t* g_MethodNamesRu[] =
 {
     L"\x041F\x043E\x0434\x043A\x043B\x044E\x0447\x0438\x0442\x044C", // Подключить
     L"\x041E\x0442\x043A\x043B\x044E\x0447\x0438\x0442\x044C",       // Отключить
-    L"\x041F\x043E\x043B\x0443\x0447\x0438\x0442\x044C\x041E\x0448\x0438\x0431\x043A\x0443" // ПолучитьОшибку
+    L"\x041F\x043E\x043B\x0443\x0447\x0438\x0442\x044C\x041E\x0448\x0438\x0431\x043A\x0443", // ПолучитьОшибку
+    L"\x0423\x0441\x0442\x0430\x043D\x043E\x0432\x0438\x0442\x044C\x041F\x043E\x0434\x043F\x0438\x0441\x043A\x0443", // УстановитьПодписку
+    L"\x041F\x043E\x0434\x043F\x0438\x0441\x0430\x0442\x044C\x0441\x044F", // Подписаться
+    L"\x041E\x0442\x043F\x0438\x0441\x0430\x0442\x044C\x0441\x044F", // Отписаться
+    L"\x041E\x0436\x0438\x0434\x0430\x0442\x044C\x0421\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x044F", // ОжидатьСообщения
+    L"\x041D\x0430\x0441\x0442\x0440\x043E\x0438\x0442\x044C\x041A\x0435\x0448\x0421\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x0439", // НастроитьКешСообщений
+    L"\x041F\x043E\x043B\x0443\x0447\x0438\x0442\x044C\x041F\x043E\x0441\x043B\x0435\x0434\x043D\x0435\x0435\x0421\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x0435", // ПолучитьПоследнееСообщение
+    L"\x041F\x043E\x043B\x0443\x0447\x0438\x0442\x044C\x041F\x043E\x0441\x043B\x0435\x0434\x043D\x0438\x0435\x0421\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x044F", // ПолучитьПоследниеСообщения
+    L"\x0423\x0441\x0442\x0430\x043D\x043E\x0432\x0438\x0442\x044C\x0420\x0435\x0436\x0438\x043C\x0414\x043E\x043A\x0443\x043C\x0435\x043D\x0442\x0430", // УстановитьРежимДокумента
+    L"\x041F\x043E\x043B\x0443\x0447\x0438\x0442\x044C\x0414\x043E\x043A\x0443\x043C\x0435\x043D\x0442", // ПолучитьДокумент
+    L"\x041F\x043E\x043B\x0443\x0447\x0438\x0442\x044C\x0422\x0435\x043C\x0443\x0421\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x044F", // ПолучитьТемуСообщения
+    L"\x041F\x043E\x043B\x0443\x0447\x0438\x0442\x044C\x041E\x043F\x043E\x0432\x0435\x0449\x0435\x043D\x0438\x0435\x0421\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x044F", // ПолучитьОповещениеСообщения
+    L"\x041F\x043E\x043B\x0443\x0447\x0438\x0442\x044C\x041F\x043E\x043B\x0435\x0414\x0430\x043D\x043D\x044B\x0445\x0421\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x044F", // ПолучитьПолеДанныхСообщения
+    L"\x041F\x043E\x043B\x0443\x0447\x0438\x0442\x044C\x0421\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x0435", // ПолучитьСообщение
+    L"\x041E\x0441\x0432\x043E\x0431\x043E\x0434\x0438\x0442\x044C\x0421\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x0435", // ОсвободитьСообщение
+    L"\x041E\x043F\x0443\x0431\x043B\x0438\x043A\x043E\x0432\x0430\x0442\x044C", // Опубликовать
+    L"\x041D\x0430\x0441\x0442\x0440\x043E\x0438\x0442\x044C\x041E\x0442\x043F\x0440\x0430\x0432\x043A\x0443", // НастроитьОтправку
+    L"\x041E\x0442\x043F\x0440\x0430\x0432\x0438\x0442\x044C\x0410\x0441\x0438\x043D\x0445\x0440\x043E\x043D\x043D\x043E", // ОтправитьАсинхронно
+    L"\x0414\x043E\x0436\x0434\x0430\x0442\x044C\x0441\x044F\x041E\x0442\x043F\x0440\x0430\x0432\x043A\x0438", // ДождатьсяОтправки
+    L"\x041F\x043E\x043B\x0443\x0447\x0438\x0442\x044C\x041E\x0448\x0438\x0431\x043A\x0438\x041E\x0442\x043F\x0440\x0430\x0432\x043A\x0438", // ПолучитьОшибкиОтправки
+    L"\x041F\x043E\x043B\x0443\x0447\x0438\x0442\x044C\x0421\x0442\x0430\x0442\x0438\x0441\x0442\x0438\x043A\x0443", // ПолучитьСтатистику
+    L"\x041D\x0430\x0447\x0430\x0442\x044C\x0417\x0430\x043F\x0438\x0441\x044C", // НачатьЗапись
+    L"\x0417\x0430\x0432\x0435\x0440\x0448\x0438\x0442\x044C\x0417\x0430\x043F\x0438\x0441\x044C", // ЗавершитьЗапись
+    L"\x0412\x043E\x0441\x043F\x0440\x043E\x0438\x0437\x0432\x0435\x0441\x0442\x0438\x0417\x0430\x043F\x0438\x0441\x044C", // ВоспроизвестиЗапись
+    L"\x041E\x0441\x0442\x0430\x043D\x043E\x0432\x0438\x0442\x044C\x0412\x043E\x0441\x043F\x0440\x043E\x0438\x0437\x0432\x0435\x0434\x0435\x043D\x0438\x0435", // ОстановитьВоспроизведение
+    L"\x041F\x043E\x043B\x0443\x0447\x0438\x0442\x044C\x0412\x043B\x043E\x0436\x0435\x043D\x0438\x0435", // ПолучитьВложение
+    L"\x041F\x043E\x043B\x0443\x0447\x0438\x0442\x044C\x0412\x043B\x043E\x0436\x0435\x043D\x0438\x0435\x0042\x0061\x0073\x0065\x0036\x0034", // ПолучитьВложениеBase64
+    L"\x041E\x0441\x0432\x043E\x0431\x043E\x0434\x0438\x0442\x044C\x0412\x043B\x043E\x0436\x0435\x043D\x0438\x0435", // ОсвободитьВложение
+    L"\x041D\x0430\x0441\x0442\x0440\x043E\x0438\x0442\x044C\x041F\x0435\x0440\x0435\x043F\x043E\x0434\x043A\x043B\x044E\x0447\x0435\x043D\x0438\x0435" // НастроитьПереподключение
 };
 
 static const wchar_t g_kClassNames[] = L"PNS4OneSComp";
@@ -31,10 +109,57 @@ static WcharWrapper s_kClassNames(g_kClassNames);
 
 static AppCapabilities g_capabilities = eAppCapabilitiesInvalid;
 
+// Текст последней ошибки устанавливается и потоком переподключения, поэтому доступ выполняется под блокировкой.
 static WCHAR_T* pwstrLastError = nullptr;
+static std::mutex lastErrorMutex;
+
+// Размер кеша последних сообщений по умолчанию - 1 Мб.
+constexpr long DEFAULT_TOPIC_CACHE_SIZE = 1024 * 1024;
+// Время ожидания отправки уведомлений по умолчанию - 30 секунд.
+constexpr long DEFAULT_FLUSH_TIMEOUT_MS = 30000;
+// Наибольшее количество сообщений в очереди асинхронной отправки.
+constexpr size_t PUBLISHER_QUEUE_MAX_SIZE = 10000;
+// Скорость воспроизведения записи по умолчанию - с исходными интервалами.
+constexpr double DEFAULT_REPLAY_SPEED = 1;
+// Наибольшая задержка между попытками переподключения по умолчанию - 30 секунд.
+constexpr long DEFAULT_RECONNECT_MAX_DELAY_MS = 30000;
+
+static long VariantToLong(const tVariant* value, long defaultValue)
+{
+    switch (TV_VT(value)) {
+    case VTYPE_I2:
+        return value->shortVal;
+    case VTYPE_I4:
+        return value->lVal;
+    case VTYPE_UI4:
+        return (long)value->ulVal;
+    case VTYPE_I8:
+        return (long)value->llVal;
+    case VTYPE_R4:
+        return (long)value->fltVal;
+    case VTYPE_R8:
+        return (long)value->dblVal;
+    default:
+        return defaultValue;
+    }
+}
+
+static double VariantToDouble(const tVariant* value, double defaultValue)
+{
+    switch (TV_VT(value)) {
+    case VTYPE_R4:
+        return value->fltVal;
+    case VTYPE_R8:
+        return value->dblVal;
+    default:
+        return (double)VariantToLong(value, (long)defaultValue);
+    }
+}
 
 void SetLastServiceError(const wchar_t* message)
 {
+    std::lock_guard<std::mutex> lock(lastErrorMutex);
+
     if (pwstrLastError != nullptr) {
         delete[] pwstrLastError;
         pwstrLastError = nullptr;
@@ -62,8 +187,11 @@ AppCapabilities SetPlatformCapabilities(const AppCapabilities capabilities)
 //---------------------------------------------------------------------------//
 long DestroyObject(IComponentBase** pIntf)
 {
-    if (pwstrLastError)
+    {
+        std::lock_guard<std::mutex> lock(lastErrorMutex);
         delete[] pwstrLastError;
+        pwstrLastError = nullptr;
+    }
 
     if (!*pIntf)
         return -1;
@@ -79,7 +207,7 @@ const WCHAR_T* GetClassNames()
 }
 //---------------------------------------------------------------------------//
 //CAddInNative
-CAddInNative::CAddInNative() : m_iConnect(nullptr), m_iMemory(nullptr)
+CAddInNative::CAddInNative() : m_iConnect(nullptr), m_iMemory(nullptr), m_publisher(PUBLISHER_QUEUE_MAX_SIZE)
 { }
 //---------------------------------------------------------------------------//
 CAddInNative::~CAddInNative()
@@ -89,8 +217,23 @@ CAddInNative::~CAddInNative()
 bool CAddInNative::Init(void* pConnection)
 {
     m_iConnect = (IAddInDefBaseEx*)pConnection;
+    if (m_iConnect == nullptr)
+        return false;
+
     m_iConnect->SetEventBufferDepth(1000);
-    return m_iConnect != nullptr;
+
+    // На сервере и во внешнем соединении внешние события не обрабатываются,
+    // поэтому сообщения по умолчанию получаются в режиме опроса.
+    auto* platformInfo = (IPlatformInfo*)m_iConnect->GetInterface(eIPlatformInfo);
+    const IPlatformInfo::AppInfo* appInfo = platformInfo ? platformInfo->GetPlatformInfo() : nullptr;
+    if (appInfo) {
+        IPlatformInfo::AppType appType = appInfo->Application;
+        SetPullMode(appType == IPlatformInfo::eAppServer
+            || appType == IPlatformInfo::eAppExtConn
+            || appType == IPlatformInfo::eAppMobileServer);
+    }
+
+    return true;
 }
 //---------------------------------------------------------------------------//
 long CAddInNative::GetInfo()
@@ -100,7 +243,10 @@ long CAddInNative::GetInfo()
 //---------------------------------------------------------------------------//
 void CAddInNative::Done()
 {
+    StopReplay();
+    StopRecording();
     StopListenService();
+    StopPublisher(m_publisher);
     m_iConnect = nullptr;
     m_iMemory = nullptr;
 }
@@ -129,32 +275,95 @@ long CAddInNative::GetNProps()
 //---------------------------------------------------------------------------//
 long CAddInNative::FindProp(const WCHAR_T* wsPropName)
 {
-    return -1;
+    long plPropNum = -1;
+    wchar_t* name = 0;
+    convFromShortWchar(&name, wsPropName);
+
+    plPropNum = findName(g_PropNames, name, eLastProp);
+
+    if (plPropNum == -1)
+        plPropNum = findName(g_PropNamesRu, name, eLastProp);
+
+    delete[] name;
+
+    return plPropNum;
 }
 //---------------------------------------------------------------------------//
 const WCHAR_T* CAddInNative::GetPropName(long lPropNum, long lPropAlias)
 {
-    return nullptr;
+    if (lPropNum >= eLastProp)
+        return nullptr;
+
+    switch (lPropAlias)
+    {
+    case 0: // First language (english)
+        return allocName(g_PropNames[lPropNum]);
+    case 1: // Second language (local)
+        return allocName(g_PropNamesRu[lPropNum]);
+    default:
+        return nullptr;
+    }
 }
 //---------------------------------------------------------------------------//
 bool CAddInNative::GetPropVal(const long lPropNum, tVariant* pvarPropVal)
 {
-    return false;
+    switch (lPropNum) {
+    case ePropPendingCount:
+        TV_VT(pvarPropVal) = VTYPE_I4;
+        TV_I4(pvarPropVal) = (int32_t)GetPendingMessagesCount();
+        return true;
+    case ePropPullMode:
+        TV_VT(pvarPropVal) = VTYPE_BOOL;
+        TV_BOOL(pvarPropVal) = GetPullMode();
+        return true;
+    case ePropPreParse:
+        TV_VT(pvarPropVal) = VTYPE_BOOL;
+        TV_BOOL(pvarPropVal) = GetPreParseMode();
+        return true;
+    case ePropPublishPending:
+        TV_VT(pvarPropVal) = VTYPE_I4;
+        TV_I4(pvarPropVal) = (int32_t)GetPublisherPendingCount(m_publisher);
+        return true;
+    case ePropReplaying:
+        TV_VT(pvarPropVal) = VTYPE_BOOL;
+        TV_BOOL(pvarPropVal) = GetReplayActive();
+        return true;
+    case ePropState: {
+        std::vector<WCHAR_T> state;
+        GetConnectionState(state);
+        return setStringResult(pvarPropVal, state);
+    }
+    default:
+        return false;
+    }
 }
 //---------------------------------------------------------------------------//
 bool CAddInNative::SetPropVal(const long lPropNum, tVariant* varPropVal)
 {
-    return false;
+    switch (lPropNum) {
+    case ePropPullMode:
+        if (TV_VT(varPropVal) != VTYPE_BOOL)
+            return false;
+        SetPullMode(TV_BOOL(varPropVal));
+        return true;
+    case ePropPreParse:
+        if (TV_VT(varPropVal) != VTYPE_BOOL)
+            return false;
+        SetPreParseMode(TV_BOOL(varPropVal));
+        return true;
+    default:
+        return false;
+    }
 }
 //---------------------------------------------------------------------------//
 bool CAddInNative::IsPropReadable(const long lPropNum)
 {
-    return false;
+    return lPropNum < eLastProp;
 }
 //---------------------------------------------------------------------------//
 bool CAddInNative::IsPropWritable(const long lPropNum)
 {
-    return false;
+    return lPropNum == ePropPullMode || lPropNum == ePropPreParse;
 }
 //---------------------------------------------------------------------------//
 long CAddInNative::GetNMethods()
@@ -212,32 +421,172 @@ const WCHAR_T* CAddInNative::GetMethodName(const long lMethodNum,
 //---------------------------------------------------------------------------//
 long CAddInNative::GetNParams(const long lMethodNum)
 {
-    if (lMethodNum == eMethConnect)
+    switch (lMethodNum) {
+    case eMethConnect:
         return 7;
-    else
+    case eMethPublish:
+    case eMethConfigurePublisher:
+    case eMethReplay:
+        return 3;
+    case eMethSetSubscription:
+    case eMethSubscribe:
+    case eMethUnsubscribe:
+        return 1;
+    case eMethWaitMessages:
+    case eMethConfigureCache:
+    case eMethSetDocumentMode:
+    case eMethGetDataField:
+    case eMethStartRecording:
+    case eMethConfigureReconnect:
+        return 2;
+    case eMethGetLast:
+    case eMethGetDocument:
+    case eMethGetTopic:
+    case eMethGetNotification:
+    case eMethGetMessage:
+    case eMethReleaseMessage:
+    case eMethGetAttachment:
+    case eMethGetAttachmentBase64:
+    case eMethReleaseAttachment:
+    case eMethPublishAsync:
+    case eMethFlushPublisher:
+        return 1;
+    default:
         return 0;
+    }
 }
 //---------------------------------------------------------------------------//
 bool CAddInNative::GetParamDefValue(const long lMethodNum, const long lParamNum,
     tVariant* pvarParamDefValue)
 {
     TV_VT(pvarParamDefValue) = VTYPE_EMPTY;
+
+    if (lMethodNum == eMethWaitMessages && lParamNum == 1) {
+        // Максимальное количество сообщений в пакете: 0 - без ограничения.
+        TV_VT(pvarParamDefValue) = VTYPE_I4;
+        TV_I4(pvarParamDefValue) = 0;
+        return true;
+    }
+    if (lMethodNum == eMethConfigureCache && lParamNum == 1) {
+        TV_VT(pvarParamDefValue) = VTYPE_I4;
+        TV_I4(pvarParamDefValue) = DEFAULT_TOPIC_CACHE_SIZE;
+        return true;
+    }
+    if (lMethodNum == eMethFlushPublisher && lParamNum == 0) {
+        TV_VT(pvarParamDefValue) = VTYPE_I4;
+        TV_I4(pvarParamDefValue) = DEFAULT_FLUSH_TIMEOUT_MS;
+        return true;
+    }
+    if (lMethodNum == eMethStartRecording && lParamNum == 1) {
+        // По умолчанию записываются кадры в том виде, в котором получены от сервиса (зашифрованные).
+        TV_VT(pvarParamDefValue) = VTYPE_BOOL;
+        TV_BOOL(pvarParamDefValue) = false;
+        return true;
+    }
+    if (lMethodNum == eMethReplay && lParamNum == 1) {
+        TV_VT(pvarParamDefValue) = VTYPE_R8;
+        TV_R8(pvarParamDefValue) = DEFAULT_REPLAY_SPEED;
+        return true;
+    }
+    if (lMethodNum == eMethConfigureReconnect && lParamNum == 1) {
+        TV_VT(pvarParamDefValue) = VTYPE_I4;
+        TV_I4(pvarParamDefValue) = DEFAULT_RECONNECT_MAX_DELAY_MS;
+        return true;
+    }
+    if (lMethodNum == eMethReplay && lParamNum == 2) {
+        // Ключ клиента не нужен для записи расшифрованных сообщений.
+        return true;
+    }
+
     return false;
 }
 //---------------------------------------------------------------------------//
 bool CAddInNative::HasRetVal(const long lMethodNum)
 {
-    return (lMethodNum == eMethConnect || lMethodNum == eMethGetLastError);
+    return (lMethodNum == eMethConnect
+        || lMethodNum == eMethGetLastError
+        || lMethodNum == eMethWaitMessages
+        || lMethodNum == eMethGetLast
+        || lMethodNum == eMethGetLastAll
+        || lMethodNum == eMethGetDocument
+        || lMethodNum == eMethGetTopic
+        || lMethodNum == eMethGetNotification
+        || lMethodNum == eMethGetDataField
+        || lMethodNum == eMethGetMessage
+        || lMethodNum == eMethGetAttachment
+        || lMethodNum == eMethGetAttachmentBase64
+        || lMethodNum == eMethPublish
+        || lMethodNum == eMethConfigurePublisher
+        || lMethodNum == eMethPublishAsync
+        || lMethodNum == eMethFlushPublisher
+        || lMethodNum == eMethGetPublishErrors
+        || lMethodNum == eMethGetStats
+        || lMethodNum == eMethStartRecording
+        || lMethodNum == eMethReplay);
 }
 //---------------------------------------------------------------------------//
 bool CAddInNative::CallAsProc(const long lMethodNum,
     tVariant* paParams, const long lSizeArray)
 {
-    if (lMethodNum == eMethShutdown) {
+    switch (lMethodNum) {
+    case eMethShutdown:
         StopListenService();
         return true;
+    case eMethSetSubscription:
+    case eMethSubscribe:
+    case eMethUnsubscribe: {
+        if (lSizeArray < 1 || TV_VT(&paParams[0]) != VTYPE_PWSTR)
+            return false;
+
+        const WCHAR_T* topics = paParams[0].pwstrVal;
+        if (lMethodNum == eMethSetSubscription)
+            return SetSubscription(topics);
+        else if (lMethodNum == eMethSubscribe)
+            return Subscribe(topics);
+        else
+            return Unsubscribe(topics);
+    }
+    case eMethConfigureCache: {
+        if (lSizeArray < 2 || TV_VT(&paParams[0]) != VTYPE_PWSTR)
+            return false;
+
+        long maxBytes = VariantToLong(&paParams[1], DEFAULT_TOPIC_CACHE_SIZE);
+        ConfigureTopicCache(paParams[0].pwstrVal, maxBytes > 0 ? (size_t)maxBytes : 0);
+        return true;
     }
-    else {
+    case eMethSetDocumentMode: {
+        // Второй параметр - ТолькоИзменения: Истина - передавать в 1С изменения документа
+        // без применения, Ложь - полное состояние документа.
+        if (lSizeArray < 2 || TV_VT(&paParams[0]) != VTYPE_PWSTR || TV_VT(&paParams[1]) != VTYPE_BOOL)
+            return false;
+
+        SetDocumentMode(paParams[0].pwstrVal, TV_BOOL(&paParams[1]));
+        return true;
+    }
+    case eMethReleaseMessage:
+        if (lSizeArray < 1)
+            return false;
+        ReleaseStoredMessage(VariantToLong(&paParams[0], 0));
+        return true;
+    case eMethReleaseAttachment:
+        if (lSizeArray < 1)
+            return false;
+        ReleaseAttachment(VariantToLong(&paParams[0], 0));
+        return true;
+    case eMethConfigureReconnect:
+        // Количество попыток переподключения после потери соединения (0 - без переподключения)
+        // и наибольшая задержка между попытками в миллисекундах.
+        if (lSizeArray < 2)
+            return false;
+        ConfigureReconnect(VariantToLong(&paParams[0], 0), VariantToLong(&paParams[1], DEFAULT_RECONNECT_MAX_DELAY_MS));
+        return true;
+    case eMethStopRecording:
+        StopRecording();
+        return true;
+    case eMethStopReplay:
+        StopReplay();
+        return true;
+    default:
         return false;
     }
 }
@@ -300,6 +649,7 @@ bool CAddInNative::CallAsFunc(const long lMethodNum,
     case eMethGetLastError: {
         WCHAR_T* pwstrResult = nullptr;
 
+        std::lock_guard<std::mutex> lock(lastErrorMutex);
         if (pwstrLastError != nullptr) {
             int size = (int)getLenShortWcharStr(pwstrLastError) + 1;
             if (m_iMemory->AllocMemory((void**)&pwstrResult, size * sizeof(WCHAR_T))) {
@@ -312,6 +662,198 @@ bool CAddInNative::CallAsFunc(const long lMethodNum,
         TV_WSTR(pvarRetValue) = pwstrResult;
         return true;
     }
+    case eMethWaitMessages: {
+        long timeoutMs = VariantToLong(&paParams[0], 0);
+        long maxCount = VariantToLong(&paParams[1], 0);
+
+        std::vector<WCHAR_T> batch;
+        WaitMessages(timeoutMs, maxCount > 0 ? (size_t)maxCount : 0, batch);
+
+        return setStringResult(pvarRetValue, batch);
+    }
+    case eMethGetLast: {
+        if (lSizeArray < 1 || TV_VT(&paParams[0]) != VTYPE_PWSTR)
+            return false;
+
+        std::vector<WCHAR_T> message;
+        if (!GetLastTopicMessage(paParams[0].pwstrVal, message)) {
+            // Сообщений по теме не было - возвращается Неопределено.
+            TV_VT(pvarRetValue) = VTYPE_EMPTY;
+            return true;
+        }
+
+        return setStringResult(pvarRetValue, message);
+    }
+    case eMethGetLastAll: {
+        std::vector<WCHAR_T> messages;
+        GetLastTopicMessages(messages);
+
+        return setStringResult(pvarRetValue, messages);
+    }
+    case eMethGetDocument: {
+        if (lSizeArray < 1 || TV_VT(&paParams[0]) != VTYPE_PWSTR)
+            return false;
+
+        std::vector<WCHAR_T> state;
+        if (!GetDocument(paParams[0].pwstrVal, state)) {
+            // Документ еще не получен - возвращается Неопределено.
+            TV_VT(pvarRetValue) = VTYPE_EMPTY;
+            return true;
+        }
+
+        return setStringResult(pvarRetValue, state);
+    }
+    case eMethGetTopic:
+    case eMethGetNotification:
+    case eMethGetMessage: {
+        if (lSizeArray < 1)
+            return false;
+
+        int32_t id = VariantToLong(&paParams[0], 0);
+        std::vector<WCHAR_T> value;
+        bool found;
+        if (lMethodNum == eMethGetTopic)
+            found = GetStoredMessageTopic(id, value);
+        else if (lMethodNum == eMethGetNotification)
+            found = GetStoredMessageNotification(id, value);
+        else
+            found = GetStoredMessage(id, value);
+
+        if (!found) {
+            // Сообщение уже освобождено или в нем нет оповещения - возвращается Неопределено.
+            TV_VT(pvarRetValue) = VTYPE_EMPTY;
+            return true;
+        }
+
+        return setStringResult(pvarRetValue, value);
+    }
+    case eMethGetAttachment: {
+        if (lSizeArray < 1)
+            return false;
+
+        AttachmentData data = GetAttachment(VariantToLong(&paParams[0], 0));
+        if (!data) {
+            // Вложение освобождено или вытеснено из хранилища - возвращается Неопределено.
+            TV_VT(pvarRetValue) = VTYPE_EMPTY;
+            return true;
+        }
+
+        // Двоичные данные возвращаются как ДвоичныеДанные; память выделяется и для пустого вложения.
+        char* pstrResult = nullptr;
+        if (!m_iMemory->AllocMemory((void**)&pstrResult, (unsigned long)std::max<size_t>(data->size(), 1)))
+            return false;
+        if (!data->empty())
+            memcpy(pstrResult, data->data(), data->size());
+
+        TV_VT(pvarRetValue) = VTYPE_BLOB;
+        pvarRetValue->pstrVal = pstrResult;
+        pvarRetValue->strLen = (uint32_t)data->size();
+        return true;
+    }
+    case eMethGetAttachmentBase64: {
+        if (lSizeArray < 1)
+            return false;
+
+        std::vector<WCHAR_T> value;
+        if (!GetAttachmentBase64(VariantToLong(&paParams[0], 0), value)) {
+            TV_VT(pvarRetValue) = VTYPE_EMPTY;
+            return true;
+        }
+
+        return setStringResult(pvarRetValue, value);
+    }
+    case eMethPublish: {
+        if (lSizeArray < 3
+            || TV_VT(&paParams[0]) != VTYPE_PWSTR
+            || TV_VT(&paParams[2]) != VTYPE_PWSTR)
+            return false;
+
+        // Для типа получателя "all" получатель не указывается.
+        const WCHAR_T* recipient = TV_VT(&paParams[1]) == VTYPE_PWSTR ? paParams[1].pwstrVal : nullptr;
+
+        TV_VT(pvarRetValue) = VTYPE_BOOL;
+        TV_BOOL(pvarRetValue) = Publish(paParams[0].pwstrVal, recipient, paParams[2].pwstrVal);
+        return true;
+    }
+    case eMethConfigurePublisher: {
+        // Параметры: адрес сервера отправления уведомлений, порт, ключ доступа (access token).
+        if (lSizeArray < 3
+            || TV_VT(&paParams[0]) != VTYPE_PWSTR
+            || TV_VT(&paParams[2]) != VTYPE_PWSTR)
+            return false;
+
+        TV_VT(pvarRetValue) = VTYPE_BOOL;
+        TV_BOOL(pvarRetValue) = ConfigurePublisher(m_publisher, paParams[0].pwstrVal,
+            VariantToLong(&paParams[1], 0), paParams[2].pwstrVal);
+        return true;
+    }
+    case eMethPublishAsync: {
+        if (lSizeArray < 1 || TV_VT(&paParams[0]) != VTYPE_PWSTR)
+            return false;
+
+        TV_VT(pvarRetValue) = VTYPE_BOOL;
+        TV_BOOL(pvarRetValue) = PublishAsync(m_publisher, paParams[0].pwstrVal);
+        return true;
+    }
+    case eMethFlushPublisher: {
+        long timeoutMs = lSizeArray > 0 ? VariantToLong(&paParams[0], DEFAULT_FLUSH_TIMEOUT_MS) : DEFAULT_FLUSH_TIMEOUT_MS;
+
+        TV_VT(pvarRetValue) = VTYPE_BOOL;
+        TV_BOOL(pvarRetValue) = FlushPublisher(m_publisher, timeoutMs > 0 ? timeoutMs : 0);
+        return true;
+    }
+    case eMethGetPublishErrors: {
+        std::vector<WCHAR_T> errors;
+        GetPublishErrors(m_publisher, errors);
+
+        return setStringResult(pvarRetValue, errors);
+    }
+    case eMethGetStats: {
+        std::vector<WCHAR_T> stats;
+        GetStats(m_publisher, stats);
+
+        return setStringResult(pvarRetValue, stats);
+    }
+    case eMethStartRecording: {
+        // Параметры: имя файла записи, записывать расшифрованные сообщения.
+        if (lSizeArray < 2 || TV_VT(&paParams[0]) != VTYPE_PWSTR)
+            return false;
+
+        bool decrypted = TV_VT(&paParams[1]) == VTYPE_BOOL && TV_BOOL(&paParams[1]);
+
+        TV_VT(pvarRetValue) = VTYPE_BOOL;
+        TV_BOOL(pvarRetValue) = StartRecording(paParams[0].pwstrVal, decrypted);
+        return true;
+    }
+    case eMethReplay: {
+        // Параметры: имя файла записи, скорость воспроизведения, ключ клиента.
+        if (lSizeArray < 3 || TV_VT(&paParams[0]) != VTYPE_PWSTR)
+            return false;
+
+        double speed = VariantToDouble(&paParams[1], DEFAULT_REPLAY_SPEED);
+        char* pstrClientKey = nullptr;
+        if (TV_VT(&paParams[2]) == VTYPE_PWSTR)
+            convFromShortWcharToAscii(&pstrClientKey, paParams[2].pwstrVal);
+
+        bool result = StartReplay(paParams[0].pwstrVal, speed > 0 ? speed : 0, pstrClientKey, m_iConnect);
+        delete[] pstrClientKey;
+
+        TV_VT(pvarRetValue) = VTYPE_BOOL;
+        TV_BOOL(pvarRetValue) = result;
+        return true;
+    }
+    case eMethGetDataField: {
+        if (lSizeArray < 2 || TV_VT(&paParams[1]) != VTYPE_PWSTR)
+            return false;
+
+        std::vector<WCHAR_T> value;
+        if (!GetStoredMessageDataField(VariantToLong(&paParams[0], 0), paParams[1].pwstrVal, value)) {
+            TV_VT(pvarRetValue) = VTYPE_EMPTY;
+            return true;
+        }
+
+        return setStringResult(pvarRetValue, value);
+    }
     default:
         return false;
     }
@@ -367,6 +909,32 @@ void CAddInNative::addError(uint32_t wcode, const wchar_t* source,
     }
 }
 //---------------------------------------------------------------------------//
+const WCHAR_T* CAddInNative::allocName(const wchar_t* name)
+{
+    WCHAR_T* wsName = nullptr;
+    uint32_t iActualSize = static_cast<uint32_t>(wcslen(name) + 1);
+
+    if (m_iMemory && m_iMemory->AllocMemory((void**)&wsName, iActualSize * sizeof(WCHAR_T)))
+        convToShortWchar(&wsName, name, iActualSize);
+
+    return wsName;
+}
+//---------------------------------------------------------------------------//
+bool CAddInNative::setStringResult(tVariant* pvarRetValue, const std::vector<WCHAR_T>& str)
+{
+    // Строка в str должна заканчиваться нулем.
+    WCHAR_T* pwstrResult = nullptr;
+    if (!m_iMemory->AllocMemory((void**)&pwstrResult, (unsigned long)(str.size() * sizeof(WCHAR_T))))
+        return false;
+
+    memcpy(pwstrResult, str.data(), str.size() * sizeof(WCHAR_T));
+
+    TV_VT(pvarRetValue) = VTYPE_PWSTR;
+    TV_WSTR(pvarRetValue) = pwstrResult;
+    pvarRetValue->wstrLen = (uint32_t)(str.size() - 1);
+    return true;
+}
+//---------------------------------------------------------------------------//
 long CAddInNative::findName(const wchar_t* names[], const wchar_t* name,
     const uint32_t size) const
 {
@@ -5,9 +5,11 @@
 #include <wtypes.h>
 #endif //__linux__
 
+#include <vector>
 #include "include/ComponentBase.h"
 #include "include/AddInDefBase.h"
 #include "include/IMemoryManager.h"
+#include "HttpPublisher.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 // class CAddInNative
@@ -16,6 +18,12 @@ class CAddInNative : public IComponentBase
 public:
     enum Props
     {
+        ePropPendingCount = 0,
+        ePropPullMode = 1,
+        ePropPreParse = 2,
+        ePropPublishPending = 3,
+        ePropReplaying = 4,
+        ePropState = 5,
         eLastProp      // Always last
     };
 
@@ -24,6 +32,34 @@ public:
         eMethConnect = 0,
         eMethShutdown = 1,
         eMethGetLastError = 2,
+        eMethSetSubscription = 3,
+        eMethSubscribe = 4,
+        eMethUnsubscribe = 5,
+        eMethWaitMessages = 6,
+        eMethConfigureCache = 7,
+        eMethGetLast = 8,
+        eMethGetLastAll = 9,
+        eMethSetDocumentMode = 10,
+        eMethGetDocument = 11,
+        eMethGetTopic = 12,
+        eMethGetNotification = 13,
+        eMethGetDataField = 14,
+        eMethGetMessage = 15,
+        eMethReleaseMessage = 16,
+        eMethPublish = 17,
+        eMethConfigurePublisher = 18,
+        eMethPublishAsync = 19,
+        eMethFlushPublisher = 20,
+        eMethGetPublishErrors = 21,
+        eMethGetStats = 22,
+        eMethStartRecording = 23,
+        eMethStopRecording = 24,
+        eMethReplay = 25,
+        eMethStopReplay = 26,
+        eMethGetAttachment = 27,
+        eMethGetAttachmentBase64 = 28,
+        eMethReleaseAttachment = 29,
+        eMethConfigureReconnect = 30,
         eLastMethod      // Always last
     };
 
@@ -62,8 +98,13 @@ private:
     // Attributes
     IAddInDefBaseEx* m_iConnect;
     IMemoryManager* m_iMemory;
+    // Асинхронная отправка уведомлений серверу отправления. Не зависит от соединения с сервисом
+    // и используется в серверном контексте (фоновые задания, обработка проведения).
+    HttpPublisher m_publisher;
 
     long findName(const wchar_t* names[], const wchar_t* name, const uint32_t size) const;
+    const WCHAR_T* allocName(const wchar_t* name);
+    bool setStringResult(tVariant* pvarRetValue, const std::vector<WCHAR_T>& str);
     void addError(uint32_t wcode, const wchar_t* source, const wchar_t* description, long code);
 };
 
@@ -0,0 +1,65 @@
+#include "AttachmentStore.h"
+
+AttachmentStore::AttachmentStore(size_t maxCount, size_t maxBytes) :
+    m_maxCount(maxCount), m_maxBytes(maxBytes), m_usedBytes(0), m_lastId(0)
+{ }
+
+int32_t AttachmentStore::Add(const AttachmentData& data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_lastId = (m_lastId == INT32_MAX) ? 1 : m_lastId + 1;
+    m_attachments[m_lastId] = data;
+    m_usedBytes += data->size();
+    m_order.push_back(m_lastId);
+
+    // Последнее вложение сохраняется, даже если оно одно превышает лимит объема.
+    while ((m_attachments.size() > m_maxCount || m_usedBytes > m_maxBytes) && m_order.front() != m_lastId) {
+        auto it = m_attachments.find(m_order.front());
+        if (it != m_attachments.end())
+            erase(it);
+        m_order.pop_front();
+    }
+    // Освобожденные идентификаторы не должны копиться в очереди.
+    if (m_order.size() > m_maxCount * 2) {
+        std::deque<int32_t> order;
+        for (int32_t id : m_order) {
+            if (m_attachments.count(id))
+                order.push_back(id);
+        }
+        m_order.swap(order);
+    }
+
+    return m_lastId;
+}
+
+AttachmentData AttachmentStore::Get(int32_t id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_attachments.find(id);
+    return it == m_attachments.end() ? AttachmentData() : it->second;
+}
+
+void AttachmentStore::Release(int32_t id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_attachments.find(id);
+    if (it != m_attachments.end())
+        erase(it);
+}
+
+void AttachmentStore::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_attachments.clear();
+    m_order.clear();
+    m_usedBytes = 0;
+}
+
+void AttachmentStore::erase(std::map<int32_t, AttachmentData>::iterator it)
+{
+    m_usedBytes -= it->second->size();
+    m_attachments.erase(it);
+}
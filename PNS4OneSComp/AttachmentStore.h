@@ -0,0 +1,46 @@
+#ifndef __ATTACHMENTSTORE_H__
+#define __ATTACHMENTSTORE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+typedef std::shared_ptr<const std::vector<unsigned char> > AttachmentData;
+
+///////////////////////////////////////////////////////////////////////////////
+// class AttachmentStore
+// Двоичные данные вложений полученных сообщений, декодированные из base64 при получении.
+// В тексте сообщения, передаваемом в 1С, вместо данных указываются идентификатор и размер
+// вложения, а данные читаются методами компоненты. Количество и общий объем вложений
+// ограничены: при переполнении удаляются самые старые.
+class AttachmentStore
+{
+public:
+    AttachmentStore(size_t maxCount, size_t maxBytes);
+
+    // Помещает вложение в хранилище и возвращает его идентификатор.
+    int32_t Add(const AttachmentData& data);
+    // Возвращает nullptr, если вложение освобождено или удалено при переполнении.
+    AttachmentData Get(int32_t id);
+    void Release(int32_t id);
+    void Clear();
+private:
+    AttachmentStore(const AttachmentStore&);
+    AttachmentStore& operator = (const AttachmentStore&);
+
+    void erase(std::map<int32_t, AttachmentData>::iterator it);
+
+    size_t m_maxCount;
+    size_t m_maxBytes;
+    size_t m_usedBytes;
+    int32_t m_lastId;
+    std::map<int32_t, AttachmentData> m_attachments;
+    std::deque<int32_t> m_order; // Идентификаторы в порядке получения, могут содержать освобожденные.
+    std::mutex m_mutex;
+};
+
+#endif //__ATTACHMENTSTORE_H__
@@ -0,0 +1,91 @@
+#include "ConnectionState.h"
+#include "Json.h"
+
+const char* ConnectionStateName(ConnectionState state)
+{
+    switch (state) {
+    case eConnectionConnecting:
+        return "connecting";
+    case eConnectionConnected:
+        return "connected";
+    case eConnectionReconnecting:
+        return "reconnecting";
+    case eConnectionDraining:
+        return "draining";
+    case eConnectionFailed:
+        return "failed";
+    default:
+        return "disconnected";
+    }
+}
+
+void ConnectionTransition::Serialize(std::string& out) const
+{
+    out.append("{\"state\":\"");
+    out.append(ConnectionStateName(to));
+    out.append("\",\"previous\":\"");
+    out.append(ConnectionStateName(from));
+    out.append("\",\"reason\":");
+    JsonWriteString(out, reason);
+    out.append(",\"at\":");
+    out.append(std::to_string(at));
+    out.append(",\"elapsedMs\":");
+    out.append(std::to_string(elapsedMs));
+    out.append(",\"attempt\":");
+    out.append(std::to_string(attempt));
+    out.push_back('}');
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ConnectionStateMachine
+
+ConnectionStateMachine::ConnectionStateMachine() :
+    m_state(eConnectionDisconnected), m_since(std::chrono::steady_clock::now())
+{
+}
+
+ConnectionState ConnectionStateMachine::State() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_state;
+}
+
+bool ConnectionStateMachine::IsAllowed(ConnectionState from, ConnectionState to)
+{
+    switch (from) {
+    case eConnectionDisconnected:
+    case eConnectionFailed:
+        return to == eConnectionConnecting;
+    case eConnectionConnecting:
+        return to == eConnectionConnected || to == eConnectionFailed;
+    case eConnectionConnected:
+        return to == eConnectionReconnecting || to == eConnectionDraining || to == eConnectionFailed;
+    case eConnectionReconnecting:
+        return to == eConnectionConnected || to == eConnectionDraining || to == eConnectionFailed;
+    case eConnectionDraining:
+        return to == eConnectionDisconnected;
+    default:
+        return false;
+    }
+}
+
+bool ConnectionStateMachine::Transition(ConnectionState to, const char* reason, int attempt,
+    ConnectionTransition& transition)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!IsAllowed(m_state, to))
+        return false;
+
+    auto now = std::chrono::steady_clock::now();
+    transition.from = m_state;
+    transition.to = to;
+    transition.reason = reason;
+    transition.at = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    transition.elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_since).count();
+    transition.attempt = attempt;
+
+    m_state = to;
+    m_since = now;
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef __CONNECTIONSTATE_H__
+#define __CONNECTIONSTATE_H__
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Состояние соединения с сервисом. Начальное состояние - eConnectionDisconnected.
+enum ConnectionState
+{
+    eConnectionDisconnected = 0,  // Соединения нет, подключение не выполнялось или завершено вызовом Отключить()
+    eConnectionConnecting,        // Выполняется подключение по вызову Подключить()
+    eConnectionConnected,         // Соединение установлено, клиент зарегистрирован
+    eConnectionReconnecting,      // Соединение потеряно, выполняются повторные попытки подключения
+    eConnectionDraining,          // Вызван Отключить(), поток прослушивания завершает обработку
+    eConnectionFailed             // Подключение не удалось или соединение потеряно без восстановления
+};
+
+// Имя состояния для 1С: disconnected, connecting, connected, reconnecting, draining, failed.
+const char* ConnectionStateName(ConnectionState state);
+
+// Переход между состояниями. Время указывается в миллисекундах.
+struct ConnectionTransition
+{
+    ConnectionTransition() : from(eConnectionDisconnected), to(eConnectionDisconnected), at(0), elapsedMs(0), attempt(0) { }
+
+    ConnectionState from;
+    ConnectionState to;
+    std::string reason;   // Причина перехода: connect, connected, connect_failed, connection_lost, ...
+    int64_t at;           // Время перехода с 01.01.1970 UTC
+    int64_t elapsedMs;    // Время нахождения в предыдущем состоянии
+    int attempt;          // Номер попытки переподключения, 0 - не переподключение
+
+    // Объект JSON {"state", "previous", "reason", "at", "elapsedMs", "attempt"}.
+    void Serialize(std::string& out) const;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// class ConnectionStateMachine
+// Состояние соединения с сервисом и допустимые переходы между состояниями. Переходы выполняются
+// потоком 1С (подключение, отключение) и потоком прослушивания (потеря и восстановление соединения).
+class ConnectionStateMachine
+{
+public:
+    ConnectionStateMachine();
+
+    ConnectionState State() const;
+    // Выполняет переход, если он допустим из текущего состояния. Возвращает false, если переход
+    // недопустим (например, соединение уже закрыто вызовом Отключить()).
+    bool Transition(ConnectionState to, const char* reason, int attempt, ConnectionTransition& transition);
+
+    static bool IsAllowed(ConnectionState from, ConnectionState to);
+private:
+    ConnectionStateMachine(const ConnectionStateMachine&);
+    ConnectionStateMachine& operator = (const ConnectionStateMachine&);
+
+    mutable std::mutex m_mutex;
+    ConnectionState m_state;
+    std::chrono::steady_clock::time_point m_since;
+};
+
+#endif //__CONNECTIONSTATE_H__
@@ -2,8 +2,11 @@
 #include <cwchar>
 #endif
 
+#include <cstdint>
 #include "ConversionWchar.h"
 
+// Символ вне BMP занимает в UTF-16 два элемента, а в UTF-8 - 4 байта, поэтому на один элемент
+// UTF-16 приходится не более 3 байт.
 constexpr auto MAX_UTF8_CHAR_LEN = 3;
 
 size_t convToShortWchar(WCHAR_T **Dest, const wchar_t *Source, size_t len) {
@@ -82,9 +85,26 @@ size_t convFromUtf8ToShortWchar(WCHAR_T **Dest, const char *Source, size_t len)
             tmpUtf8++;
         }
         else if ((*tmpUtf8 & 0b11110000) == 0b11110000) {
-            // 4 bytes not support.
-            *tmpWChar = 0xFFFD;
-            tmpUtf8 += 4;
+            // 4 bytes - code point outside the BMP, encoded as a UTF-16 surrogate pair.
+            uint32_t code = *tmpUtf8 & 0b00000111;
+            int byteCount = 1;
+            for (; byteCount < 4 && (tmpUtf8[byteCount] & 0b11000000) == 0b10000000; byteCount++)
+                code = code * 64 + (tmpUtf8[byteCount] & 0b00111111);
+
+            bool valid = (*tmpUtf8 & 0b11111000) == 0b11110000 && byteCount == 4
+                && code >= 0x10000 && code <= 0x10FFFF;
+            tmpUtf8 += byteCount;
+
+            if (!valid || i < 2) {
+                *tmpWChar = 0xFFFD;
+            }
+            else {
+                code -= 0x10000;
+                *tmpWChar++ = (WCHAR_T)(0xD800 + (code >> 10));
+                *tmpWChar = (WCHAR_T)(0xDC00 + (code & 0x3FF));
+                i--;
+                res++;
+            }
         }
         else {
             int byteCount;
@@ -130,49 +150,63 @@ size_t convFromShortWcharToUtf8(char** Dest, const WCHAR_T* Source, size_t len)
 
     ::memset(*Dest, 0, len * MAX_UTF8_CHAR_LEN);
 
-    for (; len > 0 && *tmpChar; tmpChar++, len--) {
-        if (*tmpWChar < 0x80) {
-            *tmpChar = (char)*tmpWChar;
+    for (; len > 0 && *tmpWChar; tmpWChar++, len--) {
+        uint32_t code = *tmpWChar;
+
+        // Суррогатная пара кодируется одной 4-байтовой последовательностью (раздельное кодирование
+        // половин пары - это CESU-8, который строгие декодеры UTF-8 не принимают). Одиночный
+        // суррогат заменяется символом U+FFFD.
+        if (code >= 0xD800 && code <= 0xDFFF) {
+            if (code <= 0xDBFF && len > 1 && tmpWChar[1] >= 0xDC00 && tmpWChar[1] <= 0xDFFF) {
+                code = 0x10000 + ((code - 0xD800) << 10) + (tmpWChar[1] - 0xDC00);
+                tmpWChar++;
+                len--;
+            }
+            else {
+                code = 0xFFFD;
+            }
+        }
+
+        if (code < 0x80) {
+            *tmpChar = (char)code;
             tmpChar++;
             res += 1;
         }
-        else if (*tmpWChar < 0x800) {
-            char b1 = *tmpWChar % 0x40;
-            char b2 = (*tmpWChar - b1) / 0x40;
-
-            *tmpChar = b2 + 0xC0;
+        else if (code < 0x800) {
+            *tmpChar = (char)(0xC0 | (code >> 6));
             tmpChar++;
 
-            *tmpChar = b1 + 0x80;
+            *tmpChar = (char)(0x80 | (code & 0x3F));
             tmpChar++;
 
             res += 2;
         }
-        else if (*tmpWChar < 0x10000) {
-            char b1 = *tmpWChar % 0x40;
-            char b2 = ((*tmpWChar - b1) / 0x40) % 0x40;
-            char b3 = (*tmpWChar - b1 - (b2 * 0x40)) / 0x1000;
-
-            *tmpWChar = b3 + 0xE0;
+        else if (code < 0x10000) {
+            *tmpChar = (char)(0xE0 | ((code >> 12) & 0x0F));
             tmpChar++;
 
-            *tmpWChar = b2 + 0x80;
+            *tmpChar = (char)(0x80 | ((code >> 6) & 0x3F));
             tmpChar++;
 
-            *tmpWChar = b1 + 0x80;
+            *tmpChar = (char)(0x80 | (code & 0x3F));
             tmpChar++;
 
             res += 3;
         }
         else {
-            // more 0x10000 code symbol not support.
-            *tmpChar = (char)0xEF;
+            *tmpChar = (char)(0xF0 | (code >> 18));
+            tmpChar++;
+
+            *tmpChar = (char)(0x80 | ((code >> 12) & 0x3F));
             tmpChar++;
-            *tmpChar = (char)0xBF;
+
+            *tmpChar = (char)(0x80 | ((code >> 6) & 0x3F));
             tmpChar++;
-            *tmpChar = (char)0xBD;
+
+            *tmpChar = (char)(0x80 | (code & 0x3F));
             tmpChar++;
-            res += 3;
+
+            res += 4;
         }
     }
 
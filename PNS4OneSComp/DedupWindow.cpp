@@ -0,0 +1,26 @@
+#include "DedupWindow.h"
+
+DedupWindow::DedupWindow(size_t maxSize) : m_maxSize(maxSize)
+{ }
+
+bool DedupWindow::Add(const std::string& id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_ids.insert(id).second)
+        return false;
+
+    m_order.push_back(id);
+    if (m_order.size() > m_maxSize) {
+        m_ids.erase(m_order.front());
+        m_order.pop_front();
+    }
+    return true;
+}
+
+void DedupWindow::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_ids.clear();
+    m_order.clear();
+}
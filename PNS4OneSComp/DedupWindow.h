@@ -0,0 +1,33 @@
+#ifndef __DEDUPWINDOW_H__
+#define __DEDUPWINDOW_H__
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+///////////////////////////////////////////////////////////////////////////////
+// class DedupWindow
+// Окно идентификаторов последних полученных сообщений. Позволяет отбросить
+// повторно доставленное сообщение (после переподключения или от дублирующих
+// отправителей). Хранится не более maxSize идентификаторов, самые старые вытесняются.
+class DedupWindow
+{
+public:
+    explicit DedupWindow(size_t maxSize);
+
+    // Запоминает идентификатор. Возвращает false, если он уже есть в окне.
+    bool Add(const std::string& id);
+    void Clear();
+private:
+    DedupWindow(const DedupWindow&);
+    DedupWindow& operator = (const DedupWindow&);
+
+    size_t m_maxSize;
+    std::unordered_set<std::string> m_ids;
+    std::deque<std::string> m_order;
+    std::mutex m_mutex;
+};
+
+#endif //__DEDUPWINDOW_H__
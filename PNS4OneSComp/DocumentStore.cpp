@@ -0,0 +1,64 @@
+#include "DocumentStore.h"
+
+void DocumentStore::SetPatchMode(const std::string& id, bool patchMode)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_documents[id].patchMode = patchMode;
+}
+
+bool DocumentStore::Apply(JsonValue& message)
+{
+    JsonValue* documentValue = message.Find("document");
+    if (!documentValue || !documentValue->IsObject())
+        return false;
+
+    const JsonValue* id = documentValue->Find("id");
+    if (!id || !id->IsString())
+        return false;
+
+    const JsonValue* version = documentValue->Find("version");
+    const JsonValue* state = documentValue->Find("state");
+    const JsonValue* patch = documentValue->Find("patch");
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Document& document = m_documents[id->GetString()];
+    if (state)
+        document.state = *state;
+    else if (patch)
+        document.state.ApplyMergePatch(*patch);
+    else
+        return false;
+
+    document.received = true;
+
+    if (document.patchMode || state)
+        return false;
+
+    JsonValue snapshot(JsonValue::eObject);
+    snapshot.Set("id", *id);
+    if (version)
+        snapshot.Set("version", *version);
+    snapshot.Set("state", document.state);
+    *documentValue = snapshot;
+    return true;
+}
+
+bool DocumentStore::Get(const std::string& id, std::string& state)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_documents.find(id);
+    if (it == m_documents.end() || !it->second.received)
+        return false;
+
+    state.clear();
+    it->second.state.Serialize(state);
+    return true;
+}
+
+void DocumentStore::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_documents.clear();
+}
@@ -0,0 +1,45 @@
+#ifndef __DOCUMENTSTORE_H__
+#define __DOCUMENTSTORE_H__
+
+#include <map>
+#include <mutex>
+#include <string>
+#include "Json.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// class DocumentStore
+// Локальные копии документов состояния, которые сервис передает полным снимком
+// или изменениями в формате JSON Merge Patch. В режиме состояния (по умолчанию)
+// изменения применяются к копии, и в 1С передается документ целиком. В режиме
+// изменений сообщение передается в 1С в том виде, в котором получено от сервиса.
+class DocumentStore
+{
+public:
+    DocumentStore() { }
+
+    void SetPatchMode(const std::string& id, bool patchMode);
+    // Применяет документ из сообщения к локальной копии. Если документ нужно передать
+    // в 1С полным состоянием, то свойство "document" сообщения заменяется снимком.
+    // Возвращает true, если сообщение было изменено.
+    bool Apply(JsonValue& message);
+    // Возвращает false, если документ еще не получен. Состояние помещается в state в виде JSON.
+    bool Get(const std::string& id, std::string& state);
+    void Clear();
+private:
+    DocumentStore(const DocumentStore&);
+    DocumentStore& operator = (const DocumentStore&);
+
+    struct Document
+    {
+        Document() : patchMode(false), received(false) { }
+
+        JsonValue state;
+        bool patchMode;
+        bool received;
+    };
+
+    std::mutex m_mutex;
+    std::map<std::string, Document> m_documents;
+};
+
+#endif //__DOCUMENTSTORE_H__
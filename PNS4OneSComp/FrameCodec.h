@@ -0,0 +1,452 @@
+#ifndef __FRAMECODEC_H__
+#define __FRAMECODEC_H__
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Кодек кадров протокола сервиса уведомлений в обоих направлениях. Разбор выполняется
+// представлениями над буфером вызывающего кода, запись - непосредственно в его буфер, поэтому
+// кодек не выделяет память и не копирует данные. Все числа передаются в порядке little-endian
+// независимо от платформы. Используется компонентой, стендами и сервисом на C++.
+//
+// Сервис -> клиент: 4 байта - размер кадра, затем кадр:
+//  версия 1: 4 байта - размер расшифрованных данных, зашифрованные данные;
+//  версия 2: маркер FRAME_HEADER_MARKER, 2 байта - размер заголовка, поля заголовка
+//            (тип - 1 байт, длина - 2 байта, значение), далее как в версии 1.
+// Клиент -> сервис: 2 байта - размер кадра, затем кадр:
+//  регистрация (всегда первый кадр): 2 байта - длина подписи, подпись HMAC-SHA256,
+//            идентификатор приложения, базы, пользователя, группа и версия протокола,
+//            каждая строка заканчивается нулем;
+//  управляющий кадр: тип (1 байт), темы, каждая из которых заканчивается нулем;
+//  публикация: тип (1 байт), 4 байта - номер публикации, 4 байта - размер данных до шифрования,
+//            зашифрованные данные, подпись HMAC-SHA256 всех предыдущих данных кадра.
+
+static_assert(CHAR_BIT == 8, "the protocol is defined for 8-bit bytes");
+
+// Кадр версии 2 начинается с маркера вместо размера расшифрованных данных (который не может быть отрицательным).
+constexpr uint32_t FRAME_HEADER_MARKER = 0xFFFFFFFF;
+
+// Типы полей заголовка кадра (тип - 1 байт, длина - 2 байта, значение).
+constexpr unsigned char FRAME_FIELD_MESSAGE_ID = 1; // Идентификатор сообщения, UTF-8
+constexpr unsigned char FRAME_FIELD_EXPIRES_AT = 2; // Срок жизни, миллисекунды с 01.01.1970 UTC (8 байт)
+constexpr unsigned char FRAME_FIELD_INGESTED_AT = 3; // Время приема сообщения сервисом, миллисекунды с 01.01.1970 UTC (8 байт)
+constexpr unsigned char FRAME_FIELD_TRACE_ID = 4; // Идентификатор трассировки, заданный отправителем, UTF-8
+constexpr unsigned char FRAME_FIELD_SENT_AT = 5; // Время отправки кадра сервисом, миллисекунды с 01.01.1970 UTC (8 байт)
+
+// Типы кадров, передаваемых клиентом после регистрации.
+constexpr unsigned char CONTROL_FRAME_SET_TOPICS = 1;    // Замена всего списка тем подписки
+constexpr unsigned char CONTROL_FRAME_ADD_TOPICS = 2;    // Добавление тем в подписку
+constexpr unsigned char CONTROL_FRAME_REMOVE_TOPICS = 3; // Удаление тем из подписки
+constexpr unsigned char CONTROL_FRAME_RESET_TOPICS = 4;  // Отключение фильтра (прием сообщений по всем темам)
+constexpr unsigned char CONTROL_FRAME_PUBLISH = 5;       // Публикация сообщения клиентом
+
+// Размеры элементов кадров.
+constexpr size_t MESSAGE_FRAME_SIZE_BYTES = 4;  // размер кадра сервиса
+constexpr size_t CLIENT_FRAME_SIZE_BYTES = 2;   // размер кадра клиента
+constexpr size_t CLIENT_FRAME_MAX_SIZE = 0xFFFF;
+constexpr size_t FRAME_MARKER_SIZE = 4;
+constexpr size_t FRAME_HEADER_SIZE_BYTES = 2;
+constexpr size_t FRAME_HEADER_MAX_SIZE = 0xFFFF;
+constexpr size_t FRAME_FIELD_PREFIX_SIZE = 1 + 2;
+constexpr size_t FRAME_TIMESTAMP_SIZE = 8;
+constexpr size_t DECRYPTED_SIZE_BYTES = 4;
+constexpr size_t SIGNATURE_SIZE_BYTES = 2;
+constexpr size_t HMAC_SHA256_SIZE = 32;
+constexpr size_t PUBLISH_FRAME_HEADER_SIZE = 1 + 4 + 4;
+
+// Размеры элементов должны совпадать с типами, которыми их читают и записывают FrameReader и FrameWriter.
+static_assert(MESSAGE_FRAME_SIZE_BYTES == sizeof(uint32_t), "the service frame size is read with ReadLE32");
+static_assert(CLIENT_FRAME_SIZE_BYTES == sizeof(uint16_t) && CLIENT_FRAME_MAX_SIZE == UINT16_MAX,
+    "the client frame size is written with PutLE16");
+static_assert(FRAME_MARKER_SIZE == sizeof(FRAME_HEADER_MARKER) && FRAME_MARKER_SIZE == DECRYPTED_SIZE_BYTES,
+    "the marker occupies the decrypted size position");
+static_assert(FRAME_HEADER_SIZE_BYTES == sizeof(uint16_t) && FRAME_HEADER_MAX_SIZE == UINT16_MAX,
+    "the header size is read with ReadLE16");
+static_assert(FRAME_FIELD_PREFIX_SIZE == sizeof(unsigned char) + sizeof(uint16_t), "a field is prefixed by ReadU8 and ReadLE16");
+static_assert(FRAME_TIMESTAMP_SIZE == sizeof(uint64_t) && DECRYPTED_SIZE_BYTES == sizeof(uint32_t),
+    "timestamps and the decrypted size are read with ReadLE64 and ReadLE32");
+static_assert(SIGNATURE_SIZE_BYTES == sizeof(uint16_t), "the signature size is read with ReadLE16");
+static_assert(PUBLISH_FRAME_HEADER_SIZE == sizeof(unsigned char) + 2 * sizeof(uint32_t),
+    "a publish frame starts with the type, the sequence and the decrypted size");
+static_assert(PUBLISH_FRAME_HEADER_SIZE + HMAC_SHA256_SIZE <= CLIENT_FRAME_MAX_SIZE, "a publish frame fits the client frame");
+
+///////////////////////////////////////////////////////////////////////////////
+// Числа little-endian
+
+inline void StoreLE16(unsigned char* p, uint16_t value)
+{
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+}
+
+inline void StoreLE32(unsigned char* p, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = (unsigned char)(value >> (i * 8));
+}
+
+inline void StoreLE64(unsigned char* p, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = (unsigned char)(value >> (i * 8));
+}
+
+inline uint16_t LoadLE16(const unsigned char* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+inline uint32_t LoadLE32(const unsigned char* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline uint64_t LoadLE64(const unsigned char* p)
+{
+    return (uint64_t)LoadLE32(p) | ((uint64_t)LoadLE32(p + 4) << 32);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Разбор
+
+// Участок буфера вызывающего кода.
+struct ByteView
+{
+    ByteView() : data(nullptr), size(0) { }
+    ByteView(const unsigned char* data, size_t size) : data(data), size(size) { }
+
+    const char* chars() const { return (const char*)data; }
+
+    const unsigned char* data;
+    size_t size;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// class FrameReader
+// Последовательное чтение с проверкой границ: при выходе за границу чтение возвращает false,
+// и все последующие чтения тоже завершаются неудачей.
+class FrameReader
+{
+public:
+    FrameReader(const unsigned char* data, size_t size) : m_pos(data), m_end(data + size), m_failed(false) { }
+
+    size_t Remaining() const { return m_failed ? 0 : (size_t)(m_end - m_pos); }
+    const unsigned char* Position() const { return m_pos; }
+    bool Failed() const { return m_failed; }
+
+    bool ReadU8(unsigned char& value)
+    {
+        if (!Require(1))
+            return false;
+        value = *m_pos++;
+        return true;
+    }
+
+    bool ReadLE16(uint16_t& value)
+    {
+        if (!Require(2))
+            return false;
+        value = LoadLE16(m_pos);
+        m_pos += 2;
+        return true;
+    }
+
+    bool ReadLE32(uint32_t& value)
+    {
+        if (!Require(4))
+            return false;
+        value = LoadLE32(m_pos);
+        m_pos += 4;
+        return true;
+    }
+
+    bool ReadLE64(uint64_t& value)
+    {
+        if (!Require(8))
+            return false;
+        value = LoadLE64(m_pos);
+        m_pos += 8;
+        return true;
+    }
+
+    bool ReadBytes(size_t size, ByteView& value)
+    {
+        if (!Require(size))
+            return false;
+        value = ByteView(m_pos, size);
+        m_pos += size;
+        return true;
+    }
+
+    // Строка, заканчивающаяся нулем. Завершающий ноль в представление не входит.
+    bool ReadCString(ByteView& value)
+    {
+        if (m_failed)
+            return false;
+        const unsigned char* zero = (const unsigned char*)memchr(m_pos, 0, m_end - m_pos);
+        if (!zero) {
+            m_failed = true;
+            return false;
+        }
+        value = ByteView(m_pos, zero - m_pos);
+        m_pos = zero + 1;
+        return true;
+    }
+private:
+    bool Require(size_t size)
+    {
+        if (m_failed || (size_t)(m_end - m_pos) < size)
+            m_failed = true;
+        return !m_failed;
+    }
+
+    const unsigned char* m_pos;
+    const unsigned char* m_end;
+    bool m_failed;
+};
+
+// Кадр сервиса (без поля размера кадра).
+struct MessageFrameView
+{
+    MessageFrameView() : hasHeader(false), decryptedSize(0) { }
+
+    bool hasHeader;          // кадр версии 2
+    ByteView header;         // поля заголовка
+    ByteView body;           // размер расшифрованных данных и данные
+    uint32_t decryptedSize;
+    ByteView payload;        // зашифрованные (или в записи - расшифрованные) данные
+};
+
+// Разбирает кадр сервиса. Возвращает false, если заголовок поврежден или кадр короче размера данных.
+inline bool ParseMessageFrame(const unsigned char* data, size_t size, MessageFrameView& view)
+{
+    FrameReader reader(data, size);
+    view.hasHeader = size >= FRAME_MARKER_SIZE && LoadLE32(data) == FRAME_HEADER_MARKER;
+    if (view.hasHeader) {
+        uint32_t marker;
+        uint16_t headerSize;
+        if (!reader.ReadLE32(marker) || !reader.ReadLE16(headerSize) || !reader.ReadBytes(headerSize, view.header))
+            return false;
+    }
+    else
+        view.header = ByteView();
+
+    view.body = ByteView(reader.Position(), reader.Remaining());
+    if (!reader.ReadLE32(view.decryptedSize))
+        return false;
+    view.payload = ByteView(reader.Position(), reader.Remaining());
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// class FrameFieldReader
+// Перебор полей заголовка кадра версии 2.
+class FrameFieldReader
+{
+public:
+    explicit FrameFieldReader(const ByteView& header) : m_reader(header.data, header.size) { }
+
+    // Возвращает false после последнего поля или если поле повреждено (тогда Failed() = true).
+    bool Next(unsigned char& type, ByteView& value)
+    {
+        if (m_reader.Remaining() == 0)
+            return false;
+        uint16_t size;
+        return m_reader.ReadU8(type) && m_reader.ReadLE16(size) && m_reader.ReadBytes(size, value);
+    }
+
+    bool Failed() const { return m_reader.Failed(); }
+
+    static bool ReadTimestamp(const ByteView& value, int64_t& timestamp)
+    {
+        if (value.size != FRAME_TIMESTAMP_SIZE)
+            return false;
+        timestamp = (int64_t)LoadLE64(value.data);
+        return true;
+    }
+private:
+    FrameReader m_reader;
+};
+
+// Кадр регистрации клиента (без поля размера кадра).
+struct RegistrationView
+{
+    RegistrationView() : hasProtocolVersion(false) { }
+
+    ByteView signature;
+    ByteView signedData;     // данные, подписанные ключом клиента
+    ByteView appId;
+    ByteView ibId;
+    ByteView userId;
+    ByteView userGroup;
+    bool hasProtocolVersion; // клиенты первой версии не передают версию протокола
+    ByteView protocolVersion;
+};
+
+inline bool ParseRegistration(const unsigned char* data, size_t size, RegistrationView& view)
+{
+    FrameReader reader(data, size);
+    uint16_t signatureSize;
+    if (!reader.ReadLE16(signatureSize) || signatureSize == 0 || !reader.ReadBytes(signatureSize, view.signature))
+        return false;
+
+    view.signedData = ByteView(reader.Position(), reader.Remaining());
+    if (!reader.ReadCString(view.appId) || !reader.ReadCString(view.ibId)
+        || !reader.ReadCString(view.userId) || !reader.ReadCString(view.userGroup))
+        return false;
+
+    view.hasProtocolVersion = reader.Remaining() > 0;
+    return !view.hasProtocolVersion || reader.ReadCString(view.protocolVersion);
+}
+
+// Кадр публикации (без поля размера кадра).
+struct PublishFrameView
+{
+    PublishFrameView() : sequence(0), decryptedSize(0) { }
+
+    uint32_t sequence;
+    uint32_t decryptedSize;
+    ByteView encrypted;
+    ByteView signedData;
+    ByteView signature;
+};
+
+inline bool ParsePublishFrame(const unsigned char* data, size_t size, PublishFrameView& view)
+{
+    if (size < PUBLISH_FRAME_HEADER_SIZE + HMAC_SHA256_SIZE || data[0] != CONTROL_FRAME_PUBLISH)
+        return false;
+
+    size_t signedSize = size - HMAC_SHA256_SIZE;
+    FrameReader reader(data + 1, signedSize - 1);
+    reader.ReadLE32(view.sequence);
+    reader.ReadLE32(view.decryptedSize);
+    reader.ReadBytes(reader.Remaining(), view.encrypted);
+    view.signedData = ByteView(data, signedSize);
+    view.signature = ByteView(data + signedSize, HMAC_SHA256_SIZE);
+    return !reader.Failed();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Запись
+
+///////////////////////////////////////////////////////////////////////////////
+// class FrameWriter
+// Запись кадра в буфер вызывающего кода. При нехватке места запись прекращается и Failed() = true,
+// поэтому размер буфера можно проверить один раз после формирования кадра.
+class FrameWriter
+{
+public:
+    FrameWriter(unsigned char* data, size_t capacity) : m_begin(data), m_pos(data), m_end(data + capacity), m_failed(false) { }
+
+    size_t Size() const { return (size_t)(m_pos - m_begin); }
+    unsigned char* Data() const { return m_begin; }
+    bool Failed() const { return m_failed; }
+
+    // Резервирует место под значение, которое будет записано позже (например, размер или подпись).
+    unsigned char* Reserve(size_t size)
+    {
+        if (m_failed || (size_t)(m_end - m_pos) < size) {
+            m_failed = true;
+            return nullptr;
+        }
+        unsigned char* reserved = m_pos;
+        m_pos += size;
+        return reserved;
+    }
+
+    void PutU8(unsigned char value)
+    {
+        unsigned char* p = Reserve(1);
+        if (p)
+            *p = value;
+    }
+
+    void PutLE16(uint16_t value)
+    {
+        unsigned char* p = Reserve(2);
+        if (p)
+            StoreLE16(p, value);
+    }
+
+    void PutLE32(uint32_t value)
+    {
+        unsigned char* p = Reserve(4);
+        if (p)
+            StoreLE32(p, value);
+    }
+
+    void PutLE64(uint64_t value)
+    {
+        unsigned char* p = Reserve(8);
+        if (p)
+            StoreLE64(p, value);
+    }
+
+    void PutBytes(const void* data, size_t size)
+    {
+        unsigned char* p = Reserve(size);
+        if (p && size > 0)
+            memcpy(p, data, size);
+    }
+
+    void PutCString(const char* value, size_t size)
+    {
+        PutBytes(value, size);
+        PutU8(0);
+    }
+
+    void PutField(unsigned char type, const void* value, size_t size)
+    {
+        PutU8(type);
+        PutLE16((uint16_t)size);
+        PutBytes(value, size);
+    }
+
+    void PutTimestampField(unsigned char type, int64_t value)
+    {
+        PutU8(type);
+        PutLE16((uint16_t)FRAME_TIMESTAMP_SIZE);
+        PutLE64((uint64_t)value);
+    }
+private:
+    unsigned char* m_begin;
+    unsigned char* m_pos;
+    unsigned char* m_end;
+    bool m_failed;
+};
+
+// Размер поля заголовка с учетом типа и длины.
+constexpr size_t FrameFieldSize(size_t valueSize)
+{
+    return FRAME_FIELD_PREFIX_SIZE + valueSize;
+}
+
+// Размер кадра сервиса версии 2 вместе с полем размера кадра.
+constexpr size_t MessageFrameV2Size(size_t headerSize, size_t payloadSize)
+{
+    return MESSAGE_FRAME_SIZE_BYTES + FRAME_MARKER_SIZE + FRAME_HEADER_SIZE_BYTES + headerSize
+        + DECRYPTED_SIZE_BYTES + payloadSize;
+}
+
+// Размер кадра сервиса версии 1 вместе с полем размера кадра.
+constexpr size_t MessageFrameV1Size(size_t payloadSize)
+{
+    return MESSAGE_FRAME_SIZE_BYTES + DECRYPTED_SIZE_BYTES + payloadSize;
+}
+
+// Записывает начало кадра сервиса до данных: размер кадра, для версии 2 - маркер и заголовок
+// размера headerSize (поля заголовка записываются следом), размер расшифрованных данных
+// записывается вызывающим кодом после заголовка.
+inline void PutMessageFramePrefix(FrameWriter& writer, bool v2, size_t headerSize, size_t payloadSize)
+{
+    size_t frameSize = v2 ? MessageFrameV2Size(headerSize, payloadSize) : MessageFrameV1Size(payloadSize);
+    writer.PutLE32((uint32_t)(frameSize - MESSAGE_FRAME_SIZE_BYTES));
+    if (v2) {
+        writer.PutLE32(FRAME_HEADER_MARKER);
+        writer.PutLE16((uint16_t)headerSize);
+    }
+}
+
+#endif //__FRAMECODEC_H__
@@ -0,0 +1,33 @@
+#include "FrameHeader.h"
+
+bool ReadFrameHeader(unsigned char** data, int* dataSize, FrameHeader& header) {
+    if (*dataSize < (int)FRAME_MARKER_SIZE || LoadLE32(*data) != FRAME_HEADER_MARKER)
+        return true;
+
+    MessageFrameView frame;
+    if (!ParseMessageFrame(*data, (size_t)*dataSize, frame))
+        return false;
+
+    FrameFieldReader fields(frame.header);
+    unsigned char fieldType;
+    ByteView value;
+    while (fields.Next(fieldType, value)) {
+        if (fieldType == FRAME_FIELD_MESSAGE_ID)
+            header.messageId.assign(value.chars(), value.size);
+        else if (fieldType == FRAME_FIELD_EXPIRES_AT)
+            FrameFieldReader::ReadTimestamp(value, header.expiresAt);
+        else if (fieldType == FRAME_FIELD_INGESTED_AT)
+            FrameFieldReader::ReadTimestamp(value, header.ingestedAt);
+        else if (fieldType == FRAME_FIELD_SENT_AT)
+            FrameFieldReader::ReadTimestamp(value, header.sentAt);
+        else if (fieldType == FRAME_FIELD_TRACE_ID)
+            header.traceId.assign(value.chars(), value.size);
+        // Неизвестные поля пропускаются для совместимости с новыми версиями сервиса.
+    }
+    if (fields.Failed())
+        return false;
+
+    *dataSize -= (int)(frame.body.data - *data);
+    *data = (unsigned char*)frame.body.data;
+    return true;
+}
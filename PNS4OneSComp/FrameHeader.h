@@ -0,0 +1,24 @@
+#ifndef __FRAMEHEADER_H__
+#define __FRAMEHEADER_H__
+
+#include <cstdint>
+#include <string>
+#include "FrameCodec.h"
+
+// Открытый заголовок кадра версии 2.
+struct FrameHeader
+{
+    FrameHeader() : expiresAt(0), ingestedAt(0), sentAt(0) { }
+
+    std::string messageId;
+    int64_t expiresAt;
+    int64_t ingestedAt;
+    int64_t sentAt;
+    std::string traceId;
+};
+
+// Читает открытый заголовок кадра версии 2 и сдвигает data на начало зашифрованной части.
+// Кадры версии 1 заголовка не содержат. Возвращает false, если заголовок поврежден.
+bool ReadFrameHeader(unsigned char** data, int* dataSize, FrameHeader& header);
+
+#endif //__FRAMEHEADER_H__
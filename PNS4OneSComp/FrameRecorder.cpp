@@ -0,0 +1,154 @@
+#include <chrono>
+#include <cstring>
+#include "FrameRecorder.h"
+#include "ConversionWchar.h"
+#include "FrameCodec.h"
+
+// Максимальный размер записи при чтении защищает от выделения памяти по поврежденному размеру.
+constexpr uint32_t FRAME_RECORD_MAX_SIZE = 256 * 1024 * 1024;
+
+static FILE* OpenRecordFile(const WCHAR_T* path, bool write)
+{
+#ifdef _WINDOWS
+    return _wfopen(path, write ? L"wb" : L"rb");
+#else
+    char* utf8Path = nullptr;
+    convFromShortWcharToUtf8(&utf8Path, path);
+    FILE* file = fopen(utf8Path, write ? "wb" : "rb");
+    delete[] utf8Path;
+    return file;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// FrameRecorder
+
+FrameRecorder::FrameRecorder() : m_file(nullptr), m_active(false), m_decrypted(false)
+{ }
+
+FrameRecorder::~FrameRecorder()
+{
+    Stop();
+}
+
+bool FrameRecorder::Start(const WCHAR_T* path, bool decrypted)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+        m_active = false;
+    }
+
+    m_file = OpenRecordFile(path, true);
+    if (!m_file)
+        return false;
+
+    if (fwrite(FRAME_RECORD_SIGNATURE, 1, sizeof(FRAME_RECORD_SIGNATURE), m_file) != sizeof(FRAME_RECORD_SIGNATURE)) {
+        fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+
+    m_decrypted = decrypted;
+    m_active = true;
+    return true;
+}
+
+void FrameRecorder::Stop()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_active = false;
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+void FrameRecorder::Write(FrameRecordType type, const unsigned char* head, size_t headSize,
+    const unsigned char* body, size_t bodySize)
+{
+    int64_t receivedAtUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    unsigned char recordHeader[1 + 8 + 4];
+    recordHeader[0] = (unsigned char)type;
+    StoreLE64(recordHeader + 1, (uint64_t)receivedAtUs);
+    StoreLE32(recordHeader + 9, (uint32_t)(headSize + bodySize));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file)
+        return;
+
+    // Файл открыт с буферизацией, поэтому запись не приводит к системному вызову на каждый кадр.
+    bool written = fwrite(recordHeader, 1, sizeof(recordHeader), m_file) == sizeof(recordHeader)
+        && (headSize == 0 || fwrite(head, 1, headSize, m_file) == headSize)
+        && (bodySize == 0 || fwrite(body, 1, bodySize, m_file) == bodySize);
+
+    // При ошибке записи (например, нет места на диске) запись прекращается, чтобы не получить поврежденный файл.
+    if (!written) {
+        fclose(m_file);
+        m_file = nullptr;
+        m_active = false;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// FrameRecordReader
+
+FrameRecordReader::FrameRecordReader() : m_file(nullptr)
+{ }
+
+FrameRecordReader::~FrameRecordReader()
+{
+    Close();
+}
+
+bool FrameRecordReader::Open(const WCHAR_T* path)
+{
+    Close();
+
+    m_file = OpenRecordFile(path, false);
+    if (!m_file)
+        return false;
+
+    char signature[sizeof(FRAME_RECORD_SIGNATURE)];
+    if (fread(signature, 1, sizeof(signature), m_file) != sizeof(signature)
+        || memcmp(signature, FRAME_RECORD_SIGNATURE, sizeof(signature)) != 0) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool FrameRecordReader::Next(FrameRecordType& type, int64_t& receivedAtUs, std::vector<unsigned char>& frame)
+{
+    if (!m_file)
+        return false;
+
+    unsigned char recordHeader[1 + 8 + 4];
+    if (fread(recordHeader, 1, sizeof(recordHeader), m_file) != sizeof(recordHeader))
+        return false;
+
+    if (recordHeader[0] != eFrameRecordEncrypted && recordHeader[0] != eFrameRecordDecrypted)
+        return false;
+
+    uint32_t size = LoadLE32(recordHeader + 9);
+    if (size > FRAME_RECORD_MAX_SIZE)
+        return false;
+
+    type = (FrameRecordType)recordHeader[0];
+    receivedAtUs = (int64_t)LoadLE64(recordHeader + 1);
+    frame.resize(size);
+    return size == 0 || fread(frame.data(), 1, size, m_file) == size;
+}
+
+void FrameRecordReader::Close()
+{
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
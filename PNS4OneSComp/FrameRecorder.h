@@ -0,0 +1,74 @@
+#ifndef __FRAMERECORDER_H__
+#define __FRAMERECORDER_H__
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+#include "include/types.h"
+
+// Файл записи: сигнатура FRAME_RECORD_SIGNATURE, затем записи подряд:
+// тип (1 байт), время получения в микросекундах с 01.01.1970 UTC (8 байт), размер (4 байта), кадр.
+// Числа записываются в порядке little-endian.
+constexpr char FRAME_RECORD_SIGNATURE[8] = { 'P', 'N', 'S', '4', 'R', 'E', 'C', 1 };
+
+enum FrameRecordType
+{
+    eFrameRecordEncrypted = 1, // Кадр в том виде, в котором получен от сервиса
+    eFrameRecordDecrypted = 2  // Кадр, в котором зашифрованные данные заменены расшифрованными
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// class FrameRecorder
+// Запись полученных кадров в файл для последующего воспроизведения. Запись выполняется
+// потоком прослушивания, начало и завершение записи - потоком 1С.
+class FrameRecorder
+{
+public:
+    FrameRecorder();
+    ~FrameRecorder();
+
+    // Создает файл записи (существующий файл перезаписывается). Если decrypted = Истина, то записываются
+    // расшифрованные сообщения, и для воспроизведения не нужен ключ клиента.
+    bool Start(const WCHAR_T* path, bool decrypted);
+    void Stop();
+
+    bool IsActive() const { return m_active; }
+    bool RecordsDecrypted() const { return m_decrypted; }
+
+    // Дописывает запись, данные которой состоят из двух частей (заголовок кадра и данные сообщения).
+    void Write(FrameRecordType type, const unsigned char* head, size_t headSize,
+        const unsigned char* body, size_t bodySize);
+private:
+    FrameRecorder(const FrameRecorder&);
+    FrameRecorder& operator = (const FrameRecorder&);
+
+    std::mutex m_mutex;
+    FILE* m_file;
+    std::atomic<bool> m_active;
+    std::atomic<bool> m_decrypted;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// class FrameRecordReader
+// Последовательное чтение файла записи.
+class FrameRecordReader
+{
+public:
+    FrameRecordReader();
+    ~FrameRecordReader();
+
+    // Возвращает false, если файл не найден или не является файлом записи.
+    bool Open(const WCHAR_T* path);
+    // Читает следующую запись. Возвращает false в конце файла или если запись повреждена.
+    bool Next(FrameRecordType& type, int64_t& receivedAtUs, std::vector<unsigned char>& frame);
+    void Close();
+private:
+    FrameRecordReader(const FrameRecordReader&);
+    FrameRecordReader& operator = (const FrameRecordReader&);
+
+    FILE* m_file;
+};
+
+#endif //__FRAMERECORDER_H__
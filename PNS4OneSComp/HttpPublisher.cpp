@@ -0,0 +1,508 @@
+#ifdef _WINDOWS
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include "HttpPublisher.h"
+#include "ConversionWchar.h"
+#include "Json.h"
+
+#ifdef _WINDOWS
+#pragma comment(lib, "Ws2_32.lib")
+#endif
+
+constexpr size_t PUBLISH_BATCH_MAX_SIZE = 64;
+constexpr size_t PUBLISH_ERRORS_MAX_SIZE = 1000;
+constexpr size_t RESPONSE_HEADERS_MAX_SIZE = 64 * 1024;
+constexpr long RESPONSE_TIMEOUT_MS = 30000;
+
+// Не удалось установить соединение с сервером отправления уведомлений
+static wchar_t g_ErrorConnect[] = L"\x041D\x0435\x0020\x0443\x0434\x0430\x043B\x043E\x0441\x044C\x0020\x0443\x0441\x0442\x0430\x043D\x043E\x0432\x0438\x0442\x044C\x0020\x0441\x043E\x0435\x0434\x0438\x043D\x0435\x043D\x0438\x0435\x0020\x0441\x0020\x0441\x0435\x0440\x0432\x0435\x0440\x043E\x043C\x0020\x043E\x0442\x043F\x0440\x0430\x0432\x043B\x0435\x043D\x0438\x044F\x0020\x0443\x0432\x0435\x0434\x043E\x043C\x043B\x0435\x043D\x0438\x0439";
+// Соединение с сервером отправления уведомлений разорвано
+static wchar_t g_ErrorConnectionLost[] = L"\x0421\x043E\x0435\x0434\x0438\x043D\x0435\x043D\x0438\x0435\x0020\x0441\x0020\x0441\x0435\x0440\x0432\x0435\x0440\x043E\x043C\x0020\x043E\x0442\x043F\x0440\x0430\x0432\x043B\x0435\x043D\x0438\x044F\x0020\x0443\x0432\x0435\x0434\x043E\x043C\x043B\x0435\x043D\x0438\x0439\x0020\x0440\x0430\x0437\x043E\x0440\x0432\x0430\x043D\x043E";
+
+static std::string ErrorText(const wchar_t* text) {
+    WcharWrapper wrapper(text);
+    char* utf8 = nullptr;
+    convFromShortWcharToUtf8(&utf8, wrapper);
+    std::string result(utf8);
+    delete[] utf8;
+    return result;
+}
+
+#ifdef _WINDOWS
+constexpr SOCKET INVALID_PUBLISHER_SOCKET = INVALID_SOCKET;
+constexpr int PUBLISHER_SEND_FLAGS = 0;
+#else
+constexpr int INVALID_PUBLISHER_SOCKET = -1;
+// Запись в соединение, закрытое сервером, не должна завершать процесс сигналом SIGPIPE.
+constexpr int PUBLISHER_SEND_FLAGS = MSG_NOSIGNAL;
+#endif
+
+HttpPublisher::HttpPublisher(size_t maxQueueSize) :
+    m_maxQueueSize(maxQueueSize),
+    m_inFlight(0),
+    m_configured(false),
+    m_stopping(false),
+    m_endpointVersion(0),
+    m_socket(INVALID_PUBLISHER_SOCKET),
+    m_connectedEndpointVersion(0)
+{ }
+
+HttpPublisher::~HttpPublisher()
+{
+    Stop();
+}
+
+bool HttpPublisher::Configure(const std::string& host, const std::string& port, const std::string& accessToken)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_configured) {
+#ifdef _WINDOWS
+        WSADATA wsaData;
+        if (WSAStartup(MAKEWORD(2, 2), &wsaData) != NO_ERROR)
+            return false;
+#endif
+        m_configured = true;
+    }
+
+    if (host != m_host || port != m_port) {
+        m_host = host;
+        m_port = port;
+        m_endpointVersion++;
+    }
+    m_accessToken = accessToken;
+
+    if (!m_thread.joinable()) {
+        m_stopping = false;
+        m_thread = std::thread(&HttpPublisher::Worker, this);
+    }
+
+    m_queueCond.notify_one();
+    return true;
+}
+
+bool HttpPublisher::Enqueue(const std::string& body)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (!m_configured || m_stopping || m_queue.size() >= m_maxQueueSize)
+            return false;
+
+        m_queue.push_back(body);
+    }
+
+    m_queueCond.notify_one();
+    return true;
+}
+
+bool HttpPublisher::Flush(long timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    return m_idleCond.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+        [this] { return (m_queue.empty() && m_inFlight == 0) || !m_configured; })
+        && m_queue.empty() && m_inFlight == 0;
+}
+
+size_t HttpPublisher::PendingCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queue.size() + m_inFlight;
+}
+
+void HttpPublisher::TakeErrors(std::string& errors)
+{
+    std::vector<Error> taken;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        taken.swap(m_errors);
+    }
+
+    errors.assign("[");
+    for (size_t i = 0; i < taken.size(); i++) {
+        if (i > 0)
+            errors.push_back(',');
+
+        errors.append("{\"status\":");
+        errors.append(std::to_string(taken[i].status));
+        errors.append(",\"error\":");
+        JsonWriteString(errors, taken[i].text);
+        errors.append(",\"message\":");
+        // Тело запроса уже является JSON и передается без изменений.
+        errors.append(taken[i].message.empty() ? "null" : taken[i].message);
+        errors.push_back('}');
+    }
+    errors.push_back(']');
+}
+
+void HttpPublisher::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_queueCond.notify_one();
+
+    if (m_thread.joinable())
+        m_thread.join();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.clear();
+    if (m_configured) {
+#ifdef _WINDOWS
+        WSACleanup();
+#endif
+        m_configured = false;
+        m_host.clear();
+        m_port.clear();
+    }
+    m_idleCond.notify_all();
+}
+
+void HttpPublisher::Worker()
+{
+    std::vector<std::string> batch;
+
+    while (true) {
+        std::string host, port, accessToken;
+        unsigned int endpointVersion;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_queueCond.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_stopping)
+                break;
+
+            size_t count = std::min(m_queue.size(), PUBLISH_BATCH_MAX_SIZE);
+            batch.clear();
+            for (size_t i = 0; i < count; i++) {
+                batch.push_back(std::move(m_queue.front()));
+                m_queue.pop_front();
+            }
+            m_inFlight = count;
+
+            host = m_host;
+            port = m_port;
+            accessToken = m_accessToken;
+            endpointVersion = m_endpointVersion;
+        }
+
+        SendBatch(batch, host, port, accessToken, endpointVersion);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_inFlight = 0;
+        }
+        m_idleCond.notify_all();
+    }
+
+    Disconnect();
+}
+
+void HttpPublisher::SendBatch(const std::vector<std::string>& batch, const std::string& host,
+    const std::string& port, const std::string& accessToken, unsigned int endpointVersion)
+{
+    if (IsConnected() && (m_connectedEndpointVersion != endpointVersion || IdleConnectionClosed()))
+        Disconnect();
+
+    // Метод sendmessage не идемпотентен: переданный запрос мог быть обработан сервером, даже если ответ
+    // не получен, поэтому повторяются только запросы, не переданные ни одним байтом. Так бывает, если
+    // сервер закрыл простаивающее соединение, оставшееся от предыдущего пакета.
+    size_t completed = 0;
+    bool retried = false;
+
+    while (completed < batch.size()) {
+        bool reused = IsConnected();
+        if (!reused) {
+            if (!Connect(host, port)) {
+                for (size_t i = completed; i < batch.size(); i++)
+                    AddError(0, ErrorText(g_ErrorConnect), batch[i]);
+                return;
+            }
+            m_connectedEndpointVersion = endpointVersion;
+        }
+
+        std::string requests;
+        for (size_t i = completed; i < batch.size(); i++) {
+            requests.append("POST /sendmessage HTTP/1.1\r\nHost: ");
+            requests.append(host);
+            requests.append(":");
+            requests.append(port);
+            requests.append("\r\nAuthorization: Bearer ");
+            requests.append(accessToken);
+            requests.append("\r\nContent-Type: application/json; charset=utf-8\r\nContent-Length: ");
+            requests.append(std::to_string(batch[i].size()));
+            requests.append("\r\n\r\n");
+            requests.append(batch[i]);
+        }
+
+        size_t sent = 0;
+        bool ioError = !SendAll(requests, sent);
+        if (ioError && reused && sent == 0 && !retried) {
+            Disconnect();
+            retried = true;
+            continue;
+        }
+
+        bool keepAlive = true;
+        while (!ioError && keepAlive && completed < batch.size()) {
+            int status;
+            std::string body;
+            if (!ReadResponse(status, body, keepAlive)) {
+                ioError = true;
+                break;
+            }
+
+            if (status < 200 || status >= 400)
+                AddError(status, body, batch[completed]);
+            completed++;
+        }
+
+        if (!ioError && keepAlive)
+            continue;
+
+        Disconnect();
+
+        // Сервер закрыл соединение после ответа (Connection: close) и не обрабатывал следующие запросы
+        // пакета: они передаются по новому соединению.
+        if (!ioError)
+            continue;
+
+        for (size_t i = completed; i < batch.size(); i++)
+            AddError(0, ErrorText(g_ErrorConnectionLost), batch[i]);
+        return;
+    }
+}
+
+bool HttpPublisher::Connect(const std::string& host, const std::string& port)
+{
+    struct addrinfo hints{};
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    struct addrinfo* addrInfo = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addrInfo) != 0)
+        return false;
+
+    m_socket = socket(addrInfo->ai_family, addrInfo->ai_socktype, addrInfo->ai_protocol);
+    if (m_socket == INVALID_PUBLISHER_SOCKET) {
+        freeaddrinfo(addrInfo);
+        return false;
+    }
+
+    bool connected = connect(m_socket, addrInfo->ai_addr, (int)addrInfo->ai_addrlen) == 0;
+    freeaddrinfo(addrInfo);
+
+    if (!connected) {
+        Disconnect();
+        return false;
+    }
+
+    // Ответ сервера ожидается ограниченное время, чтобы зависшее соединение не блокировало очередь.
+#ifdef _WINDOWS
+    DWORD timeout = RESPONSE_TIMEOUT_MS;
+#else
+    struct timeval timeout;
+    timeout.tv_sec = RESPONSE_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (RESPONSE_TIMEOUT_MS % 1000) * 1000;
+#endif
+    setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+    setsockopt(m_socket, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+
+    m_recvBuf.clear();
+    return true;
+}
+
+void HttpPublisher::Disconnect()
+{
+    if (!IsConnected())
+        return;
+
+#ifdef _WINDOWS
+    shutdown(m_socket, SD_BOTH);
+    closesocket(m_socket);
+#else
+    shutdown(m_socket, SHUT_RDWR);
+    close(m_socket);
+#endif
+    m_socket = INVALID_PUBLISHER_SOCKET;
+    m_recvBuf.clear();
+}
+
+bool HttpPublisher::IsConnected() const
+{
+    return m_socket != INVALID_PUBLISHER_SOCKET;
+}
+
+bool HttpPublisher::IdleConnectionClosed()
+{
+    // Между пакетами сервер ничего не передает: доступность чтения означает закрытие соединения
+    // или ошибку, и соединение не используется для следующего пакета.
+#ifdef _WINDOWS
+    WSAPOLLFD pfd = { m_socket, POLLRDNORM, 0 };
+    return WSAPoll(&pfd, 1, 0) != 0;
+#else
+    struct pollfd pfd = { m_socket, POLLIN, 0 };
+    return poll(&pfd, 1, 0) != 0;
+#endif
+}
+
+bool HttpPublisher::SendAll(const std::string& data, size_t& sent)
+{
+    const char* buf = data.data();
+    size_t size = data.size();
+    sent = 0;
+
+    while (size > 0) {
+        long count = send(m_socket, buf, (int)size, PUBLISHER_SEND_FLAGS);
+        if (count <= 0)
+            return false;
+
+        buf += count;
+        size -= count;
+        sent += count;
+    }
+    return true;
+}
+
+bool HttpPublisher::ReceiveMore()
+{
+    char buf[4096];
+    long count = recv(m_socket, buf, sizeof(buf), 0);
+    if (count <= 0)
+        return false;
+
+    m_recvBuf.append(buf, count);
+    return true;
+}
+
+bool HttpPublisher::ReadLine(std::string& line)
+{
+    size_t end;
+    while ((end = m_recvBuf.find("\r\n")) == std::string::npos) {
+        if (m_recvBuf.size() > RESPONSE_HEADERS_MAX_SIZE || !ReceiveMore())
+            return false;
+    }
+
+    line.assign(m_recvBuf, 0, end);
+    m_recvBuf.erase(0, end + 2);
+    return true;
+}
+
+bool HttpPublisher::ReadBytes(size_t count, std::string& data)
+{
+    while (m_recvBuf.size() < count) {
+        if (!ReceiveMore())
+            return false;
+    }
+
+    data.append(m_recvBuf, 0, count);
+    m_recvBuf.erase(0, count);
+    return true;
+}
+
+bool HttpPublisher::ReadResponse(int& status, std::string& body, bool& keepAlive)
+{
+    std::string line;
+    if (!ReadLine(line))
+        return false;
+
+    // Строка состояния: HTTP/1.1 200 OK
+    size_t space = line.find(' ');
+    if (line.compare(0, 5, "HTTP/") != 0 || space == std::string::npos)
+        return false;
+
+    status = atoi(line.c_str() + space + 1);
+    keepAlive = line.compare(0, 8, "HTTP/1.0") != 0;
+
+    size_t contentLength = 0;
+    bool chunked = false;
+    size_t headersSize = 0;
+
+    while (true) {
+        if (!ReadLine(line))
+            return false;
+        if (line.empty())
+            break;
+
+        headersSize += line.size();
+        if (headersSize > RESPONSE_HEADERS_MAX_SIZE)
+            return false;
+
+        size_t colon = line.find(':');
+        if (colon == std::string::npos)
+            continue;
+
+        std::string name = line.substr(0, colon);
+        std::string value = line.substr(colon + 1);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+
+        if (name == "content-length")
+            contentLength = (size_t)strtoul(value.c_str(), nullptr, 10);
+        else if (name == "transfer-encoding")
+            chunked = value.find("chunked") != std::string::npos;
+        else if (name == "connection") {
+            if (value.find("close") != std::string::npos)
+                keepAlive = false;
+            else if (value.find("keep-alive") != std::string::npos)
+                keepAlive = true;
+        }
+    }
+
+    // Промежуточные ответы (1xx) не содержат тела, за ними следует окончательный ответ.
+    if (status >= 100 && status < 200)
+        return ReadResponse(status, body, keepAlive);
+
+    if (!chunked)
+        return ReadBytes(contentLength, body);
+
+    while (true) {
+        if (!ReadLine(line))
+            return false;
+
+        size_t chunkSize = (size_t)strtoul(line.c_str(), nullptr, 16);
+        if (chunkSize == 0)
+            break;
+
+        if (!ReadBytes(chunkSize, body) || !ReadLine(line))
+            return false;
+    }
+
+    // Завершающие заголовки после последнего блока.
+    do {
+        if (!ReadLine(line))
+            return false;
+    } while (!line.empty());
+
+    return true;
+}
+
+void HttpPublisher::AddError(int status, const std::string& text, const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // При переполнении новые ошибки не сохраняются, чтобы не расходовать память, если ошибки не забираются.
+    if (m_errors.size() >= PUBLISH_ERRORS_MAX_SIZE)
+        return;
+
+    Error error;
+    error.status = status;
+    error.text = text;
+    error.message = message;
+    m_errors.push_back(error);
+}
@@ -0,0 +1,102 @@
+#ifndef __HTTPPUBLISHER_H__
+#define __HTTPPUBLISHER_H__
+
+#if defined(_WINDOWS)
+#include <WinSock2.h>
+#endif
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// class HttpPublisher
+// Асинхронная отправка уведомлений серверу отправления (метод sendmessage).
+// Сообщения помещаются в очередь без ожидания, а отдельный поток отправляет их
+// пакетами по одному постоянному соединению HTTP/1.1: запросы пакета передаются
+// подряд без ожидания ответов (конвейерная обработка), после чего читаются ответы.
+// Ошибки отправки накапливаются и забираются вызывающим кодом отдельно.
+// Поддерживается только незащищенное соединение (HTTP).
+class HttpPublisher
+{
+public:
+    explicit HttpPublisher(size_t maxQueueSize);
+    ~HttpPublisher();
+
+    // Задает адрес сервера и ключ доступа. Может вызываться повторно, например, для
+    // замены ключа доступа с истекшим сроком действия; очередь при этом сохраняется.
+    bool Configure(const std::string& host, const std::string& port, const std::string& accessToken);
+    // Помещает тело запроса (JSON в кодировке UTF-8) в очередь. Возвращает false, если
+    // отправка не настроена или очередь заполнена.
+    bool Enqueue(const std::string& body);
+    // Ожидает отправки всех сообщений очереди не дольше timeoutMs миллисекунд.
+    // Возвращает true, если очередь отправлена полностью.
+    bool Flush(long timeoutMs);
+    size_t PendingCount();
+    // Забирает накопленные ошибки в виде JSON-массива объектов
+    // {"status": код состояния HTTP или 0, "error": текст, "message": тело запроса}.
+    void TakeErrors(std::string& errors);
+    // Останавливает поток отправки. Неотправленные сообщения отбрасываются.
+    void Stop();
+private:
+    HttpPublisher(const HttpPublisher&);
+    HttpPublisher& operator = (const HttpPublisher&);
+
+#ifdef _WINDOWS
+    typedef SOCKET Socket;
+#else
+    typedef int Socket;
+#endif
+
+    struct Error
+    {
+        int status;
+        std::string text;
+        std::string message;
+    };
+
+    void Worker();
+    void SendBatch(const std::vector<std::string>& batch, const std::string& host,
+        const std::string& port, const std::string& accessToken, unsigned int endpointVersion);
+
+    bool Connect(const std::string& host, const std::string& port);
+    void Disconnect();
+    bool IsConnected() const;
+    // Проверяет, не закрыто ли сервером соединение, оставшееся от предыдущего пакета.
+    bool IdleConnectionClosed();
+    // Передает данные; в sent возвращается количество переданных байт, в том числе при ошибке.
+    bool SendAll(const std::string& data, size_t& sent);
+    bool ReceiveMore();
+    bool ReadLine(std::string& line);
+    bool ReadBytes(size_t count, std::string& data);
+    bool ReadResponse(int& status, std::string& body, bool& keepAlive);
+
+    void AddError(int status, const std::string& text, const std::string& message);
+
+    size_t m_maxQueueSize;
+
+    // Очередь, настройки и ошибки защищены m_mutex. Соединение используется только потоком отправки.
+    std::mutex m_mutex;
+    std::condition_variable m_queueCond;
+    std::condition_variable m_idleCond;
+    std::deque<std::string> m_queue;
+    size_t m_inFlight;
+    bool m_configured;
+    bool m_stopping;
+    std::string m_host;
+    std::string m_port;
+    std::string m_accessToken;
+    // Увеличивается при изменении адреса сервера, чтобы поток отправки переподключился.
+    unsigned int m_endpointVersion;
+    std::vector<Error> m_errors;
+    std::thread m_thread;
+
+    Socket m_socket;
+    unsigned int m_connectedEndpointVersion;
+    std::string m_recvBuf;
+};
+
+#endif //__HTTPPUBLISHER_H__
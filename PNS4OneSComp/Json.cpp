@@ -0,0 +1,513 @@
+#include <cstring>
+#include "Json.h"
+
+constexpr int JSON_MAX_DEPTH = 128;
+
+///////////////////////////////////////////////////////////////////////////////
+// class JsonParser
+// Рекурсивный разбор JSON. Если вместо значения передан nullptr, то значение
+// только проверяется и пропускается без выделения памяти.
+class JsonParser
+{
+public:
+    JsonParser(const char* text, size_t len) : m_pos(text), m_end(text + len), m_depth(0) { }
+
+    bool ParseDocument(JsonValue* value)
+    {
+        if (!ParseValue(value))
+            return false;
+        SkipSpaces();
+        return m_pos == m_end;
+    }
+
+    bool FindTopLevelString(const char* key, std::string& value)
+    {
+        SkipSpaces();
+        if (m_pos == m_end || *m_pos != '{')
+            return false;
+        m_pos++;
+
+        SkipSpaces();
+        if (m_pos < m_end && *m_pos == '}')
+            return false;
+
+        std::string name;
+        while (true) {
+            SkipSpaces();
+            name.clear();
+            if (!ParseString(&name))
+                return false;
+
+            SkipSpaces();
+            if (m_pos == m_end || *m_pos != ':')
+                return false;
+            m_pos++;
+            SkipSpaces();
+
+            if (name == key)
+                return m_pos < m_end && *m_pos == '"' && ParseString(&value);
+
+            if (!ParseValue(nullptr))
+                return false;
+
+            SkipSpaces();
+            if (m_pos == m_end || *m_pos != ',')
+                return false;
+            m_pos++;
+        }
+    }
+private:
+    const char* m_pos;
+    const char* m_end;
+    int m_depth;
+
+    void SkipSpaces()
+    {
+        while (m_pos < m_end && (*m_pos == ' ' || *m_pos == '\t' || *m_pos == '\r' || *m_pos == '\n'))
+            m_pos++;
+    }
+
+    bool Literal(const char* literal)
+    {
+        size_t len = strlen(literal);
+        if ((size_t)(m_end - m_pos) < len || memcmp(m_pos, literal, len) != 0)
+            return false;
+        m_pos += len;
+        return true;
+    }
+
+    bool ParseValue(JsonValue* value)
+    {
+        SkipSpaces();
+        if (m_pos == m_end)
+            return false;
+
+        switch (*m_pos) {
+        case '{':
+            return ParseObject(value);
+        case '[':
+            return ParseArray(value);
+        case '"':
+            if (value)
+                value->m_type = JsonValue::eString;
+            return ParseString(value ? &value->m_string : nullptr);
+        case 't':
+            if (value) {
+                value->m_type = JsonValue::eBool;
+                value->m_bool = true;
+            }
+            return Literal("true");
+        case 'f':
+            if (value) {
+                value->m_type = JsonValue::eBool;
+                value->m_bool = false;
+            }
+            return Literal("false");
+        case 'n':
+            if (value)
+                value->m_type = JsonValue::eNull;
+            return Literal("null");
+        default:
+            return ParseNumber(value);
+        }
+    }
+
+    bool ParseObject(JsonValue* value)
+    {
+        if (++m_depth > JSON_MAX_DEPTH)
+            return false;
+
+        m_pos++; // {
+        if (value)
+            value->m_type = JsonValue::eObject;
+
+        SkipSpaces();
+        if (m_pos < m_end && *m_pos == '}') {
+            m_pos++;
+            m_depth--;
+            return true;
+        }
+
+        while (true) {
+            SkipSpaces();
+            if (m_pos == m_end || *m_pos != '"')
+                return false;
+
+            JsonValue* memberValue = nullptr;
+            if (value) {
+                value->m_members.push_back(JsonValue::Member());
+                if (!ParseString(&value->m_members.back().first))
+                    return false;
+                memberValue = &value->m_members.back().second;
+            }
+            else if (!ParseString(nullptr))
+                return false;
+
+            SkipSpaces();
+            if (m_pos == m_end || *m_pos != ':')
+                return false;
+            m_pos++;
+
+            if (!ParseValue(memberValue))
+                return false;
+
+            SkipSpaces();
+            if (m_pos == m_end)
+                return false;
+            if (*m_pos == '}') {
+                m_pos++;
+                break;
+            }
+            if (*m_pos != ',')
+                return false;
+            m_pos++;
+        }
+
+        m_depth--;
+        return true;
+    }
+
+    bool ParseArray(JsonValue* value)
+    {
+        if (++m_depth > JSON_MAX_DEPTH)
+            return false;
+
+        m_pos++; // [
+        if (value)
+            value->m_type = JsonValue::eArray;
+
+        SkipSpaces();
+        if (m_pos < m_end && *m_pos == ']') {
+            m_pos++;
+            m_depth--;
+            return true;
+        }
+
+        while (true) {
+            JsonValue* itemValue = nullptr;
+            if (value) {
+                value->m_array.push_back(JsonValue());
+                itemValue = &value->m_array.back();
+            }
+
+            if (!ParseValue(itemValue))
+                return false;
+
+            SkipSpaces();
+            if (m_pos == m_end)
+                return false;
+            if (*m_pos == ']') {
+                m_pos++;
+                break;
+            }
+            if (*m_pos != ',')
+                return false;
+            m_pos++;
+        }
+
+        m_depth--;
+        return true;
+    }
+
+    bool ParseNumber(JsonValue* value)
+    {
+        const char* start = m_pos;
+
+        if (m_pos < m_end && *m_pos == '-')
+            m_pos++;
+        if (m_pos == m_end || *m_pos < '0' || *m_pos > '9')
+            return false;
+        while (m_pos < m_end && ((*m_pos >= '0' && *m_pos <= '9')
+            || *m_pos == '.' || *m_pos == 'e' || *m_pos == 'E' || *m_pos == '+' || *m_pos == '-'))
+            m_pos++;
+
+        if (value) {
+            value->m_type = JsonValue::eNumber;
+            value->m_string.assign(start, m_pos - start);
+        }
+        return true;
+    }
+
+    static int HexDigit(char c)
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+
+    bool ParseHex4(unsigned int& code)
+    {
+        if (m_end - m_pos < 4)
+            return false;
+
+        code = 0;
+        for (int i = 0; i < 4; i++) {
+            int digit = HexDigit(*m_pos++);
+            if (digit < 0)
+                return false;
+            code = code * 16 + digit;
+        }
+        return true;
+    }
+
+    static void AppendUtf8(std::string& out, unsigned int code)
+    {
+        if (code < 0x80) {
+            out.push_back((char)code);
+        }
+        else if (code < 0x800) {
+            out.push_back((char)(0xC0 | (code >> 6)));
+            out.push_back((char)(0x80 | (code & 0x3F)));
+        }
+        else if (code < 0x10000) {
+            out.push_back((char)(0xE0 | (code >> 12)));
+            out.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+            out.push_back((char)(0x80 | (code & 0x3F)));
+        }
+        else {
+            out.push_back((char)(0xF0 | (code >> 18)));
+            out.push_back((char)(0x80 | ((code >> 12) & 0x3F)));
+            out.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+            out.push_back((char)(0x80 | (code & 0x3F)));
+        }
+    }
+
+    bool ParseString(std::string* out)
+    {
+        if (m_pos == m_end || *m_pos != '"')
+            return false;
+        m_pos++;
+
+        while (m_pos < m_end) {
+            // Участки без экранирования копируются целиком.
+            const char* start = m_pos;
+            while (m_pos < m_end && *m_pos != '"' && *m_pos != '\\')
+                m_pos++;
+            if (out)
+                out->append(start, m_pos - start);
+
+            if (m_pos == m_end)
+                return false;
+
+            if (*m_pos == '"') {
+                m_pos++;
+                return true;
+            }
+
+            m_pos++; // '\\'
+            if (m_pos == m_end)
+                return false;
+
+            char escaped = *m_pos++;
+            char unescaped;
+            switch (escaped) {
+            case '"': unescaped = '"'; break;
+            case '\\': unescaped = '\\'; break;
+            case '/': unescaped = '/'; break;
+            case 'b': unescaped = '\b'; break;
+            case 'f': unescaped = '\f'; break;
+            case 'n': unescaped = '\n'; break;
+            case 'r': unescaped = '\r'; break;
+            case 't': unescaped = '\t'; break;
+            case 'u': {
+                unsigned int code;
+                if (!ParseHex4(code))
+                    return false;
+
+                if (code >= 0xD800 && code <= 0xDBFF && m_end - m_pos >= 6 && m_pos[0] == '\\' && m_pos[1] == 'u') {
+                    m_pos += 2;
+                    unsigned int low;
+                    if (!ParseHex4(low))
+                        return false;
+                    if (low >= 0xDC00 && low <= 0xDFFF) {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    else {
+                        if (out)
+                            AppendUtf8(*out, 0xFFFD);
+                        code = low;
+                    }
+                }
+
+                // Непарные суррогаты заменяются символом U+FFFD.
+                if (code >= 0xD800 && code <= 0xDFFF)
+                    code = 0xFFFD;
+
+                if (out)
+                    AppendUtf8(*out, code);
+                continue;
+            }
+            default:
+                return false;
+            }
+
+            if (out)
+                out->push_back(unescaped);
+        }
+
+        return false;
+    }
+};
+
+JsonValue JsonValue::String(const std::string& value)
+{
+    JsonValue result(eString);
+    result.m_string = value;
+    return result;
+}
+
+JsonValue JsonValue::Number(int64_t value)
+{
+    JsonValue result(eNumber);
+    result.m_string = std::to_string(value);
+    return result;
+}
+
+const JsonValue* JsonValue::Find(const std::string& key) const
+{
+    for (const auto& member : m_members) {
+        if (member.first == key)
+            return &member.second;
+    }
+    return nullptr;
+}
+
+JsonValue* JsonValue::Find(const std::string& key)
+{
+    for (auto& member : m_members) {
+        if (member.first == key)
+            return &member.second;
+    }
+    return nullptr;
+}
+
+JsonValue& JsonValue::Set(const std::string& key, const JsonValue& value)
+{
+    m_type = eObject;
+
+    JsonValue* existing = Find(key);
+    if (existing) {
+        *existing = value;
+        return *existing;
+    }
+
+    m_members.push_back(Member(key, value));
+    return m_members.back().second;
+}
+
+bool JsonValue::Remove(const std::string& key)
+{
+    for (auto it = m_members.begin(); it != m_members.end(); ++it) {
+        if (it->first == key) {
+            m_members.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+void JsonValue::ApplyMergePatch(const JsonValue& patch)
+{
+    if (!patch.IsObject()) {
+        *this = patch;
+        return;
+    }
+
+    if (!IsObject())
+        *this = JsonValue(eObject);
+
+    for (const auto& member : patch.m_members) {
+        if (member.second.IsNull()) {
+            Remove(member.first);
+            continue;
+        }
+
+        JsonValue* existing = Find(member.first);
+        if (existing)
+            existing->ApplyMergePatch(member.second);
+        else
+            Set(member.first, JsonValue()).ApplyMergePatch(member.second);
+    }
+}
+
+bool JsonValue::Parse(const char* text, size_t len, JsonValue& result)
+{
+    result = JsonValue();
+    JsonParser parser(text, len);
+    return parser.ParseDocument(&result);
+}
+
+void JsonWriteString(std::string& out, const std::string& value)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    out.push_back('"');
+    for (char c : value) {
+        switch (c) {
+        case '"': out.append("\\\""); break;
+        case '\\': out.append("\\\\"); break;
+        case '\b': out.append("\\b"); break;
+        case '\f': out.append("\\f"); break;
+        case '\n': out.append("\\n"); break;
+        case '\r': out.append("\\r"); break;
+        case '\t': out.append("\\t"); break;
+        default:
+            if ((unsigned char)c < 0x20) {
+                out.append("\\u00");
+                out.push_back(hex[(c >> 4) & 0x0F]);
+                out.push_back(hex[c & 0x0F]);
+            }
+            else
+                out.push_back(c);
+        }
+    }
+    out.push_back('"');
+}
+
+void JsonValue::Serialize(std::string& out) const
+{
+    switch (m_type) {
+    case eNull:
+        out.append("null");
+        break;
+    case eBool:
+        out.append(m_bool ? "true" : "false");
+        break;
+    case eNumber:
+        out.append(m_string);
+        break;
+    case eString:
+        JsonWriteString(out, m_string);
+        break;
+    case eArray:
+        out.push_back('[');
+        for (size_t i = 0; i < m_array.size(); i++) {
+            if (i > 0)
+                out.push_back(',');
+            m_array[i].Serialize(out);
+        }
+        out.push_back(']');
+        break;
+    case eObject:
+        out.push_back('{');
+        for (size_t i = 0; i < m_members.size(); i++) {
+            if (i > 0)
+                out.push_back(',');
+            JsonWriteString(out, m_members[i].first);
+            out.push_back(':');
+            m_members[i].second.Serialize(out);
+        }
+        out.push_back('}');
+        break;
+    }
+}
+
+bool JsonFindTopLevelString(const char* text, size_t len, const char* key, std::string& value)
+{
+    JsonParser parser(text, len);
+    return parser.FindTopLevelString(key, value);
+}
@@ -0,0 +1,78 @@
+#ifndef __JSON_H__
+#define __JSON_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// class JsonValue
+// Минимальная реализация JSON для разбора сообщений сервиса внутри компоненты.
+// Строки хранятся в UTF-8, числа - в исходном текстовом виде, чтобы при повторной
+// сериализации значение не искажалось. Порядок свойств объекта сохраняется.
+class JsonValue
+{
+public:
+    enum Type
+    {
+        eNull,
+        eBool,
+        eNumber,
+        eString,
+        eArray,
+        eObject
+    };
+
+    typedef std::pair<std::string, JsonValue> Member;
+
+    JsonValue() : m_type(eNull), m_bool(false) { }
+    explicit JsonValue(Type type) : m_type(type), m_bool(false) { }
+
+    static JsonValue String(const std::string& value);
+    static JsonValue Number(int64_t value);
+
+    Type GetType() const { return m_type; }
+    bool IsNull() const { return m_type == eNull; }
+    bool IsObject() const { return m_type == eObject; }
+    bool IsString() const { return m_type == eString; }
+
+    bool GetBool() const { return m_bool; }
+    // Строковое значение или текстовое представление числа.
+    const std::string& GetString() const { return m_string; }
+    const std::vector<JsonValue>& GetArray() const { return m_array; }
+    std::vector<JsonValue>& GetArray() { return m_array; }
+    const std::vector<Member>& GetMembers() const { return m_members; }
+
+    // Поиск и изменение свойств объекта.
+    const JsonValue* Find(const std::string& key) const;
+    JsonValue* Find(const std::string& key);
+    JsonValue& Set(const std::string& key, const JsonValue& value);
+    bool Remove(const std::string& key);
+
+    // Применяет изменения в формате JSON Merge Patch (RFC 7386).
+    void ApplyMergePatch(const JsonValue& patch);
+
+    // Разбирает текст JSON в кодировке UTF-8. Возвращает false, если текст некорректен.
+    static bool Parse(const char* text, size_t len, JsonValue& result);
+    // Дописывает значение в виде текста JSON в кодировке UTF-8.
+    void Serialize(std::string& out) const;
+private:
+    friend class JsonParser;
+
+    Type m_type;
+    bool m_bool;
+    std::string m_string;
+    std::vector<JsonValue> m_array;
+    std::vector<Member> m_members;
+};
+
+// Быстро находит строковое свойство верхнего уровня объекта без построения дерева значений.
+// Используется на горячем пути, когда из сообщения нужна только тема.
+bool JsonFindTopLevelString(const char* text, size_t len, const char* key, std::string& value);
+
+// Дописывает строку в виде строкового литерала JSON (с кавычками и экранированием).
+void JsonWriteString(std::string& out, const std::string& value);
+
+#endif //__JSON_H__
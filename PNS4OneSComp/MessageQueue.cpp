@@ -0,0 +1,77 @@
+#include <chrono>
+#include "MessageQueue.h"
+#include "ConversionWchar.h"
+
+MessageQueue::MessageQueue(size_t maxSize) : m_maxSize(maxSize), m_dropped(0)
+{ }
+
+void MessageQueue::Push(const WCHAR_T* message)
+{
+    size_t len = getLenShortWcharStr(message);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_messages.size() >= m_maxSize) {
+            m_messages.pop_front();
+            m_dropped++;
+        }
+        m_messages.push_back(std::vector<WCHAR_T>(message, message + len));
+    }
+
+    m_cond.notify_one();
+}
+
+size_t MessageQueue::WaitBatch(long timeoutMs, size_t maxCount, std::vector<WCHAR_T>& batch)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (m_messages.empty() && timeoutMs > 0) {
+        m_cond.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+            [this] { return !m_messages.empty(); });
+    }
+
+    size_t count = m_messages.size();
+    if (maxCount > 0 && count > maxCount)
+        count = maxCount;
+
+    size_t batchLen = 2 + 1; // [ ] и завершающий ноль
+    for (size_t i = 0; i < count; i++)
+        batchLen += m_messages[i].size() + 1;
+
+    batch.clear();
+    batch.reserve(batchLen);
+    batch.push_back((WCHAR_T)'[');
+
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0)
+            batch.push_back((WCHAR_T)',');
+
+        const std::vector<WCHAR_T>& message = m_messages.front();
+        batch.insert(batch.end(), message.begin(), message.end());
+        m_messages.pop_front();
+    }
+
+    batch.push_back((WCHAR_T)']');
+    batch.push_back(0);
+
+    return count;
+}
+
+size_t MessageQueue::Size()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_messages.size();
+}
+
+size_t MessageQueue::DroppedCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+
+void MessageQueue::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_messages.clear();
+}
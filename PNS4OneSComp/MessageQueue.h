@@ -0,0 +1,41 @@
+#ifndef __MESSAGEQUEUE_H__
+#define __MESSAGEQUEUE_H__
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "include/types.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// class MessageQueue
+// Очередь полученных сообщений для режима опроса (сеансы без внешних событий:
+// сервер, внешнее соединение, фоновые задания). Поток прослушивания помещает
+// сообщения в очередь, а поток 1С забирает их пакетами.
+class MessageQueue
+{
+public:
+    explicit MessageQueue(size_t maxSize);
+
+    // Помещает сообщение в очередь. При переполнении удаляется самое старое сообщение.
+    void Push(const WCHAR_T* message);
+    // Ожидает появления сообщений не дольше timeoutMs миллисекунд и забирает из очереди
+    // не более maxCount сообщений (0 - без ограничения). Сообщения помещаются в batch в виде
+    // JSON-массива, заканчивающегося нулем. Возвращает количество извлеченных сообщений.
+    size_t WaitBatch(long timeoutMs, size_t maxCount, std::vector<WCHAR_T>& batch);
+    size_t Size();
+    size_t DroppedCount();
+    void Clear();
+private:
+    MessageQueue(const MessageQueue&);
+    MessageQueue& operator = (const MessageQueue&);
+
+    size_t m_maxSize;
+    size_t m_dropped;
+    std::deque<std::vector<WCHAR_T>> m_messages;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+};
+
+#endif //__MESSAGEQUEUE_H__
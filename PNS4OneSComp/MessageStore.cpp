@@ -0,0 +1,109 @@
+#include <utility>
+#include "MessageStore.h"
+
+MessageStore::MessageStore(size_t maxSize) : m_maxSize(maxSize), m_lastId(0)
+{ }
+
+int32_t MessageStore::Add(JsonValue& message)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_lastId = (m_lastId == INT32_MAX) ? 1 : m_lastId + 1;
+    m_messages[m_lastId] = std::move(message);
+    m_order.push_back(m_lastId);
+
+    while (m_messages.size() > m_maxSize && !m_order.empty()) {
+        m_messages.erase(m_order.front());
+        m_order.pop_front();
+    }
+    // Освобожденные идентификаторы не должны копиться в очереди.
+    if (m_order.size() > m_maxSize * 2) {
+        std::deque<int32_t> order;
+        for (int32_t id : m_order) {
+            if (m_messages.count(id))
+                order.push_back(id);
+        }
+        m_order.swap(order);
+    }
+
+    return m_lastId;
+}
+
+const JsonValue* MessageStore::find(int32_t id) const
+{
+    auto it = m_messages.find(id);
+    return it == m_messages.end() ? nullptr : &it->second;
+}
+
+bool MessageStore::GetTopic(int32_t id, std::string& topic)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const JsonValue* message = find(id);
+    if (!message)
+        return false;
+
+    const JsonValue* value = message->Find("topic");
+    topic = (value && value->IsString()) ? value->GetString() : std::string();
+    return true;
+}
+
+bool MessageStore::GetNotification(int32_t id, std::string& notification)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const JsonValue* message = find(id);
+    const JsonValue* value = message ? message->Find("notification") : nullptr;
+    if (!value || !value->IsObject())
+        return false;
+
+    notification.clear();
+    value->Serialize(notification);
+    return true;
+}
+
+bool MessageStore::GetDataField(int32_t id, const std::string& key, std::string& value)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const JsonValue* message = find(id);
+    const JsonValue* data = message ? message->Find("data") : nullptr;
+    const JsonValue* field = (data && data->IsObject()) ? data->Find(key) : nullptr;
+    if (!field || field->IsNull())
+        return false;
+
+    // Сервис передает данные строками, прочие значения возвращаются в виде JSON.
+    if (field->IsString())
+        value = field->GetString();
+    else {
+        value.clear();
+        field->Serialize(value);
+    }
+    return true;
+}
+
+bool MessageStore::GetMessage(int32_t id, std::string& message)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const JsonValue* value = find(id);
+    if (!value)
+        return false;
+
+    message.clear();
+    value->Serialize(message);
+    return true;
+}
+
+void MessageStore::Release(int32_t id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_messages.erase(id);
+}
+
+void MessageStore::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_messages.clear();
+    m_order.clear();
+}
@@ -0,0 +1,45 @@
+#ifndef __MESSAGESTORE_H__
+#define __MESSAGESTORE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include "Json.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// class MessageStore
+// Хранилище сообщений, разобранных компонентой при получении. В 1С передается
+// только идентификатор сообщения, а тема, оповещение и поля данных читаются
+// методами компоненты без разбора JSON во встроенном языке. Количество сообщений
+// ограничено: при переполнении удаляются самые старые.
+class MessageStore
+{
+public:
+    explicit MessageStore(size_t maxSize);
+
+    // Помещает сообщение в хранилище и возвращает его идентификатор.
+    int32_t Add(JsonValue& message);
+    // Методы возвращают false, если сообщения (или запрошенного свойства) нет.
+    bool GetTopic(int32_t id, std::string& topic);
+    bool GetNotification(int32_t id, std::string& notification);
+    bool GetDataField(int32_t id, const std::string& key, std::string& value);
+    bool GetMessage(int32_t id, std::string& message);
+    void Release(int32_t id);
+    void Clear();
+private:
+    MessageStore(const MessageStore&);
+    MessageStore& operator = (const MessageStore&);
+
+    const JsonValue* find(int32_t id) const;
+
+    size_t m_maxSize;
+    int32_t m_lastId;
+    std::map<int32_t, JsonValue> m_messages;
+    std::deque<int32_t> m_order; // Идентификаторы в порядке получения, могут содержать освобожденные.
+    std::mutex m_mutex;
+};
+
+#endif //__MESSAGESTORE_H__
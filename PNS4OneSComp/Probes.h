@@ -0,0 +1,27 @@
+#ifndef __PROBES_H__
+#define __PROBES_H__
+
+// Статические точки трассировки (USDT) потока прослушивания для perf и bpftrace, провайдер pns4onescomp:
+//  connect(hostname, port)              - соединение с сервисом установлено;
+//  disconnect()                         - соединение закрыто;
+//  state_change(from, to)               - переход состояния соединения (значения ConnectionState);
+//  frame_receive(size)                  - получен кадр, размер в байтах;
+//  decrypt_start(size)                  - начало расшифровки, размер зашифрованных данных;
+//  decrypt_end(size, ok)                - окончание расшифровки, размер расшифрованных данных и признак успеха;
+//  transcode(size)                      - сообщение подготовлено для 1С, размер в UTF-8;
+//  dispatch_start(pullMode)             - начало передачи сообщения в 1С (событием или в очередь);
+//  dispatch_end(ok)                     - окончание передачи, false - событие не принято платформой.
+// Точки собираются при наличии sys/sdt.h (Linux, пакет systemtap-sdt-dev). Пока трассировка
+// не подключена, каждая точка - одна инструкция nop.
+#if defined(PNS4ONES_USDT)
+#include <sys/sdt.h>
+#define PNS4ONES_PROBE0(name) DTRACE_PROBE(pns4onescomp, name)
+#define PNS4ONES_PROBE1(name, a) DTRACE_PROBE1(pns4onescomp, name, a)
+#define PNS4ONES_PROBE2(name, a, b) DTRACE_PROBE2(pns4onescomp, name, a, b)
+#else
+#define PNS4ONES_PROBE0(name) do { } while (0)
+#define PNS4ONES_PROBE1(name, a) do { } while (0)
+#define PNS4ONES_PROBE2(name, a, b) do { } while (0)
+#endif
+
+#endif //__PROBES_H__
@@ -0,0 +1,74 @@
+#include <cstring>
+#include "Registration.h"
+#include "ConversionWchar.h"
+#include "crypt.h"
+#include "FrameCodec.h"
+
+// Версия протокола, передаваемая сервису при регистрации. Начиная с версии 2 сервис
+// передает перед зашифрованным сообщением открытый заголовок (идентификатор сообщения,
+// срок жизни), что позволяет отбросить устаревшее или повторное сообщение без расшифровки.
+static const char PROTOCOL_VERSION[] = "2";
+
+size_t ConnectDataToSendBuf(
+    const char* appId,
+    const char* ibId,
+    const char* userId,
+    const WCHAR_T* userGroup,
+    unsigned char* hmacKey,
+    int hmacKeySize,
+    char** ppSendBuf
+) {
+    *ppSendBuf = nullptr;
+
+    char* userGroupUtf8 = nullptr;
+    size_t appIdLen = strlen(appId);
+    size_t ibIdLen = strlen(ibId);
+    size_t userIdLen = strlen(userId);
+    size_t userGroupLen = convFromShortWcharToUtf8(&userGroupUtf8, userGroup);
+    size_t protocolVersionLen = sizeof(PROTOCOL_VERSION) - 1;
+
+    // В буфер для отправки помещаются следующие данные:
+    //  2 байта - общая длина данных;
+    //  2 байта - длина подписи (хеш HMAC-SHA256);
+    //  подпись (хеш HMAC-SHA256);
+    //  идентификатор приложения, заканчивающийся нулем;
+    //  идентификатор базы данных, заканчивающийся нулем;
+    //  идентификатор пользователя, заканчивающийся нулем;
+    //  имя группы пользователя, заканчивающееся нулем;
+    //  версия протокола, заканчивающаяся нулем.
+    // Подписываемые данные записываются сразу в буфер отправки после места под подпись.
+    size_t dataSize = appIdLen + ibIdLen + userIdLen + userGroupLen + protocolVersionLen + 5;
+    size_t sendBufSize = CLIENT_FRAME_SIZE_BYTES + SIGNATURE_SIZE_BYTES + HMAC_SHA256_SIZE + dataSize;
+    if (sendBufSize - CLIENT_FRAME_SIZE_BYTES > CLIENT_FRAME_MAX_SIZE) {
+        delete[] userGroupUtf8;
+        return 0;
+    }
+
+    char* sendBuf = new char[sendBufSize];
+    FrameWriter writer((unsigned char*)sendBuf, sendBufSize);
+    writer.PutLE16((uint16_t)(sendBufSize - CLIENT_FRAME_SIZE_BYTES));
+    writer.PutLE16((uint16_t)HMAC_SHA256_SIZE);
+    unsigned char* signature = writer.Reserve(HMAC_SHA256_SIZE);
+    unsigned char* data = writer.Data() + writer.Size();
+    writer.PutCString(appId, appIdLen);
+    writer.PutCString(ibId, ibIdLen);
+    writer.PutCString(userId, userIdLen);
+    writer.PutCString(userGroupUtf8, userGroupLen);
+    writer.PutCString(PROTOCOL_VERSION, protocolVersionLen);
+    delete[] userGroupUtf8;
+
+    unsigned char* hmacHash = nullptr;
+    int hashSize = 0;
+    if (writer.Failed() || !hmacsha256_sign(data, (int)dataSize, hmacKey, hmacKeySize, &hmacHash, &hashSize)
+        || hashSize != (int)HMAC_SHA256_SIZE) {
+        delete[] hmacHash;
+        delete[] sendBuf;
+        return 0;
+    }
+
+    memcpy(signature, hmacHash, HMAC_SHA256_SIZE);
+    delete[] hmacHash;
+
+    *ppSendBuf = sendBuf;
+    return sendBufSize;
+}
@@ -0,0 +1,21 @@
+#ifndef __REGISTRATION_H__
+#define __REGISTRATION_H__
+
+#include <cstddef>
+#include "include/types.h"
+
+// Формирует кадр регистрации получателя уведомлений, подписанный ключом клиента (HMAC-SHA256).
+// Кадр формируется непосредственно в буфере отправки, который выделяется через new[] и освобождается
+// вызывающим. Возвращает размер кадра или 0 (буфер не выделяется), если подписать данные не удалось
+// или данные кадра превышают CLIENT_FRAME_MAX_SIZE.
+size_t ConnectDataToSendBuf(
+    const char* appId,
+    const char* ibId,
+    const char* userId,
+    const WCHAR_T* userGroup,
+    unsigned char* hmacKey,
+    int hmacKeySize,
+    char** ppSendBuf
+);
+
+#endif //__REGISTRATION_H__
@@ -5,24 +5,65 @@
 #include <sys/socket.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <cerrno>
-#include <thread>
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
 #include "ConversionWchar.h"
 #include "ServiceConnector.h"
+#include "ConnectionState.h"
+#include "MessageQueue.h"
+#include "TopicCache.h"
+#include "Json.h"
+#include "DocumentStore.h"
+#include "MessageStore.h"
+#include "AttachmentStore.h"
+#include "DedupWindow.h"
+#include "HttpPublisher.h"
+#include "Stats.h"
+#include "Probes.h"
+#include "FrameCodec.h"
+#include "FrameHeader.h"
+#include "FrameRecorder.h"
+#include "Registration.h"
 #include "crypt.h"
+#include "base64.h"
 
 #ifdef _WINDOWS
 #pragma comment(lib, "Ws2_32.lib")
 #endif
 
 constexpr auto CONNECTION_CLOSED = -1;
+constexpr auto FRAME_REJECTED = -2;
+constexpr size_t MESSAGE_QUEUE_MAX_SIZE = 10000;
+constexpr size_t MESSAGE_STORE_MAX_SIZE = 1000;
+constexpr size_t ATTACHMENT_STORE_MAX_COUNT = 1000;
+constexpr size_t ATTACHMENT_STORE_MAX_BYTES = 256 * 1024 * 1024;
+constexpr size_t DEDUP_WINDOW_SIZE = 4096;
+constexpr int AES_BLOCK_BYTES = 16;
+constexpr long PUBLISHER_STOP_TIMEOUT_MS = 5000;
+constexpr long RECONNECT_INITIAL_DELAY_MS = 500;
+constexpr long RECONNECT_DEFAULT_MAX_DELAY_MS = 30000;
 
 static wchar_t g_SourceId[] = L"com_ptolkachev_pns4ones";
 static wchar_t g_EventId[] = L"message";
+static wchar_t g_StoredEventId[] = L"storedmessage";
+static wchar_t g_StateEventId[] = L"statechange";
 static WcharWrapper s_SourceId(g_SourceId);
 static WcharWrapper s_EventId(g_EventId);
+static WcharWrapper s_StoredEventId(g_StoredEventId);
+static WcharWrapper s_StateEventId(g_StateEventId);
 
 // В Visual Studio под Windows для русских букв исходный файл должен быть в кодировке ASCII, а в Linux - в UTF-8.
 // В результате в той или иной системе, в зависимости от кодировки, получаются "кракозябры". Поэтому символы заданы
@@ -42,102 +83,85 @@ IAddInDefBaseEx *conn;
 AesKey aesKey;
 
 #ifdef _WINDOWS
-SOCKET sock = INVALID_SOCKET;
+typedef SOCKET SocketHandle;
+constexpr SocketHandle INVALID_SOCKET_HANDLE = INVALID_SOCKET;
 #else
-int sock = -1;
+typedef int SocketHandle;
+constexpr SocketHandle INVALID_SOCKET_HANDLE = -1;
 #endif
 
-extern void SetLastServiceError(const wchar_t *message);
-
-void ConnectDataToByteArray(
-    const char* appId,
-    const char* ibId,
-    const char* userId,
-    const WCHAR_T* userGroup,
-    unsigned char** byteArray,
-    int *byteArrayLen
-) {
-    size_t appIdLen = strlen(appId) + 1;
-    size_t ibIdLen = strlen(ibId) + 1;
-    size_t userIdLen = strlen(userId) + 1;
-    char* userGroupUtf8 = nullptr;
-    size_t userGroupLen = convFromShortWcharToUtf8(&userGroupUtf8, userGroup) + 1;
-
-    *byteArrayLen = (int)(appIdLen + ibIdLen + userIdLen + userGroupLen);
-    *byteArray = new unsigned char[*byteArrayLen];
-    memset(*byteArray, 0, *byteArrayLen);
+// Сокет становится доступен другим потокам (под sendMutex) только после регистрации клиента.
+SocketHandle sock = INVALID_SOCKET_HANDLE;
 
-    unsigned char* pos = *byteArray;
-    memcpy(pos, appId, appIdLen);
+// Защищает отправку данных сервису и закрытие соединения, т.к. управляющие кадры
+// отправляются из потока 1С, а соединение может быть закрыто потоком прослушивания.
+std::mutex sendMutex;
 
-    pos += appIdLen;
-    memcpy(pos, ibId, ibIdLen);
-
-    pos += ibIdLen;
-    memcpy(pos, userId, userIdLen);
-
-    pos += userIdLen;
-    memcpy(pos, userGroupUtf8, userGroupLen);
-
-    delete[] userGroupUtf8;
-}
-
-WORD ConnectDataToSendBuf(
-    const char* appId,
-    const char* ibId,
-    const char* userId,
-    const WCHAR_T* userGroup,
-    unsigned char* hmacKey,
-    int hmacKeySize,
-    char** ppSendBuf
-) {
-    unsigned char* dataByteArray = NULL, * hmacHash = NULL;
-    char* sendBuf, * bufPos;
-    int dataSize;
-    int hashSize;
+// Темы, на которые подписан клиент. Если фильтр не включен, то сервис передает сообщения по всем темам.
+std::set<std::string> subscribedTopics;
+bool topicsFilterEnabled = false;
 
-    ConnectDataToByteArray(appId, ibId, userId, userGroup, &dataByteArray, &dataSize);
+// Информационная база, к которой подключен клиент, и номер последнего опубликованного сообщения.
+// Сервис принимает публикацию только с номером больше предыдущего, что защищает от повторной отправки
+// перехваченного кадра. Номер сбрасывается при подключении и защищен sendMutex.
+std::string serviceIbId;
+uint32_t publishSequence = 0;
 
-    if (!hmacsha256_sign(dataByteArray, dataSize, hmacKey, hmacKeySize, &hmacHash, &hashSize)) {
-        if (!dataByteArray)
-            delete[] dataByteArray;
+// В режиме опроса сообщения не передаются через ExternalEvent, а накапливаются в очереди
+// до вызова ОжидатьСообщения().
+std::atomic<bool> pullMode(false);
+MessageQueue messageQueue(MESSAGE_QUEUE_MAX_SIZE);
 
-        return -1;
-    }
+// Состояние соединения. Каждый переход передается в 1С событием statechange.
+ConnectionStateMachine connectionState;
 
-    // В буфер для отправки помещаются следующие данные:
-    //  2 байта - общая длина данных;
-    //  2 байта - длина подписи (хеш HMAC-SHA256);
-    //  подпись (хеш HMAC-SHA256);
-    //  идентификатор приложения, заканчивающийся нулем;
-    //  идентификатор базы данных, заканчивающийся нулем;
-    //  идентификатор пользователя, заканчивающийся нулем;
-    //  имя группы пользователя, заканчивающееся нулем.
-    int sendBufSize = dataSize + hashSize + (int)sizeof(WORD);
-    sendBuf = new char[sendBufSize + sizeof(WORD)];
-    bufPos = sendBuf;
-
-    WORD* pSendBufSize = (WORD*)bufPos;
-    *pSendBufSize = (WORD)sendBufSize;
-    bufPos += sizeof(WORD);
-
-    WORD* pHashSize = (WORD*)bufPos;
-    *pHashSize = (WORD)hashSize;
-    bufPos += sizeof(WORD);
-
-    memcpy(bufPos, hmacHash, hashSize);
-    bufPos += hashSize;
-
-    memcpy(bufPos, dataByteArray, dataSize);
-
-    delete[] dataByteArray;
-    delete[] hmacHash;
+// Параметры подключения сохраняются для переподключения после потери соединения. Задержка перед
+// попыткой удваивается от RECONNECT_INITIAL_DELAY_MS до reconnectMaxDelayMs; 0 попыток - без переподключения.
+// Ожидание попытки прерывается вызовом Отключить() (listenStopRequested).
+struct ConnectParams
+{
+    std::string hostname;
+    std::string port;
+    std::string appId;
+    std::string ibId;
+    std::string userId;
+    std::vector<WCHAR_T> userGroup;
+} connectParams;
+std::atomic<long> reconnectAttempts(0);
+std::atomic<long> reconnectMaxDelayMs(RECONNECT_DEFAULT_MAX_DELAY_MS);
+std::mutex listenMutex;
+std::condition_variable listenCondition;
+std::atomic<bool> listenStopRequested(false); // Изменяется под listenMutex
+
+TopicCache topicCache;
+DocumentStore documentStore;
+
+// В режиме предварительного разбора сообщения разбираются компонентой и помещаются в хранилище,
+// а в 1С передается только идентификатор сообщения (событие storedmessage).
+std::atomic<bool> preParseMode(false);
+MessageStore messageStore(MESSAGE_STORE_MAX_SIZE);
+
+// Вложения сообщений декодируются при получении, в 1С передаются их идентификаторы.
+AttachmentStore attachmentStore(ATTACHMENT_STORE_MAX_COUNT, ATTACHMENT_STORE_MAX_BYTES);
+
+// Окно сохраняется между переподключениями: именно после них сообщения чаще всего приходят повторно.
+DedupWindow dedupWindow(DEDUP_WINDOW_SIZE);
+
+ComponentStats componentStats;
+
+// Запись полученных кадров в файл и воспроизведение записи без подключения к сервису.
+// Воспроизводимые кадры передаются в 1С тем же путем, что и полученные от сервиса.
+FrameRecorder frameRecorder;
+std::thread replayThread;
+std::atomic<bool> replayActive(false);
+std::mutex replayMutex;
+std::condition_variable replayCondition;
+bool replayStopRequested = false; // Защищен replayMutex
+AesKey replayKey;
 
-    *ppSendBuf = sendBuf;
-    return (WORD)(sendBufSize + sizeof(WORD));
-}
+extern void SetLastServiceError(const wchar_t *message);
 
-bool SocketInit(const char *hostname, const char *port, struct addrinfo **pAddrInfo) {
+bool SocketInit(const char *hostname, const char *port, struct addrinfo **pAddrInfo, SocketHandle& s) {
 #ifdef _WINDOWS
     WSADATA wsaData;
 
@@ -163,13 +187,8 @@ bool SocketInit(const char *hostname, const char *port, struct addrinfo **pAddrI
         return false;
     }
 
-    sock = socket((*pAddrInfo)->ai_family, (*pAddrInfo)->ai_socktype, (*pAddrInfo)->ai_protocol);
-#ifdef _WINDOWS
-    bool invalidSocket = (sock == INVALID_SOCKET);
-#else
-    bool invalidSocket = (sock == -1);
-#endif
-    if (invalidSocket) {
+    s = socket((*pAddrInfo)->ai_family, (*pAddrInfo)->ai_socktype, (*pAddrInfo)->ai_protocol);
+    if (s == INVALID_SOCKET_HANDLE) {
         // Ошибка создания сетевого соединения
         SetLastServiceError(L"\x041E\x0448\x0438\x0431\x043A\x0430\x0020\x0441\x043E\x0437\x0434\x0430\x043D\x0438\x044F\x0020\x0441\x0435\x0442\x0435\x0432\x043E\x0433\x043E\x0020\x0441\x043E\x0435\x0434\x0438\x043D\x0435\x043D\x0438\x044F");
 #ifdef _WINDOWS
@@ -181,22 +200,37 @@ bool SocketInit(const char *hostname, const char *port, struct addrinfo **pAddrI
     return true;
 }
 
-bool SocketConnect(addrinfo *pAddrInfo) {
-    if (connect(sock, pAddrInfo->ai_addr, (int)pAddrInfo->ai_addrlen)) {
-        // Не удалось установить соединение, возможно, сервис недоступен
-        SetLastServiceError(L"\x041D\x0435\x0020\x0443\x0434\x0430\x043B\x043E\x0441\x044C\x0020\x0443\x0441\x0442\x0430\x043D\x043E\x0432\x0438\x0442\x044C\x0020\x0441\x043E\x0435\x0434\x0438\x043D\x0435\x043D\x0438\x0435\x002C\x0020\x0432\x043E\x0437\x043C\x043E\x0436\x043D\x043E\x002C\x0020\x0441\x0435\x0440\x0432\x0438\x0441\x0020\x043D\x0435\x0434\x043E\x0441\x0442\x0443\x043F\x0435\x043D");
+// Закрывает сокет, который еще не передан потоку прослушивания (ошибка подключения или регистрации).
+void CloseSocket(SocketHandle& s) {
 #ifdef _WINDOWS
-        closesocket(sock);
-        WSACleanup();
+    closesocket(s);
+    WSACleanup();
 #else
-        close(sock);
+    close(s);
 #endif
+    s = INVALID_SOCKET_HANDLE;
+}
+
+bool SocketConnect(addrinfo *pAddrInfo, SocketHandle& s) {
+    if (connect(s, pAddrInfo->ai_addr, (int)pAddrInfo->ai_addrlen)) {
+        // Не удалось установить соединение, возможно, сервис недоступен
+        SetLastServiceError(L"\x041D\x0435\x0020\x0443\x0434\x0430\x043B\x043E\x0441\x044C\x0020\x0443\x0441\x0442\x0430\x043D\x043E\x0432\x0438\x0442\x044C\x0020\x0441\x043E\x0435\x0434\x0438\x043D\x0435\x043D\x0438\x0435\x002C\x0020\x0432\x043E\x0437\x043C\x043E\x0436\x043D\x043E\x002C\x0020\x0441\x0435\x0440\x0432\x0438\x0441\x0020\x043D\x0435\x0434\x043E\x0441\x0442\x0443\x043F\x0435\x043D");
+        CloseSocket(s);
         return false;
     }
     return true;
 }
 
-void CloseServiceConnection() {
+bool SocketIsValid() {
+    return sock != INVALID_SOCKET_HANDLE;
+}
+
+// Закрывает соединение. Вызывающий код должен удерживать sendMutex.
+void CloseServiceConnectionLocked() {
+    // Соединение может быть закрыто как потоком прослушивания, так и вызовом Отключить().
+    if (!SocketIsValid())
+        return;
+
 #ifdef _WINDOWS
     shutdown(sock, SD_BOTH);
     closesocket(sock);
@@ -205,9 +239,96 @@ void CloseServiceConnection() {
 #else
     shutdown(sock, SHUT_RDWR);
     close(sock);
-    sock = 0;
+    sock = -1;
 #endif
-    dispose_aes_key(aesKey);
+    PNS4ONES_PROBE0(disconnect);
+}
+
+void CloseServiceConnection() {
+    std::lock_guard<std::mutex> lock(sendMutex);
+    CloseServiceConnectionLocked();
+}
+
+bool SendAll(SocketHandle s, const char* buf, size_t bufSize) {
+    while (bufSize > 0) {
+        long count = send(s, buf, (int)bufSize, 0);
+        if (count <= 0)
+            return false;
+
+        buf += count;
+        bufSize -= count;
+    }
+    return true;
+}
+
+// Отправляет сервису управляющий кадр. Вызывающий код должен удерживать sendMutex.
+bool SendControlFrameLocked(unsigned char frameType, const std::vector<std::string>& topics) {
+    // В кадр помещаются следующие данные:
+    //  2 байта - общая длина данных;
+    //  1 байт - тип кадра;
+    //  темы, каждая из которых заканчивается нулем.
+    size_t dataSize = 1;
+    for (const auto& topic : topics)
+        dataSize += topic.size() + 1;
+
+    if (dataSize > CLIENT_FRAME_MAX_SIZE) {
+        // Слишком длинный список тем подписки
+        SetLastServiceError(L"\x0421\x043B\x0438\x0448\x043A\x043E\x043C\x0020\x0434\x043B\x0438\x043D\x043D\x044B\x0439\x0020\x0441\x043F\x0438\x0441\x043E\x043A\x0020\x0442\x0435\x043C\x0020\x043F\x043E\x0434\x043F\x0438\x0441\x043A\x0438");
+        return false;
+    }
+
+    std::vector<unsigned char> frame(CLIENT_FRAME_SIZE_BYTES + dataSize);
+    FrameWriter writer(frame.data(), frame.size());
+    writer.PutLE16((uint16_t)dataSize);
+    writer.PutU8(frameType);
+    for (const auto& topic : topics)
+        writer.PutCString(topic.data(), topic.size());
+
+    if (!SendAll(sock, (const char*)frame.data(), frame.size())) {
+        // Ошибка при передаче подписки сервису уведомлений
+        SetLastServiceError(L"\x041E\x0448\x0438\x0431\x043A\x0430\x0020\x043F\x0440\x0438\x0020\x043F\x0435\x0440\x0435\x0434\x0430\x0447\x0435\x0020\x043F\x043E\x0434\x043F\x0438\x0441\x043A\x0438\x0020\x0441\x0435\x0440\x0432\x0438\x0441\x0443\x0020\x0443\x0432\x0435\x0434\x043E\x043C\x043B\x0435\x043D\x0438\x0439");
+        return false;
+    }
+
+    return true;
+}
+
+// Отправляет управляющий кадр, если соединение установлено. Вызывающий код должен удерживать sendMutex,
+// под которым изменяется и подписка: при переподключении сервису передается подписка без пропущенных изменений.
+bool SendControlFrame(unsigned char frameType, const std::vector<std::string>& topics) {
+    // Без соединения достаточно изменить подписку локально, она будет передана сервису при подключении.
+    if (!SocketIsValid())
+        return true;
+
+    return SendControlFrameLocked(frameType, topics);
+}
+
+std::vector<std::string> SplitTopics(const WCHAR_T* topics) {
+    std::vector<std::string> result;
+    if (topics == nullptr)
+        return result;
+
+    char* topicsUtf8 = nullptr;
+    convFromShortWcharToUtf8(&topicsUtf8, topics);
+
+    std::string current;
+    for (const char* pos = topicsUtf8; ; pos++) {
+        if (*pos == ',' || *pos == 0) {
+            size_t first = current.find_first_not_of(" \t");
+            size_t last = current.find_last_not_of(" \t");
+            if (first != std::string::npos)
+                result.push_back(current.substr(first, last - first + 1));
+            current.clear();
+
+            if (*pos == 0)
+                break;
+        }
+        else
+            current.push_back(*pos);
+    }
+
+    delete[] topicsUtf8;
+    return result;
 }
 
 bool ConnectToService(
@@ -221,48 +342,125 @@ bool ConnectToService(
     int hmacKeySize
 ) {
     struct addrinfo *pAddrInfo = nullptr;
+    SocketHandle newSock = INVALID_SOCKET_HANDLE;
 
-    if (!SocketInit(hostname, port, &pAddrInfo)) {
+    if (!SocketInit(hostname, port, &pAddrInfo, newSock)) {
         if (pAddrInfo)
             freeaddrinfo(pAddrInfo);
         return false;
     }
-    if (!SocketConnect(pAddrInfo)) {
+    if (!SocketConnect(pAddrInfo, newSock)) {
         freeaddrinfo(pAddrInfo);
         return false;
     }
 
     freeaddrinfo(pAddrInfo);
 
-    char *buf;
-    WORD bufSize = ConnectDataToSendBuf(appId, ibId, userId, userGroup, hmacKey, hmacKeySize, &buf);
-    if (bufSize == -1)
+    char *buf = nullptr;
+    size_t bufSize = ConnectDataToSendBuf(appId, ibId, userId, userGroup, hmacKey, hmacKeySize, &buf);
+    if (bufSize == 0)
     {
         // Ошибка при подписании запроса на подключение
         SetLastServiceError(L"\x041E\x0448\x0438\x0431\x043A\x0430\x0020\x043F\x0440\x0438\x0020\x043F\x043E\x0434\x043F\x0438\x0441\x0430\x043D\x0438\x0438\x0020\x0437\x0430\x043F\x0440\x043E\x0441\x0430\x0020\x043D\x0430\x0020\x043F\x043E\x0434\x043A\x043B\x044E\x0447\x0435\x043D\x0438\x0435");
-        delete[] buf;
+        CloseSocket(newSock);
         return false;
     }
 
+    // Регистрация и подписка передаются до того, как сокет станет доступен для публикации и управляющих кадров.
+    std::lock_guard<std::mutex> lock(sendMutex);
+
     bool result = true;
-    if (send(sock, buf, bufSize, 0) == -1) {
+    if (listenStopRequested) {
+        // Подключение к сервису прервано вызовом Отключить()
+        SetLastServiceError(L"\x041F\x043E\x0434\x043A\x043B\x044E\x0447\x0435\x043D\x0438\x0435\x0020\x043A\x0020\x0441\x0435\x0440\x0432\x0438\x0441\x0443\x0020\x043F\x0440\x0435\x0440\x0432\x0430\x043D\x043E\x0020\x0432\x044B\x0437\x043E\x0432\x043E\x043C\x0020\x041E\x0442\x043A\x043B\x044E\x0447\x0438\x0442\x044C\x0028\x0029");
+        result = false;
+    }
+    else if (!SendAll(newSock, buf, bufSize)) {
         // Ошибка при регистрации получателя уведомлений, возможно, сервис недоступен
         SetLastServiceError(L"\x041E\x0448\x0438\x0431\x043A\x0430\x0020\x043F\x0440\x0438\x0020\x0440\x0435\x0433\x0438\x0441\x0442\x0440\x0430\x0446\x0438\x0438\x0020\x043F\x043E\x043B\x0443\x0447\x0430\x0442\x0435\x043B\x044F\x0020\x0443\x0432\x0435\x0434\x043E\x043C\x043B\x0435\x043D\x0438\x0439\x002C\x0020\x0432\x043E\x0437\x043C\x043E\x0436\x043D\x043E\x002C\x0020\x0441\x0435\x0440\x0432\x0438\x0441\x0020\x043D\x0435\x0434\x043E\x0441\x0442\x0443\x043F\x0435\x043D");
-        CloseServiceConnection();
         result = false;
     }
 
     delete[] buf;
-    return result;
+
+    if (!result) {
+        CloseSocket(newSock);
+        return false;
+    }
+
+    sock = newSock;
+    publishSequence = 0;
+
+    if (topicsFilterEnabled) {
+        std::vector<std::string> topics(subscribedTopics.begin(), subscribedTopics.end());
+        if (!SendControlFrameLocked(CONTROL_FRAME_SET_TOPICS, topics)) {
+            CloseServiceConnectionLocked();
+            return false;
+        }
+    }
+
+    componentStats.connects.fetch_add(1, std::memory_order_relaxed);
+    PNS4ONES_PROBE2(connect, hostname, port);
+    return true;
+}
+
+// Переводит соединение в новое состояние и передает переход в 1С событием statechange.
+// Возвращает false, если переход недопустим из текущего состояния.
+bool ChangeConnectionState(ConnectionState to, const char* reason, int attempt = 0) {
+    ConnectionTransition transition;
+    if (!connectionState.Transition(to, reason, attempt, transition))
+        return false;
+
+    PNS4ONES_PROBE2(state_change, (int)transition.from, (int)transition.to);
+
+    if (conn) {
+        std::string json;
+        transition.Serialize(json);
+        WCHAR_T* data = nullptr;
+        convFromUtf8ToShortWchar(&data, json.c_str());
+        if (!conn->ExternalEvent(s_SourceId, s_StateEventId, data))
+            componentStats.droppedEvents.fetch_add(1, std::memory_order_relaxed);
+        delete[] data;
+    }
+    return true;
 }
 
 void ProceedReceivedMessage(WCHAR_T *message) {
-    conn->ExternalEvent(s_SourceId, s_EventId, message);
+    bool accepted = true;
+
+    PNS4ONES_PROBE1(dispatch_start, (bool)pullMode);
+    if (pullMode)
+        messageQueue.Push(message);
+    else
+        accepted = conn->ExternalEvent(s_SourceId, s_EventId, message);
+    PNS4ONES_PROBE1(dispatch_end, accepted);
+
+    if (!accepted)
+        componentStats.droppedEvents.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ProceedStoredMessage(int32_t id) {
+    WCHAR_T* idString = nullptr;
+    convFromUtf8ToShortWchar(&idString, std::to_string(id).c_str());
+
+    bool accepted = true;
+
+    PNS4ONES_PROBE1(dispatch_start, (bool)pullMode);
+    if (pullMode)
+        messageQueue.Push(idString);
+    else
+        accepted = conn->ExternalEvent(s_SourceId, s_StoredEventId, idString);
+    PNS4ONES_PROBE1(dispatch_end, accepted);
+
+    if (!accepted)
+        componentStats.droppedEvents.fetch_add(1, std::memory_order_relaxed);
+
+    delete[] idString;
 }
 
 int ReadUInt32(uint32_t *res) {
     char buf[sizeof(uint32_t)];
-    char bufRes[sizeof(uint32_t)];
+    unsigned char bufRes[sizeof(uint32_t)];
     long count, bytesRead = 0;
 
     memset(bufRes, 0, sizeof(uint32_t));
@@ -283,7 +481,7 @@ int ReadUInt32(uint32_t *res) {
         bytesRead += count;
     }
 
-    *res = *((uint32_t *) bufRes);
+    *res = LoadLE32(bufRes);
 
     return 0;
 }
@@ -323,59 +521,337 @@ int ReadBytesArray(unsigned char** bytesArray, int *arrayLength)
     return 0;
 }
 
+static int64_t UnixTimeMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Устаревшие и повторные сообщения отбрасываются до расшифровки. Срок жизни проверяется на момент
+// получения кадра (для воспроизводимой записи - на момент записи).
+bool FrameIsRelevant(const FrameHeader& header, int64_t receivedAt) {
+    if (header.expiresAt > 0) {
+        if (receivedAt > header.expiresAt) {
+            componentStats.droppedExpired.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    if (!header.messageId.empty() && !dedupWindow.Add(header.messageId)) {
+        componentStats.droppedDuplicates.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+// Имя потока прослушивания отображается в отладчике, perf и top -H.
+void SetListenThreadName() {
 #ifdef _WINDOWS
-DWORD WINAPI ListenService(LPVOID lpParam)
+    // SetThreadDescription доступна начиная с Windows 10 1607, поэтому функция получается динамически.
+    typedef HRESULT (WINAPI *SetThreadDescriptionFunc)(HANDLE, PCWSTR);
+    HMODULE kernel = GetModuleHandleW(L"kernel32.dll");
+    auto setThreadDescription = kernel
+        ? (SetThreadDescriptionFunc)GetProcAddress(kernel, "SetThreadDescription")
+        : nullptr;
+    if (setThreadDescription)
+        setThreadDescription(GetCurrentThread(), L"pns4ones-listen");
 #else
-void *ListenService(void *lpParam)
+    // Длина имени потока в Linux ограничена 15 символами.
+    pthread_setname_np(pthread_self(), "pns4ones-listen");
 #endif
+}
+
+// В сообщение с идентификатором трассировки добавляется свойство trace с отметками времени доставки
+// (миллисекунды с 01.01.1970 UTC): прием и отправка сервисом, получение компонентой и передача в 1С.
+void AddMessageTrace(JsonValue& message, const FrameHeader& header, int64_t receivedAt) {
+    JsonValue trace(JsonValue::eObject);
+    trace.Set("id", JsonValue::String(header.traceId));
+    if (header.ingestedAt > 0)
+        trace.Set("ingestedAt", JsonValue::Number(header.ingestedAt));
+    if (header.sentAt > 0)
+        trace.Set("sentAt", JsonValue::Number(header.sentAt));
+    trace.Set("receivedAt", JsonValue::Number(receivedAt));
+    trace.Set("dispatchedAt", JsonValue::Number(UnixTimeMs()));
+    message.Set("trace", trace);
+}
+
+// Данные вложений (свойство data в base64) декодируются и помещаются в хранилище вложений, а в сообщении
+// заменяются идентификатором (id) и размером (size) вложения. Текст base64 не преобразуется в строку 1С.
+// Вложение с некорректными данными передается без идентификатора. Возвращает true, если сообщение изменено.
+bool ExtractAttachments(JsonValue& message) {
+    JsonValue* attachments = message.Find("attachments");
+    if (!attachments || attachments->GetType() != JsonValue::eArray)
+        return false;
+
+    bool changed = false;
+    for (JsonValue& attachment : attachments->GetArray()) {
+        JsonValue* data = attachment.IsObject() ? attachment.Find("data") : nullptr;
+        if (!data || !data->IsString())
+            continue;
+
+        const std::string& base64 = data->GetString();
+        std::vector<unsigned char>* decoded = new std::vector<unsigned char>(
+            base64_decoded_size(base64.data(), base64.size()));
+        size_t decodedSize = 0;
+        bool isDecoded = base64_decode_n(base64.data(), base64.size(), decoded->data(), decoded->size(), &decodedSize) != 0;
+        AttachmentData attachmentData(decoded);
+
+        attachment.Remove("data");
+        if (isDecoded) {
+            attachment.Set("id", JsonValue::Number(attachmentStore.Add(attachmentData)));
+            attachment.Set("size", JsonValue::Number((int64_t)decodedSize));
+        }
+        changed = true;
+    }
+    return changed;
+}
+
+// Кадр, полученный от сервиса или прочитанный из записи.
+struct ReceivedFrame
 {
-    unsigned char* encrypted, * decrypted;
-    int encryptedSize = 0, decryptedSize = 0;
-    char* utf8Array;
-    WCHAR_T* message;
-    int res = 0;
+    unsigned char* data;
+    int size;
+    bool decrypted;      // Зашифрованные данные заменены расшифрованными (запись расшифрованных сообщений)
+    bool replayed;       // Кадр прочитан из записи
+    int64_t receivedAt;  // Время получения, миллисекунды с 01.01.1970 UTC
+    std::chrono::steady_clock::time_point receivedTime;
+};
+
+void RecordDeliveryTimes(const FrameHeader& header, const ReceivedFrame& frame) {
+    componentStats.clientTime.Record((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - frame.receivedTime).count());
+
+    // Отметки времени сервиса в записи относятся к исходной доставке.
+    if (frame.replayed)
+        return;
+
+    int64_t receivedAt = frame.receivedAt;
+
+    // Отрицательные интервалы возможны при расхождении часов сервиса и клиента и учитываются как нулевые.
+    if (header.ingestedAt > 0 && header.sentAt >= header.ingestedAt)
+        componentStats.serverQueueTime.Record((uint64_t)(header.sentAt - header.ingestedAt) * 1000);
+    if (header.sentAt > 0)
+        componentStats.networkTime.Record(receivedAt > header.sentAt ? (uint64_t)(receivedAt - header.sentAt) * 1000 : 0);
+    if (header.ingestedAt > 0) {
+        int64_t now = UnixTimeMs();
+        componentStats.deliveryTime.Record(now > header.ingestedAt ? (uint64_t)(now - header.ingestedAt) * 1000 : 0);
+    }
+}
+
+// Разбирает кадр, расшифровывает сообщение и передает его в 1С. Возвращает false, если кадр
+// поврежден или не расшифрован и прием сообщений нужно прекратить.
+bool ProceedFrame(const ReceivedFrame& frame, const AesKey& key) {
+    unsigned char* frameData = frame.data;
+    int frameSize = frame.size;
+    FrameHeader frameHeader;
+    if (!ReadFrameHeader(&frameData, &frameSize, frameHeader)) {
+        ProceedReceivedMessage(s_ErrorMessageCommon);
+        return false;
+    }
+    if (!FrameIsRelevant(frameHeader, frame.receivedAt))
+        return true; // Сообщение отброшено.
+
+    int decryptedSize = frameSize >= (int)DECRYPTED_SIZE_BYTES ? (int)LoadLE32(frameData) : -1;
+    unsigned char* decrypted = nullptr;
+    bool isDecrypted;
+    if (frame.decrypted) {
+        isDecrypted = decryptedSize >= 0 && decryptedSize == frameSize - 4;
+    }
+    else {
+        StatsTimer decryptTimer(componentStats.decryptTime);
+        PNS4ONES_PROBE1(decrypt_start, frameSize);
+        // Размер данных берется из кадра (в том числе из файла записи) и не должен выходить за пределы
+        // зашифрованных данных, иначе расшифровка прочитает память за кадром.
+        int encryptedSize = frameSize - 4;
+        isDecrypted = decryptedSize >= 0 && decryptedSize <= encryptedSize
+            && encryptedSize % AES_BLOCK_BYTES == 0 && key.Key
+            && aes_decrypt(frameData + 4, encryptedSize, key, &decrypted, decryptedSize);
+        PNS4ONES_PROBE2(decrypt_end, decryptedSize, isDecrypted);
+        decryptTimer.Stop();
+    }
+
+    if (!isDecrypted) {
+        if (decrypted)
+            delete[] decrypted;
+        componentStats.decryptFailures.fetch_add(1, std::memory_order_relaxed);
+        ProceedReceivedMessage(s_ErrorEncryptMessage);
+        return false;
+    }
+
+    const unsigned char* plain = frame.decrypted ? frameData + 4 : decrypted;
+    if (!frame.replayed && frameRecorder.IsActive() && frameRecorder.RecordsDecrypted()) {
+        // Заголовок кадра и размер данных сохраняются как есть, зашифрованные данные заменяются расшифрованными.
+        frameRecorder.Write(eFrameRecordDecrypted, frame.data, (size_t)(frameData + 4 - frame.data),
+            plain, (size_t)decryptedSize);
+    }
+
+    StatsTimer transcodeTimer(componentStats.transcodeTime);
+    char* utf8Array = new char[(size_t)decryptedSize + 1];
+    memcpy(utf8Array, plain, decryptedSize);
+    utf8Array[decryptedSize] = 0;
+    if (decrypted)
+        delete[] decrypted;
+
+    // Без предварительного разбора полный разбор нужен только для сообщений с документом состояния,
+    // вложениями и трассируемых сообщений.
+    bool storeMessage = preParseMode;
+    bool traced = !frameHeader.traceId.empty();
+    JsonValue parsed;
+    bool isParsed = false;
+    std::string transformed;
+    if (storeMessage || traced || strstr(utf8Array, "\"document\"") || strstr(utf8Array, "\"attachments\"")) {
+        isParsed = JsonValue::Parse(utf8Array, decryptedSize, parsed);
+        bool changed = isParsed && documentStore.Apply(parsed);
+        if (isParsed && ExtractAttachments(parsed))
+            changed = true;
+        if (isParsed && traced) {
+            AddMessageTrace(parsed, frameHeader, frame.receivedAt);
+            changed = true;
+        }
+        if (changed)
+            parsed.Serialize(transformed);
+    }
+    storeMessage = storeMessage && isParsed;
 
-    conn = (IAddInDefBaseEx *) lpParam;
+    const char* messageUtf8 = transformed.empty() ? utf8Array : transformed.c_str();
+    size_t messageUtf8Len = transformed.empty() ? (size_t)decryptedSize : transformed.size();
+
+    WCHAR_T* message = nullptr;
+    bool cacheEnabled = topicCache.IsEnabled();
+    size_t messageLen = 0;
+    if (!storeMessage || cacheEnabled)
+        messageLen = convFromUtf8ToShortWchar(&message, messageUtf8);
+
+    std::string topic;
+    if (cacheEnabled && JsonFindTopLevelString(messageUtf8, messageUtf8Len, "topic", topic))
+        topicCache.Put(topic, message, messageLen);
+
+    int32_t storedId = storeMessage ? messageStore.Add(parsed) : 0;
+    PNS4ONES_PROBE1(transcode, messageUtf8Len);
+    transcodeTimer.Stop();
+
+    StatsTimer dispatchTimer(componentStats.dispatchTime);
+    if (storeMessage)
+        ProceedStoredMessage(storedId);
+    else
+        ProceedReceivedMessage(message);
+    dispatchTimer.Stop();
+
+    RecordDeliveryTimes(frameHeader, frame);
+
+    delete[] utf8Array;
+    if (message)
+        delete[] message;
+    return true;
+}
+
+// Принимает кадры, пока соединение не будет закрыто. Возвращает CONNECTION_CLOSED, код ошибки
+// сокета или FRAME_REJECTED, если кадр не удалось обработать (например, расшифровать).
+int ReceiveFrames() {
+    unsigned char* encrypted;
+    int encryptedSize = 0;
+    int res = 0;
 
     while (res == 0) {
         encrypted = nullptr;
-        decrypted = nullptr;
-        utf8Array = nullptr;
-        message = nullptr;
 
         res = ReadBytesArray(&encrypted, &encryptedSize);
-
         if (res == 0) {
-            decryptedSize = bytearray4_to_int(encrypted);
-            if (aes_decrypt(encrypted + 4, encryptedSize - 4, aesKey, &decrypted, decryptedSize)) {
-                utf8Array = new char[(size_t)decryptedSize + 1];
-                memcpy(utf8Array, decrypted, decryptedSize);
-                utf8Array[decryptedSize] = 0;
-
-                convFromUtf8ToShortWchar(&message, utf8Array);
-                ProceedReceivedMessage(message);
-            }
-            else {
-                ProceedReceivedMessage(s_ErrorEncryptMessage);
-                res = -1; // Прерывание цикла
-            }
+            ReceivedFrame frame;
+            frame.data = encrypted;
+            frame.size = encryptedSize;
+            frame.decrypted = false;
+            frame.replayed = false;
+            frame.receivedTime = std::chrono::steady_clock::now();
+            frame.receivedAt = UnixTimeMs();
+
+            PNS4ONES_PROBE1(frame_receive, encryptedSize);
+            componentStats.messagesReceived.fetch_add(1, std::memory_order_relaxed);
+            componentStats.bytesReceived.fetch_add(encryptedSize + sizeof(uint32_t), std::memory_order_relaxed);
+
+            if (frameRecorder.IsActive() && !frameRecorder.RecordsDecrypted())
+                frameRecorder.Write(eFrameRecordEncrypted, encrypted, (size_t)encryptedSize, nullptr, 0);
+
+            if (!ProceedFrame(frame, aesKey))
+                res = FRAME_REJECTED;
         }
-        else if (res == CONNECTION_CLOSED)
-            ProceedReceivedMessage(s_ErrorMessageServiceStopped);
-        else
-            ProceedReceivedMessage(s_ErrorMessageCommon);
 
         if (encrypted)
             delete[] encrypted;
-        if (decrypted)
-            delete[] decrypted;
-        if (utf8Array)
-            delete[] utf8Array;
-        if (message)
-            delete[] message;
     }
 
-    CloseServiceConnection();
+    return res;
+}
+
+// Повторно подключается к сервису после потери соединения. Возвращает false, если переподключение
+// не настроено, попытки исчерпаны или прерваны вызовом Отключить().
+bool Reconnect() {
+    long attempts = reconnectAttempts;
+    if (attempts <= 0 || !ChangeConnectionState(eConnectionReconnecting, "connection_lost"))
+        return false;
+
+    // Задержка выбирается случайно в пределах [delay / 2, delay], чтобы клиенты, потерявшие соединение
+    // одновременно (например, при перезапуске сервиса), не подключались все в один момент.
+    std::minstd_rand random((unsigned)std::chrono::steady_clock::now().time_since_epoch().count());
+    long delayMs = std::min(RECONNECT_INITIAL_DELAY_MS, (long)reconnectMaxDelayMs);
+
+    for (long attempt = 1; attempt <= attempts; attempt++) {
+        long waitMs = delayMs / 2 + (long)(random() % (unsigned long)(delayMs / 2 + 1));
+        {
+            std::unique_lock<std::mutex> lock(listenMutex);
+            if (listenCondition.wait_for(lock, std::chrono::milliseconds(waitMs), [] { return (bool)listenStopRequested; }))
+                return false;
+        }
+
+        const ConnectParams& p = connectParams;
+        if (ConnectToService(p.hostname.c_str(), p.port.c_str(), p.appId.c_str(), p.ibId.c_str(), p.userId.c_str(),
+            p.userGroup.data(), aesKey.Key, aesKey.KeySize)) {
+            // После Отключить() переход недопустим, и соединение будет закрыто.
+            ChangeConnectionState(eConnectionConnected, "reconnected", (int)attempt);
+            return true;
+        }
+
+        delayMs = std::min(delayMs * 2, (long)reconnectMaxDelayMs);
+    }
+
+    return false;
+}
+
+#ifdef _WINDOWS
+DWORD WINAPI ListenService(LPVOID lpParam)
+#else
+void *ListenService(void *lpParam)
+#endif
+{
+    SetListenThreadName();
+
+    for (;;) {
+        int res = ReceiveFrames();
+        CloseServiceConnection();
+
+        // Кадр, который не удалось обработать, не будет принят и после переподключения (например, неверный ключ).
+        if (res != FRAME_REJECTED && !listenStopRequested && Reconnect())
+            continue;
+
+        // Решение принимается под listenMutex, чтобы не пересечься с переходом в draining при Отключить().
+        WcharWrapper* errorMessage = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(listenMutex);
+            if (listenStopRequested)
+                ChangeConnectionState(eConnectionDisconnected, "closed");
+            else if (res == FRAME_REJECTED)
+                ChangeConnectionState(eConnectionFailed, "frame_rejected");
+            else {
+                ChangeConnectionState(eConnectionFailed, reconnectAttempts > 0 ? "reconnect_failed" : "connection_lost");
+                errorMessage = res == CONNECTION_CLOSED ? &s_ErrorMessageServiceStopped : &s_ErrorMessageCommon;
+            }
+        }
+
+        // Для совместимости потеря соединения по-прежнему передается и сообщением с ошибкой.
+        if (errorMessage)
+            ProceedReceivedMessage(*errorMessage);
+        break;
+    }
+
 #ifdef _WINDOWS
     return 0;
 #else
@@ -393,16 +869,56 @@ bool StartListenService(
     const WCHAR_T *userGroup,
     IAddInDefBaseEx *piConnect
 ) {
+    if (replayActive) {
+        // Подключение к сервису недоступно во время воспроизведения записи
+        SetLastServiceError(L"\x041F\x043E\x0434\x043A\x043B\x044E\x0447\x0435\x043D\x0438\x0435\x0020\x043A\x0020\x0441\x0435\x0440\x0432\x0438\x0441\x0443\x0020\x043D\x0435\x0434\x043E\x0441\x0442\x0443\x043F\x043D\x043E\x0020\x0432\x043E\x0020\x0432\x0440\x0435\x043C\x044F\x0020\x0432\x043E\x0441\x043F\x0440\x043E\x0438\x0437\x0432\x0435\x0434\x0435\x043D\x0438\x044F\x0020\x0437\x0430\x043F\x0438\x0441\x0438");
+        return false;
+    }
+
+    // Поток прослушивания предыдущего подключения (в том числе выполняющий переподключение) должен быть завершен.
+    ConnectionState state = connectionState.State();
+    if (state != eConnectionDisconnected && state != eConnectionFailed) {
+        // Соединение с сервисом уже установлено
+        SetLastServiceError(L"\x0421\x043E\x0435\x0434\x0438\x043D\x0435\x043D\x0438\x0435\x0020\x0441\x0020\x0441\x0435\x0440\x0432\x0438\x0441\x043E\x043C\x0020\x0443\x0436\x0435\x0020\x0443\x0441\x0442\x0430\x043D\x043E\x0432\x043B\x0435\x043D\x043E");
+        return false;
+    }
+
+    // Ключ используется потоком прослушивания до его завершения, поэтому освобождается только здесь.
+    if (aesKey.Key) {
+        dispose_aes_key(aesKey);
+        aesKey = AesKey();
+    }
+
     if (!get_aes_keys_from_base64(clientKey, &aesKey)) {
         // Некорректный ключ клиента
         SetLastServiceError(L"\x041D\x0435\x043A\x043E\x0440\x0440\x0435\x043A\x0442\x043D\x044B\x0439\x0020\x043A\x043B\x044E\x0447\x0020\x043A\x043B\x0438\x0435\x043D\x0442\x0430");
         return false;
     }
 
+    serviceIbId = ibId;
+
+    connectParams.hostname = hostname;
+    connectParams.port = port;
+    connectParams.appId = appId;
+    connectParams.ibId = ibId;
+    connectParams.userId = userId;
+    connectParams.userGroup.assign(userGroup, userGroup + getLenShortWcharStr(userGroup) + 1);
+
+    conn = piConnect;
+    {
+        std::lock_guard<std::mutex> lock(listenMutex);
+        listenStopRequested = false;
+    }
+
+    ChangeConnectionState(eConnectionConnecting, "connect");
     if (!ConnectToService(hostname, port, appId, ibId, userId, userGroup, aesKey.Key, aesKey.KeySize)) {
+        ChangeConnectionState(eConnectionFailed, "connect_failed");
         return false;
     }
 
+    // Поток прослушивания может сразу обнаружить потерю соединения, поэтому переход выполняется до его запуска.
+    ChangeConnectionState(eConnectionConnected, "connected");
+
 #ifdef _WINDOWS
     DWORD dwThreadId;
     HANDLE hThread;
@@ -411,23 +927,532 @@ bool StartListenService(
         CloseServiceConnection();
         // Ошибка инициализации прослушивания сообщений
         SetLastServiceError(L"\x041E\x0448\x0438\x0431\x043A\x0430\x0020\x0438\x043D\x0438\x0446\x0438\x0430\x043B\x0438\x0437\x0430\x0446\x0438\x0438\x0020\x043F\x0440\x043E\x0441\x043B\x0443\x0448\x0438\x0432\x0430\x043D\x0438\x044F\x0020\x0441\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x0439");
+        ChangeConnectionState(eConnectionFailed, "connect_failed");
         return false;
     }
+    CloseHandle(hThread);
 #else
     pthread_t thr;
-    pthread_create(&thr, nullptr, ListenService, piConnect);
+    if (pthread_create(&thr, nullptr, ListenService, piConnect) == 0)
+        pthread_detach(thr);
 #endif
 
     return true;
 }
 
 void StopListenService() {
-#ifdef _WINDOWS
-    bool invalidSocket = (sock == INVALID_SOCKET);
-#else
-    bool invalidSocket = (sock == -1);
-#endif
-    if (!invalidSocket) {
-        CloseServiceConnection();
+    {
+        // Ожидание переподключения прерывается, поток прослушивания переводит соединение в disconnected.
+        std::lock_guard<std::mutex> lock(listenMutex);
+        listenStopRequested = true;
+        ChangeConnectionState(eConnectionDraining, "shutdown");
+    }
+    listenCondition.notify_all();
+    CloseServiceConnection();
+}
+
+bool SetSubscription(const WCHAR_T* topics) {
+    std::vector<std::string> topicsList = SplitTopics(topics);
+    std::lock_guard<std::mutex> lock(sendMutex);
+
+    subscribedTopics.clear();
+    subscribedTopics.insert(topicsList.begin(), topicsList.end());
+    topicsFilterEnabled = !subscribedTopics.empty();
+
+    if (!topicsFilterEnabled)
+        return SendControlFrame(CONTROL_FRAME_RESET_TOPICS, topicsList);
+
+    return SendControlFrame(CONTROL_FRAME_SET_TOPICS, topicsList);
+}
+
+bool Subscribe(const WCHAR_T* topics) {
+    std::vector<std::string> topicsList = SplitTopics(topics);
+    if (topicsList.empty())
+        return true;
+
+    std::lock_guard<std::mutex> lock(sendMutex);
+    subscribedTopics.insert(topicsList.begin(), topicsList.end());
+
+    if (!topicsFilterEnabled) {
+        // Первая подписка включает фильтр: далее сервис передает только сообщения по выбранным темам.
+        topicsFilterEnabled = true;
+        return SendControlFrame(CONTROL_FRAME_SET_TOPICS, topicsList);
+    }
+
+    return SendControlFrame(CONTROL_FRAME_ADD_TOPICS, topicsList);
+}
+
+bool Unsubscribe(const WCHAR_T* topics) {
+    std::vector<std::string> topicsList = SplitTopics(topics);
+    std::lock_guard<std::mutex> lock(sendMutex);
+    if (topicsList.empty() || !topicsFilterEnabled)
+        return true;
+
+    for (const auto& topic : topicsList)
+        subscribedTopics.erase(topic);
+
+    return SendControlFrame(CONTROL_FRAME_REMOVE_TOPICS, topicsList);
+}
+void SetPullMode(bool enabled) {
+    pullMode = enabled;
+    if (!enabled)
+        messageQueue.Clear();
+}
+
+bool GetPullMode() {
+    return pullMode;
+}
+
+size_t GetPendingMessagesCount() {
+    return messageQueue.Size();
+}
+
+size_t WaitMessages(long timeoutMs, size_t maxCount, std::vector<WCHAR_T>& batch) {
+    return messageQueue.WaitBatch(timeoutMs, maxCount, batch);
+}
+
+void ConfigureTopicCache(const WCHAR_T* topics, size_t maxBytes) {
+    topicCache.Configure(SplitTopics(topics), maxBytes);
+}
+
+bool GetLastTopicMessage(const WCHAR_T* topic, std::vector<WCHAR_T>& message) {
+    if (topic == nullptr)
+        return false;
+
+    char* topicUtf8 = nullptr;
+    convFromShortWcharToUtf8(&topicUtf8, topic);
+    bool result = topicCache.Get(topicUtf8, message);
+    delete[] topicUtf8;
+    return result;
+}
+
+void GetLastTopicMessages(std::vector<WCHAR_T>& messages) {
+    topicCache.GetAll(messages);
+}
+
+static void Utf8ToWcharVector(const std::string& utf8, std::vector<WCHAR_T>& result) {
+    WCHAR_T* wchar = nullptr;
+    size_t len = convFromUtf8ToShortWchar(&wchar, utf8.c_str());
+    result.assign(wchar, wchar + len);
+    result.push_back(0);
+    delete[] wchar;
+}
+
+void SetDocumentMode(const WCHAR_T* documentId, bool patchMode) {
+    if (documentId == nullptr)
+        return;
+
+    char* idUtf8 = nullptr;
+    convFromShortWcharToUtf8(&idUtf8, documentId);
+    documentStore.SetPatchMode(idUtf8, patchMode);
+    delete[] idUtf8;
+}
+
+bool GetDocument(const WCHAR_T* documentId, std::vector<WCHAR_T>& state) {
+    if (documentId == nullptr)
+        return false;
+
+    char* idUtf8 = nullptr;
+    convFromShortWcharToUtf8(&idUtf8, documentId);
+    std::string stateUtf8;
+    bool result = documentStore.Get(idUtf8, stateUtf8);
+    delete[] idUtf8;
+    if (!result)
+        return false;
+
+    Utf8ToWcharVector(stateUtf8, state);
+    return true;
+}
+
+void SetPreParseMode(bool enabled) {
+    preParseMode = enabled;
+    if (!enabled)
+        messageStore.Clear();
+}
+
+bool GetPreParseMode() {
+    return preParseMode;
+}
+
+bool GetStoredMessageTopic(int32_t id, std::vector<WCHAR_T>& topic) {
+    std::string topicUtf8;
+    if (!messageStore.GetTopic(id, topicUtf8))
+        return false;
+
+    Utf8ToWcharVector(topicUtf8, topic);
+    return true;
+}
+
+bool GetStoredMessageNotification(int32_t id, std::vector<WCHAR_T>& notification) {
+    std::string notificationUtf8;
+    if (!messageStore.GetNotification(id, notificationUtf8))
+        return false;
+
+    Utf8ToWcharVector(notificationUtf8, notification);
+    return true;
+}
+
+bool GetStoredMessageDataField(int32_t id, const WCHAR_T* key, std::vector<WCHAR_T>& value) {
+    if (key == nullptr)
+        return false;
+
+    char* keyUtf8 = nullptr;
+    convFromShortWcharToUtf8(&keyUtf8, key);
+    std::string valueUtf8;
+    bool result = messageStore.GetDataField(id, keyUtf8, valueUtf8);
+    delete[] keyUtf8;
+    if (!result)
+        return false;
+
+    Utf8ToWcharVector(valueUtf8, value);
+    return true;
+}
+
+bool GetStoredMessage(int32_t id, std::vector<WCHAR_T>& message) {
+    std::string messageUtf8;
+    if (!messageStore.GetMessage(id, messageUtf8))
+        return false;
+
+    Utf8ToWcharVector(messageUtf8, message);
+    return true;
+}
+
+void ReleaseStoredMessage(int32_t id) {
+    messageStore.Release(id);
+}
+
+AttachmentData GetAttachment(int32_t id) {
+    return attachmentStore.Get(id);
+}
+
+bool GetAttachmentBase64(int32_t id, std::vector<WCHAR_T>& base64) {
+    AttachmentData data = attachmentStore.Get(id);
+    if (!data)
+        return false;
+
+    // Алфавит base64 состоит из символов ASCII, поэтому текст переносится в строку 1С без преобразования кодировки.
+    std::string text(base64_encoded_size(data->size()), '\0');
+    base64_encode(data->data(), data->size(), &text[0]);
+    base64.assign(text.begin(), text.end());
+    base64.push_back(0);
+    return true;
+}
+
+void ReleaseAttachment(int32_t id) {
+    attachmentStore.Release(id);
+}
+
+bool Publish(const WCHAR_T* recipientType, const WCHAR_T* recipient, const WCHAR_T* message) {
+    if (recipientType == nullptr || message == nullptr)
+        return false;
+
+    char* typeUtf8 = nullptr;
+    char* recipientUtf8 = nullptr;
+    char* messageUtf8 = nullptr;
+    convFromShortWcharToUtf8(&typeUtf8, recipientType);
+    static const WCHAR_T emptyString[] = { 0 };
+    convFromShortWcharToUtf8(&recipientUtf8, recipient ? recipient : emptyString);
+    convFromShortWcharToUtf8(&messageUtf8, message);
+    std::string type(typeUtf8);
+    std::string target(recipientUtf8);
+    std::string messageText(messageUtf8);
+    delete[] typeUtf8;
+    delete[] recipientUtf8;
+    delete[] messageUtf8;
+
+    const char* targetKey = nullptr;
+    if (type == "user")
+        targetKey = "UserId";
+    else if (type == "group")
+        targetKey = "UserGroup";
+    else if (type != "all") {
+        // Некорректный тип получателя сообщения
+        SetLastServiceError(L"\x041D\x0435\x043A\x043E\x0440\x0440\x0435\x043A\x0442\x043D\x044B\x0439\x0020\x0442\x0438\x043F\x0020\x043F\x043E\x043B\x0443\x0447\x0430\x0442\x0435\x043B\x044F\x0020\x0441\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x044F");
+        return false;
+    }
+
+    JsonValue messageValue;
+    if (!JsonValue::Parse(messageText.c_str(), messageText.size(), messageValue) || !messageValue.IsObject()) {
+        // Некорректное сообщение для публикации
+        SetLastServiceError(L"\x041D\x0435\x043A\x043E\x0440\x0440\x0435\x043A\x0442\x043D\x043E\x0435\x0020\x0441\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x0435\x0020\x0434\x043B\x044F\x0020\x043F\x0443\x0431\x043B\x0438\x043A\x0430\x0446\x0438\x0438");
+        return false;
     }
-}
\ No newline at end of file
+
+    // Данные публикации совпадают с телом HTTP-запроса отправки сообщения.
+    std::string request("{\"Recipient\":{\"Type\":");
+    JsonWriteString(request, type);
+    request.append(",\"IbId\":");
+    JsonWriteString(request, serviceIbId);
+    if (targetKey) {
+        request.append(",\"");
+        request.append(targetKey);
+        request.append("\":");
+        JsonWriteString(request, target);
+    }
+    request.append("},\"Message\":");
+    request.append(messageText);
+    request.push_back('}');
+
+    std::lock_guard<std::mutex> lock(sendMutex);
+
+    if (!SocketIsValid()) {
+        // Нет соединения с сервисом уведомлений
+        SetLastServiceError(L"\x041D\x0435\x0442\x0020\x0441\x043E\x0435\x0434\x0438\x043D\x0435\x043D\x0438\x044F\x0020\x0441\x0020\x0441\x0435\x0440\x0432\x0438\x0441\x043E\x043C\x0020\x0443\x0432\x0435\x0434\x043E\x043C\x043B\x0435\x043D\x0438\x0439");
+        return false;
+    }
+
+    unsigned char* encrypted = nullptr;
+    int encryptedSize = 0;
+    if (!aes_encrypt((unsigned char*)request.data(), (int)request.size(), aesKey, &encrypted, &encryptedSize)) {
+        // Ошибка при публикации сообщения
+        SetLastServiceError(L"\x041E\x0448\x0438\x0431\x043A\x0430\x0020\x043F\x0440\x0438\x0020\x043F\x0443\x0431\x043B\x0438\x043A\x0430\x0446\x0438\x0438\x0020\x0441\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x044F");
+        return false;
+    }
+
+    // В кадр помещаются следующие данные:
+    //  2 байта - общая длина данных;
+    //  1 байт - тип кадра;
+    //  4 байта - номер публикации;
+    //  4 байта - размер данных до шифрования;
+    //  зашифрованные данные;
+    //  подпись (хеш HMAC-SHA256) всех данных кадра после длины.
+    size_t dataSize = PUBLISH_FRAME_HEADER_SIZE + (size_t)encryptedSize + HMAC_SHA256_SIZE;
+    if (dataSize > CLIENT_FRAME_MAX_SIZE) {
+        delete[] encrypted;
+        // Слишком большое сообщение для публикации
+        SetLastServiceError(L"\x0421\x043B\x0438\x0448\x043A\x043E\x043C\x0020\x0431\x043E\x043B\x044C\x0448\x043E\x0435\x0020\x0441\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x0435\x0020\x0434\x043B\x044F\x0020\x043F\x0443\x0431\x043B\x0438\x043A\x0430\x0446\x0438\x0438");
+        return false;
+    }
+
+    std::vector<unsigned char> frame(CLIENT_FRAME_SIZE_BYTES + dataSize);
+    FrameWriter writer(frame.data(), frame.size());
+    writer.PutLE16((uint16_t)dataSize);
+    writer.PutU8(CONTROL_FRAME_PUBLISH);
+    writer.PutLE32(++publishSequence);
+    writer.PutLE32((uint32_t)request.size());
+    writer.PutBytes(encrypted, encryptedSize);
+    delete[] encrypted;
+
+    unsigned char* hmacHash = nullptr;
+    int hashSize = 0;
+    if (!hmacsha256_sign(frame.data() + CLIENT_FRAME_SIZE_BYTES, (int)writer.Size() - (int)CLIENT_FRAME_SIZE_BYTES,
+        aesKey.Key, aesKey.KeySize, &hmacHash, &hashSize) || hashSize != (int)HMAC_SHA256_SIZE) {
+        delete[] hmacHash;
+        // Ошибка при публикации сообщения
+        SetLastServiceError(L"\x041E\x0448\x0438\x0431\x043A\x0430\x0020\x043F\x0440\x0438\x0020\x043F\x0443\x0431\x043B\x0438\x043A\x0430\x0446\x0438\x0438\x0020\x0441\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x044F");
+        return false;
+    }
+    writer.PutBytes(hmacHash, HMAC_SHA256_SIZE);
+    delete[] hmacHash;
+
+    if (!SendAll(sock, (const char*)frame.data(), frame.size())) {
+        // Ошибка при публикации сообщения
+        SetLastServiceError(L"\x041E\x0448\x0438\x0431\x043A\x0430\x0020\x043F\x0440\x0438\x0020\x043F\x0443\x0431\x043B\x0438\x043A\x0430\x0446\x0438\x0438\x0020\x0441\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x044F");
+        return false;
+    }
+
+    return true;
+}
+
+bool ConfigurePublisher(HttpPublisher& publisher, const WCHAR_T* host, long port, const WCHAR_T* accessToken) {
+    if (host == nullptr || accessToken == nullptr || port <= 0 || port > 0xFFFF)
+        return false;
+
+    char* hostUtf8 = nullptr;
+    char* tokenUtf8 = nullptr;
+    convFromShortWcharToUtf8(&hostUtf8, host);
+    convFromShortWcharToUtf8(&tokenUtf8, accessToken);
+    bool result = publisher.Configure(hostUtf8, std::to_string(port), tokenUtf8);
+    delete[] hostUtf8;
+    delete[] tokenUtf8;
+
+    if (!result) {
+        // Не удалось настроить асинхронную отправку уведомлений
+        SetLastServiceError(L"\x041D\x0435\x0020\x0443\x0434\x0430\x043B\x043E\x0441\x044C\x0020\x043D\x0430\x0441\x0442\x0440\x043E\x0438\x0442\x044C\x0020\x0430\x0441\x0438\x043D\x0445\x0440\x043E\x043D\x043D\x0443\x044E\x0020\x043E\x0442\x043F\x0440\x0430\x0432\x043A\x0443\x0020\x0443\x0432\x0435\x0434\x043E\x043C\x043B\x0435\x043D\x0438\x0439");
+    }
+    return result;
+}
+
+bool PublishAsync(HttpPublisher& publisher, const WCHAR_T* request) {
+    if (request == nullptr)
+        return false;
+
+    char* requestUtf8 = nullptr;
+    convFromShortWcharToUtf8(&requestUtf8, request);
+    bool result = publisher.Enqueue(requestUtf8);
+    delete[] requestUtf8;
+
+    if (!result) {
+        // Очередь асинхронной отправки уведомлений заполнена или отправка не настроена
+        SetLastServiceError(L"\x041E\x0447\x0435\x0440\x0435\x0434\x044C\x0020\x0430\x0441\x0438\x043D\x0445\x0440\x043E\x043D\x043D\x043E\x0439\x0020\x043E\x0442\x043F\x0440\x0430\x0432\x043A\x0438\x0020\x0443\x0432\x0435\x0434\x043E\x043C\x043B\x0435\x043D\x0438\x0439\x0020\x0437\x0430\x043F\x043E\x043B\x043D\x0435\x043D\x0430\x0020\x0438\x043B\x0438\x0020\x043E\x0442\x043F\x0440\x0430\x0432\x043A\x0430\x0020\x043D\x0435\x0020\x043D\x0430\x0441\x0442\x0440\x043E\x0435\x043D\x0430");
+    }
+    return result;
+}
+
+bool FlushPublisher(HttpPublisher& publisher, long timeoutMs) {
+    return publisher.Flush(timeoutMs);
+}
+
+size_t GetPublisherPendingCount(HttpPublisher& publisher) {
+    return publisher.PendingCount();
+}
+
+void GetPublishErrors(HttpPublisher& publisher, std::vector<WCHAR_T>& errors) {
+    std::string errorsUtf8;
+    publisher.TakeErrors(errorsUtf8);
+    Utf8ToWcharVector(errorsUtf8, errors);
+}
+
+void StopPublisher(HttpPublisher& publisher) {
+    // Перед остановкой оставшиеся в очереди сообщения отправляются в течение ограниченного времени.
+    publisher.Flush(PUBLISHER_STOP_TIMEOUT_MS);
+    publisher.Stop();
+}
+
+bool StartRecording(const WCHAR_T* fileName, bool decrypted) {
+    if (!frameRecorder.Start(fileName, decrypted)) {
+        // Не удалось создать файл записи полученных сообщений
+        SetLastServiceError(L"\x041D\x0435\x0020\x0443\x0434\x0430\x043B\x043E\x0441\x044C\x0020\x0441\x043E\x0437\x0434\x0430\x0442\x044C\x0020\x0444\x0430\x0439\x043B\x0020\x0437\x0430\x043F\x0438\x0441\x0438\x0020\x043F\x043E\x043B\x0443\x0447\x0435\x043D\x043D\x044B\x0445\x0020\x0441\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x0439");
+        return false;
+    }
+    return true;
+}
+
+void StopRecording() {
+    frameRecorder.Stop();
+}
+
+void ReplayRecording(FrameRecordReader* reader, double speed) {
+    FrameRecordType type;
+    int64_t recordedAtUs = 0, firstRecordedAtUs = 0;
+    std::vector<unsigned char> frameData;
+    auto start = std::chrono::steady_clock::now();
+    bool first = true;
+
+    while (reader->Next(type, recordedAtUs, frameData)) {
+        if (first) {
+            firstRecordedAtUs = recordedAtUs;
+            first = false;
+        }
+
+        {
+            // Кадр передается не раньше исходного интервала от начала записи, деленного на скорость.
+            std::unique_lock<std::mutex> lock(replayMutex);
+            if (speed > 0 && recordedAtUs > firstRecordedAtUs) {
+                auto due = start + std::chrono::microseconds((int64_t)((recordedAtUs - firstRecordedAtUs) / speed));
+                replayCondition.wait_until(lock, due, [] { return replayStopRequested; });
+            }
+            if (replayStopRequested)
+                break;
+        }
+
+        ReceivedFrame frame;
+        frame.data = frameData.data();
+        frame.size = (int)frameData.size();
+        frame.decrypted = type == eFrameRecordDecrypted;
+        frame.replayed = true;
+        frame.receivedTime = std::chrono::steady_clock::now();
+        frame.receivedAt = recordedAtUs / 1000;
+        if (!ProceedFrame(frame, replayKey))
+            break;
+    }
+
+    delete reader;
+    if (replayKey.Key) {
+        dispose_aes_key(replayKey);
+        replayKey = AesKey();
+    }
+    replayActive = false;
+}
+
+bool StartReplay(const WCHAR_T* fileName, double speed, const char* clientKey, IAddInDefBaseEx* piConnect) {
+    StopReplay();
+
+    ConnectionState state = connectionState.State();
+    if (state != eConnectionDisconnected && state != eConnectionFailed) {
+        // Воспроизведение записи недоступно при подключении к сервису
+        SetLastServiceError(L"\x0412\x043E\x0441\x043F\x0440\x043E\x0438\x0437\x0432\x0435\x0434\x0435\x043D\x0438\x0435\x0020\x0437\x0430\x043F\x0438\x0441\x0438\x0020\x043D\x0435\x0434\x043E\x0441\x0442\x0443\x043F\x043D\x043E\x0020\x043F\x0440\x0438\x0020\x043F\x043E\x0434\x043A\x043B\x044E\x0447\x0435\x043D\x0438\x0438\x0020\x043A\x0020\x0441\x0435\x0440\x0432\x0438\x0441\x0443");
+        return false;
+    }
+
+    auto* reader = new FrameRecordReader();
+    if (!reader->Open(fileName)) {
+        delete reader;
+        // Не удалось открыть файл записи полученных сообщений
+        SetLastServiceError(L"\x041D\x0435\x0020\x0443\x0434\x0430\x043B\x043E\x0441\x044C\x0020\x043E\x0442\x043A\x0440\x044B\x0442\x044C\x0020\x0444\x0430\x0439\x043B\x0020\x0437\x0430\x043F\x0438\x0441\x0438\x0020\x043F\x043E\x043B\x0443\x0447\x0435\x043D\x043D\x044B\x0445\x0020\x0441\x043E\x043E\x0431\x0449\x0435\x043D\x0438\x0439");
+        return false;
+    }
+
+    // Ключ клиента нужен только для записи зашифрованных кадров.
+    replayKey = AesKey();
+    if (clientKey && *clientKey && !get_aes_keys_from_base64(clientKey, &replayKey)) {
+        delete reader;
+        replayKey = AesKey();
+        // Некорректный ключ клиента
+        SetLastServiceError(L"\x041D\x0435\x043A\x043E\x0440\x0440\x0435\x043A\x0442\x043D\x044B\x0439\x0020\x043A\x043B\x044E\x0447\x0020\x043A\x043B\x0438\x0435\x043D\x0442\x0430");
+        return false;
+    }
+
+    conn = piConnect;
+    // Повторное воспроизведение той же записи не должно отбрасываться как повторная доставка.
+    dedupWindow.Clear();
+
+    {
+        std::lock_guard<std::mutex> lock(replayMutex);
+        replayStopRequested = false;
+    }
+    replayActive = true;
+    replayThread = std::thread(ReplayRecording, reader, speed);
+    return true;
+}
+
+void StopReplay() {
+    {
+        std::lock_guard<std::mutex> lock(replayMutex);
+        replayStopRequested = true;
+    }
+    replayCondition.notify_all();
+    if (replayThread.joinable())
+        replayThread.join();
+}
+
+bool GetReplayActive() {
+    return replayActive;
+}
+
+void ConfigureReconnect(long attempts, long maxDelayMs) {
+    reconnectAttempts = std::max(0L, attempts);
+    reconnectMaxDelayMs = maxDelayMs > 0 ? maxDelayMs : RECONNECT_DEFAULT_MAX_DELAY_MS;
+}
+
+void GetConnectionState(std::vector<WCHAR_T>& state) {
+    Utf8ToWcharVector(ConnectionStateName(connectionState.State()), state);
+}
+
+void GetStats(HttpPublisher& publisher, std::vector<WCHAR_T>& stats) {
+    bool connected;
+    {
+        std::lock_guard<std::mutex> lock(sendMutex);
+        connected = SocketIsValid();
+    }
+
+    std::string statsUtf8("{\"connected\":");
+    statsUtf8.append(connected ? "true," : "false,");
+    statsUtf8.append("\"state\":\"");
+    statsUtf8.append(ConnectionStateName(connectionState.State()));
+    statsUtf8.append("\",");
+    componentStats.Serialize(statsUtf8);
+    statsUtf8.append(",\"queueDepth\":");
+    statsUtf8.append(std::to_string(messageQueue.Size()));
+    statsUtf8.append(",\"queueDropped\":");
+    statsUtf8.append(std::to_string(messageQueue.DroppedCount()));
+    statsUtf8.append(",\"publishPending\":");
+    statsUtf8.append(std::to_string(publisher.PendingCount()));
+    statsUtf8.append(",\"recording\":");
+    statsUtf8.append(frameRecorder.IsActive() ? "true" : "false");
+    statsUtf8.append(",\"replaying\":");
+    statsUtf8.append(replayActive ? "true" : "false");
+    statsUtf8.push_back('}');
+
+    Utf8ToWcharVector(statsUtf8, stats);
+}
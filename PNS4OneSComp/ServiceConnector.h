@@ -1,7 +1,12 @@
 #ifndef __SERVICECONNECTOR_H__
 #define __SERVICECONNECTOR_H__
 
+#include <cstddef>
+#include <cstdint>
+#include <vector>
 #include "include/AddInDefBase.h"
+#include "AttachmentStore.h"
+#include "HttpPublisher.h"
 
 bool StartListenService(
 	const char* hostname,
@@ -15,4 +20,78 @@ bool StartListenService(
 );
 void StopListenService();
 
+// Переподключение после потери соединения: количество попыток (0 - без переподключения) и наибольшая
+// задержка между попытками в миллисекундах. Состояние соединения: disconnected, connecting, connected,
+// reconnecting, draining или failed; каждый переход передается в 1С внешним событием statechange.
+void ConfigureReconnect(long attempts, long maxDelayMs);
+void GetConnectionState(std::vector<WCHAR_T>& state);
+
+// Управление подпиской на темы сообщений. Темы передаются строкой через запятую.
+// Пустая подписка в SetSubscription отключает фильтр, и сервис передает сообщения по всем темам.
+bool SetSubscription(const WCHAR_T* topics);
+bool Subscribe(const WCHAR_T* topics);
+bool Unsubscribe(const WCHAR_T* topics);
+
+// Режим опроса: сообщения накапливаются в очереди и забираются пакетами через WaitMessages.
+void SetPullMode(bool enabled);
+bool GetPullMode();
+size_t GetPendingMessagesCount();
+size_t WaitMessages(long timeoutMs, size_t maxCount, std::vector<WCHAR_T>& batch);
+
+// Кеш последних сообщений по темам. Темы передаются строкой через запятую, "*" - все темы.
+void ConfigureTopicCache(const WCHAR_T* topics, size_t maxBytes);
+bool GetLastTopicMessage(const WCHAR_T* topic, std::vector<WCHAR_T>& message);
+void GetLastTopicMessages(std::vector<WCHAR_T>& messages);
+
+// Документы состояния. В режиме изменений (patchMode) сообщения с документом передаются
+// в 1С без применения изменений к локальной копии.
+void SetDocumentMode(const WCHAR_T* documentId, bool patchMode);
+bool GetDocument(const WCHAR_T* documentId, std::vector<WCHAR_T>& state);
+
+// Предварительный разбор: сообщения хранятся в компоненте, в 1С передается идентификатор сообщения.
+// Функции возвращают false, если сообщения или запрошенного свойства нет.
+void SetPreParseMode(bool enabled);
+bool GetPreParseMode();
+bool GetStoredMessageTopic(int32_t id, std::vector<WCHAR_T>& topic);
+bool GetStoredMessageNotification(int32_t id, std::vector<WCHAR_T>& notification);
+bool GetStoredMessageDataField(int32_t id, const WCHAR_T* key, std::vector<WCHAR_T>& value);
+bool GetStoredMessage(int32_t id, std::vector<WCHAR_T>& message);
+void ReleaseStoredMessage(int32_t id);
+
+// Вложения полученных сообщений. Данные декодируются из base64 при получении, в тексте сообщения передаются
+// идентификатор и размер вложения. Возвращают nullptr (false), если вложение освобождено или вытеснено.
+AttachmentData GetAttachment(int32_t id);
+bool GetAttachmentBase64(int32_t id, std::vector<WCHAR_T>& base64);
+void ReleaseAttachment(int32_t id);
+
+// Публикует сообщение другим клиентам по открытому соединению с сервисом. Тип получателя: user, group или all;
+// получатель - идентификатор пользователя или группа; сообщение - JSON в формате свойства Message запроса отправки.
+bool Publish(const WCHAR_T* recipientType, const WCHAR_T* recipient, const WCHAR_T* message);
+
+// Асинхронная отправка уведомлений серверу отправления по постоянному соединению HTTP. Запрос - JSON
+// в формате тела запроса sendmessage. Ошибки возвращаются JSON-массивом и после получения очищаются.
+// Отправитель принадлежит экземпляру компоненты: очередь и ошибки одного экземпляра не видны другим.
+bool ConfigurePublisher(HttpPublisher& publisher, const WCHAR_T* host, long port, const WCHAR_T* accessToken);
+bool PublishAsync(HttpPublisher& publisher, const WCHAR_T* request);
+bool FlushPublisher(HttpPublisher& publisher, long timeoutMs);
+size_t GetPublisherPendingCount(HttpPublisher& publisher);
+void GetPublishErrors(HttpPublisher& publisher, std::vector<WCHAR_T>& errors);
+void StopPublisher(HttpPublisher& publisher);
+
+// Запись полученных кадров в файл: зашифрованных (как получены от сервиса) или расшифрованных. Файл записи
+// расшифрованных сообщений содержит данные сообщений в открытом виде, но воспроизводится без ключа клиента.
+bool StartRecording(const WCHAR_T* fileName, bool decrypted);
+void StopRecording();
+
+// Воспроизведение записи без подключения к сервису: кадры передаются в 1С так же, как полученные от сервиса.
+// Скорость 1 - с исходными интервалами, больше 1 - быстрее во столько раз, 0 - без пауз. Ключ клиента
+// нужен для записи зашифрованных кадров.
+bool StartReplay(const WCHAR_T* fileName, double speed, const char* clientKey, IAddInDefBaseEx* piConnect);
+void StopReplay();
+bool GetReplayActive();
+
+// Статистика работы компоненты в формате JSON: счетчики сообщений, отброшенных сообщений и событий,
+// глубина очереди, гистограммы времени расшифровки, преобразования и передачи сообщений в 1С (в микросекундах).
+void GetStats(HttpPublisher& publisher, std::vector<WCHAR_T>& stats);
+
 #endif
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include "Stats.h"
+
+LatencyHistogram::LatencyHistogram() : m_max(0)
+{
+    for (int i = 0; i < BUCKETS_COUNT; i++)
+        m_buckets[i] = 0;
+}
+
+void LatencyHistogram::Record(uint64_t micros)
+{
+    // Интервал i содержит значения [2^(i-1), 2^i), интервал 0 - нулевые значения.
+    int bucket = 0;
+    for (uint64_t value = micros; value != 0 && bucket < BUCKETS_COUNT - 1; value >>= 1)
+        bucket++;
+
+    m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (micros > max && !m_max.compare_exchange_weak(max, micros, std::memory_order_relaxed))
+        ;
+}
+
+uint64_t LatencyHistogram::Percentile(uint64_t total, const uint64_t* counts, double fraction) const
+{
+    uint64_t rank = (uint64_t)(total * fraction);
+    if (rank >= total)
+        rank = total - 1;
+
+    uint64_t accumulated = 0;
+    for (int i = 0; i < BUCKETS_COUNT; i++) {
+        accumulated += counts[i];
+        if (accumulated > rank)
+            return i == 0 ? 0 : ((uint64_t)1 << i) - 1;
+    }
+    return 0;
+}
+
+void LatencyHistogram::Serialize(std::string& out) const
+{
+    // Снимок счетчиков: запись в других потоках может продолжаться во время чтения.
+    uint64_t counts[BUCKETS_COUNT];
+    uint64_t total = 0;
+    for (int i = 0; i < BUCKETS_COUNT; i++) {
+        counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+
+    // Верхняя граница интервала не может превышать наибольшее записанное значение.
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    uint64_t p50 = total ? std::min(Percentile(total, counts, 0.5), max) : 0;
+    uint64_t p99 = total ? std::min(Percentile(total, counts, 0.99), max) : 0;
+
+    out.append("{\"count\":");
+    out.append(std::to_string(total));
+    out.append(",\"p50\":");
+    out.append(std::to_string(p50));
+    out.append(",\"p99\":");
+    out.append(std::to_string(p99));
+    out.append(",\"max\":");
+    out.append(std::to_string(max));
+    out.push_back('}');
+}
+
+ComponentStats::ComponentStats() :
+    messagesReceived(0),
+    bytesReceived(0),
+    decryptFailures(0),
+    connects(0),
+    droppedExpired(0),
+    droppedDuplicates(0),
+    droppedEvents(0)
+{ }
+
+static void AppendCounter(std::string& out, const char* name, uint64_t value)
+{
+    out.push_back('"');
+    out.append(name);
+    out.append("\":");
+    out.append(std::to_string(value));
+    out.push_back(',');
+}
+
+void ComponentStats::Serialize(std::string& out) const
+{
+    AppendCounter(out, "messagesReceived", messagesReceived.load(std::memory_order_relaxed));
+    AppendCounter(out, "bytesReceived", bytesReceived.load(std::memory_order_relaxed));
+    AppendCounter(out, "decryptFailures", decryptFailures.load(std::memory_order_relaxed));
+    AppendCounter(out, "connects", connects.load(std::memory_order_relaxed));
+    AppendCounter(out, "droppedExpired", droppedExpired.load(std::memory_order_relaxed));
+    AppendCounter(out, "droppedDuplicates", droppedDuplicates.load(std::memory_order_relaxed));
+    AppendCounter(out, "droppedEvents", droppedEvents.load(std::memory_order_relaxed));
+
+    out.append("\"decryptTimeUs\":");
+    decryptTime.Serialize(out);
+    out.append(",\"transcodeTimeUs\":");
+    transcodeTime.Serialize(out);
+    out.append(",\"dispatchTimeUs\":");
+    dispatchTime.Serialize(out);
+    out.append(",\"serverQueueTimeUs\":");
+    serverQueueTime.Serialize(out);
+    out.append(",\"networkTimeUs\":");
+    networkTime.Serialize(out);
+    out.append(",\"clientTimeUs\":");
+    clientTime.Serialize(out);
+    out.append(",\"deliveryTimeUs\":");
+    deliveryTime.Serialize(out);
+}
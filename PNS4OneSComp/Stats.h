@@ -0,0 +1,88 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+///////////////////////////////////////////////////////////////////////////////
+// class LatencyHistogram
+// Гистограмма длительностей операций в микросекундах с интервалами по степеням двойки.
+// Запись выполняется без блокировок, поэтому может вызываться в потоке прослушивания
+// на каждом сообщении. Процентили вычисляются с точностью до интервала (верхняя граница).
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void Record(uint64_t micros);
+    // Дописывает объект JSON {"count", "p50", "p99", "max"}.
+    void Serialize(std::string& out) const;
+private:
+    LatencyHistogram(const LatencyHistogram&);
+    LatencyHistogram& operator = (const LatencyHistogram&);
+
+    uint64_t Percentile(uint64_t total, const uint64_t* counts, double fraction) const;
+
+    static const int BUCKETS_COUNT = 40;
+
+    std::atomic<uint64_t> m_buckets[BUCKETS_COUNT];
+    std::atomic<uint64_t> m_max;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// class ComponentStats
+// Счетчики работы компоненты. Все значения атомарные и изменяются без блокировок.
+class ComponentStats
+{
+public:
+    ComponentStats();
+
+    std::atomic<uint64_t> messagesReceived;
+    std::atomic<uint64_t> bytesReceived;
+    std::atomic<uint64_t> decryptFailures;
+    std::atomic<uint64_t> connects;
+    std::atomic<uint64_t> droppedExpired;
+    std::atomic<uint64_t> droppedDuplicates;
+    // Внешние события, не принятые платформой из-за переполнения буфера событий.
+    std::atomic<uint64_t> droppedEvents;
+
+    LatencyHistogram decryptTime;
+    LatencyHistogram transcodeTime;
+    LatencyHistogram dispatchTime;
+
+    // Время доставки по отметкам времени сервиса (кадры протокола версии 2). Время в сети и полное
+    // время доставки сравнивают часы сервиса и клиента, поэтому включают их расхождение.
+    LatencyHistogram serverQueueTime;  // от приема сообщения сервисом до отправки клиенту
+    LatencyHistogram networkTime;      // от отправки сервисом до получения компонентой
+    LatencyHistogram clientTime;       // от получения компонентой до передачи в 1С
+    LatencyHistogram deliveryTime;     // от приема сообщения сервисом до передачи в 1С
+
+    // Дописывает счетчики и гистограммы в виде свойств объекта JSON (без фигурных скобок).
+    void Serialize(std::string& out) const;
+private:
+    ComponentStats(const ComponentStats&);
+    ComponentStats& operator = (const ComponentStats&);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// class StatsTimer
+// Замеряет время от создания до вызова Stop() и записывает его в гистограмму.
+class StatsTimer
+{
+public:
+    explicit StatsTimer(LatencyHistogram& histogram) :
+        m_histogram(histogram), m_start(std::chrono::steady_clock::now()) { }
+
+    void Stop()
+    {
+        m_histogram.Record((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - m_start).count());
+    }
+private:
+    LatencyHistogram& m_histogram;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+#endif //__STATS_H__
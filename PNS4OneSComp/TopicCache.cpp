@@ -0,0 +1,132 @@
+#include "TopicCache.h"
+#include "ConversionWchar.h"
+#include "Json.h"
+
+TopicCache::TopicCache() : m_allTopics(false), m_maxBytes(0), m_usedBytes(0)
+{ }
+
+void TopicCache::Configure(const std::vector<std::string>& topics, size_t maxBytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_allowedTopics.clear();
+    m_allTopics = false;
+    for (const auto& topic : topics) {
+        if (topic == "*")
+            m_allTopics = true;
+        else
+            m_allowedTopics.insert(topic);
+    }
+    m_maxBytes = maxBytes;
+
+    // Удаляются темы, которые больше не разрешены, и лишнее сверх нового лимита.
+    for (auto it = m_entries.begin(); it != m_entries.end(); ) {
+        if (!allowed(it->first)) {
+            m_usedBytes -= it->second.message.size() * sizeof(WCHAR_T);
+            m_lru.erase(it->second.lruPos);
+            it = m_entries.erase(it);
+        }
+        else
+            ++it;
+    }
+    evict();
+}
+
+bool TopicCache::IsEnabled()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_maxBytes > 0 && (m_allTopics || !m_allowedTopics.empty());
+}
+
+void TopicCache::Put(const std::string& topic, const WCHAR_T* message, size_t len)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    size_t messageBytes = len * sizeof(WCHAR_T);
+    if (topic.empty() || !allowed(topic) || messageBytes > m_maxBytes)
+        return;
+
+    auto it = m_entries.find(topic);
+    if (it == m_entries.end()) {
+        m_lru.push_back(topic);
+        Entry entry;
+        entry.lruPos = --m_lru.end();
+        it = m_entries.insert(std::make_pair(topic, entry)).first;
+    }
+    else {
+        m_usedBytes -= it->second.message.size() * sizeof(WCHAR_T);
+        m_lru.splice(m_lru.end(), m_lru, it->second.lruPos);
+    }
+
+    it->second.message.assign(message, message + len);
+    m_usedBytes += messageBytes;
+
+    evict();
+}
+
+bool TopicCache::Get(const std::string& topic, std::vector<WCHAR_T>& message)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_entries.find(topic);
+    if (it == m_entries.end())
+        return false;
+
+    message.assign(it->second.message.begin(), it->second.message.end());
+    message.push_back(0);
+    return true;
+}
+
+void TopicCache::GetAll(std::vector<WCHAR_T>& result)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    result.clear();
+    result.push_back((WCHAR_T)'{');
+
+    std::string topicJson;
+    bool first = true;
+    for (const auto& entry : m_entries) {
+        if (!first)
+            result.push_back((WCHAR_T)',');
+        first = false;
+
+        topicJson.clear();
+        JsonWriteString(topicJson, entry.first);
+
+        WCHAR_T* topicWchar = nullptr;
+        size_t topicLen = convFromUtf8ToShortWchar(&topicWchar, topicJson.c_str());
+        result.insert(result.end(), topicWchar, topicWchar + topicLen);
+        delete[] topicWchar;
+
+        result.push_back((WCHAR_T)':');
+        result.insert(result.end(), entry.second.message.begin(), entry.second.message.end());
+    }
+
+    result.push_back((WCHAR_T)'}');
+    result.push_back(0);
+}
+
+void TopicCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_entries.clear();
+    m_lru.clear();
+    m_usedBytes = 0;
+}
+
+bool TopicCache::allowed(const std::string& topic) const
+{
+    return m_allTopics || m_allowedTopics.count(topic) > 0;
+}
+
+void TopicCache::evict()
+{
+    while (m_usedBytes > m_maxBytes && !m_lru.empty()) {
+        auto it = m_entries.find(m_lru.front());
+        m_usedBytes -= it->second.message.size() * sizeof(WCHAR_T);
+        m_entries.erase(it);
+        m_lru.pop_front();
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef __TOPICCACHE_H__
+#define __TOPICCACHE_H__
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include "include/types.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// class TopicCache
+// Хранит последнее полученное сообщение по каждой теме, чтобы при открытии формы
+// сразу получить текущее состояние темы без обращения к серверу 1С.
+// Кешируются только темы из списка разрешенных ("*" - все темы). Когда суммарный
+// размер сообщений превышает лимит, удаляются темы, которые дольше всех не обновлялись.
+class TopicCache
+{
+public:
+    TopicCache();
+
+    void Configure(const std::vector<std::string>& topics, size_t maxBytes);
+    bool IsEnabled();
+    void Put(const std::string& topic, const WCHAR_T* message, size_t len);
+    // Возвращает false, если по теме сообщений нет. Сообщение помещается в message с завершающим нулем.
+    bool Get(const std::string& topic, std::vector<WCHAR_T>& message);
+    // Формирует JSON-объект вида {"<тема>": <сообщение>, ...} с завершающим нулем.
+    void GetAll(std::vector<WCHAR_T>& result);
+    void Clear();
+private:
+    TopicCache(const TopicCache&);
+    TopicCache& operator = (const TopicCache&);
+
+    struct Entry
+    {
+        std::vector<WCHAR_T> message;
+        std::list<std::string>::iterator lruPos;
+    };
+
+    bool allowed(const std::string& topic) const;
+    void evict();
+
+    std::mutex m_mutex;
+    std::set<std::string> m_allowedTopics;
+    bool m_allTopics;
+    size_t m_maxBytes;
+    size_t m_usedBytes;
+    std::map<std::string, Entry> m_entries;
+    std::list<std::string> m_lru; // Темы в порядке обновления, последние - в конце.
+};
+
+#endif //__TOPICCACHE_H__
@@ -1,78 +1,222 @@
 #include <cstring>
+#include "base64.h"
 
-int base64_isvalidchar(char c)
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define BASE64_SSSE3
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define BASE64_TARGET_SSSE3
+#else
+#define BASE64_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+#endif
+
+static const char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Значения символов алфавита, 0xFF - символ не входит в алфавит.
+struct Base64DecodeTable
+{
+	Base64DecodeTable()
+	{
+		memset(values, 0xFF, sizeof(values));
+		for (int i = 0; i < 64; i++)
+			values[(unsigned char)base64_alphabet[i]] = (unsigned char)i;
+	}
+
+	unsigned char values[256];
+};
+
+static const Base64DecodeTable base64_table;
+
+#ifdef BASE64_SSSE3
+
+static bool base64_cpu_has_ssse3()
 {
-	if (c >= '0' && c <= '9')
-		return 1;
-	if (c >= 'A' && c <= 'Z')
-		return 1;
-	if (c >= 'a' && c <= 'z')
-		return 1;
-	if (c == '+' || c == '/' || c == '=')
-		return 1;
-	return 0;
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 9)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("ssse3") != 0;
+#endif
 }
 
-size_t base64_decoded_size(const char* base64)
+static bool base64_use_ssse3()
 {
-	size_t len, ret, i;
+	static const bool supported = base64_cpu_has_ssse3();
+	return supported;
+}
 
-	if (base64 == NULL)
-		return 0;
+// 12 байт из 16 загруженных -> 16 символов. Значения 6-битных групп получаются умножением
+// (W. Mula, D. Lemire. Faster Base64 Encoding and Decoding Using AVX2 Instructions).
+BASE64_TARGET_SSSE3
+static size_t base64_encode_ssse3(const unsigned char* data, size_t size, char* out)
+{
+	const __m128i shuffle = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	const __m128i shiftLut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
 
-	len = strlen(base64);
-	ret = len / 4 * 3;
+	size_t i = 0;
+	char* pos = out;
+	for (; size - i >= 16; i += 12, pos += 16) {
+		__m128i in = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i)), shuffle);
+		__m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+		__m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+		__m128i indices = _mm_or_si128(t0, t1);
 
-	for (i = len; i-- > 0; )
-	{
-		if (base64[i] == '=')
-			ret--;
-		else
+		// 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12: номер смещения в shiftLut.
+		__m128i reduced = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+		__m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+		reduced = _mm_or_si128(reduced, _mm_and_si128(less, _mm_set1_epi8(13)));
+		__m128i chars = _mm_add_epi8(_mm_shuffle_epi8(shiftLut, reduced), indices);
+		_mm_storeu_si128((__m128i*)pos, chars);
+	}
+	return i;
+}
+
+// 16 символов -> 12 байт. Возвращает количество обработанных символов; обработка прекращается
+// на первом блоке с символом вне алфавита (в том числе '='), он проверяется по таблице.
+BASE64_TARGET_SSSE3
+static size_t base64_decode_ssse3(const char* base64, size_t len, unsigned char* out)
+{
+	const __m128i shiftLut = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	// Для младшей половины байта - допустимые значения старшей половины (бит номер старшей половины).
+	const __m128i maskLut = _mm_setr_epi8((char)0xA8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8,
+		(char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF0, 0x54, 0x50, 0x50, 0x50, 0x54);
+	const __m128i bitLut = _mm_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+	size_t i = 0;
+	unsigned char* pos = out;
+	// Последний блок может содержать дополнение и всегда декодируется по таблице.
+	for (; len - i > 16; i += 16, pos += 12) {
+		__m128i in = _mm_loadu_si128((const __m128i*)(base64 + i));
+		__m128i hi = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0F));
+		__m128i lo = _mm_and_si128(in, _mm_set1_epi8(0x0F));
+
+		__m128i allowed = _mm_and_si128(_mm_shuffle_epi8(maskLut, lo), _mm_shuffle_epi8(bitLut, hi));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(allowed, _mm_setzero_si128())) != 0)
 			break;
+
+		// '+' и '/' имеют одну старшую половину: для '/' смещение 16 вместо 19.
+		__m128i shift = _mm_add_epi8(_mm_shuffle_epi8(shiftLut, hi),
+			_mm_and_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('/')), _mm_set1_epi8(-3)));
+		__m128i values = _mm_add_epi8(in, shift);
+
+		__m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+		merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+		__m128i bytes = _mm_shuffle_epi8(merged, pack);
+
+		unsigned char block[16];
+		_mm_storeu_si128((__m128i*)block, bytes);
+		memcpy(pos, block, 12);
 	}
+	return i;
+}
 
-	return ret;
+#endif
+
+size_t base64_encoded_size(size_t size)
+{
+	return (size + 2) / 3 * 4;
 }
 
-int base64_decode(const char* base64, unsigned char* out, size_t size)
+void base64_encode(const unsigned char* data, size_t size, char* out)
 {
-	size_t len, i, j;
-	int v;
-	int b64invs[] =
-	{
-		62, -1, -1, -1, 63, 52, 53, 54, 55, 56, 57, 58,
-		59, 60, 61, -1, -1, -1, -1, -1, -1, -1, 0, 1, 2, 3, 4, 5,
-		6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20,
-		21, 22, 23, 24, 25, -1, -1, -1, -1, -1, -1, 26, 27, 28,
-		29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42,
-		43, 44, 45, 46, 47, 48, 49, 50, 51
-	};
+	size_t i = 0;
+#ifdef BASE64_SSSE3
+	if (base64_use_ssse3()) {
+		i = base64_encode_ssse3(data, size, out);
+		out += i / 3 * 4;
+	}
+#endif
 
-	if (base64 == NULL || out == NULL)
+	for (; size - i >= 3; i += 3, out += 4) {
+		unsigned int v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+		out[0] = base64_alphabet[v >> 18];
+		out[1] = base64_alphabet[(v >> 12) & 0x3F];
+		out[2] = base64_alphabet[(v >> 6) & 0x3F];
+		out[3] = base64_alphabet[v & 0x3F];
+	}
+
+	if (i < size) {
+		unsigned int v = data[i] << 16;
+		if (i + 1 < size)
+			v |= data[i + 1] << 8;
+		out[0] = base64_alphabet[v >> 18];
+		out[1] = base64_alphabet[(v >> 12) & 0x3F];
+		out[2] = i + 1 < size ? base64_alphabet[(v >> 6) & 0x3F] : '=';
+		out[3] = '=';
+	}
+}
+
+size_t base64_decoded_size(const char* base64, size_t len)
+{
+	if (base64 == NULL || len % 4 != 0)
 		return 0;
 
-	len = strlen(base64);
-	if (size < base64_decoded_size(base64) || len % 4 != 0)
+	size_t ret = len / 4 * 3;
+	if (len > 0 && base64[len - 1] == '=')
+		ret--;
+	if (len > 1 && base64[len - 2] == '=')
+		ret--;
+	return ret;
+}
+
+int base64_decode_n(const char* base64, size_t len, unsigned char* out, size_t size, size_t* outSize)
+{
+	if (base64 == NULL || (out == NULL && len > 0) || len % 4 != 0)
 		return 0;
 
-	for (i = 0; i < len; i++) {
-		if (!base64_isvalidchar(base64[i])) {
-			return 0;
-		}
+	size_t decodedSize = base64_decoded_size(base64, len);
+	if (size < decodedSize)
+		return 0;
+
+	size_t i = 0;
+	unsigned char* pos = out;
+#ifdef BASE64_SSSE3
+	if (base64_use_ssse3() && len > 16) {
+		i = base64_decode_ssse3(base64, len, out);
+		pos += i / 4 * 3;
 	}
+#endif
 
-	for (i = 0, j = 0; i < len; i += 4, j += 3) {
-		v = b64invs[base64[i] - 43];
-		v = (v << 6) | b64invs[base64[i + 1] - 43];
-		v = base64[i + 2] == '=' ? v << 6 : (v << 6) | b64invs[base64[i + 2] - 43];
-		v = base64[i + 3] == '=' ? v << 6 : (v << 6) | b64invs[base64[i + 3] - 43];
-
-		out[j] = (v >> 16) & 0xFF;
-		if (base64[i + 2] != '=')
-			out[j + 1] = (v >> 8) & 0xFF;
-		if (base64[i + 3] != '=')
-			out[j + 2] = v & 0xFF;
+	const unsigned char* values = base64_table.values;
+	for (; i < len; i += 4) {
+		unsigned char a = values[(unsigned char)base64[i]];
+		unsigned char b = values[(unsigned char)base64[i + 1]];
+		unsigned char c = values[(unsigned char)base64[i + 2]];
+		unsigned char d = values[(unsigned char)base64[i + 3]];
+
+		// Дополнение допускается только в последнем блоке: "xx==" или "xxx=".
+		bool last = i + 4 == len;
+		if (last && base64[i + 3] == '=') {
+			d = 0;
+			if (base64[i + 2] == '=')
+				c = 0;
+		}
+		if ((a | b | c | d) > 63)
+			return 0;
+
+		unsigned int v = (a << 18) | (b << 12) | (c << 6) | d;
+		*pos++ = (unsigned char)(v >> 16);
+		if (!last || base64[i + 2] != '=')
+			*pos++ = (unsigned char)(v >> 8);
+		if (!last || base64[i + 3] != '=')
+			*pos++ = (unsigned char)v;
 	}
 
+	if (outSize)
+		*outSize = (size_t)(pos - out);
 	return 1;
 }
+
+int base64_decode(const char* base64, unsigned char* out, size_t size)
+{
+	if (base64 == NULL || out == NULL)
+		return 0;
+
+	return base64_decode_n(base64, strlen(base64), out, size, NULL);
+}
@@ -3,6 +3,22 @@
 
 #include <cstddef>
 
+// Стандартный алфавит base64 с дополнением '='. На процессорах x86 с SSSE3 кодирование и декодирование
+// выполняются по 16 символов за шаг, на остальных - по таблице.
+
+// Декодирует строку, заканчивающуюся нулем. Возвращает 0, если строка некорректна или буфер мал.
 int base64_decode(const char* base64, unsigned char* out, size_t size);
 
+// Размер данных (с учетом дополнения) текста base64 длины len; 0, если длина не кратна 4.
+size_t base64_decoded_size(const char* base64, size_t len);
+// Декодирует текст base64 длины len в out размера size. Возвращает 0, если текст некорректен
+// или буфер мал, иначе 1 и размер данных в outSize.
+int base64_decode_n(const char* base64, size_t len, unsigned char* out, size_t size, size_t* outSize);
+
+// Длина текста base64 для size байт данных.
+size_t base64_encoded_size(size_t size);
+// Кодирует size байт в out, который должен вмещать base64_encoded_size(size) символов.
+// Завершающий ноль не записывается.
+void base64_encode(const unsigned char* data, size_t size, char* out);
+
 #endif //__BASE64_H__
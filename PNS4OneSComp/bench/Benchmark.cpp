@@ -0,0 +1,369 @@
+// Микротесты производительности основных операций компоненты: расшифровка, подпись, base64,
+// преобразование UTF-8 <-> UTF-16 и разбор заголовка кадра. Размеры данных от 64 байт до 10 МБ,
+// тексты - латиница, кириллица и смесь с эмодзи.
+//
+// Запуск: pns4onescomp_bench [--filter подстрока] [--min-time мс] [--max-size байт]
+//                            [--json файл] [--baseline файл]
+//  --json     - сохранить результаты в JSON для последующего сравнения;
+//  --baseline - сравнить с ранее сохраненными результатами (изменение времени операции в процентах).
+//
+// Учитываются выделения памяти через operator new (память, выделяемая OpenSSL через malloc, не учитывается).
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../ConversionWchar.h"
+#include "../FrameHeader.h"
+#include "../Json.h"
+#include "../base64.h"
+#include "../crypt.h"
+#include "TestData.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Подсчет выделений памяти
+
+static size_t g_allocCount = 0;
+static size_t g_allocBytes = 0;
+
+void* operator new(size_t size)
+{
+    g_allocCount++;
+    g_allocBytes += size;
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Выполнение и результаты
+
+struct BenchOptions
+{
+    BenchOptions() : minTimeMs(200), maxSize(10 * 1024 * 1024) { }
+
+    std::string filter;
+    long minTimeMs;
+    size_t maxSize;
+    std::string jsonPath;
+    std::string baselinePath;
+};
+
+struct BenchResult
+{
+    std::string name;
+    size_t bytes;
+    uint64_t iterations;
+    double nsPerOp;
+    double mbPerSec;
+    double allocsPerOp;
+    double allocBytesPerOp;
+};
+
+// Выполняет операцию, удваивая число повторений, пока общее время не превысит minTimeMs.
+static BenchResult RunBench(const std::string& name, size_t bytes, long minTimeMs, const std::function<void()>& op)
+{
+    op(); // прогрев
+
+    uint64_t iterations = 1;
+    double elapsedNs = 0;
+    size_t allocCount = 0, allocBytes = 0;
+    for (;;) {
+        size_t startCount = g_allocCount, startBytes = g_allocBytes;
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; i++)
+            op();
+        elapsedNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        allocCount = g_allocCount - startCount;
+        allocBytes = g_allocBytes - startBytes;
+
+        if (elapsedNs >= minTimeMs * 1e6 || iterations >= ((uint64_t)1 << 40))
+            break;
+
+        // Оценка числа повторений по прошедшему времени, но не более чем в 10 раз за шаг.
+        double factor = elapsedNs > 0 ? minTimeMs * 1e6 * 1.2 / elapsedNs : 10;
+        factor = std::max(2.0, std::min(10.0, factor));
+        iterations = (uint64_t)(iterations * factor);
+    }
+
+    BenchResult result;
+    result.name = name;
+    result.bytes = bytes;
+    result.iterations = iterations;
+    result.nsPerOp = elapsedNs / iterations;
+    result.mbPerSec = bytes ? bytes / (result.nsPerOp / 1e9) / (1024 * 1024) : 0;
+    result.allocsPerOp = (double)allocCount / iterations;
+    result.allocBytesPerOp = (double)allocBytes / iterations;
+    return result;
+}
+
+static std::string FormatNumber(double value, int precision)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", precision, value);
+    return buf;
+}
+
+static void WriteJson(const std::string& path, const std::vector<BenchResult>& results)
+{
+    std::string out = "{\"benchmarks\":[";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        if (i)
+            out.push_back(',');
+        out.append("\n{\"name\":");
+        JsonWriteString(out, r.name);
+        out.append(",\"bytes\":" + std::to_string(r.bytes));
+        out.append(",\"iterations\":" + std::to_string(r.iterations));
+        out.append(",\"nsPerOp\":" + FormatNumber(r.nsPerOp, 1));
+        out.append(",\"mbPerSec\":" + FormatNumber(r.mbPerSec, 1));
+        out.append(",\"allocsPerOp\":" + FormatNumber(r.allocsPerOp, 2));
+        out.append(",\"allocBytesPerOp\":" + FormatNumber(r.allocBytesPerOp, 0));
+        out.push_back('}');
+    }
+    out.append("\n]}\n");
+
+    std::ofstream file(path, std::ios::binary);
+    file << out;
+}
+
+// Загружает время операции из ранее сохраненных результатов: имя -> нс/операцию.
+static bool LoadBaseline(const std::string& path, std::vector<std::pair<std::string, double> >& baseline)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    std::stringstream content;
+    content << file.rdbuf();
+    std::string text = content.str();
+
+    JsonValue root;
+    if (!JsonValue::Parse(text.c_str(), text.size(), root) || !root.IsObject())
+        return false;
+    const JsonValue* benchmarks = root.Find("benchmarks");
+    if (!benchmarks || benchmarks->GetType() != JsonValue::eArray)
+        return false;
+
+    for (const JsonValue& item : benchmarks->GetArray()) {
+        const JsonValue* name = item.Find("name");
+        const JsonValue* nsPerOp = item.Find("nsPerOp");
+        if (name && nsPerOp && name->IsString() && nsPerOp->GetType() == JsonValue::eNumber)
+            baseline.push_back(std::make_pair(name->GetString(), atof(nsPerOp->GetString().c_str())));
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Тестовые данные
+
+// JSON-сообщение сервиса размером около size байт (расшифровка проверяет первый символ "{").
+static std::string MakeMessage(size_t size)
+{
+    std::string message = "{\"topic\":\"bench\",\"data\":{\"text\":\"";
+    std::string tail = "\"}}";
+    if (size > message.size() + tail.size())
+        message.append(MakeText("ascii", size - message.size() - tail.size()));
+    message.append(tail);
+    return message;
+}
+
+// Кадр версии 2 со всеми полями заголовка, которые передает сервис.
+static std::vector<unsigned char> MakeBenchFrame()
+{
+    std::vector<unsigned char> fields;
+    std::string messageId = "6f1c2a7e-3b5d-4e8f-9a0b-1c2d3e4f5a6b";
+    std::string traceId = "bench-trace-0001";
+    AppendFrameField(fields, FRAME_FIELD_MESSAGE_ID, messageId.data(), messageId.size());
+    AppendFrameField(fields, FRAME_FIELD_EXPIRES_AT, (int64_t)4102444800000LL);
+    AppendFrameField(fields, FRAME_FIELD_INGESTED_AT, (int64_t)1767225600000LL);
+    AppendFrameField(fields, FRAME_FIELD_TRACE_ID, traceId.data(), traceId.size());
+    AppendFrameField(fields, FRAME_FIELD_SENT_AT, (int64_t)1767225600005LL);
+
+    unsigned char encrypted[64] = { 0 };
+    return MakeFrame(fields, sizeof(encrypted), encrypted, sizeof(encrypted));
+}
+
+static std::string SizeName(size_t size)
+{
+    if (size >= 1024 * 1024 && size % (1024 * 1024) == 0)
+        return std::to_string(size / (1024 * 1024)) + "M";
+    if (size >= 1024 && size % 1024 == 0)
+        return std::to_string(size / 1024) + "K";
+    return std::to_string(size);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--filter" && hasValue)
+            options.filter = argv[++i];
+        else if (arg == "--min-time" && hasValue)
+            options.minTimeMs = atol(argv[++i]);
+        else if (arg == "--max-size" && hasValue)
+            options.maxSize = (size_t)atoll(argv[++i]);
+        else if (arg == "--json" && hasValue)
+            options.jsonPath = argv[++i];
+        else if (arg == "--baseline" && hasValue)
+            options.baselinePath = argv[++i];
+        else {
+            fprintf(stderr, "usage: %s [--filter text] [--min-time ms] [--max-size bytes] [--json file] [--baseline file]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<std::pair<std::string, double> > baseline;
+    if (!options.baselinePath.empty() && !LoadBaseline(options.baselinePath, baseline)) {
+        fprintf(stderr, "cannot read baseline %s\n", options.baselinePath.c_str());
+        return 1;
+    }
+
+    const size_t allSizes[] = { 64, 1024, 16 * 1024, 256 * 1024, 1024 * 1024, 10 * 1024 * 1024 };
+    std::vector<size_t> sizes;
+    for (size_t size : allSizes) {
+        if (size <= options.maxSize)
+            sizes.push_back(size);
+    }
+    const char* mixes[] = { "ascii", "cyrillic", "emoji" };
+
+    unsigned char key[32], iv[16];
+    for (int i = 0; i < 32; i++)
+        key[i] = (unsigned char)(i * 7 + 1);
+    for (int i = 0; i < 16; i++)
+        iv[i] = (unsigned char)(i * 13 + 5);
+    AesKey aesKey;
+    aesKey.Key = key;
+    aesKey.KeySize = sizeof(key);
+    aesKey.IV = iv;
+    aesKey.IVSize = sizeof(iv);
+
+    std::vector<BenchResult> results;
+    auto run = [&](const std::string& name, size_t bytes, const std::function<void()>& op) {
+        if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+            return;
+        BenchResult result = RunBench(name, bytes, options.minTimeMs, op);
+
+        std::string compare;
+        for (const auto& item : baseline) {
+            if (item.first == name && item.second > 0) {
+                double change = (result.nsPerOp - item.second) / item.second * 100;
+                compare = (change >= 0 ? "  +" : "  ") + FormatNumber(change, 1) + "%";
+                break;
+            }
+        }
+        printf("%-32s %14s ns/op %10s MB/s %8s allocs/op %12s B/op%s\n",
+            name.c_str(),
+            FormatNumber(result.nsPerOp, 1).c_str(),
+            FormatNumber(result.mbPerSec, 1).c_str(),
+            FormatNumber(result.allocsPerOp, 2).c_str(),
+            FormatNumber(result.allocBytesPerOp, 0).c_str(),
+            compare.c_str());
+        fflush(stdout);
+        results.push_back(result);
+    };
+
+    for (size_t size : sizes) {
+        std::string message = MakeMessage(size);
+        unsigned char* encrypted = nullptr;
+        int encryptedSize = 0;
+        aes_encrypt((unsigned char*)message.data(), (int)message.size(), aesKey, &encrypted, &encryptedSize);
+        int decryptedSize = (int)message.size();
+        run("aes_decrypt/" + SizeName(size), message.size(), [&]() {
+            unsigned char* decrypted = nullptr;
+            aes_decrypt(encrypted, encryptedSize, aesKey, &decrypted, decryptedSize);
+            delete[] decrypted;
+        });
+        delete[] encrypted;
+
+        run("hmacsha256_sign/" + SizeName(size), message.size(), [&]() {
+            unsigned char* hash = nullptr;
+            int hashSize = 0;
+            hmacsha256_sign((unsigned char*)message.data(), (int)message.size(), key, sizeof(key), &hash, &hashSize);
+            delete[] hash;
+        });
+
+        std::string base64 = Base64Encode((const unsigned char*)message.data(), message.size());
+        std::vector<unsigned char> decoded(message.size());
+        run("base64_decode/" + SizeName(size), base64.size(), [&]() {
+            base64_decode(base64.c_str(), decoded.data(), decoded.size());
+        });
+
+        std::vector<char> encoded(base64_encoded_size(message.size()));
+        run("base64_encode/" + SizeName(size), message.size(), [&]() {
+            base64_encode((const unsigned char*)message.data(), message.size(), encoded.data());
+        });
+    }
+
+    for (const char* mix : mixes) {
+        for (size_t size : sizes) {
+            std::string text = MakeText(mix, size);
+            run(std::string("utf8_to_wchar/") + mix + "/" + SizeName(size), text.size(), [&]() {
+                WCHAR_T* wide = nullptr;
+                convFromUtf8ToShortWchar(&wide, text.c_str(), text.size() + 1);
+                delete[] wide;
+            });
+
+            WCHAR_T* wide = nullptr;
+            convFromUtf8ToShortWchar(&wide, text.c_str(), text.size() + 1);
+            size_t wideLen = getLenShortWcharStr(wide);
+            run(std::string("wchar_to_utf8/") + mix + "/" + SizeName(size), wideLen * sizeof(WCHAR_T), [&]() {
+                char* utf8 = nullptr;
+                convFromShortWcharToUtf8(&utf8, wide, wideLen + 1);
+                delete[] utf8;
+            });
+            delete[] wide;
+        }
+    }
+
+    std::vector<unsigned char> frame = MakeBenchFrame();
+    run("read_frame_header", frame.size(), [&]() {
+        unsigned char* data = frame.data();
+        int dataSize = (int)frame.size();
+        FrameHeader header;
+        ReadFrameHeader(&data, &dataSize, header);
+    });
+
+    if (!options.jsonPath.empty())
+        WriteJson(options.jsonPath, results);
+
+    return 0;
+}
@@ -0,0 +1,738 @@
+// Стенд для измерения пропускной способности и задержки доставки компоненты без платформы 1С и сервиса.
+// Загружает libpns4onescomp.so, вызывает компоненту через GetClassObject/IComponentBase как платформа,
+// а сообщения передает встроенный сервис (MockServer) по протоколу регистрации и зашифрованных кадров.
+//
+// Запуск: pns4onescomp_harness [--lib путь] [--messages N] [--size байт] [--rate сообщений/с]
+//                              [--burst N] [--traced] [--pull] [--handler-us мкс] [--event-buffer N]
+//                              [--idle-timeout мс] [--json файл]
+//                              [--record файл [--record-decrypted]] [--replay файл [--speed N]]
+//  --rate         - темп отправки, 0 - без ограничения;
+//  --burst        - количество сообщений, передаваемых подряд без пауз;
+//  --traced       - передавать идентификатор трассировки и отметки времени в заголовке кадра;
+//  --pull         - режим опроса (ОжидатьСообщения) вместо внешних событий;
+//  --handler-us   - время обработки одного сообщения обработчиком 1С;
+//  --event-buffer - глубина буфера внешних событий (по умолчанию задается компонентой);
+//  --record       - записать полученные кадры в файл (с --record-decrypted - расшифрованные сообщения);
+//  --replay       - воспроизвести запись без сервиса со скоростью --speed (1 - исходная, 0 - без пауз).
+//                   Записи зашифрованных кадров воспроизводятся с ключом клиента стенда.
+//
+// Задержка доставки - от отправки кадра сервисом до вызова ExternalEvent (передача в 1С)
+// и до окончания обработки сообщения.
+
+#include <dlfcn.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../include/ComponentBase.h"
+#include "../include/AddInDefBase.h"
+#include "../include/IMemoryManager.h"
+#include "../ConversionWchar.h"
+#include "../Json.h"
+#include "MockServer.h"
+#include "TestData.h"
+
+#ifndef PNS4ONES_COMPONENT_PATH
+#define PNS4ONES_COMPONENT_PATH "libpns4onescomp.so"
+#endif
+
+typedef std::chrono::steady_clock::time_point TimePoint;
+
+static std::vector<WCHAR_T> ToWchar(const std::string& utf8)
+{
+    WCHAR_T* wchar = nullptr;
+    size_t len = convFromUtf8ToShortWchar(&wchar, utf8.c_str());
+    std::vector<WCHAR_T> result(wchar, wchar + len);
+    result.push_back(0);
+    delete[] wchar;
+    return result;
+}
+
+static std::string ToUtf8(const WCHAR_T* wchar)
+{
+    char* utf8 = nullptr;
+    convFromShortWcharToUtf8(&utf8, wchar);
+    std::string result(utf8);
+    delete[] utf8;
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Платформа: менеджер памяти, сведения о приложении и внешние события
+
+class HarnessMemory : public IMemoryManager
+{
+public:
+    bool ADDIN_API AllocMemory(void** pMemory, unsigned long ulCountByte) override
+    {
+        *pMemory = malloc(ulCountByte);
+        return *pMemory != nullptr;
+    }
+
+    void ADDIN_API FreeMemory(void** pMemory) override
+    {
+        free(*pMemory);
+        *pMemory = nullptr;
+    }
+};
+
+class HarnessPlatformInfo : public IPlatformInfo
+{
+public:
+    HarnessPlatformInfo()
+    {
+        m_appInfo.AppVersion = nullptr;
+        m_appInfo.UserAgentInformation = nullptr;
+        m_appInfo.Application = eAppThinClient;
+    }
+
+    const AppInfo* ADDIN_API GetPlatformInfo() override { return &m_appInfo; }
+private:
+    AppInfo m_appInfo;
+};
+
+// Событие, принятое платформой: данные сообщения и время вызова ExternalEvent.
+struct HarnessEvent
+{
+    std::vector<WCHAR_T> data;
+    TimePoint acceptedAt;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// class HarnessHost
+// Платформа 1С для компоненты. Внешние события помещаются в буфер ограниченной глубины
+// (как в платформе: при переполнении ExternalEvent возвращает false) и обрабатываются
+// основным потоком стенда, имитирующим обработчик ВнешнееСобытие.
+class HarnessHost : public IAddInDefBaseEx
+{
+public:
+    HarnessHost() : m_eventBufferDepth(1000), m_fixedDepth(false), m_stopping(false), m_rejected(0) { }
+
+    void FixEventBufferDepth(long depth)
+    {
+        m_eventBufferDepth = depth;
+        m_fixedDepth = true;
+    }
+
+    bool ADDIN_API AddError(unsigned short wcode, const WCHAR_T* source, const WCHAR_T* descr, long scode) override
+    {
+        fprintf(stderr, "component error: %s\n", descr ? ToUtf8(descr).c_str() : "");
+        return true;
+    }
+
+    bool ADDIN_API Read(WCHAR_T* wszPropName, tVariant* pVal, long* pErrCode, WCHAR_T** errDescriptor) override
+    {
+        return false;
+    }
+
+    bool ADDIN_API Write(WCHAR_T* wszPropName, tVariant* pVar) override { return false; }
+    bool ADDIN_API RegisterProfileAs(WCHAR_T* wszProfileName) override { return false; }
+
+    bool ADDIN_API SetEventBufferDepth(long lDepth) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_fixedDepth)
+            m_eventBufferDepth = lDepth;
+        return true;
+    }
+
+    long ADDIN_API GetEventBufferDepth() override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_eventBufferDepth;
+    }
+
+    bool ADDIN_API ExternalEvent(WCHAR_T* wszSource, WCHAR_T* wszMessage, WCHAR_T* wszData) override
+    {
+        TimePoint acceptedAt = std::chrono::steady_clock::now();
+        // События изменения состояния соединения не относятся к сообщениям и не учитываются стендом.
+        if (wszMessage && ToUtf8(wszMessage) == "statechange")
+            return true;
+        size_t len = wszData ? getLenShortWcharStr(wszData) : 0;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if ((long)m_events.size() >= m_eventBufferDepth) {
+            m_rejected++;
+            return false;
+        }
+
+        HarnessEvent event;
+        event.data.assign(wszData, wszData + len);
+        event.data.push_back(0);
+        event.acceptedAt = acceptedAt;
+        m_events.push_back(std::move(event));
+        m_cond.notify_one();
+        return true;
+    }
+
+    void ADDIN_API CleanEventBuffer() override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_events.clear();
+    }
+
+    bool ADDIN_API SetStatusLine(WCHAR_T* wszStatusLine) override { return true; }
+    void ADDIN_API ResetStatusLine() override { }
+
+    IInterface* ADDIN_API GetInterface(Interfaces iface) override
+    {
+        return iface == eIPlatformInfo ? &m_platformInfo : nullptr;
+    }
+
+    // Забирает следующее событие. Возвращает false, если событий нет в течение timeoutMs или стенд остановлен.
+    bool WaitEvent(long timeoutMs, HarnessEvent& event)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+            [this] { return !m_events.empty() || m_stopping; });
+        if (m_events.empty())
+            return false;
+        event = std::move(m_events.front());
+        m_events.pop_front();
+        return true;
+    }
+
+    void Stop()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        m_cond.notify_all();
+    }
+
+    size_t RejectedCount()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_rejected;
+    }
+private:
+    HarnessPlatformInfo m_platformInfo;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<HarnessEvent> m_events;
+    long m_eventBufferDepth;
+    bool m_fixedDepth;
+    bool m_stopping;
+    size_t m_rejected;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Вызов методов компоненты
+
+class ComponentClient
+{
+public:
+    explicit ComponentClient(IComponentBase* component, IMemoryManager* memory) :
+        m_component(component), m_memory(memory) { }
+
+    long FindMethod(const char* name)
+    {
+        return m_component->FindMethod(ToWchar(name).data());
+    }
+
+    // Вызывает функцию со строковыми параметрами и возвращает результат в tVariant
+    // (строка результата освобождается вызывающим через FreeResult).
+    bool CallWithStrings(const char* name, const std::vector<std::string>& params, tVariant& result)
+    {
+        std::vector<std::vector<WCHAR_T> > strings;
+        std::vector<tVariant> variants(params.size());
+        for (size_t i = 0; i < params.size(); i++) {
+            strings.push_back(ToWchar(params[i]));
+            memset(&variants[i], 0, sizeof(tVariant));
+            TV_VT(&variants[i]) = VTYPE_PWSTR;
+            variants[i].pwstrVal = strings.back().data();
+            variants[i].wstrLen = (uint32_t)(strings.back().size() - 1);
+        }
+        return Call(name, variants, result);
+    }
+
+    bool Call(const char* name, std::vector<tVariant>& params, tVariant& result)
+    {
+        memset(&result, 0, sizeof(result));
+        long method = FindMethod(name);
+        if (method < 0)
+            return false;
+        tVariant* paParams = params.empty() ? nullptr : params.data();
+        if (m_component->HasRetVal(method))
+            return m_component->CallAsFunc(method, &result, paParams, (long)params.size());
+        return m_component->CallAsProc(method, paParams, (long)params.size());
+    }
+
+    bool GetBoolProp(const char* name)
+    {
+        long prop = m_component->FindProp(ToWchar(name).data());
+        tVariant variant;
+        memset(&variant, 0, sizeof(variant));
+        return prop >= 0 && m_component->GetPropVal(prop, &variant)
+            && TV_VT(&variant) == VTYPE_BOOL && TV_BOOL(&variant);
+    }
+
+    bool SetBoolProp(const char* name, bool value)
+    {
+        long prop = m_component->FindProp(ToWchar(name).data());
+        if (prop < 0)
+            return false;
+        tVariant variant;
+        memset(&variant, 0, sizeof(variant));
+        TV_VT(&variant) = VTYPE_BOOL;
+        TV_BOOL(&variant) = value;
+        return m_component->SetPropVal(prop, &variant);
+    }
+
+    std::string ResultString(tVariant& result)
+    {
+        std::string value;
+        if (TV_VT(&result) == VTYPE_PWSTR && result.pwstrVal) {
+            std::vector<WCHAR_T> wchar(result.pwstrVal, result.pwstrVal + result.wstrLen);
+            wchar.push_back(0);
+            value = ToUtf8(wchar.data());
+        }
+        FreeResult(result);
+        return value;
+    }
+
+    void FreeResult(tVariant& result)
+    {
+        if (TV_VT(&result) == VTYPE_PWSTR && result.pwstrVal)
+            m_memory->FreeMemory((void**)&result.pwstrVal);
+        TV_VT(&result) = VTYPE_EMPTY;
+    }
+private:
+    IComponentBase* m_component;
+    IMemoryManager* m_memory;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Результаты
+
+struct HarnessOptions
+{
+    HarnessOptions() :
+        libPath(PNS4ONES_COMPONENT_PATH), pullMode(false), handlerUs(0), eventBuffer(0), idleTimeoutMs(5000),
+        recordDecrypted(false), replaySpeed(0) { }
+
+    std::string libPath;
+    MockScenario scenario;
+    bool pullMode;
+    long handlerUs;
+    long eventBuffer;
+    long idleTimeoutMs;
+    std::string jsonPath;
+    std::string recordPath;
+    bool recordDecrypted;
+    std::string replayPath;
+    double replaySpeed;
+};
+
+// Номера сообщений (data.seq) в тексте события или пакета режима опроса.
+static void FindSequenceNumbers(const std::vector<WCHAR_T>& data, std::vector<size_t>& numbers)
+{
+    static const char pattern[] = "\"seq\":";
+    const size_t patternLen = sizeof(pattern) - 1;
+    for (size_t i = 0; i + patternLen < data.size(); i++) {
+        size_t j = 0;
+        while (j < patternLen && data[i + j] == (WCHAR_T)pattern[j])
+            j++;
+        if (j < patternLen)
+            continue;
+
+        size_t pos = i + patternLen;
+        size_t value = 0;
+        bool hasDigits = false;
+        while (pos < data.size() && data[pos] >= '0' && data[pos] <= '9') {
+            value = value * 10 + (data[pos] - '0');
+            hasDigits = true;
+            pos++;
+        }
+        if (hasDigits)
+            numbers.push_back(value);
+        i = pos - 1;
+    }
+}
+
+static void AppendPercentiles(std::string& out, const char* name, std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    auto percentile = [&](double fraction) {
+        if (values.empty())
+            return 0.0;
+        size_t index = std::min(values.size() - 1, (size_t)(values.size() * fraction));
+        return values[index];
+    };
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "\"%s\":{\"count\":%zu,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"max\":%.1f}",
+        name, values.size(), percentile(0.5), percentile(0.9), percentile(0.99),
+        values.empty() ? 0.0 : values.back());
+    out.append(buf);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static bool ParseOptions(int argc, char* argv[], HarnessOptions& options)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--lib" && hasValue)
+            options.libPath = argv[++i];
+        else if (arg == "--messages" && hasValue)
+            options.scenario.messages = (size_t)atoll(argv[++i]);
+        else if (arg == "--size" && hasValue)
+            options.scenario.messageSize = (size_t)atoll(argv[++i]);
+        else if (arg == "--rate" && hasValue)
+            options.scenario.rate = atof(argv[++i]);
+        else if (arg == "--burst" && hasValue)
+            options.scenario.burst = (size_t)atoll(argv[++i]);
+        else if (arg == "--traced")
+            options.scenario.traced = true;
+        else if (arg == "--pull")
+            options.pullMode = true;
+        else if (arg == "--handler-us" && hasValue)
+            options.handlerUs = atol(argv[++i]);
+        else if (arg == "--event-buffer" && hasValue)
+            options.eventBuffer = atol(argv[++i]);
+        else if (arg == "--idle-timeout" && hasValue)
+            options.idleTimeoutMs = atol(argv[++i]);
+        else if (arg == "--json" && hasValue)
+            options.jsonPath = argv[++i];
+        else if (arg == "--record" && hasValue)
+            options.recordPath = argv[++i];
+        else if (arg == "--record-decrypted")
+            options.recordDecrypted = true;
+        else if (arg == "--replay" && hasValue)
+            options.replayPath = argv[++i];
+        else if (arg == "--speed" && hasValue)
+            options.replaySpeed = atof(argv[++i]);
+        else
+            return false;
+    }
+    return options.scenario.messages > 0;
+}
+
+// Принимает сообщения из записи, воспроизводимой компонентой. Задержка доставки не рассчитывается:
+// время отправки сервисом относится к исходной доставке, поэтому выводятся пропускная способность
+// и статистика компоненты.
+static int RunReplay(ComponentClient& client, HarnessHost& host, const HarnessOptions& options,
+    const std::string& clientKey)
+{
+    std::vector<tVariant> params(3);
+    memset(params.data(), 0, sizeof(tVariant) * params.size());
+    std::vector<WCHAR_T> path = ToWchar(options.replayPath);
+    std::vector<WCHAR_T> key = ToWchar(clientKey);
+    TV_VT(&params[0]) = VTYPE_PWSTR;
+    params[0].pwstrVal = path.data();
+    params[0].wstrLen = (uint32_t)(path.size() - 1);
+    TV_VT(&params[1]) = VTYPE_R8;
+    TV_R8(&params[1]) = options.replaySpeed;
+    TV_VT(&params[2]) = VTYPE_PWSTR;
+    params[2].pwstrVal = key.data();
+    params[2].wstrLen = (uint32_t)(key.size() - 1);
+
+    tVariant result;
+    if (!client.Call("Replay", params, result) || TV_VT(&result) != VTYPE_BOOL || !TV_BOOL(&result)) {
+        fprintf(stderr, "cannot replay %s\n", options.replayPath.c_str());
+        return 1;
+    }
+
+    size_t receivedCount = 0, errorCount = 0;
+    std::vector<double> handleTimes;
+    TimePoint started = std::chrono::steady_clock::now();
+    TimePoint lastHandled = started;
+    for (;;) {
+        std::vector<WCHAR_T> data;
+        if (options.pullMode) {
+            std::vector<tVariant> waitParams(2);
+            memset(waitParams.data(), 0, sizeof(tVariant) * waitParams.size());
+            TV_VT(&waitParams[0]) = VTYPE_I4;
+            TV_I4(&waitParams[0]) = 100;
+            TV_VT(&waitParams[1]) = VTYPE_I4;
+            TV_I4(&waitParams[1]) = 0;
+            client.Call("WaitMessages", waitParams, result);
+            if (TV_VT(&result) == VTYPE_PWSTR && result.wstrLen > 2)
+                data.assign(result.pwstrVal, result.pwstrVal + result.wstrLen);
+            client.FreeResult(result);
+        }
+        else {
+            HarnessEvent event;
+            if (host.WaitEvent(100, event))
+                data = std::move(event.data);
+        }
+
+        if (data.empty()) {
+            // Воспроизведение завершено, и все переданные сообщения получены.
+            if (!client.GetBoolProp("Replaying"))
+                break;
+            continue;
+        }
+
+        std::vector<size_t> numbers;
+        FindSequenceNumbers(data, numbers);
+        if (numbers.empty())
+            errorCount++;
+        for (size_t i = 0; i < numbers.size(); i++) {
+            TimePoint handleStart = std::chrono::steady_clock::now();
+            if (options.handlerUs > 0)
+                std::this_thread::sleep_for(std::chrono::microseconds(options.handlerUs));
+            lastHandled = std::chrono::steady_clock::now();
+            handleTimes.push_back(std::chrono::duration<double, std::micro>(lastHandled - handleStart).count());
+            receivedCount++;
+        }
+    }
+
+    std::vector<tVariant> noParams;
+    std::string stats;
+    if (client.Call("GetStats", noParams, result))
+        stats = client.ResultString(result);
+
+    double seconds = receivedCount ? std::chrono::duration<double>(lastHandled - started).count() : 0;
+    double throughput = seconds > 0 ? receivedCount / seconds : 0;
+
+    char buf[512];
+    std::string out = "{";
+    snprintf(buf, sizeof(buf),
+        "\"replay\":true,\"speed\":%.2f,\"pullMode\":%s,\"handlerUs\":%ld,\"received\":%zu,\"errorEvents\":%zu,"
+        "\"rejectedEvents\":%zu,\"seconds\":%.3f,\"messagesPerSec\":%.1f,",
+        options.replaySpeed, options.pullMode ? "true" : "false", options.handlerUs, receivedCount, errorCount,
+        host.RejectedCount(), seconds, throughput);
+    out.append(buf);
+    AppendPercentiles(out, "handleTimeUs", handleTimes);
+    out.append(",\"componentStats\":");
+    JsonValue parsedStats;
+    if (!stats.empty() && JsonValue::Parse(stats.c_str(), stats.size(), parsedStats))
+        out.append(stats);
+    else
+        out.append("null");
+    out.append("}\n");
+
+    printf("replayed %zu messages, rejected events %zu\n", receivedCount, host.RejectedCount());
+    printf("throughput %.1f msg/s over %.3f s\n", throughput, seconds);
+    printf("%s", out.c_str());
+
+    if (!options.jsonPath.empty()) {
+        std::ofstream file(options.jsonPath, std::ios::binary);
+        file << out;
+    }
+
+    host.Stop();
+    return errorCount == 0 ? 0 : 3;
+}
+
+int main(int argc, char* argv[])
+{
+    HarnessOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        fprintf(stderr, "usage: %s [--lib path] [--messages N] [--size bytes] [--rate msg/s] [--burst N] [--traced]"
+            " [--pull] [--handler-us us] [--event-buffer N] [--idle-timeout ms] [--json file]"
+            " [--record file [--record-decrypted]] [--replay file [--speed N]]\n", argv[0]);
+        return 2;
+    }
+
+    // Библиотека не выгружается: поток прослушивания компоненты может завершаться после Done().
+    void* library = dlopen(options.libPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!library) {
+        fprintf(stderr, "cannot load %s: %s\n", options.libPath.c_str(), dlerror());
+        return 1;
+    }
+    auto getClassObject = (GetClassObjectPtr)dlsym(library, "GetClassObject");
+    auto destroyObject = (DestroyObjectPtr)dlsym(library, "DestroyObject");
+    auto setPlatformCapabilities = (SetPlatformCapabilitiesPtr)dlsym(library, "SetPlatformCapabilities");
+    if (!getClassObject || !destroyObject) {
+        fprintf(stderr, "%s is not a native add-in\n", options.libPath.c_str());
+        return 1;
+    }
+    if (setPlatformCapabilities)
+        setPlatformCapabilities(eAppCapabilitiesLast);
+
+    static HarnessMemory memory;
+    static HarnessHost host;
+    if (options.eventBuffer > 0)
+        host.FixEventBufferDepth(options.eventBuffer);
+
+    IComponentBase* component = nullptr;
+    getClassObject(ToWchar("PNS4OneSComp").data(), &component);
+    if (!component || !component->setMemManager(&memory) || !component->Init(&host)) {
+        fprintf(stderr, "cannot create component\n");
+        return 1;
+    }
+    ComponentClient client(component, &memory);
+    client.SetBoolProp("PullMode", options.pullMode);
+
+    unsigned char key[32], iv[16];
+    for (int i = 0; i < 32; i++)
+        key[i] = (unsigned char)(i * 11 + 3);
+    for (int i = 0; i < 16; i++)
+        iv[i] = (unsigned char)(i * 17 + 9);
+
+    if (!options.replayPath.empty()) {
+        int code = RunReplay(client, host, options, MakeClientKey(key, sizeof(key), iv, sizeof(iv)));
+        component->Done();
+        destroyObject(&component);
+        return code;
+    }
+
+    MockServer server(key, sizeof(key), iv, sizeof(iv));
+    int port = server.Listen();
+    if (!port) {
+        fprintf(stderr, "cannot start mock server\n");
+        return 1;
+    }
+
+    tVariant result;
+    client.CallWithStrings("Connect", { "127.0.0.1", std::to_string(port), "harness-app", "harness-ib",
+        "harness-user", "", MakeClientKey(key, sizeof(key), iv, sizeof(iv)) }, result);
+    MockRegistration registration;
+    if (TV_VT(&result) != VTYPE_BOOL || !TV_BOOL(&result) || !server.AcceptClient(5000, registration)) {
+        fprintf(stderr, "component did not register\n");
+        return 1;
+    }
+
+    server.Prepare(options.scenario);
+
+    if (!options.recordPath.empty()) {
+        std::vector<tVariant> params(2);
+        memset(params.data(), 0, sizeof(tVariant) * params.size());
+        std::vector<WCHAR_T> path = ToWchar(options.recordPath);
+        TV_VT(&params[0]) = VTYPE_PWSTR;
+        params[0].pwstrVal = path.data();
+        params[0].wstrLen = (uint32_t)(path.size() - 1);
+        TV_VT(&params[1]) = VTYPE_BOOL;
+        TV_BOOL(&params[1]) = options.recordDecrypted;
+        if (!client.Call("StartRecording", params, result) || !TV_BOOL(&result)) {
+            fprintf(stderr, "cannot start recording to %s\n", options.recordPath.c_str());
+            return 1;
+        }
+    }
+
+    // Время передачи в 1С и окончания обработки по номеру сообщения.
+    const size_t messages = options.scenario.messages;
+    std::vector<TimePoint> acceptedTimes(messages), handledTimes(messages);
+    std::vector<bool> received(messages, false);
+    size_t receivedCount = 0, duplicateCount = 0, errorCount = 0;
+    TimePoint lastHandled;
+
+    auto handle = [&](const std::vector<WCHAR_T>& data, TimePoint acceptedAt) {
+        std::vector<size_t> numbers;
+        FindSequenceNumbers(data, numbers);
+        if (numbers.empty())
+            errorCount++;
+        for (size_t seq : numbers) {
+            if (options.handlerUs > 0)
+                std::this_thread::sleep_for(std::chrono::microseconds(options.handlerUs));
+            if (seq >= messages)
+                continue;
+            if (received[seq]) {
+                duplicateCount++;
+                continue;
+            }
+            received[seq] = true;
+            receivedCount++;
+            acceptedTimes[seq] = acceptedAt;
+            handledTimes[seq] = lastHandled = std::chrono::steady_clock::now();
+        }
+    };
+
+    size_t sentCount = 0;
+    std::thread sender([&]() { sentCount = server.Run(); });
+    TimePoint started = std::chrono::steady_clock::now();
+
+    TimePoint lastProgress = started;
+    while (receivedCount < messages) {
+        size_t before = receivedCount;
+        if (options.pullMode) {
+            std::vector<tVariant> params(2);
+            memset(params.data(), 0, sizeof(tVariant) * params.size());
+            TV_VT(&params[0]) = VTYPE_I4;
+            TV_I4(&params[0]) = 100;
+            TV_VT(&params[1]) = VTYPE_I4;
+            TV_I4(&params[1]) = 0;
+            client.Call("WaitMessages", params, result);
+            TimePoint acceptedAt = std::chrono::steady_clock::now();
+            if (TV_VT(&result) == VTYPE_PWSTR && result.wstrLen > 2) {
+                std::vector<WCHAR_T> batch(result.pwstrVal, result.pwstrVal + result.wstrLen);
+                handle(batch, acceptedAt);
+            }
+            client.FreeResult(result);
+        }
+        else {
+            HarnessEvent event;
+            if (host.WaitEvent(100, event))
+                handle(event.data, event.acceptedAt);
+        }
+
+        TimePoint now = std::chrono::steady_clock::now();
+        if (receivedCount != before)
+            lastProgress = now;
+        else if (now - lastProgress > std::chrono::milliseconds(options.idleTimeoutMs))
+            break;
+    }
+    sender.join();
+
+    std::vector<tVariant> noParams;
+    std::string stats;
+    if (client.Call("GetStats", noParams, result))
+        stats = client.ResultString(result);
+
+    client.Call("StopRecording", noParams, result);
+    client.Call("Shutdown", noParams, result);
+    server.Close();
+    host.Stop();
+    component->Done();
+    destroyObject(&component);
+
+    std::vector<double> dispatchLatency, handleLatency;
+    dispatchLatency.reserve(receivedCount);
+    handleLatency.reserve(receivedCount);
+    for (size_t seq = 0; seq < messages; seq++) {
+        if (!received[seq])
+            continue;
+        TimePoint sentAt = server.SentTime(seq);
+        dispatchLatency.push_back(std::chrono::duration<double, std::micro>(acceptedTimes[seq] - sentAt).count());
+        handleLatency.push_back(std::chrono::duration<double, std::micro>(handledTimes[seq] - sentAt).count());
+    }
+
+    double seconds = receivedCount ? std::chrono::duration<double>(lastHandled - started).count() : 0;
+    double throughput = seconds > 0 ? receivedCount / seconds : 0;
+
+    char buf[512];
+    std::string out = "{";
+    snprintf(buf, sizeof(buf),
+        "\"messages\":%zu,\"messageSize\":%zu,\"rate\":%.1f,\"burst\":%zu,\"traced\":%s,\"pullMode\":%s,"
+        "\"handlerUs\":%ld,\"sent\":%zu,\"received\":%zu,\"lost\":%zu,\"duplicates\":%zu,\"errorEvents\":%zu,"
+        "\"rejectedEvents\":%zu,\"seconds\":%.3f,\"messagesPerSec\":%.1f,\"bytesSent\":%zu,",
+        messages, options.scenario.messageSize, options.scenario.rate, options.scenario.burst,
+        options.scenario.traced ? "true" : "false", options.pullMode ? "true" : "false",
+        options.handlerUs, sentCount, receivedCount, messages - receivedCount, duplicateCount, errorCount,
+        host.RejectedCount(), seconds, throughput, server.BytesSent());
+    out.append(buf);
+    AppendPercentiles(out, "dispatchLatencyUs", dispatchLatency);
+    out.push_back(',');
+    AppendPercentiles(out, "handleLatencyUs", handleLatency);
+    out.append(",\"componentStats\":");
+    JsonValue parsedStats;
+    if (!stats.empty() && JsonValue::Parse(stats.c_str(), stats.size(), parsedStats))
+        out.append(stats);
+    else
+        out.append("null");
+    out.append("}\n");
+
+    printf("sent %zu, received %zu, lost %zu, rejected events %zu\n",
+        sentCount, receivedCount, messages - receivedCount, host.RejectedCount());
+    printf("throughput %.1f msg/s over %.3f s\n", throughput, seconds);
+    printf("%s", out.c_str());
+
+    if (!options.jsonPath.empty()) {
+        std::ofstream file(options.jsonPath, std::ios::binary);
+        file << out;
+    }
+
+    return receivedCount == messages ? 0 : 3;
+}
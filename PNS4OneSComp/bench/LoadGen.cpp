@@ -0,0 +1,631 @@
+// Генератор нагрузки на сервис уведомлений: открывает N подключений, ведущих себя как компоненты
+// (регистрация ConnectDataToSendBuf, прием и расшифровка кадров), и отправляет сообщения через
+// HTTP-метод sendmessage с заданным темпом. Каждое полученное сообщение расшифровывается и проверяется:
+// получатель должен соответствовать адресату сообщения. По итогам выводятся задержка доставки
+// (от постановки в очередь отправки до получения клиентом), время рассылки всем получателям и потери.
+//
+// Запуск: pns4onescomp_loadgen --port порт_клиентов --send-port порт_отправки --app-id ид
+//                              --client-key ключ --access-token ключ_доступа [параметры]
+//  --host адрес         - адрес сервиса (127.0.0.1);
+//  --connections N      - количество подключений (1000);
+//  --ibs N              - количество информационных баз, между которыми распределяются подключения (1);
+//  --groups N           - количество групп пользователей в каждой базе (10);
+//  --threads N          - количество потоков приема (4);
+//  --connect-rate N     - подключений в секунду, 0 - без ограничения (2000);
+//  --rate N             - сообщений в секунду (100);
+//  --duration с         - длительность отправки в секундах (10);
+//  --mix u,g,a          - доли сообщений пользователю, группе и всем пользователям базы (80,15,5);
+//  --size байт          - размер данных сообщения (128);
+//  --senders N          - количество соединений HTTP для отправки (2);
+//  --drain с            - ожидание доставки после окончания отправки (5);
+//  --json файл          - сохранить результаты в JSON.
+// Ключ доступа выдает метод /auth сервиса: curl "http://сервис:порт/auth?server_key=...".
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../ConversionWchar.h"
+#include "../FrameCodec.h"
+#include "../FrameHeader.h"
+#include "../HttpPublisher.h"
+#include "../Json.h"
+#include "../Registration.h"
+#include "../crypt.h"
+
+constexpr size_t RECEIVE_BUFFER_SIZE = 64 * 1024;
+constexpr int EPOLL_MAX_EVENTS = 256;
+
+static int64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Параметры и адресаты
+
+struct LoadOptions
+{
+    LoadOptions() :
+        host("127.0.0.1"), connections(1000), ibs(1), groups(10), threads(4), connectRate(2000),
+        rate(100), durationSec(10), size(128), senders(2), drainSec(5)
+    {
+        mix[0] = 80;
+        mix[1] = 15;
+        mix[2] = 5;
+    }
+
+    std::string host;
+    std::string port;
+    std::string sendPort;
+    std::string appId;
+    std::string clientKey;
+    std::string accessToken;
+    size_t connections;
+    size_t ibs;
+    size_t groups;
+    size_t threads;
+    double connectRate;
+    double rate;
+    double durationSec;
+    double mix[3];
+    size_t size;
+    size_t senders;
+    double drainSec;
+    std::string jsonPath;
+};
+
+// Подключение номер i: база i % ibs, пользователь u<i>, группа g<(i / ibs) % groups>.
+static size_t IbOf(const LoadOptions& options, size_t conn) { return conn % options.ibs; }
+static size_t GroupOf(const LoadOptions& options, size_t conn) { return (conn / options.ibs) % options.groups; }
+
+enum RecipientType
+{
+    eRecipientUser,
+    eRecipientGroup,
+    eRecipientAll
+};
+
+// Сообщение, отправленное генератором. Счетчики изменяются потоками приема.
+struct SentMessage
+{
+    SentMessage() : type(eRecipientUser), ib(0), target(0), sentAt(0), expected(0), received(0), lastReceivedAt(0) { }
+
+    RecipientType type;
+    size_t ib;
+    size_t target;  // номер подключения (пользователь) или номер группы
+    int64_t sentAt;
+    uint32_t expected;
+    std::atomic<uint32_t> received;
+    std::atomic<int64_t> lastReceivedAt;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Подключения и потоки приема
+
+struct LoadConnection
+{
+    size_t index;
+    int socket;
+    std::vector<unsigned char> buffer;
+    bool closed;
+};
+
+struct WorkerStats
+{
+    WorkerStats() : connected(0), connectFailed(0), disconnected(0), frames(0), bytes(0),
+        decryptFailures(0), invalidFrames(0), misrouted(0), unknown(0) { }
+
+    size_t connected;
+    size_t connectFailed;
+    size_t disconnected;
+    size_t frames;
+    size_t bytes;
+    size_t decryptFailures;
+    size_t invalidFrames;
+    size_t misrouted;
+    size_t unknown;
+    std::vector<uint32_t> latencyUs;
+};
+
+class LoadWorker
+{
+public:
+    LoadWorker(const LoadOptions& options, const AesKey& aesKey, std::vector<SentMessage>& messages) :
+        m_options(options), m_aesKey(aesKey), m_messages(messages), m_epoll(-1) { }
+
+    ~LoadWorker()
+    {
+        for (auto& conn : m_connections) {
+            if (conn->socket >= 0)
+                close(conn->socket);
+        }
+        if (m_epoll >= 0)
+            close(m_epoll);
+    }
+
+    void AddConnection(size_t index)
+    {
+        std::unique_ptr<LoadConnection> conn(new LoadConnection());
+        conn->index = index;
+        conn->socket = -1;
+        conn->closed = false;
+        m_connections.push_back(std::move(conn));
+    }
+
+    // Подключает и регистрирует свои подключения, затем принимает кадры до установки stop.
+    void Run(const addrinfo* address, std::atomic<bool>& stop, std::atomic<size_t>& connectTicket,
+        int64_t connectStart)
+    {
+        m_epoll = epoll_create1(0);
+        for (auto& conn : m_connections) {
+            // Общий темп подключения всех потоков ограничивается номером в очереди подключений.
+            size_t ticket = connectTicket.fetch_add(1);
+            if (m_options.connectRate > 0) {
+                int64_t due = connectStart + (int64_t)(ticket / m_options.connectRate * 1e9);
+                int64_t wait = due - NowNs();
+                if (wait > 0)
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+            }
+            if (Connect(*conn, address))
+                m_stats.connected++;
+            else
+                m_stats.connectFailed++;
+            if (stop)
+                return;
+        }
+
+        epoll_event events[EPOLL_MAX_EVENTS];
+        std::vector<unsigned char> chunk(RECEIVE_BUFFER_SIZE);
+        while (!stop) {
+            int count = epoll_wait(m_epoll, events, EPOLL_MAX_EVENTS, 100);
+            for (int i = 0; i < count; i++) {
+                LoadConnection& conn = *(LoadConnection*)events[i].data.ptr;
+                Receive(conn, chunk);
+            }
+        }
+    }
+
+    WorkerStats& Stats() { return m_stats; }
+private:
+    bool Connect(LoadConnection& conn, const addrinfo* address)
+    {
+        int sock = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (sock < 0)
+            return false;
+        if (connect(sock, address->ai_addr, address->ai_addrlen) != 0) {
+            close(sock);
+            return false;
+        }
+        int noDelay = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        std::string ibId = "ib-" + std::to_string(IbOf(m_options, conn.index));
+        std::string userId = "u" + std::to_string(conn.index);
+        WCHAR_T* group = nullptr;
+        convFromUtf8ToShortWchar(&group, ("g" + std::to_string(GroupOf(m_options, conn.index))).c_str());
+
+        char* buf = nullptr;
+        size_t bufSize = ConnectDataToSendBuf(m_options.appId.c_str(), ibId.c_str(), userId.c_str(), group,
+            m_aesKey.Key, m_aesKey.KeySize, &buf);
+        delete[] group;
+
+        bool sent = bufSize > 0 && send(sock, buf, bufSize, MSG_NOSIGNAL) == (ssize_t)bufSize;
+        delete[] buf;
+        if (!sent) {
+            close(sock);
+            return false;
+        }
+
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+        conn.socket = sock;
+
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = &conn;
+        return epoll_ctl(m_epoll, EPOLL_CTL_ADD, sock, &event) == 0;
+    }
+
+    void Receive(LoadConnection& conn, std::vector<unsigned char>& chunk)
+    {
+        for (;;) {
+            ssize_t count = recv(conn.socket, chunk.data(), chunk.size(), 0);
+            if (count > 0) {
+                conn.buffer.insert(conn.buffer.end(), chunk.data(), chunk.data() + count);
+                m_stats.bytes += (size_t)count;
+                continue;
+            }
+            if (count == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                epoll_ctl(m_epoll, EPOLL_CTL_DEL, conn.socket, nullptr);
+                close(conn.socket);
+                conn.socket = -1;
+                conn.closed = true;
+                m_stats.disconnected++;
+            }
+            break;
+        }
+
+        int64_t receivedAt = NowNs();
+        size_t pos = 0;
+        while (conn.buffer.size() - pos >= MESSAGE_FRAME_SIZE_BYTES) {
+            uint32_t frameSize = LoadLE32(conn.buffer.data() + pos);
+            if (conn.buffer.size() - pos - MESSAGE_FRAME_SIZE_BYTES < frameSize)
+                break;
+            ProcessFrame(conn, conn.buffer.data() + pos + MESSAGE_FRAME_SIZE_BYTES, (int)frameSize, receivedAt);
+            pos += MESSAGE_FRAME_SIZE_BYTES + frameSize;
+        }
+        conn.buffer.erase(conn.buffer.begin(), conn.buffer.begin() + pos);
+    }
+
+    void ProcessFrame(const LoadConnection& conn, unsigned char* data, int dataSize, int64_t receivedAt)
+    {
+        m_stats.frames++;
+
+        FrameHeader header;
+        if (!ReadFrameHeader(&data, &dataSize, header) || dataSize < (int)DECRYPTED_SIZE_BYTES) {
+            m_stats.invalidFrames++;
+            return;
+        }
+
+        int decryptedSize = (int)LoadLE32(data);
+        unsigned char* decrypted = nullptr;
+        bool isDecrypted = decryptedSize > 0 && aes_decrypt(data + DECRYPTED_SIZE_BYTES,
+            dataSize - (int)DECRYPTED_SIZE_BYTES, m_aesKey, &decrypted, decryptedSize);
+        JsonValue message;
+        bool isParsed = isDecrypted && JsonValue::Parse((const char*)decrypted, decryptedSize, message);
+        delete[] decrypted;
+        if (!isParsed) {
+            m_stats.decryptFailures++;
+            return;
+        }
+
+        const JsonValue* messageData = message.Find("data");
+        const JsonValue* seqValue = messageData ? messageData->Find("seq") : nullptr;
+        size_t seq = seqValue ? (size_t)strtoull(seqValue->GetString().c_str(), nullptr, 10) : m_messages.size();
+        if (seq >= m_messages.size() || header.messageId != "lg-" + seqValue->GetString()) {
+            m_stats.unknown++;
+            return;
+        }
+
+        SentMessage& sent = m_messages[seq];
+        bool addressed = IbOf(m_options, conn.index) == sent.ib;
+        if (sent.type == eRecipientUser)
+            addressed = addressed && conn.index == sent.target;
+        else if (sent.type == eRecipientGroup)
+            addressed = addressed && GroupOf(m_options, conn.index) == sent.target;
+        if (!addressed) {
+            m_stats.misrouted++;
+            return;
+        }
+
+        sent.received.fetch_add(1, std::memory_order_relaxed);
+        int64_t last = sent.lastReceivedAt.load(std::memory_order_relaxed);
+        while (receivedAt > last && !sent.lastReceivedAt.compare_exchange_weak(last, receivedAt, std::memory_order_relaxed))
+            ;
+        m_stats.latencyUs.push_back((uint32_t)std::max<int64_t>(0, (receivedAt - sent.sentAt) / 1000));
+    }
+
+    const LoadOptions& m_options;
+    AesKey m_aesKey;
+    std::vector<SentMessage>& m_messages;
+    int m_epoll;
+    std::vector<std::unique_ptr<LoadConnection> > m_connections;
+    WorkerStats m_stats;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Отправка
+
+static std::string MessageBody(const LoadOptions& options, const SentMessage& message, size_t seq)
+{
+    std::string ib = "ib-" + std::to_string(message.ib);
+    std::string recipient;
+    if (message.type == eRecipientUser)
+        recipient = "{\"Type\":\"user\",\"IbId\":\"" + ib + "\",\"UserId\":\"u" + std::to_string(message.target) + "\"}";
+    else if (message.type == eRecipientGroup)
+        recipient = "{\"Type\":\"group\",\"IbId\":\"" + ib + "\",\"UserGroup\":\"g" + std::to_string(message.target) + "\"}";
+    else
+        recipient = "{\"Type\":\"all\",\"IbId\":\"" + ib + "\"}";
+
+    std::string seqString = std::to_string(seq);
+    std::string payload(options.size > seqString.size() ? options.size - seqString.size() : 0, 'x');
+    return "{\"Recipient\":" + recipient + ",\"Message\":{\"Id\":\"lg-" + seqString
+        + "\",\"Topic\":\"loadgen\",\"Data\":{\"seq\":\"" + seqString + "\",\"payload\":\"" + payload + "\"}}}";
+}
+
+static size_t CountErrors(const std::string& errors)
+{
+    JsonValue parsed;
+    if (errors.empty() || !JsonValue::Parse(errors.c_str(), errors.size(), parsed))
+        return 0;
+    return parsed.GetArray().size();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Результаты
+
+static std::string Percentiles(std::vector<uint32_t>& values)
+{
+    std::sort(values.begin(), values.end());
+    auto percentile = [&](double fraction) -> double {
+        if (values.empty())
+            return 0;
+        return values[std::min(values.size() - 1, (size_t)(values.size() * fraction))] / 1000.0;
+    };
+    char buf[256];
+    snprintf(buf, sizeof(buf), "{\"count\":%zu,\"p50\":%.2f,\"p90\":%.2f,\"p99\":%.2f,\"p999\":%.2f,\"max\":%.2f}",
+        values.size(), percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999),
+        values.empty() ? 0.0 : values.back() / 1000.0);
+    return buf;
+}
+
+static bool ParseOptions(int argc, char* argv[], LoadOptions& options)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+            return false;
+        const char* value = argv[++i];
+        if (arg == "--host")
+            options.host = value;
+        else if (arg == "--port")
+            options.port = value;
+        else if (arg == "--send-port")
+            options.sendPort = value;
+        else if (arg == "--app-id")
+            options.appId = value;
+        else if (arg == "--client-key")
+            options.clientKey = value;
+        else if (arg == "--access-token")
+            options.accessToken = value;
+        else if (arg == "--connections")
+            options.connections = (size_t)atoll(value);
+        else if (arg == "--ibs")
+            options.ibs = std::max<size_t>(1, (size_t)atoll(value));
+        else if (arg == "--groups")
+            options.groups = std::max<size_t>(1, (size_t)atoll(value));
+        else if (arg == "--threads")
+            options.threads = std::max<size_t>(1, (size_t)atoll(value));
+        else if (arg == "--connect-rate")
+            options.connectRate = atof(value);
+        else if (arg == "--rate")
+            options.rate = atof(value);
+        else if (arg == "--duration")
+            options.durationSec = atof(value);
+        else if (arg == "--mix") {
+            if (sscanf(value, "%lf,%lf,%lf", &options.mix[0], &options.mix[1], &options.mix[2]) != 3)
+                return false;
+        }
+        else if (arg == "--size")
+            options.size = (size_t)atoll(value);
+        else if (arg == "--senders")
+            options.senders = std::max<size_t>(1, (size_t)atoll(value));
+        else if (arg == "--drain")
+            options.drainSec = atof(value);
+        else if (arg == "--json")
+            options.jsonPath = value;
+        else
+            return false;
+    }
+    return !options.port.empty() && !options.sendPort.empty() && !options.appId.empty()
+        && !options.clientKey.empty() && !options.accessToken.empty()
+        && options.connections > 0 && options.rate > 0;
+}
+
+int main(int argc, char* argv[])
+{
+    LoadOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        fprintf(stderr, "usage: %s --port port --send-port port --app-id id --client-key key --access-token token"
+            " [--host addr] [--connections N] [--ibs N] [--groups N] [--threads N] [--connect-rate N]"
+            " [--rate N] [--duration s] [--mix user,group,all] [--size bytes] [--senders N] [--drain s]"
+            " [--json file]\n", argv[0]);
+        return 2;
+    }
+
+    AesKey aesKey;
+    if (!get_aes_keys_from_base64(options.clientKey.c_str(), &aesKey)) {
+        fprintf(stderr, "invalid client key\n");
+        return 1;
+    }
+
+    // Каждое подключение занимает дескриптор файла.
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    addrinfo hints, * address = nullptr;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(options.host.c_str(), options.port.c_str(), &hints, &address) != 0) {
+        fprintf(stderr, "cannot resolve %s\n", options.host.c_str());
+        return 1;
+    }
+
+    // Адресаты всех сообщений выбираются заранее, чтобы знать ожидаемое количество доставок.
+    size_t messageCount = (size_t)(options.rate * options.durationSec);
+    std::vector<SentMessage> messages(messageCount);
+    std::vector<size_t> ibConnections(options.ibs, 0);
+    std::vector<size_t> groupConnections(options.ibs * options.groups, 0);
+    for (size_t conn = 0; conn < options.connections; conn++) {
+        ibConnections[IbOf(options, conn)]++;
+        groupConnections[IbOf(options, conn) * options.groups + GroupOf(options, conn)]++;
+    }
+
+    std::mt19937_64 random(42);
+    std::discrete_distribution<int> typeDistribution({ options.mix[0], options.mix[1], options.mix[2] });
+    for (SentMessage& message : messages) {
+        message.type = (RecipientType)typeDistribution(random);
+        if (message.type == eRecipientUser) {
+            message.target = random() % options.connections;
+            message.ib = IbOf(options, message.target);
+            message.expected = 1;
+        }
+        else if (message.type == eRecipientGroup) {
+            message.ib = random() % options.ibs;
+            message.target = random() % options.groups;
+            message.expected = (uint32_t)groupConnections[message.ib * options.groups + message.target];
+        }
+        else {
+            message.ib = random() % options.ibs;
+            message.expected = (uint32_t)ibConnections[message.ib];
+        }
+    }
+
+    std::vector<std::unique_ptr<LoadWorker> > workers;
+    for (size_t i = 0; i < options.threads; i++)
+        workers.emplace_back(new LoadWorker(options, aesKey, messages));
+    for (size_t conn = 0; conn < options.connections; conn++)
+        workers[conn % options.threads]->AddConnection(conn);
+
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> connectTicket(0);
+    int64_t connectStart = NowNs();
+    std::vector<std::thread> threads;
+    for (auto& worker : workers) {
+        LoadWorker* w = worker.get();
+        threads.emplace_back([w, address, &stop, &connectTicket, connectStart]() {
+            w->Run(address, stop, connectTicket, connectStart);
+        });
+    }
+
+    // Отправка начинается после подключения всех клиентов.
+    while (connectTicket < options.connections)
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    double connectSeconds = (NowNs() - connectStart) / 1e9;
+    printf("connected %zu clients in %.1f s\n", options.connections, connectSeconds);
+    fflush(stdout);
+
+    std::vector<std::unique_ptr<HttpPublisher> > publishers;
+    for (size_t i = 0; i < options.senders; i++) {
+        publishers.emplace_back(new HttpPublisher((size_t)(options.rate * 10) + 1000));
+        publishers.back()->Configure(options.host, options.sendPort, options.accessToken);
+    }
+
+    size_t sendErrors = 0, notQueued = 0;
+    int64_t sendStart = NowNs();
+    for (size_t seq = 0; seq < messageCount; seq++) {
+        int64_t due = sendStart + (int64_t)(seq / options.rate * 1e9);
+        int64_t wait = due - NowNs();
+        if (wait > 0)
+            std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+
+        std::string body = MessageBody(options, messages[seq], seq);
+        messages[seq].sentAt = NowNs();
+        if (!publishers[seq % publishers.size()]->Enqueue(body))
+            notQueued++;
+    }
+    for (auto& publisher : publishers) {
+        publisher->Flush((long)(options.drainSec * 1000) + 30000);
+        std::string errors;
+        publisher->TakeErrors(errors);
+        sendErrors += CountErrors(errors);
+    }
+    double sendSeconds = (NowNs() - sendStart) / 1e9;
+
+    // Ожидание доставки оставшихся сообщений.
+    int64_t drainEnd = NowNs() + (int64_t)(options.drainSec * 1e9);
+    for (;;) {
+        bool complete = true;
+        for (const SentMessage& message : messages) {
+            if (message.received.load(std::memory_order_relaxed) < message.expected) {
+                complete = false;
+                break;
+            }
+        }
+        if (complete || NowNs() > drainEnd)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    stop = true;
+    for (auto& thread : threads)
+        thread.join();
+    for (auto& publisher : publishers)
+        publisher->Stop();
+    freeaddrinfo(address);
+
+    WorkerStats total;
+    for (auto& worker : workers) {
+        WorkerStats& stats = worker->Stats();
+        total.connected += stats.connected;
+        total.connectFailed += stats.connectFailed;
+        total.disconnected += stats.disconnected;
+        total.frames += stats.frames;
+        total.bytes += stats.bytes;
+        total.decryptFailures += stats.decryptFailures;
+        total.invalidFrames += stats.invalidFrames;
+        total.misrouted += stats.misrouted;
+        total.unknown += stats.unknown;
+        total.latencyUs.insert(total.latencyUs.end(), stats.latencyUs.begin(), stats.latencyUs.end());
+    }
+
+    // Время рассылки - до получения сообщения последним адресатом (для полностью доставленных сообщений).
+    uint64_t expected = 0, delivered = 0, duplicates = 0;
+    size_t completeMessages = 0;
+    std::vector<uint32_t> fanoutUs;
+    for (const SentMessage& message : messages) {
+        uint32_t received = message.received.load();
+        expected += message.expected;
+        delivered += std::min(received, message.expected);
+        if (received > message.expected)
+            duplicates += received - message.expected;
+        if (message.expected > 0 && received >= message.expected) {
+            completeMessages++;
+            fanoutUs.push_back((uint32_t)std::max<int64_t>(0, (message.lastReceivedAt.load() - message.sentAt) / 1000));
+        }
+    }
+
+    char buf[1024];
+    snprintf(buf, sizeof(buf),
+        "{\"connections\":%zu,\"connected\":%zu,\"connectFailed\":%zu,\"disconnected\":%zu,\"connectSeconds\":%.2f,"
+        "\"messages\":%zu,\"notQueued\":%zu,\"sendErrors\":%zu,\"sendSeconds\":%.2f,"
+        "\"expectedDeliveries\":%llu,\"delivered\":%llu,\"lost\":%llu,\"duplicates\":%llu,\"completeMessages\":%zu,"
+        "\"frames\":%zu,\"bytesReceived\":%zu,\"decryptFailures\":%zu,\"invalidFrames\":%zu,\"misrouted\":%zu,"
+        "\"unknown\":%zu,\"deliveriesPerSec\":%.1f,",
+        options.connections, total.connected, total.connectFailed, total.disconnected, connectSeconds,
+        messageCount, notQueued, sendErrors, sendSeconds,
+        (unsigned long long)expected, (unsigned long long)delivered, (unsigned long long)(expected - delivered),
+        (unsigned long long)duplicates, completeMessages,
+        total.frames, total.bytes, total.decryptFailures, total.invalidFrames, total.misrouted,
+        total.unknown, sendSeconds > 0 ? delivered / sendSeconds : 0.0);
+    std::string out = buf;
+    out.append("\"deliveryLatencyMs\":" + Percentiles(total.latencyUs));
+    out.append(",\"fanoutLatencyMs\":" + Percentiles(fanoutUs));
+    out.append("}\n");
+
+    printf("sent %zu messages in %.1f s, delivered %llu of %llu (lost %llu), send errors %zu\n",
+        messageCount, sendSeconds, (unsigned long long)delivered, (unsigned long long)expected,
+        (unsigned long long)(expected - delivered), sendErrors);
+    printf("%s", out.c_str());
+
+    if (!options.jsonPath.empty()) {
+        std::ofstream file(options.jsonPath, std::ios::binary);
+        file << out;
+    }
+
+    dispose_aes_key(aesKey);
+    return expected == delivered && total.misrouted == 0 && total.decryptFailures == 0 ? 0 : 3;
+}
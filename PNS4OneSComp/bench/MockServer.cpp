@@ -0,0 +1,225 @@
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include "MockServer.h"
+#include "TestData.h"
+#include "../crypt.h"
+
+// Смещения значений полей времени в кадре трассируемого сообщения:
+// длина кадра, маркер, размер заголовка, тип и длина поля.
+constexpr size_t TRACE_SENT_AT_OFFSET = MESSAGE_FRAME_SIZE_BYTES + FRAME_MARKER_SIZE + FRAME_HEADER_SIZE_BYTES
+    + FRAME_FIELD_PREFIX_SIZE;
+constexpr size_t TRACE_INGESTED_AT_OFFSET = TRACE_SENT_AT_OFFSET + FrameFieldSize(FRAME_TIMESTAMP_SIZE);
+static_assert(TRACE_SENT_AT_OFFSET == 13, "sentAt is the first header field");
+
+MockServer::MockServer(const unsigned char* key, int keySize, const unsigned char* iv, int ivSize) :
+    m_key(key, key + keySize),
+    m_iv(iv, iv + ivSize),
+    m_listenSocket(-1),
+    m_clientSocket(-1),
+    m_closing(false),
+    m_bytesSent(0)
+{ }
+
+MockServer::~MockServer()
+{
+    Close();
+}
+
+int MockServer::Listen()
+{
+    m_listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listenSocket < 0)
+        return 0;
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (bind(m_listenSocket, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(m_listenSocket, 1) != 0)
+        return 0;
+
+    socklen_t addrLen = sizeof(addr);
+    if (getsockname(m_listenSocket, (sockaddr*)&addr, &addrLen) != 0)
+        return 0;
+    return ntohs(addr.sin_port);
+}
+
+bool MockServer::ReadExact(unsigned char* buf, size_t size)
+{
+    size_t done = 0;
+    while (done < size) {
+        ssize_t count = recv(m_clientSocket, buf + done, size - done, 0);
+        if (count <= 0)
+            return false;
+        done += (size_t)count;
+    }
+    return true;
+}
+
+bool MockServer::WriteAll(const unsigned char* buf, size_t size)
+{
+    size_t done = 0;
+    while (done < size) {
+        ssize_t count = send(m_clientSocket, buf + done, size - done, MSG_NOSIGNAL);
+        if (count <= 0)
+            return false;
+        done += (size_t)count;
+    }
+    return true;
+}
+
+bool MockServer::AcceptClient(long timeoutMs, MockRegistration& registration)
+{
+    pollfd pfd;
+    pfd.fd = m_listenSocket;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, (int)timeoutMs) <= 0)
+        return false;
+
+    m_clientSocket = accept(m_listenSocket, nullptr, nullptr);
+    if (m_clientSocket < 0)
+        return false;
+
+    int noDelay = 1;
+    setsockopt(m_clientSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    // Регистрация: 2 байта - общая длина, 2 байта - длина подписи, подпись, строки с завершающим нулем.
+    unsigned char sizeBuf[CLIENT_FRAME_SIZE_BYTES];
+    if (!ReadExact(sizeBuf, sizeof(sizeBuf)))
+        return false;
+    std::vector<unsigned char> data(LoadLE16(sizeBuf));
+    if (!ReadExact(data.data(), data.size()))
+        return false;
+
+    RegistrationView view;
+    if (!ParseRegistration(data.data(), data.size(), view))
+        return false;
+
+    unsigned char* hash = nullptr;
+    int expectedSize = 0;
+    if (!hmacsha256_sign((unsigned char*)view.signedData.data, (int)view.signedData.size, m_key.data(), (int)m_key.size(),
+        &hash, &expectedSize))
+        return false;
+    bool signatureValid = (size_t)expectedSize == view.signature.size && memcmp(hash, view.signature.data, view.signature.size) == 0;
+    delete[] hash;
+    if (!signatureValid)
+        return false;
+
+    registration.appId.assign(view.appId.chars(), view.appId.size);
+    registration.ibId.assign(view.ibId.chars(), view.ibId.size);
+    registration.userId.assign(view.userId.chars(), view.userId.size);
+    registration.userGroup.assign(view.userGroup.chars(), view.userGroup.size);
+    registration.protocolVersion.assign(view.protocolVersion.chars(), view.protocolVersion.size);
+
+    // Управляющие кадры компоненты (подписка, публикация) стендом не обрабатываются.
+    m_drainThread = std::thread(&MockServer::DrainClient, this);
+    return true;
+}
+
+void MockServer::DrainClient()
+{
+    unsigned char buf[4096];
+    while (!m_closing && recv(m_clientSocket, buf, sizeof(buf), 0) > 0)
+        ;
+}
+
+void MockServer::Prepare(const MockScenario& scenario)
+{
+    m_scenario = scenario;
+    if (m_scenario.burst == 0)
+        m_scenario.burst = 1;
+
+    AesKey aesKey;
+    aesKey.Key = m_key.data();
+    aesKey.KeySize = (int)m_key.size();
+    aesKey.IV = m_iv.data();
+    aesKey.IVSize = (int)m_iv.size();
+
+    m_frames.clear();
+    m_frames.reserve(scenario.messages);
+    for (size_t seq = 0; seq < scenario.messages; seq++) {
+        std::string message = "{\"topic\":\"harness\",\"data\":{\"seq\":" + std::to_string(seq) + ",\"text\":\"";
+        const std::string tail = "\"}}";
+        if (scenario.messageSize > message.size() + tail.size())
+            message.append(MakeText("ascii", scenario.messageSize - message.size() - tail.size()));
+        message.append(tail);
+
+        unsigned char* encrypted = nullptr;
+        int encryptedSize = 0;
+        aes_encrypt((unsigned char*)message.data(), (int)message.size(), aesKey, &encrypted, &encryptedSize);
+
+        // Отметки времени трассируемого сообщения заполняются при отправке, поэтому идут первыми
+        // и находятся по постоянному смещению (см. TRACE_SENT_AT_OFFSET).
+        std::vector<unsigned char> fields;
+        std::string messageId = "harness-" + std::to_string(seq);
+        if (scenario.traced) {
+            AppendFrameField(fields, FRAME_FIELD_SENT_AT, (int64_t)0);
+            AppendFrameField(fields, FRAME_FIELD_INGESTED_AT, (int64_t)0);
+            AppendFrameField(fields, FRAME_FIELD_TRACE_ID, messageId.data(), messageId.size());
+        }
+        AppendFrameField(fields, FRAME_FIELD_MESSAGE_ID, messageId.data(), messageId.size());
+
+        std::vector<unsigned char> body = MakeFrame(fields, (uint32_t)message.size(), encrypted, encryptedSize);
+        std::vector<unsigned char> frame(MESSAGE_FRAME_SIZE_BYTES + body.size());
+        StoreLE32(frame.data(), (uint32_t)body.size());
+        memcpy(frame.data() + MESSAGE_FRAME_SIZE_BYTES, body.data(), body.size());
+        m_frames.push_back(frame);
+
+        delete[] encrypted;
+    }
+    m_sentTimes.assign(scenario.messages, std::chrono::steady_clock::time_point());
+}
+
+size_t MockServer::Run()
+{
+    auto start = std::chrono::steady_clock::now();
+    size_t sent = 0;
+    while (sent < m_frames.size()) {
+        if (m_scenario.rate > 0) {
+            // Пачка номер k отправляется не раньше k * burst / rate секунд от начала.
+            auto due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(sent / m_scenario.rate));
+            std::this_thread::sleep_until(due);
+        }
+
+        size_t burstEnd = std::min(sent + m_scenario.burst, m_frames.size());
+        for (; sent < burstEnd; sent++) {
+            std::vector<unsigned char>& frame = m_frames[sent];
+            if (m_scenario.traced) {
+                // Сообщение считается принятым сервисом в момент отправки.
+                uint64_t sentAt = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+                StoreLE64(&frame[TRACE_SENT_AT_OFFSET], sentAt);
+                StoreLE64(&frame[TRACE_INGESTED_AT_OFFSET], sentAt);
+            }
+            m_sentTimes[sent] = std::chrono::steady_clock::now();
+            if (!WriteAll(frame.data(), frame.size()))
+                return sent;
+            m_bytesSent += frame.size();
+        }
+    }
+    return sent;
+}
+
+void MockServer::Close()
+{
+    m_closing = true;
+    if (m_clientSocket >= 0)
+        shutdown(m_clientSocket, SHUT_RDWR);
+    if (m_drainThread.joinable())
+        m_drainThread.join();
+    if (m_clientSocket >= 0)
+        close(m_clientSocket);
+    if (m_listenSocket >= 0)
+        close(m_listenSocket);
+    m_clientSocket = -1;
+    m_listenSocket = -1;
+}
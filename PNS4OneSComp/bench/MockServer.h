@@ -0,0 +1,80 @@
+#ifndef __MOCKSERVER_H__
+#define __MOCKSERVER_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Параметры потока сообщений, передаваемого компоненте.
+struct MockScenario
+{
+    MockScenario() : messages(10000), messageSize(256), rate(0), burst(1), traced(false) { }
+
+    size_t messages;
+    size_t messageSize;  // примерный размер JSON сообщения в байтах
+    double rate;         // сообщений в секунду, 0 - без ограничения
+    size_t burst;        // количество сообщений, передаваемых подряд без пауз
+    bool traced;         // передавать идентификатор трассировки в заголовке кадра
+};
+
+// Данные регистрации получателя, переданные компонентой.
+struct MockRegistration
+{
+    std::string appId;
+    std::string ibId;
+    std::string userId;
+    std::string userGroup;
+    std::string protocolVersion;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// class MockServer
+// Сервис уведомлений для стенда: принимает одно подключение компоненты, проверяет подпись
+// регистрации (HMAC-SHA256 ключом клиента) и передает зашифрованные кадры версии 2.
+// Сообщение номер N содержит свойство data.seq = N, время отправки каждого сообщения
+// сохраняется для расчета задержки доставки.
+class MockServer
+{
+public:
+    MockServer(const unsigned char* key, int keySize, const unsigned char* iv, int ivSize);
+    ~MockServer();
+
+    // Начинает прослушивание на 127.0.0.1 со случайным портом. Возвращает номер порта или 0.
+    int Listen();
+    // Ожидает подключения и регистрации компоненты. Возвращает false при неверной подписи или по таймауту.
+    bool AcceptClient(long timeoutMs, MockRegistration& registration);
+    // Готовит кадры сценария заранее, чтобы шифрование не влияло на темп отправки.
+    void Prepare(const MockScenario& scenario);
+    // Передает подготовленные кадры с заданным темпом. Возвращает количество переданных сообщений.
+    size_t Run();
+    void Close();
+
+    // Время отправки сообщения (steady_clock) по его номеру.
+    std::chrono::steady_clock::time_point SentTime(size_t seq) const { return m_sentTimes[seq]; }
+    size_t BytesSent() const { return m_bytesSent; }
+private:
+    MockServer(const MockServer&);
+    MockServer& operator = (const MockServer&);
+
+    bool ReadExact(unsigned char* buf, size_t size);
+    bool WriteAll(const unsigned char* buf, size_t size);
+    void DrainClient();
+
+    std::vector<unsigned char> m_key;
+    std::vector<unsigned char> m_iv;
+    int m_listenSocket;
+    int m_clientSocket;
+    std::atomic<bool> m_closing;
+    std::thread m_drainThread;
+
+    MockScenario m_scenario;
+    std::vector<std::vector<unsigned char> > m_frames;
+    std::vector<std::chrono::steady_clock::time_point> m_sentTimes;
+    size_t m_bytesSent;
+};
+
+#endif //__MOCKSERVER_H__
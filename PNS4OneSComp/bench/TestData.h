@@ -0,0 +1,137 @@
+#ifndef __TESTDATA_H__
+#define __TESTDATA_H__
+
+// Общие функции подготовки данных для микротестов и стенда: тексты, base64, ключ клиента и кадры сервиса.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../FrameCodec.h"
+#include "../FrameHeader.h"
+
+inline void AppendUtf8(std::string& out, uint32_t cp)
+{
+    if (cp < 0x80)
+        out.push_back((char)cp);
+    else if (cp < 0x800) {
+        out.push_back((char)(0xC0 | (cp >> 6)));
+        out.push_back((char)(0x80 | (cp & 0x3F)));
+    }
+    else if (cp < 0x10000) {
+        out.push_back((char)(0xE0 | (cp >> 12)));
+        out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back((char)(0x80 | (cp & 0x3F)));
+    }
+    else {
+        out.push_back((char)(0xF0 | (cp >> 18)));
+        out.push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back((char)(0x80 | (cp & 0x3F)));
+    }
+}
+
+// Текст в UTF-8 размером не более size байт (обрезается по границе символа).
+// Набор символов: ascii - латиница, cyrillic - кириллица, emoji - смесь латиницы, кириллицы и эмодзи.
+inline std::string MakeText(const std::string& mix, size_t size)
+{
+    std::string pattern;
+    if (mix == "ascii") {
+        pattern = "The quick brown fox jumps over the lazy dog 0123456789. ";
+    }
+    else if (mix == "cyrillic") {
+        for (uint32_t cp = 0x0430; cp <= 0x044F; cp++) {
+            AppendUtf8(pattern, cp);
+            if (cp % 6 == 0)
+                pattern.push_back(' ');
+        }
+    }
+    else {
+        // Символы вне BMP компонента заменяет на U+FFFD.
+        pattern = "Hello, ";
+        for (uint32_t cp = 0x041F; cp <= 0x0425; cp++)
+            AppendUtf8(pattern, cp);
+        pattern.push_back(' ');
+        for (uint32_t cp = 0x1F600; cp <= 0x1F603; cp++)
+            AppendUtf8(pattern, cp);
+        pattern.append(" ok ");
+    }
+
+    std::string text;
+    text.reserve(size + pattern.size());
+    while (text.size() < size)
+        text.append(pattern);
+    size_t len = size;
+    while (len > 0 && ((unsigned char)text[len] & 0xC0) == 0x80)
+        len--;
+    text.resize(len);
+    return text;
+}
+
+inline std::string Base64Encode(const unsigned char* data, size_t size)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((size + 2) / 3 * 4);
+    for (size_t i = 0; i < size; i += 3) {
+        uint32_t v = data[i] << 16;
+        if (i + 1 < size)
+            v |= data[i + 1] << 8;
+        if (i + 2 < size)
+            v |= data[i + 2];
+        out.push_back(alphabet[(v >> 18) & 0x3F]);
+        out.push_back(alphabet[(v >> 12) & 0x3F]);
+        out.push_back(i + 1 < size ? alphabet[(v >> 6) & 0x3F] : '=');
+        out.push_back(i + 2 < size ? alphabet[v & 0x3F] : '=');
+    }
+    return out;
+}
+
+inline void AppendUInt32(std::vector<unsigned char>& buf, uint32_t value)
+{
+    buf.resize(buf.size() + 4);
+    StoreLE32(&buf[buf.size() - 4], value);
+}
+
+// Ключ клиента в формате сервиса: base64 от [длина ключа][длина вектора][ключ][вектор].
+inline std::string MakeClientKey(const unsigned char* key, uint32_t keySize, const unsigned char* iv, uint32_t ivSize)
+{
+    std::vector<unsigned char> data;
+    AppendUInt32(data, keySize);
+    AppendUInt32(data, ivSize);
+    data.insert(data.end(), key, key + keySize);
+    data.insert(data.end(), iv, iv + ivSize);
+    return Base64Encode(data.data(), data.size());
+}
+
+inline void AppendFrameField(std::vector<unsigned char>& fields, unsigned char type, const void* value, size_t size)
+{
+    size_t offset = fields.size();
+    fields.resize(offset + FrameFieldSize(size));
+    FrameWriter writer(&fields[offset], FrameFieldSize(size));
+    writer.PutField(type, value, size);
+}
+
+inline void AppendFrameField(std::vector<unsigned char>& fields, unsigned char type, int64_t value)
+{
+    unsigned char field[FrameFieldSize(FRAME_TIMESTAMP_SIZE)];
+    FrameWriter writer(field, sizeof(field));
+    writer.PutTimestampField(type, value);
+    fields.insert(fields.end(), field, field + sizeof(field));
+}
+
+// Кадр версии 2 без поля длины: маркер, заголовок с полями fields, размер расшифрованных данных
+// и зашифрованные данные.
+inline std::vector<unsigned char> MakeFrame(const std::vector<unsigned char>& fields,
+    uint32_t decryptedSize, const unsigned char* encrypted, size_t encryptedSize)
+{
+    std::vector<unsigned char> frame(MessageFrameV2Size(fields.size(), encryptedSize) - MESSAGE_FRAME_SIZE_BYTES);
+    FrameWriter writer(frame.data(), frame.size());
+    writer.PutLE32(FRAME_HEADER_MARKER);
+    writer.PutLE16((uint16_t)fields.size());
+    writer.PutBytes(fields.data(), fields.size());
+    writer.PutLE32(decryptedSize);
+    writer.PutBytes(encrypted, encryptedSize);
+    return frame;
+}
+
+#endif //__TESTDATA_H__
@@ -155,6 +155,110 @@ cleanup:
 	return NT_SUCCESS(status);
 }
 
+int aes_encrypt(
+	unsigned char* data,
+	int dataSize,
+	AesKey aesKey,
+	unsigned char** encrypted,
+	int* encryptedSize
+)
+{
+	BCRYPT_ALG_HANDLE hAesAlg = NULL;
+	BCRYPT_KEY_HANDLE hKey = NULL;
+	PBYTE tempIV = NULL;
+	DWORD tempIVLen = 0;
+	NTSTATUS status = STATUS_UNSUCCESSFUL;
+	PBYTE result = NULL;
+	ULONG resultSize = 0;
+
+	if (!NT_SUCCESS(status = BCryptOpenAlgorithmProvider(&hAesAlg, BCRYPT_AES_ALGORITHM, 0, NULL)))
+	{
+		goto cleanup;
+	}
+
+	if (!NT_SUCCESS(status = BCryptGenerateSymmetricKey(hAesAlg, &hKey, NULL, 0, aesKey.Key, aesKey.KeySize, 0)))
+	{
+		goto cleanup;
+	}
+
+	if (!NT_SUCCESS(status = BCryptSetProperty(
+		hKey,
+		BCRYPT_CHAINING_MODE,
+		(PBYTE)BCRYPT_CHAIN_MODE_CBC,
+		sizeof(BCRYPT_CHAIN_MODE_CBC),
+		0)))
+	{
+		goto cleanup;
+	}
+
+	tempIV = (PBYTE)HeapAlloc(GetProcessHeap(), 0, aesKey.IVSize);
+	if (tempIV == NULL)
+	{
+		status = STATUS_NO_MEMORY;
+		goto cleanup;
+	}
+
+	tempIVLen = aesKey.IVSize;
+	memcpy(tempIV, aesKey.IV, tempIVLen);
+
+	// Размер зашифрованных данных с учетом дополнения до размера блока.
+	if (!NT_SUCCESS(status = BCryptEncrypt(
+		hKey,
+		data,
+		dataSize,
+		NULL,
+		tempIV,
+		tempIVLen,
+		NULL,
+		0,
+		&resultSize,
+		BCRYPT_BLOCK_PADDING
+	)))
+	{
+		goto cleanup;
+	}
+
+	result = (PBYTE)HeapAlloc(GetProcessHeap(), 0, resultSize);
+	if (result == 0)
+	{
+		status = STATUS_NO_MEMORY;
+		goto cleanup;
+	}
+
+	if (!NT_SUCCESS(status = BCryptEncrypt(
+		hKey,
+		data,
+		dataSize,
+		NULL,
+		tempIV,
+		tempIVLen,
+		result,
+		resultSize,
+		&resultSize,
+		BCRYPT_BLOCK_PADDING
+	)))
+	{
+		goto cleanup;
+	}
+
+	*encrypted = new unsigned char[resultSize];
+	memcpy(*encrypted, result, resultSize);
+	*encryptedSize = (int)resultSize;
+
+cleanup:
+
+	if (result != NULL)
+		HeapFree(GetProcessHeap(), 0, result);
+	if (tempIV != NULL)
+		HeapFree(GetProcessHeap(), 0, tempIV);
+	if (hKey != NULL)
+		BCryptDestroyKey(hKey);
+	if (hAesAlg != NULL)
+		BCryptCloseAlgorithmProvider(hAesAlg, 0);
+
+	return NT_SUCCESS(status);
+}
+
 int hmacsha256_sign(
 	unsigned char* message,
 	int messageSize,
@@ -244,30 +348,62 @@ int aes_decrypt(
 	unsigned char** decrypted,
 	int decryptedSize
 ) {
-	AES_KEY aesKeyOpenSSL;
-    unsigned char *key, *iv;
+    *decrypted = nullptr;
 
-    // Ключ в структуре AesKey после расшифровки "портится", поэтому необходимо сделать копию.
-    key = new unsigned char[aesKey.KeySize];
-    iv = new unsigned char[aesKey.IVSize];
-    memcpy(key, aesKey.Key, aesKey.KeySize);
-    memcpy(iv, aesKey.IV, aesKey.IVSize);
+    // Расшифровываются только блоки, в которые попадают данные, дополнение не проверяется.
+    int blocksSize = (decryptedSize + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE * AES_BLOCK_SIZE;
+    if (decryptedSize <= 0 || blocksSize > encryptedSize)
+        return 0;
 
-	*decrypted = new unsigned char[decryptedSize];
-    AES_set_decrypt_key(key, 256, &aesKeyOpenSSL);
-	AES_cbc_encrypt(encrypted, *decrypted, decryptedSize, &aesKeyOpenSSL, iv, AES_DECRYPT);
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (ctx == nullptr)
+        return 0;
 
-    delete[] key;
-    delete[] iv;
+    *decrypted = new unsigned char[blocksSize];
+    int outSize = 0;
+    bool isDecrypted = EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, aesKey.Key, aesKey.IV)
+        && EVP_CIPHER_CTX_set_padding(ctx, 0)
+        && EVP_DecryptUpdate(ctx, *decrypted, &outSize, encrypted, blocksSize)
+        && outSize == blocksSize;
+    EVP_CIPHER_CTX_free(ctx);
 
     // Проверка корректности расшифровки. Просто проверяем, что первый символ сообщения "{" (начало JSON).
     // Да, "костыль", но для этой задачи достаточно, чтобы не усложнять код.
-	if (*decrypted[0] != '{')
+	if (!isDecrypted || *decrypted[0] != '{')
 		return 0;
 
 	return 1;
 }
 
+int aes_encrypt(
+	unsigned char* data,
+	int dataSize,
+	AesKey aesKey,
+	unsigned char** encrypted,
+	int* encryptedSize
+) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (ctx == nullptr)
+        return 0;
+
+    // EVP дополняет данные до размера блока по PKCS#7, как это делает сервис.
+    *encrypted = new unsigned char[dataSize + AES_BLOCK_SIZE];
+    int updateSize = 0, finalSize = 0;
+    bool isEncrypted = EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, aesKey.Key, aesKey.IV)
+        && EVP_EncryptUpdate(ctx, *encrypted, &updateSize, data, dataSize)
+        && EVP_EncryptFinal_ex(ctx, *encrypted + updateSize, &finalSize);
+    EVP_CIPHER_CTX_free(ctx);
+
+    if (!isEncrypted) {
+        delete[] *encrypted;
+        *encrypted = nullptr;
+        return 0;
+    }
+
+    *encryptedSize = updateSize + finalSize;
+	return 1;
+}
+
 int hmacsha256_sign(
 	unsigned char* message,
 	int messageSize,
@@ -16,6 +16,13 @@ int aes_decrypt(
 	unsigned char** decrypted,
 	int decryptedSize
 );
+int aes_encrypt(
+	unsigned char* data,
+	int dataSize,
+	AesKey aesKey,
+	unsigned char** encrypted,
+	int* encryptedSize
+);
 int hmacsha256_sign(
 	unsigned char* message,
 	int messageSize,
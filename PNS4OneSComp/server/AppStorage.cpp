@@ -0,0 +1,249 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <openssl/rand.h>
+#include "AppStorage.h"
+#include "Log.h"
+#include "../crypt.h"
+
+// Ключ доступа действует 60 минут, как в сервисе на C#.
+constexpr int64_t ACCESS_TOKEN_LIFETIME_TICKS = 60LL * 60 * 10000000;
+constexpr size_t ACCESS_TOKEN_LENGTH = 64;
+// Количество тактов .NET с 01.01.0001 до 01.01.1970.
+constexpr int64_t DOTNET_UNIX_EPOCH_TICKS = 621355968000000000LL;
+
+int64_t NowDotNetTicks()
+{
+    int64_t unixTicks = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count() * 10;
+    return unixTicks + DOTNET_UNIX_EPOCH_TICKS;
+}
+
+static std::string Trim(const std::string& s)
+{
+    size_t begin = s.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos)
+        return std::string();
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(begin, end - begin + 1);
+}
+
+static bool GenerateAccessToken(std::string& token)
+{
+    static const char chars[] = "0123456789abcdefghjiklmnopqrstuvwxyzABCDEFGHJIKLMNOPQRSTUVWXYZ";
+    unsigned char random[ACCESS_TOKEN_LENGTH];
+    if (RAND_bytes(random, sizeof(random)) != 1)
+        return false;
+
+    token.resize(ACCESS_TOKEN_LENGTH);
+    for (size_t i = 0; i < ACCESS_TOKEN_LENGTH; i++)
+        token[i] = chars[random[i] % (sizeof(chars) - 1)];
+    return true;
+}
+
+AppStorage::AppStorage(const std::string& path) : m_path(path)
+{ }
+
+void AppStorage::AddApp(std::vector<std::shared_ptr<ClientApp> >& apps, const std::shared_ptr<ClientApp>& app)
+{
+    bool isFailure = false;
+
+    if (app->id.empty()) {
+        Log(eLogWarning, "application %s is not loaded: id is missing", app->title.c_str());
+        isFailure = true;
+    }
+    if (app->serverKey.empty()) {
+        Log(eLogWarning, "application %s is not loaded: server key is missing", app->title.c_str());
+        isFailure = true;
+    }
+
+    AesKey aesKey;
+    if (!get_aes_keys_from_base64(app->clientKeyBase64.c_str(), &aesKey)) {
+        Log(eLogWarning, "application %s is not loaded: client key is missing or invalid", app->title.c_str());
+        isFailure = true;
+    }
+    else {
+        app->clientKey.assign(aesKey.Key, aesKey.Key + aesKey.KeySize);
+        app->clientIV.assign(aesKey.IV, aesKey.IV + aesKey.IVSize);
+        dispose_aes_key(aesKey);
+    }
+
+    for (const std::shared_ptr<ClientApp>& existApp : apps) {
+        if (existApp->id == app->id) {
+            Log(eLogWarning, "application %s is not loaded: id %s is already used by application %s",
+                app->title.c_str(), app->id.c_str(), existApp->title.c_str());
+            isFailure = true;
+            break;
+        }
+    }
+
+    if (!isFailure)
+        apps.push_back(app);
+}
+
+bool AppStorage::Load()
+{
+    std::ifstream file(m_path);
+    if (!file) {
+        Log(eLogError, "cannot open applications file %s", m_path.c_str());
+        return false;
+    }
+
+    // Разбор повторяет ClientAppsFileStorage сервиса на C#: после названия приложения
+    // ожидаются идентификатор, ключ сервера, ключ клиента и необязательный ключ доступа.
+    std::vector<std::shared_ptr<ClientApp> > apps;
+    std::shared_ptr<ClientApp> app;
+    std::string elemType = "title";
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty())
+            continue;
+
+        if (line[0] == '#') {
+            if (elemType != "title" && elemType != "token") {
+                Log(eLogError, "applications are not loaded: invalid applications file format");
+                return false;
+            }
+
+            elemType = "id";
+            if (app)
+                AddApp(apps, app);
+
+            app = std::make_shared<ClientApp>();
+            app->title = Trim(line.substr(1));
+        }
+        else if (elemType == "id") {
+            elemType = "server_key";
+            app->id = Trim(line);
+        }
+        else if (elemType == "server_key") {
+            elemType = "client_key";
+            app->serverKey = Trim(line);
+        }
+        else if (elemType == "client_key") {
+            elemType = "token";
+            app->clientKeyBase64 = Trim(line);
+        }
+        else if (elemType == "token") {
+            elemType = "title";
+
+            size_t pos = line.rfind(':');
+            long long expiresIn = 0;
+            if (pos == std::string::npos || sscanf(line.c_str() + pos + 1, "%lld", &expiresIn) != 1) {
+                Log(eLogWarning, "application %s: invalid access token, the token is reset", app->title.c_str());
+                continue;
+            }
+
+            app->accessToken = line.substr(0, pos);
+            app->tokenExpiresIn = expiresIn;
+        }
+        else {
+            Log(eLogError, "applications are not loaded: invalid applications file format");
+            return false;
+        }
+    }
+
+    if (app)
+        AddApp(apps, app);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_apps.assign(apps.begin(), apps.end());
+    m_appsById.clear();
+    m_appsByToken.clear();
+    for (const std::shared_ptr<const ClientApp>& loaded : m_apps) {
+        m_appsById[loaded->id] = loaded;
+        if (!loaded->accessToken.empty())
+            m_appsByToken[loaded->accessToken] = loaded;
+    }
+    return true;
+}
+
+bool AppStorage::Save()
+{
+    // Файл записывается во временный и затем заменяется, чтобы при сбое не остаться без приложений.
+    std::string tempPath = m_path + ".tmp";
+    FILE* file = fopen(tempPath.c_str(), "w");
+    if (!file) {
+        Log(eLogError, "cannot write applications file %s", tempPath.c_str());
+        return false;
+    }
+
+    bool written = true;
+    for (const std::shared_ptr<const ClientApp>& app : m_apps) {
+        written = written && fprintf(file, "#%s\n%s\n%s\n%s\n", app->title.c_str(), app->id.c_str(),
+            app->serverKey.c_str(), app->clientKeyBase64.c_str()) > 0;
+        if (!app->accessToken.empty())
+            written = written && fprintf(file, "%s:%lld\n", app->accessToken.c_str(), (long long)app->tokenExpiresIn) > 0;
+    }
+
+    if (fclose(file) != 0 || !written || rename(tempPath.c_str(), m_path.c_str()) != 0) {
+        Log(eLogError, "cannot write applications file %s", m_path.c_str());
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const ClientApp> AppStorage::GetApp(const std::string& appId)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_appsById.find(appId);
+    return it == m_appsById.end() ? std::shared_ptr<const ClientApp>() : it->second;
+}
+
+AccessTokenStatus AppStorage::CheckAccessToken(const std::string& token, std::string& appId)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_appsByToken.find(token);
+    if (token.empty() || it == m_appsByToken.end())
+        return eAccessTokenInvalid;
+    if (NowDotNetTicks() > it->second->tokenExpiresIn)
+        return eAccessTokenExpired;
+
+    appId = it->second->id;
+    return eAccessTokenValid;
+}
+
+int AppStorage::IssueAccessToken(const std::string& serverKey, std::string& token, int64_t& expiresIn)
+{
+    if (serverKey.empty())
+        return 401;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    size_t index = 0;
+    while (index < m_apps.size() && m_apps[index]->serverKey != serverKey)
+        index++;
+    if (index == m_apps.size())
+        return 400;
+
+    if (!GenerateAccessToken(token))
+        return 500;
+
+    // Приложение не изменяется на месте: его могут читать другие потоки.
+    std::shared_ptr<ClientApp> app = std::make_shared<ClientApp>(*m_apps[index]);
+    app->accessToken = token;
+    app->tokenExpiresIn = NowDotNetTicks() + ACCESS_TOKEN_LIFETIME_TICKS;
+    expiresIn = app->tokenExpiresIn;
+
+    std::shared_ptr<const ClientApp> previous = m_apps[index];
+    m_apps[index] = app;
+    if (!Save()) {
+        m_apps[index] = previous;
+        return 500;
+    }
+
+    if (!previous->accessToken.empty())
+        m_appsByToken.erase(previous->accessToken);
+    m_appsById[app->id] = app;
+    m_appsByToken[token] = app;
+    return 200;
+}
+
+size_t AppStorage::Count()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_apps.size();
+}
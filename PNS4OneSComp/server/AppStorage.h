@@ -0,0 +1,74 @@
+#ifndef __APPSTORAGE_H__
+#define __APPSTORAGE_H__
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Клиентское приложение из файла приложений сервиса.
+struct ClientApp
+{
+    ClientApp() : tokenExpiresIn(0) { }
+
+    std::string id;
+    std::string title;
+    std::string serverKey;
+    std::string clientKeyBase64;
+    std::vector<unsigned char> clientKey;
+    std::vector<unsigned char> clientIV;
+    std::string accessToken;
+    // Срок действия ключа доступа в тактах .NET (100 нс с 01.01.0001 UTC), как его хранит сервис на C#.
+    int64_t tokenExpiresIn;
+};
+
+enum AccessTokenStatus
+{
+    eAccessTokenValid,
+    eAccessTokenInvalid,
+    eAccessTokenExpired
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// class AppStorage
+// Файл приложений в формате сервиса на C# (/etc/pns4ones/keys): для каждого приложения строки
+// "#название", идентификатор, ключ сервера, ключ клиента в base64 и необязательная строка
+// "ключ_доступа:срок_действия". Выданные ключи доступа записываются в тот же файл, поэтому
+// сервисы могут заменять друг друга без повторного получения ключа.
+class AppStorage
+{
+public:
+    explicit AppStorage(const std::string& path);
+
+    // Читает файл приложений. При ошибке формата ранее загруженные приложения сохраняются.
+    bool Load();
+
+    std::shared_ptr<const ClientApp> GetApp(const std::string& appId);
+    AccessTokenStatus CheckAccessToken(const std::string& token, std::string& appId);
+
+    // Выдает новый ключ доступа приложению с указанным ключом сервера и сохраняет файл.
+    // Возвращает код состояния HTTP, как метод auth сервиса на C#.
+    int IssueAccessToken(const std::string& serverKey, std::string& token, int64_t& expiresIn);
+
+    size_t Count();
+private:
+    AppStorage(const AppStorage&);
+    AppStorage& operator = (const AppStorage&);
+
+    bool Save();
+    void AddApp(std::vector<std::shared_ptr<ClientApp> >& apps, const std::shared_ptr<ClientApp>& app);
+
+    std::string m_path;
+    std::mutex m_mutex;
+    // Порядок приложений сохраняется при записи файла.
+    std::vector<std::shared_ptr<const ClientApp> > m_apps;
+    std::unordered_map<std::string, std::shared_ptr<const ClientApp> > m_appsById;
+    std::unordered_map<std::string, std::shared_ptr<const ClientApp> > m_appsByToken;
+};
+
+// Текущее время в тактах .NET.
+int64_t NowDotNetTicks();
+
+#endif //__APPSTORAGE_H__
@@ -0,0 +1,409 @@
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include "Dispatcher.h"
+#include "AppStorage.h"
+#include "Reactor.h"
+#include "../FrameCodec.h"
+#include "../crypt.h"
+#include "../base64.h"
+
+// Идентификаторы сообщения и трассировки передаются в открытом заголовке кадра, их длина ограничена.
+constexpr size_t MESSAGE_ID_MAX_SIZE = 256;
+
+int64_t NowUnixMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Разбор сообщения
+
+// Значения читаются так же строго, как System.Text.Json: свойство может отсутствовать
+// или быть null, но значение другого типа делает сообщение некорректным.
+static bool ReadString(const JsonValue& object, const char* key, std::string& value)
+{
+    const JsonValue* item = object.Find(key);
+    if (!item || item->IsNull())
+        return true;
+    if (!item->IsString())
+        return false;
+    value = item->GetString();
+    return true;
+}
+
+static bool ReadObject(const JsonValue& object, const char* key, const JsonValue*& value)
+{
+    value = object.Find(key);
+    if (value && value->IsNull())
+        value = nullptr;
+    return !value || value->IsObject();
+}
+
+static bool ReadInt(const JsonValue& object, const char* key, int& value)
+{
+    const JsonValue* item = object.Find(key);
+    if (!item || item->IsNull())
+        return true;
+    if (item->GetType() != JsonValue::eNumber)
+        return false;
+
+    const std::string& text = item->GetString();
+    char* end = nullptr;
+    long long number = strtoll(text.c_str(), &end, 10);
+    if (*end != '\0' || number < INT_MIN || number > INT_MAX)
+        return false;
+    value = (int)number;
+    return true;
+}
+
+static bool ReadBool(const JsonValue& object, const char* key, bool& value)
+{
+    const JsonValue* item = object.Find(key);
+    if (!item)
+        return true;
+    if (item->GetType() != JsonValue::eBool)
+        return false;
+    value = item->GetBool();
+    return true;
+}
+
+bool ParseIncomingMessage(const char* text, size_t len, IncomingMessage& message)
+{
+    JsonValue root;
+    if (!JsonValue::Parse(text, len, root) || !root.IsObject())
+        return false;
+
+    const JsonValue* recipient = nullptr;
+    const JsonValue* body = nullptr;
+    if (!ReadObject(root, "Recipient", recipient) || !ReadObject(root, "Message", body) || !recipient || !body)
+        return false;
+
+    std::string type;
+    if (!ReadString(*recipient, "Type", type)
+        || !ReadString(*recipient, "IbId", message.ibId)
+        || !ReadString(*recipient, "UserId", message.userId)
+        || !ReadString(*recipient, "UserGroup", message.userGroup)
+        || message.ibId.empty())
+        return false;
+
+    if (type == "user" && !message.userId.empty())
+        message.type = eRecipientUser;
+    else if (type == "group" && !message.userGroup.empty())
+        message.type = eRecipientGroup;
+    else if (type == "all")
+        message.type = eRecipientAll;
+    else
+        return false;
+
+    if (!ReadString(*body, "Id", message.id)
+        || !ReadInt(*body, "Ttl", message.ttl)
+        || !ReadString(*body, "Topic", message.topic)
+        || !ReadString(*body, "TraceId", message.traceId)
+        || message.ttl < 0
+        || message.id.size() > MESSAGE_ID_MAX_SIZE
+        || message.traceId.size() > MESSAGE_ID_MAX_SIZE)
+        return false;
+
+    const JsonValue* notification = nullptr;
+    if (!ReadObject(*body, "Notification", notification))
+        return false;
+    if (notification) {
+        message.hasNotification = true;
+        if (!ReadString(*notification, "Title", message.title)
+            || !ReadString(*notification, "Body", message.body)
+            || !ReadString(*notification, "Icon", message.icon)
+            || !ReadString(*notification, "Action", message.action)
+            || !ReadBool(*notification, "Important", message.important))
+            return false;
+    }
+
+    const JsonValue* data = nullptr;
+    if (!ReadObject(*body, "Data", data))
+        return false;
+    if (data) {
+        for (const JsonValue::Member& member : data->GetMembers()) {
+            if (!member.second.IsNull() && !member.second.IsString())
+                return false;
+            message.data.push_back(std::make_pair(member.first, member.second.GetString()));
+        }
+    }
+
+    // Данные вложения (byte[] в сервисе на C#) должны быть корректным текстом base64.
+    const JsonValue* attachments = body->Find("Attachments");
+    if (attachments && !attachments->IsNull()) {
+        if (attachments->GetType() != JsonValue::eArray)
+            return false;
+
+        std::vector<unsigned char> decoded;
+        for (const JsonValue& item : attachments->GetArray()) {
+            MessageAttachment attachment;
+            const JsonValue* data = item.IsObject() ? item.Find("Data") : nullptr;
+            if (!data || !data->IsString()
+                || !ReadString(item, "Name", attachment.name)
+                || !ReadString(item, "ContentType", attachment.contentType)
+                || attachment.name.empty())
+                return false;
+
+            attachment.data = data->GetString();
+            decoded.resize(base64_decoded_size(attachment.data.data(), attachment.data.size()));
+            if (!base64_decode_n(attachment.data.data(), attachment.data.size(), decoded.data(), decoded.size(), nullptr))
+                return false;
+            message.attachments.push_back(std::move(attachment));
+        }
+    }
+
+    // Документ передается либо полным состоянием, либо изменениями.
+    const JsonValue* document = nullptr;
+    if (!ReadObject(*body, "Document", document))
+        return false;
+    if (document) {
+        const JsonValue* state = document->Find("State");
+        const JsonValue* patch = document->Find("Patch");
+        bool hasState = state && !state->IsNull();
+        bool hasPatch = patch && !patch->IsNull();
+        if (!ReadString(*document, "Id", message.documentId) || message.documentId.empty() || hasState == hasPatch)
+            return false;
+
+        if (hasState)
+            message.documentState = *state;
+        else
+            message.documentPatch = *patch;
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Сериализация сообщения
+
+// Текст сообщения совпадает с NotificationServer.SerializeMessage сервиса на C#,
+// но строки дополнительно экранируются.
+static void SerializeStringValue(std::string& out, const char* name, const std::string& value, bool appendSeparator = true)
+{
+    if (value.empty())
+        return;
+
+    JsonWriteString(out, name);
+    out.append(": ");
+    JsonWriteString(out, value);
+    if (appendSeparator)
+        out.append(", ");
+}
+
+static std::string SerializeMessage(const IncomingMessage& message, int64_t documentVersion,
+    const char* documentPart, const JsonValue* documentContent)
+{
+    std::string out;
+    out.reserve(512);
+    out.push_back('{');
+
+    SerializeStringValue(out, "topic", message.topic, false);
+    bool needSeparator = !message.topic.empty();
+
+    if (message.hasNotification && (!message.title.empty() || !message.body.empty())) {
+        if (needSeparator)
+            out.append(", ");
+
+        out.append("\"notification\": {");
+        SerializeStringValue(out, "title", message.title);
+        SerializeStringValue(out, "body", message.body);
+        SerializeStringValue(out, "icon", message.icon);
+        SerializeStringValue(out, "action", message.action);
+        out.append("\"important\": ");
+        out.append(message.important ? "true" : "false");
+        out.push_back('}');
+        needSeparator = true;
+    }
+
+    if (!message.data.empty()) {
+        if (needSeparator)
+            out.append(", ");
+
+        // Пустые значения не передаются.
+        out.append("\"data\": {");
+        bool first = true;
+        for (const std::pair<std::string, std::string>& item : message.data) {
+            if (item.second.empty())
+                continue;
+            if (!first)
+                out.append(", ");
+            first = false;
+            SerializeStringValue(out, item.first.c_str(), item.second, false);
+        }
+        out.push_back('}');
+        needSeparator = true;
+    }
+
+    if (!message.attachments.empty()) {
+        if (needSeparator)
+            out.append(", ");
+
+        out.append("\"attachments\": [");
+        for (size_t i = 0; i < message.attachments.size(); i++) {
+            const MessageAttachment& attachment = message.attachments[i];
+            if (i > 0)
+                out.append(", ");
+            out.push_back('{');
+            SerializeStringValue(out, "name", attachment.name);
+            SerializeStringValue(out, "contentType", attachment.contentType);
+            out.append("\"data\": ");
+            JsonWriteString(out, attachment.data);
+            out.push_back('}');
+        }
+        out.push_back(']');
+        needSeparator = true;
+    }
+
+    if (documentContent) {
+        if (needSeparator)
+            out.append(", ");
+
+        out.append("\"document\": {");
+        SerializeStringValue(out, "id", message.documentId);
+        out.append("\"version\": ");
+        out.append(std::to_string(documentVersion));
+        out.append(", \"");
+        out.append(documentPart);
+        out.append("\": ");
+        documentContent->Serialize(out);
+        out.push_back('}');
+    }
+
+    out.push_back('}');
+    return out;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Формирование кадров
+
+static bool PrepareFrames(const std::string& text, const ClientApp& app, const IncomingMessage& message,
+    int64_t expiresAt, int64_t ingestedAt, PreparedFrames& frames)
+{
+    AesKey aesKey;
+    aesKey.Key = const_cast<unsigned char*>(app.clientKey.data());
+    aesKey.KeySize = (int)app.clientKey.size();
+    aesKey.IV = const_cast<unsigned char*>(app.clientIV.data());
+    aesKey.IVSize = (int)app.clientIV.size();
+
+    unsigned char* encrypted = nullptr;
+    int encryptedSize = 0;
+    if (!aes_encrypt((unsigned char*)text.data(), (int)text.size(), aesKey, &encrypted, &encryptedSize))
+        return false;
+
+    // Версия 1: размер кадра, размер расшифрованных данных, зашифрованные данные.
+    std::vector<unsigned char>* v1 = new std::vector<unsigned char>(MessageFrameV1Size(encryptedSize));
+    FrameWriter v1Writer(v1->data(), v1->size());
+    PutMessageFramePrefix(v1Writer, false, 0, encryptedSize);
+    v1Writer.PutLE32((uint32_t)text.size());
+    v1Writer.PutBytes(encrypted, encryptedSize);
+    frames.v1.reset(v1);
+
+    // Версия 2: размер кадра, маркер, размер заголовка, заголовок, размер расшифрованных данных,
+    // зашифрованные данные. Время отправки - последнее поле заголовка.
+    size_t headerSize = FrameFieldSize(FRAME_TIMESTAMP_SIZE) * 2;
+    if (!message.id.empty())
+        headerSize += FrameFieldSize(message.id.size());
+    if (expiresAt)
+        headerSize += FrameFieldSize(FRAME_TIMESTAMP_SIZE);
+    if (!message.traceId.empty())
+        headerSize += FrameFieldSize(message.traceId.size());
+    if (headerSize > FRAME_HEADER_MAX_SIZE) {
+        delete[] encrypted;
+        return false;
+    }
+
+    frames.v2.assign(MessageFrameV2Size(headerSize, encryptedSize), 0);
+    FrameWriter writer(frames.v2.data(), frames.v2.size());
+    PutMessageFramePrefix(writer, true, headerSize, encryptedSize);
+    if (!message.id.empty())
+        writer.PutField(FRAME_FIELD_MESSAGE_ID, message.id.data(), message.id.size());
+    if (expiresAt)
+        writer.PutTimestampField(FRAME_FIELD_EXPIRES_AT, expiresAt);
+    writer.PutTimestampField(FRAME_FIELD_INGESTED_AT, ingestedAt);
+    if (!message.traceId.empty())
+        writer.PutField(FRAME_FIELD_TRACE_ID, message.traceId.data(), message.traceId.size());
+    writer.PutTimestampField(FRAME_FIELD_SENT_AT, 0);
+    frames.sentAtOffset = writer.Size() - FRAME_TIMESTAMP_SIZE;
+    writer.PutLE32((uint32_t)text.size());
+    writer.PutBytes(encrypted, encryptedSize);
+
+    delete[] encrypted;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Dispatcher
+
+Dispatcher::Dispatcher(AppStorage& apps) : m_apps(apps)
+{ }
+
+void Dispatcher::AddReactor(Reactor* reactor)
+{
+    m_reactors.push_back(reactor);
+}
+
+void Dispatcher::Post(const std::shared_ptr<const OutgoingMessage>& message)
+{
+    for (Reactor* reactor : m_reactors)
+        reactor->Post(message);
+}
+
+bool Dispatcher::Dispatch(const std::string& appId, const IncomingMessage& message, int64_t ingestedAt)
+{
+    std::shared_ptr<const ClientApp> app = m_apps.GetApp(appId);
+    if (!app)
+        return false;
+
+    std::shared_ptr<OutgoingMessage> outgoing = std::make_shared<OutgoingMessage>();
+    outgoing->appId = appId;
+    outgoing->ibId = message.ibId;
+    outgoing->type = message.type;
+    outgoing->target = message.type == eRecipientUser ? message.userId : message.userGroup;
+    outgoing->topic = message.topic;
+    if (message.ttl > 0)
+        outgoing->expiresAt = NowUnixMs() + (int64_t)message.ttl * 1000;
+
+    if (message.documentId.empty()) {
+        if (!PrepareFrames(SerializeMessage(message, 0, nullptr, nullptr), *app, message,
+            outgoing->expiresAt, ingestedAt, outgoing->frames))
+            return false;
+
+        Post(outgoing);
+        return true;
+    }
+
+    std::string key = appId + "\n" + message.ibId + "\n" + message.documentId;
+    bool isPatch = !message.documentPatch.IsNull();
+
+    std::lock_guard<std::mutex> lock(m_documentsMutex);
+
+    Document& document = m_documents[key];
+    JsonValue previousState = document.state;
+    if (isPatch)
+        document.state.ApplyMergePatch(message.documentPatch);
+    else
+        document.state = message.documentState;
+
+    outgoing->isDocument = true;
+    outgoing->documentKey = key;
+    outgoing->documentVersion = document.version + 1;
+    outgoing->hasPatch = isPatch;
+
+    bool prepared = PrepareFrames(SerializeMessage(message, outgoing->documentVersion, "state", &document.state),
+        *app, message, outgoing->expiresAt, ingestedAt, outgoing->frames);
+    if (prepared && isPatch) {
+        prepared = PrepareFrames(SerializeMessage(message, outgoing->documentVersion, "patch", &message.documentPatch),
+            *app, message, outgoing->expiresAt, ingestedAt, outgoing->patchFrames);
+    }
+    if (!prepared) {
+        document.state = previousState;
+        return false;
+    }
+
+    document.version = outgoing->documentVersion;
+    Post(outgoing);
+    return true;
+}
@@ -0,0 +1,139 @@
+#ifndef __DISPATCHER_H__
+#define __DISPATCHER_H__
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../Json.h"
+
+class AppStorage;
+class Reactor;
+
+// Вложение сообщения. Данные хранятся проверенным текстом base64 и передаются клиенту без повторного кодирования.
+struct MessageAttachment
+{
+    std::string name;
+    std::string contentType;
+    std::string data;
+};
+
+enum RecipientType
+{
+    eRecipientUser,
+    eRecipientGroup,
+    eRecipientAll
+};
+
+// Сообщение метода sendmessage или публикации клиента. Имена свойств JSON совпадают
+// с классами IncomingMessage, MessageRecipient и Message сервиса на C# (с учетом регистра).
+struct IncomingMessage
+{
+    IncomingMessage() : type(eRecipientAll), ttl(0), hasNotification(false), important(false) { }
+
+    RecipientType type;
+    std::string ibId;
+    std::string userId;
+    std::string userGroup;
+
+    std::string id;
+    int ttl;
+    std::string topic;
+    std::string traceId;
+
+    bool hasNotification;
+    std::string title;
+    std::string body;
+    std::string icon;
+    std::string action;
+    bool important;
+
+    std::vector<std::pair<std::string, std::string> > data;
+    std::vector<MessageAttachment> attachments;
+
+    std::string documentId;
+    JsonValue documentState;
+    JsonValue documentPatch;
+};
+
+// Разбирает и проверяет сообщение по правилам SendMessageHandler.IncomingMessageIsCorrect.
+// Возвращает false, если сообщение некорректно (ответ 400).
+bool ParseIncomingMessage(const char* text, size_t len, IncomingMessage& message);
+
+typedef std::shared_ptr<const std::vector<unsigned char> > SharedFrame;
+
+// Кадры одного зашифрованного сообщения. Кадр версии 1 передается всем клиентам без изменений,
+// в копию шаблона версии 2 поток соединений записывает время отправки.
+struct PreparedFrames
+{
+    PreparedFrames() : sentAtOffset(0) { }
+
+    SharedFrame v1;
+    std::vector<unsigned char> v2;
+    size_t sentAtOffset;
+};
+
+// Сообщение, подготовленное к рассылке. Не изменяется после передачи потокам соединений.
+struct OutgoingMessage
+{
+    OutgoingMessage() : type(eRecipientAll), expiresAt(0), isDocument(false), documentVersion(0), hasPatch(false) { }
+
+    std::string appId;
+    std::string ibId;
+    RecipientType type;
+    std::string target; // пользователь или группа получателей
+    std::string topic;
+    int64_t expiresAt;  // миллисекунды с 01.01.1970 UTC, 0 - без ограничения
+
+    // Сообщение или полный снимок документа.
+    PreparedFrames frames;
+
+    // Изменения документа получают только клиенты, у которых есть предыдущая версия.
+    bool isDocument;
+    std::string documentKey;
+    int64_t documentVersion;
+    bool hasPatch;
+    PreparedFrames patchFrames;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// class Dispatcher
+// Шифрует сообщение один раз для всех получателей и передает его всем потокам соединений:
+// каждый поток сам выбирает получателей среди своих подключений, поэтому общих блокировок
+// на пути рассылки нет. Состояние документов хранится здесь же, изменения документа
+// применяются и передаются потокам под блокировкой, чтобы версии приходили клиентам по порядку.
+class Dispatcher
+{
+public:
+    explicit Dispatcher(AppStorage& apps);
+
+    void AddReactor(Reactor* reactor);
+    // Возвращает false, если приложение не найдено или сообщение не удалось зашифровать.
+    bool Dispatch(const std::string& appId, const IncomingMessage& message, int64_t ingestedAt);
+private:
+    Dispatcher(const Dispatcher&);
+    Dispatcher& operator = (const Dispatcher&);
+
+    struct Document
+    {
+        Document() : version(0) { }
+
+        JsonValue state;
+        int64_t version;
+    };
+
+    void Post(const std::shared_ptr<const OutgoingMessage>& message);
+
+    AppStorage& m_apps;
+    std::vector<Reactor*> m_reactors;
+
+    std::mutex m_documentsMutex;
+    std::unordered_map<std::string, Document> m_documents;
+};
+
+int64_t NowUnixMs();
+
+#endif //__DISPATCHER_H__
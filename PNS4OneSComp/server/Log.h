@@ -0,0 +1,49 @@
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include <cstdarg>
+#include <cstdio>
+#include <ctime>
+#include <string>
+
+// Уровни логов совпадают с уровнями сервиса на C# (параметр /log_level).
+enum LogLevel
+{
+    eLogTrace,
+    eLogDebug,
+    eLogInformation,
+    eLogWarning,
+    eLogError,
+    eLogCritical,
+    eLogNone
+};
+
+extern LogLevel g_LogLevel;
+
+bool ParseLogLevel(const std::string& name, LogLevel& level);
+
+#if defined(__GNUC__)
+__attribute__((format(printf, 2, 3)))
+#endif
+inline void Log(LogLevel level, const char* format, ...)
+{
+    static const char* names[] = { "trce", "dbug", "info", "warn", "fail", "crit" };
+    if (level < g_LogLevel || level >= eLogNone)
+        return;
+
+    char timeBuf[32];
+    time_t now = time(nullptr);
+    tm utc;
+    gmtime_r(&now, &utc);
+    strftime(timeBuf, sizeof(timeBuf), "%Y-%m-%d %H:%M:%S", &utc);
+
+    // Строка формируется целиком, чтобы строки разных потоков не перемешивались.
+    char message[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    fprintf(stderr, "%s %s: %s\n", timeBuf, names[level], message);
+}
+
+#endif //__LOG_H__
@@ -0,0 +1,821 @@
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <openssl/crypto.h>
+#include "Reactor.h"
+#include "AppStorage.h"
+#include "Log.h"
+#include "../FrameCodec.h"
+#include "../crypt.h"
+
+constexpr int EPOLL_MAX_EVENTS = 256;
+constexpr size_t RECEIVE_CHUNK_SIZE = 64 * 1024;
+constexpr size_t RECEIVE_KEEP_CAPACITY = 4 * 1024;
+constexpr int LISTEN_BACKLOG = 4096;
+constexpr size_t WRITE_MAX_IOV = 64;
+constexpr size_t HTTP_HEADER_MAX_SIZE = 16 * 1024;
+
+static bool IsConnectionReset(int error)
+{
+    return error == ECONNRESET || error == EPIPE || error == ETIMEDOUT;
+}
+
+static std::string ToLower(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return (char)tolower(c); });
+    return s;
+}
+
+static std::string UrlDecode(const std::string& s)
+{
+    std::string result;
+    result.reserve(s.size());
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '+')
+            result.push_back(' ');
+        else if (s[i] == '%' && i + 2 < s.size() && isxdigit((unsigned char)s[i + 1]) && isxdigit((unsigned char)s[i + 2])) {
+            result.push_back((char)strtol(s.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        }
+        else
+            result.push_back(s[i]);
+    }
+    return result;
+}
+
+static std::string QueryParameter(const std::string& query, const std::string& name)
+{
+    size_t pos = 0;
+    while (pos <= query.size()) {
+        size_t end = query.find('&', pos);
+        if (end == std::string::npos)
+            end = query.size();
+        std::string pair = query.substr(pos, end - pos);
+        size_t eq = pair.find('=');
+        if (UrlDecode(pair.substr(0, eq)) == name)
+            return eq == std::string::npos ? std::string() : UrlDecode(pair.substr(eq + 1));
+        pos = end + 1;
+    }
+    return std::string();
+}
+
+static const char* HttpReason(int status)
+{
+    switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 411: return "Length Required";
+    case 413: return "Payload Too Large";
+    case 431: return "Request Header Fields Too Large";
+    default: return "Internal Server Error";
+    }
+}
+
+static int OpenListenSocket(const sockaddr_in& address)
+{
+    int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return -1;
+
+    int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+    if (bind(sock, (const sockaddr*)&address, sizeof(address)) != 0 || listen(sock, LISTEN_BACKLOG) != 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Reactor
+
+Reactor::Connection::Connection(int fd, ConnectionKind kind) :
+    fd(fd),
+    kind(kind),
+    closed(false),
+    dirty(false),
+    writeArmed(false),
+    closeAfterWrite(false),
+    outBytes(0),
+    registered(false),
+    protocolVersion(1),
+    lastPublishSequence(0)
+{ }
+
+Reactor::Reactor(AppStorage& apps, Dispatcher& dispatcher, const ReactorOptions& options) :
+    m_apps(apps),
+    m_dispatcher(dispatcher),
+    m_options(options),
+    m_epoll(-1),
+    m_wakeup(-1),
+    m_serviceSocket(-1),
+    m_listenSocket(-1),
+    m_stop(false),
+    m_receiveBuffer(RECEIVE_CHUNK_SIZE),
+    m_clientCount(0)
+{ }
+
+Reactor::~Reactor()
+{
+    for (Connection* conn : m_connections) {
+        close(conn->fd);
+        delete conn;
+    }
+
+    int* fds[] = { &m_serviceSocket, &m_listenSocket, &m_wakeup, &m_epoll };
+    for (int* fd : fds) {
+        if (*fd >= 0)
+            close(*fd);
+    }
+}
+
+bool Reactor::Listen(const sockaddr_in& serviceAddress, const sockaddr_in& listenAddress)
+{
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_serviceSocket = OpenListenSocket(serviceAddress);
+    m_listenSocket = OpenListenSocket(listenAddress);
+    if (m_epoll < 0 || m_wakeup < 0 || m_serviceSocket < 0 || m_listenSocket < 0)
+        return false;
+
+    // Для служебных дескрипторов в событии передается адрес поля с дескриптором.
+    int* fds[] = { &m_serviceSocket, &m_listenSocket, &m_wakeup };
+    for (int* fd : fds) {
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = fd;
+        if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, *fd, &event) != 0)
+            return false;
+    }
+    return true;
+}
+
+void Reactor::Stop()
+{
+    m_stop = true;
+    uint64_t one = 1;
+    ssize_t written = write(m_wakeup, &one, sizeof(one));
+    (void)written;
+}
+
+void Reactor::Post(const std::shared_ptr<const OutgoingMessage>& message)
+{
+    bool wasEmpty;
+    {
+        std::lock_guard<std::mutex> lock(m_postMutex);
+        wasEmpty = m_posted.empty();
+        m_posted.push_back(message);
+    }
+
+    // Поток уже разбужен предыдущим сообщением и заберет очередь целиком.
+    if (wasEmpty) {
+        uint64_t one = 1;
+        ssize_t written = write(m_wakeup, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+void Reactor::Run()
+{
+    epoll_event events[EPOLL_MAX_EVENTS];
+
+    while (!m_stop) {
+        int count = epoll_wait(m_epoll, events, EPOLL_MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            Log(eLogCritical, "epoll_wait failed: %s", strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            void* ptr = events[i].data.ptr;
+            if (ptr == &m_serviceSocket)
+                Accept(m_serviceSocket, eConnectionClient);
+            else if (ptr == &m_listenSocket)
+                Accept(m_listenSocket, eConnectionHttp);
+            else if (ptr == &m_wakeup) {
+                uint64_t value;
+                ssize_t received = read(m_wakeup, &value, sizeof(value));
+                (void)received;
+                DrainPosted();
+            }
+            else {
+                Connection* conn = (Connection*)ptr;
+                if (!conn->closed && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+                    OnReadable(conn);
+                if (!conn->closed && (events[i].events & EPOLLOUT))
+                    OnWritable(conn);
+            }
+        }
+
+        // Данные, добавленные за проход, отправляются одним вызовом sendmsg на соединение.
+        FlushDirty();
+        ReapClosed();
+    }
+}
+
+void Reactor::Accept(int listenSocket, ConnectionKind kind)
+{
+    while (true) {
+        int fd = accept4(listenSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EMFILE || errno == ENFILE)
+                Log(eLogError, "cannot accept connection: %s", strerror(errno));
+            return;
+        }
+
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        Connection* conn = new Connection(fd, kind);
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = conn;
+        if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            delete conn;
+            continue;
+        }
+        m_connections.insert(conn);
+    }
+}
+
+void Reactor::OnReadable(Connection* conn)
+{
+    while (true) {
+        ssize_t count = recv(conn->fd, m_receiveBuffer.data(), m_receiveBuffer.size(), 0);
+        if (count == 0) {
+            MarkClosed(conn);
+            return;
+        }
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                if (!IsConnectionReset(errno))
+                    Log(eLogWarning, "receive failed: %s", strerror(errno));
+                MarkClosed(conn);
+            }
+            return;
+        }
+
+        conn->in.insert(conn->in.end(), m_receiveBuffer.begin(), m_receiveBuffer.begin() + count);
+        bool processed = conn->kind == eConnectionClient ? ProcessClientFrames(conn) : ProcessHttpRequests(conn);
+        if (!processed) {
+            MarkClosed(conn);
+            return;
+        }
+
+        // Буфер приема освобождается после обработки, иначе при большом числе подключений
+        // память занимают буферы, выделенные под редкие большие кадры.
+        if (conn->in.empty() && conn->in.capacity() > RECEIVE_KEEP_CAPACITY)
+            std::vector<unsigned char>().swap(conn->in);
+        if ((size_t)count < m_receiveBuffer.size())
+            return;
+    }
+}
+
+void Reactor::OnWritable(Connection* conn)
+{
+    SetWriteArmed(conn, false);
+    Flush(conn);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Протокол клиентов
+
+bool Reactor::ProcessClientFrames(Connection* conn)
+{
+    // Каждый кадр клиента: 2 байта - размер данных, данные. Первым кадром передаются данные регистрации.
+    size_t pos = 0;
+    bool result = true;
+    while (result && conn->in.size() - pos >= CLIENT_FRAME_SIZE_BYTES) {
+        size_t size = LoadLE16(conn->in.data() + pos);
+        if (conn->in.size() - pos - CLIENT_FRAME_SIZE_BYTES < size)
+            break;
+
+        const unsigned char* data = conn->in.data() + pos + CLIENT_FRAME_SIZE_BYTES;
+        pos += CLIENT_FRAME_SIZE_BYTES + size;
+
+        if (!conn->registered)
+            result = RegisterClient(conn, data, size);
+        else if (size > 0 && data[0] == CONTROL_FRAME_PUBLISH)
+            result = ProcessPublishFrame(conn, data, size);
+        else
+            result = ProcessControlFrame(conn, data, size);
+    }
+
+    conn->in.erase(conn->in.begin(), conn->in.begin() + pos);
+    return result;
+}
+
+bool Reactor::RegisterClient(Connection* conn, const unsigned char* data, size_t size)
+{
+    RegistrationView registration;
+    if (!ParseRegistration(data, size, registration))
+        return false;
+
+    std::string appId(registration.appId.chars(), registration.appId.size);
+    std::shared_ptr<const ClientApp> app = m_apps.GetApp(appId);
+    if (!app)
+        return false;
+
+    unsigned char* hash = nullptr;
+    int computedSize = 0;
+    if (!hmacsha256_sign(const_cast<unsigned char*>(registration.signedData.data), (int)registration.signedData.size,
+        const_cast<unsigned char*>(app->clientKey.data()), (int)app->clientKey.size(), &hash, &computedSize))
+        return false;
+    bool signatureValid = (size_t)computedSize == registration.signature.size
+        && CRYPTO_memcmp(hash, registration.signature.data, registration.signature.size) == 0;
+    delete[] hash;
+    if (!signatureValid)
+        return false;
+
+    conn->appId = appId;
+    conn->ibId.assign(registration.ibId.chars(), registration.ibId.size);
+    conn->userId.assign(registration.userId.chars(), registration.userId.size);
+    conn->userGroup.assign(registration.userGroup.chars(), registration.userGroup.size);
+    if (registration.hasProtocolVersion) {
+        int protocolVersion = atoi(std::string(registration.protocolVersion.chars(), registration.protocolVersion.size).c_str());
+        if (protocolVersion > 0)
+            conn->protocolVersion = protocolVersion;
+    }
+    conn->registered = true;
+
+    std::string ibKey = conn->appId + "\n" + conn->ibId;
+    m_byIb[ibKey].insert(conn);
+    m_byUser[ibKey + "\n" + conn->userId].insert(conn);
+    m_byGroup[ibKey + "\n" + conn->userGroup].insert(conn);
+    m_clientCount++;
+    return true;
+}
+
+bool Reactor::ProcessControlFrame(Connection* conn, const unsigned char* data, size_t size)
+{
+    if (size == 0)
+        return false;
+
+    std::vector<std::string> topics;
+    FrameReader reader(data + 1, size - 1);
+    ByteView topic;
+    while (reader.Remaining() > 0) {
+        if (!reader.ReadCString(topic))
+            return false;
+        topics.push_back(std::string(topic.chars(), topic.size));
+    }
+
+    switch (data[0]) {
+    case CONTROL_FRAME_SET_TOPICS:
+        conn->topics.reset(new std::unordered_set<std::string>(topics.begin(), topics.end()));
+        break;
+    case CONTROL_FRAME_ADD_TOPICS:
+        if (!conn->topics)
+            conn->topics.reset(new std::unordered_set<std::string>());
+        conn->topics->insert(topics.begin(), topics.end());
+        break;
+    case CONTROL_FRAME_REMOVE_TOPICS:
+        if (conn->topics) {
+            for (const std::string& topic : topics)
+                conn->topics->erase(topic);
+        }
+        break;
+    case CONTROL_FRAME_RESET_TOPICS:
+        conn->topics.reset();
+        break;
+    default:
+        Log(eLogWarning, "unknown control frame type %d from client %s", data[0], conn->userId.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Reactor::ProcessPublishFrame(Connection* conn, const unsigned char* data, size_t size)
+{
+    std::shared_ptr<const ClientApp> app = m_apps.GetApp(conn->appId);
+    if (!app)
+        return false;
+
+    // тип кадра + номер публикации + размер данных + зашифрованные данные + подпись
+    PublishFrameView frame;
+    if (!ParsePublishFrame(data, size, frame))
+        return false;
+
+    unsigned char* hash = nullptr;
+    int hashSize = 0;
+    if (!hmacsha256_sign(const_cast<unsigned char*>(frame.signedData.data), (int)frame.signedData.size,
+        const_cast<unsigned char*>(app->clientKey.data()), (int)app->clientKey.size(), &hash, &hashSize))
+        return false;
+    bool signatureValid = hashSize == (int)HMAC_SHA256_SIZE && CRYPTO_memcmp(hash, frame.signature.data, hashSize) == 0;
+    delete[] hash;
+    if (!signatureValid) {
+        Log(eLogWarning, "invalid publication signature from client %s", conn->userId.c_str());
+        return false;
+    }
+
+    if (frame.sequence <= conn->lastPublishSequence) {
+        Log(eLogWarning, "repeated publication from client %s is rejected", conn->userId.c_str());
+        return false;
+    }
+    conn->lastPublishSequence = frame.sequence;
+
+    // Расшифровываются все блоки, чтобы проверить дополнение PKCS#7 так же, как сервис на C#.
+    int dataSize = (int)frame.decryptedSize;
+    int encryptedSize = (int)frame.encrypted.size;
+    if (encryptedSize == 0 || encryptedSize % 16 != 0 || dataSize <= 0 || dataSize > encryptedSize
+        || encryptedSize - dataSize > 16)
+        return false;
+
+    AesKey aesKey;
+    aesKey.Key = const_cast<unsigned char*>(app->clientKey.data());
+    aesKey.KeySize = (int)app->clientKey.size();
+    aesKey.IV = const_cast<unsigned char*>(app->clientIV.data());
+    aesKey.IVSize = (int)app->clientIV.size();
+
+    unsigned char* decrypted = nullptr;
+    bool decryptedValid = aes_decrypt(const_cast<unsigned char*>(frame.encrypted.data), encryptedSize, aesKey,
+        &decrypted, encryptedSize) && decrypted[encryptedSize - 1] == encryptedSize - dataSize;
+
+    IncomingMessage message;
+    bool messageValid = decryptedValid
+        && ParseIncomingMessage((const char*)decrypted, dataSize, message)
+        && message.ibId == conn->ibId;
+    delete[] decrypted;
+
+    if (!messageValid) {
+        Log(eLogWarning, "invalid publication from client %s", conn->userId.c_str());
+        return false;
+    }
+
+    return m_dispatcher.Dispatch(conn->appId, message, NowUnixMs());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// HTTP
+
+bool Reactor::ProcessHttpRequests(Connection* conn)
+{
+    // Запросы конвейера обрабатываются по порядку, ответы передаются в том же порядке.
+    size_t pos = 0;
+    while (!conn->closeAfterWrite) {
+        const char* begin = (const char*)conn->in.data() + pos;
+        const char* end = (const char*)conn->in.data() + conn->in.size();
+        const char* headerEnd = std::search(begin, end, "\r\n\r\n", "\r\n\r\n" + 4);
+        if (headerEnd == end) {
+            if ((size_t)(end - begin) > HTTP_HEADER_MAX_SIZE) {
+                conn->closeAfterWrite = true;
+                SendHttpResponse(conn, 431);
+            }
+            break;
+        }
+
+        std::string head(begin, headerEnd);
+        size_t lineEnd = head.find("\r\n");
+        std::string requestLine = head.substr(0, lineEnd);
+        size_t methodEnd = requestLine.find(' ');
+        size_t targetEnd = requestLine.rfind(' ');
+        if (methodEnd == std::string::npos || targetEnd <= methodEnd) {
+            conn->closeAfterWrite = true;
+            SendHttpResponse(conn, 400);
+            break;
+        }
+
+        std::string method = requestLine.substr(0, methodEnd);
+        std::string target = requestLine.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+        bool keepAlive = requestLine.compare(targetEnd + 1, std::string::npos, "HTTP/1.0") != 0;
+
+        size_t contentLength = 0;
+        bool chunked = false;
+        std::string authorization;
+        size_t linePos = lineEnd == std::string::npos ? head.size() : lineEnd + 2;
+        while (linePos < head.size()) {
+            size_t next = head.find("\r\n", linePos);
+            if (next == std::string::npos)
+                next = head.size();
+            std::string line = head.substr(linePos, next - linePos);
+            linePos = next + 2;
+
+            size_t colon = line.find(':');
+            if (colon == std::string::npos)
+                continue;
+            std::string name = ToLower(line.substr(0, colon));
+            size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+            std::string value = valueStart == std::string::npos ? std::string() : line.substr(valueStart);
+
+            if (name == "content-length")
+                contentLength = (size_t)strtoull(value.c_str(), nullptr, 10);
+            else if (name == "authorization")
+                authorization = value;
+            else if (name == "transfer-encoding")
+                chunked = ToLower(value).find("chunked") != std::string::npos;
+            else if (name == "connection") {
+                std::string lower = ToLower(value);
+                if (lower.find("close") != std::string::npos)
+                    keepAlive = false;
+                else if (lower.find("keep-alive") != std::string::npos)
+                    keepAlive = true;
+            }
+        }
+
+        // Запросы отправителей небольшие, передача тела частями не поддерживается.
+        if (chunked || contentLength > m_options.requestBodyLimit) {
+            conn->closeAfterWrite = true;
+            SendHttpResponse(conn, chunked ? 411 : 413);
+            break;
+        }
+
+        const char* body = headerEnd + 4;
+        if ((size_t)(end - body) < contentLength)
+            break;
+
+        conn->closeAfterWrite = !keepAlive;
+        HandleHttpRequest(conn, method, target, authorization, body, contentLength);
+        pos = body + contentLength - (const char*)conn->in.data();
+    }
+
+    conn->in.erase(conn->in.begin(), conn->in.begin() + pos);
+    return true;
+}
+
+void Reactor::HandleHttpRequest(Connection* conn, const std::string& method, const std::string& target,
+    const std::string& authorization, const char* body, size_t bodySize)
+{
+    size_t queryPos = target.find('?');
+    std::string path = ToLower(target.substr(0, queryPos));
+    std::string query = queryPos == std::string::npos ? std::string() : target.substr(queryPos + 1);
+
+    if (path == "/auth") {
+        if (method != "GET") {
+            SendHttpResponse(conn, 405);
+            return;
+        }
+
+        std::string token;
+        int64_t expiresIn = 0;
+        int status = m_apps.IssueAccessToken(QueryParameter(query, "server_key"), token, expiresIn);
+        if (status != 200) {
+            SendHttpResponse(conn, status);
+            return;
+        }
+
+        // Срок действия передается в секундах с 01.01.0001, как его возвращает сервис на C#.
+        char response[256];
+        snprintf(response, sizeof(response), "{\"access_token\": \"%s\", \"expires_in\": %lld}",
+            token.c_str(), (long long)((expiresIn + 5000000) / 10000000));
+        SendHttpResponse(conn, 200, response);
+    }
+    else if (path == "/sendmessage") {
+        if (method != "POST") {
+            SendHttpResponse(conn, 405);
+            return;
+        }
+
+        int64_t ingestedAt = NowUnixMs();
+        const std::string bearer = "Bearer ";
+        std::string appId;
+        AccessTokenStatus tokenStatus = authorization.compare(0, bearer.size(), bearer) == 0
+            ? m_apps.CheckAccessToken(authorization.substr(bearer.size()), appId)
+            : eAccessTokenInvalid;
+        if (tokenStatus != eAccessTokenValid) {
+            SendHttpResponse(conn, tokenStatus == eAccessTokenExpired ? 403 : 401);
+            return;
+        }
+
+        IncomingMessage message;
+        if (!ParseIncomingMessage(body, bodySize, message)) {
+            SendHttpResponse(conn, 400);
+            return;
+        }
+
+        SendHttpResponse(conn, m_dispatcher.Dispatch(appId, message, ingestedAt) ? 200 : 500);
+    }
+    else
+        SendHttpResponse(conn, 404);
+}
+
+void Reactor::SendHttpResponse(Connection* conn, int status, const std::string& body)
+{
+    std::string response = "HTTP/1.1 " + std::to_string(status) + " " + HttpReason(status) + "\r\n";
+    if (!body.empty())
+        response += "Content-Type: application/json\r\n";
+    if (conn->closeAfterWrite)
+        response += "Connection: close\r\n";
+    response += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+
+    Enqueue(conn, std::make_shared<const std::vector<unsigned char> >(response.begin(), response.end()));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Рассылка
+
+void Reactor::DrainPosted()
+{
+    std::vector<std::shared_ptr<const OutgoingMessage> > posted;
+    {
+        std::lock_guard<std::mutex> lock(m_postMutex);
+        posted.swap(m_posted);
+    }
+
+    int64_t now = NowUnixMs();
+    for (const std::shared_ptr<const OutgoingMessage>& message : posted)
+        Deliver(*message, now);
+}
+
+static SharedFrame StampSentAt(const PreparedFrames& frames, int64_t sentAt)
+{
+    std::vector<unsigned char>* frame = new std::vector<unsigned char>(frames.v2);
+    StoreLE64(&(*frame)[frames.sentAtOffset], (uint64_t)sentAt);
+    return SharedFrame(frame);
+}
+
+void Reactor::Deliver(const OutgoingMessage& message, int64_t now)
+{
+    // Сообщение могло устареть, пока ожидало отправки.
+    if (message.expiresAt && message.expiresAt < now)
+        return;
+
+    std::string key = message.appId + "\n" + message.ibId;
+    ConnectionIndex* index = &m_byIb;
+    if (message.type != eRecipientAll) {
+        key += "\n" + message.target;
+        index = message.type == eRecipientUser ? &m_byUser : &m_byGroup;
+    }
+
+    ConnectionIndex::iterator recipients = index->find(key);
+    if (recipients == index->end())
+        return;
+
+    // Время отправки записывается один раз на поток: все получатели потока получают кадр
+    // в одном проходе цикла.
+    SharedFrame v2;
+    SharedFrame patchV2;
+    for (Connection* conn : recipients->second) {
+        if (conn->closed)
+            continue;
+
+        // Широковещательные сообщения передаются только клиентам, подписанным на тему сообщения.
+        // Сообщения без темы передаются всем клиентам независимо от подписки.
+        if (message.type != eRecipientUser && !message.topic.empty()
+            && conn->topics && conn->topics->count(message.topic) == 0)
+            continue;
+
+        bool sendPatch = false;
+        if (message.isDocument) {
+            std::unordered_map<std::string, int64_t>::iterator version = conn->documentVersions.find(message.documentKey);
+            sendPatch = message.hasPatch && version != conn->documentVersions.end()
+                && version->second == message.documentVersion - 1;
+            conn->documentVersions[message.documentKey] = message.documentVersion;
+        }
+
+        const PreparedFrames& frames = sendPatch ? message.patchFrames : message.frames;
+        if (conn->protocolVersion < 2) {
+            Enqueue(conn, frames.v1);
+            continue;
+        }
+
+        SharedFrame& stamped = sendPatch ? patchV2 : v2;
+        if (!stamped)
+            stamped = StampSentAt(frames, NowUnixMs());
+        Enqueue(conn, stamped);
+    }
+}
+
+void Reactor::Enqueue(Connection* conn, const SharedFrame& frame)
+{
+    if (conn->closed)
+        return;
+
+    OutChunk chunk;
+    chunk.data = frame;
+    chunk.offset = 0;
+    conn->out.push_back(chunk);
+    conn->outBytes += frame->size();
+
+    // Клиент, который не успевает принимать сообщения, отключается, чтобы очередь не росла без ограничений.
+    if (conn->outBytes > m_options.outboundLimit) {
+        Log(eLogWarning, "client %s is disconnected: %zu bytes are not sent", conn->userId.c_str(), conn->outBytes);
+        MarkClosed(conn);
+        return;
+    }
+
+    if (!conn->dirty) {
+        conn->dirty = true;
+        m_dirty.push_back(conn);
+    }
+}
+
+void Reactor::FlushDirty()
+{
+    for (Connection* conn : m_dirty) {
+        conn->dirty = false;
+        // Если сокет заполнен, данные будут отправлены по событию EPOLLOUT.
+        if (!conn->closed && !conn->writeArmed)
+            Flush(conn);
+    }
+    m_dirty.clear();
+}
+
+void Reactor::Flush(Connection* conn)
+{
+    while (!conn->out.empty()) {
+        iovec iov[WRITE_MAX_IOV];
+        size_t iovCount = 0;
+        for (std::deque<OutChunk>::iterator it = conn->out.begin(); it != conn->out.end() && iovCount < WRITE_MAX_IOV; ++it) {
+            iov[iovCount].iov_base = (void*)(it->data->data() + it->offset);
+            iov[iovCount].iov_len = it->data->size() - it->offset;
+            iovCount++;
+        }
+
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovCount;
+        ssize_t sent = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                SetWriteArmed(conn, true);
+                return;
+            }
+            if (!IsConnectionReset(errno))
+                Log(eLogWarning, "send to client %s failed: %s", conn->userId.c_str(), strerror(errno));
+            MarkClosed(conn);
+            return;
+        }
+
+        conn->outBytes -= (size_t)sent;
+        while (sent > 0) {
+            OutChunk& chunk = conn->out.front();
+            size_t left = chunk.data->size() - chunk.offset;
+            if ((size_t)sent < left) {
+                chunk.offset += (size_t)sent;
+                break;
+            }
+            sent -= (ssize_t)left;
+            conn->out.pop_front();
+        }
+    }
+
+    if (conn->closeAfterWrite)
+        MarkClosed(conn);
+}
+
+void Reactor::SetWriteArmed(Connection* conn, bool armed)
+{
+    if (conn->writeArmed == armed)
+        return;
+
+    epoll_event event;
+    event.events = armed ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    event.data.ptr = conn;
+    epoll_ctl(m_epoll, EPOLL_CTL_MOD, conn->fd, &event);
+    conn->writeArmed = armed;
+}
+
+void Reactor::MarkClosed(Connection* conn)
+{
+    // Соединение удаляется в конце прохода цикла: на него могут ссылаться события
+    // текущего прохода и перебираемый при рассылке индекс.
+    if (conn->closed)
+        return;
+    conn->closed = true;
+    m_closed.push_back(conn);
+}
+
+void Reactor::ReapClosed()
+{
+    for (Connection* conn : m_closed) {
+        if (conn->registered) {
+            std::string ibKey = conn->appId + "\n" + conn->ibId;
+            std::string keys[] = { ibKey, ibKey + "\n" + conn->userId, ibKey + "\n" + conn->userGroup };
+            ConnectionIndex* indexes[] = { &m_byIb, &m_byUser, &m_byGroup };
+            for (size_t i = 0; i < 3; i++) {
+                ConnectionIndex::iterator it = indexes[i]->find(keys[i]);
+                if (it == indexes[i]->end())
+                    continue;
+                it->second.erase(conn);
+                if (it->second.empty())
+                    indexes[i]->erase(it);
+            }
+            m_clientCount--;
+        }
+
+        m_connections.erase(conn);
+        close(conn->fd);
+        delete conn;
+    }
+    m_closed.clear();
+}
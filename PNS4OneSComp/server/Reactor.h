@@ -0,0 +1,140 @@
+#ifndef __REACTOR_H__
+#define __REACTOR_H__
+
+#include <netinet/in.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Dispatcher.h"
+
+class AppStorage;
+
+struct ReactorOptions
+{
+    ReactorOptions() : outboundLimit(4 * 1024 * 1024), requestBodyLimit(1024 * 1024) { }
+
+    // Объем неотправленных данных, при превышении которого медленный клиент отключается.
+    size_t outboundLimit;
+    size_t requestBodyLimit;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// class Reactor
+// Поток соединений: собственный epoll, собственные сокеты прослушивания клиентов и метода
+// sendmessage (SO_REUSEPORT, подключения распределяет ядро) и индексы получателей по базе,
+// пользователю и группе. Подключения потока не доступны другим потокам: подготовленные
+// сообщения передаются через очередь и eventfd, и каждый поток рассылает их своим клиентам.
+class Reactor
+{
+public:
+    Reactor(AppStorage& apps, Dispatcher& dispatcher, const ReactorOptions& options);
+    ~Reactor();
+
+    bool Listen(const sockaddr_in& serviceAddress, const sockaddr_in& listenAddress);
+    void Run();
+    // Может вызываться из любого потока.
+    void Stop();
+    void Post(const std::shared_ptr<const OutgoingMessage>& message);
+
+    size_t ClientCount() const { return m_clientCount; }
+private:
+    Reactor(const Reactor&);
+    Reactor& operator = (const Reactor&);
+
+    enum ConnectionKind
+    {
+        eConnectionClient,
+        eConnectionHttp
+    };
+
+    struct OutChunk
+    {
+        SharedFrame data;
+        size_t offset;
+    };
+
+    struct Connection
+    {
+        Connection(int fd, ConnectionKind kind);
+
+        int fd;
+        ConnectionKind kind;
+        bool closed;
+        bool dirty;
+        bool writeArmed;
+        bool closeAfterWrite;
+
+        std::vector<unsigned char> in;
+        std::deque<OutChunk> out;
+        size_t outBytes;
+
+        bool registered;
+        std::string appId;
+        std::string ibId;
+        std::string userId;
+        std::string userGroup;
+        int protocolVersion;
+        // Темы подписки. nullptr - фильтр не установлен, клиент получает сообщения по всем темам.
+        std::unique_ptr<std::unordered_set<std::string> > topics;
+        std::unordered_map<std::string, int64_t> documentVersions;
+        uint32_t lastPublishSequence;
+    };
+
+    typedef std::unordered_map<std::string, std::unordered_set<Connection*> > ConnectionIndex;
+
+    void Accept(int listenSocket, ConnectionKind kind);
+    void OnReadable(Connection* conn);
+    void OnWritable(Connection* conn);
+
+    bool ProcessClientFrames(Connection* conn);
+    bool RegisterClient(Connection* conn, const unsigned char* data, size_t size);
+    bool ProcessControlFrame(Connection* conn, const unsigned char* data, size_t size);
+    bool ProcessPublishFrame(Connection* conn, const unsigned char* data, size_t size);
+
+    bool ProcessHttpRequests(Connection* conn);
+    void HandleHttpRequest(Connection* conn, const std::string& method, const std::string& target,
+        const std::string& authorization, const char* body, size_t bodySize);
+    void SendHttpResponse(Connection* conn, int status, const std::string& body = std::string());
+
+    void DrainPosted();
+    void Deliver(const OutgoingMessage& message, int64_t now);
+    void Enqueue(Connection* conn, const SharedFrame& frame);
+    void Flush(Connection* conn);
+    void FlushDirty();
+    void SetWriteArmed(Connection* conn, bool armed);
+    void MarkClosed(Connection* conn);
+    void ReapClosed();
+
+    AppStorage& m_apps;
+    Dispatcher& m_dispatcher;
+    ReactorOptions m_options;
+
+    int m_epoll;
+    int m_wakeup;
+    int m_serviceSocket;
+    int m_listenSocket;
+    std::atomic<bool> m_stop;
+    std::vector<unsigned char> m_receiveBuffer;
+
+    std::mutex m_postMutex;
+    std::vector<std::shared_ptr<const OutgoingMessage> > m_posted;
+
+    std::unordered_set<Connection*> m_connections;
+    std::vector<Connection*> m_dirty;
+    std::vector<Connection*> m_closed;
+    std::atomic<size_t> m_clientCount;
+
+    // Ключи индексов: "приложение\nбаза", "приложение\nбаза\nпользователь", "приложение\nбаза\nгруппа".
+    ConnectionIndex m_byIb;
+    ConnectionIndex m_byUser;
+    ConnectionIndex m_byGroup;
+};
+
+#endif //__REACTOR_H__
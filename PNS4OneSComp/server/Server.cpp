@@ -0,0 +1,204 @@
+// Сервис уведомлений на C++ для Linux: принимает подключения компоненты по тому же протоколу,
+// что и сервис на C# (регистрация, управляющие кадры и публикации клиентов, кадры версий 1 и 2),
+// и сообщения по методам auth и sendmessage. Использует тот же файл приложений. Предназначен
+// для узлов с большим количеством подключений: каждый поток соединений обслуживает свою часть
+// клиентов в собственном epoll, сообщение шифруется один раз для всех получателей.
+// Администрирование приложений выполняется утилитой pns4onesadmin, после изменения файла
+// приложений сервису передается сигнал SIGHUP. Защищенное соединение (SSL) не поддерживается.
+//
+// Запуск: pns4ones_server [параметры]
+//  /listen адрес[:порт]      - интерфейс приема новых уведомлений (*:36696);
+//  /service адрес[:порт]     - интерфейс подключения клиентов (*:36695);
+//  /keys файл                - файл приложений (/etc/pns4ones/keys);
+//  /threads N                - количество потоков соединений (количество процессоров);
+//  /outbound_limit байт      - объем неотправленных клиенту данных, при превышении
+//                              которого клиент отключается (4194304);
+//  /log_level уровень        - Trace, Debug, Information, Warning, Error, Critical, None (Information).
+
+#include <sys/resource.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AppStorage.h"
+#include "Dispatcher.h"
+#include "Log.h"
+#include "Reactor.h"
+
+constexpr int SERVICE_DEFAULT_PORT = 36695;
+constexpr int LISTEN_DEFAULT_PORT = 36696;
+constexpr int STATS_INTERVAL_SEC = 60;
+
+LogLevel g_LogLevel = eLogInformation;
+
+bool ParseLogLevel(const std::string& name, LogLevel& level)
+{
+    static const char* names[] = { "trace", "debug", "information", "warning", "error", "critical", "none" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcasecmp(name.c_str(), names[i]) == 0) {
+            level = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct ServerOptions
+{
+    ServerOptions() : keysPath("/etc/pns4ones/keys"), threads(std::max(1u, std::thread::hardware_concurrency()))
+    {
+        ParseEndPoint("", SERVICE_DEFAULT_PORT, serviceAddress);
+        ParseEndPoint("", LISTEN_DEFAULT_PORT, listenAddress);
+    }
+
+    // Разбор адреса совпадает с IPEndPointExtensions.ParseOrDefault сервиса на C#.
+    static void ParseEndPoint(const std::string& s, int defaultPort, sockaddr_in& address)
+    {
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons((uint16_t)defaultPort);
+
+        size_t pos = s.find(':');
+        std::string host = s.substr(0, pos);
+        if (pos != std::string::npos) {
+            int port = atoi(s.c_str() + pos + 1);
+            if (port > 0 && port < 65536)
+                address.sin_port = htons((uint16_t)port);
+        }
+
+        if (strcasecmp(host.c_str(), "localhost") == 0)
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        else if (!host.empty() && host != "*" && inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1)
+            address.sin_addr.s_addr = htonl(INADDR_ANY);
+    }
+
+    sockaddr_in serviceAddress;
+    sockaddr_in listenAddress;
+    std::string keysPath;
+    unsigned threads;
+    ReactorOptions reactor;
+};
+
+static bool ParseOptions(int argc, char* argv[], ServerOptions& options)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string name = argv[i];
+        if (i + 1 >= argc || name.size() < 2 || name[0] != '/')
+            return false;
+        std::string value = argv[++i];
+
+        if (name == "/listen")
+            ServerOptions::ParseEndPoint(value, LISTEN_DEFAULT_PORT, options.listenAddress);
+        else if (name == "/service")
+            ServerOptions::ParseEndPoint(value, SERVICE_DEFAULT_PORT, options.serviceAddress);
+        else if (name == "/keys")
+            options.keysPath = value;
+        else if (name == "/threads")
+            options.threads = (unsigned)std::max(1, atoi(value.c_str()));
+        else if (name == "/outbound_limit")
+            options.reactor.outboundLimit = (size_t)std::max(1LL, atoll(value.c_str()));
+        else if (name == "/log_level") {
+            if (!ParseLogLevel(value, g_LogLevel))
+                return false;
+        }
+        else
+            return false;
+    }
+    return true;
+}
+
+static std::string FormatEndPoint(const sockaddr_in& address)
+{
+    char host[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &address.sin_addr, host, sizeof(host));
+    return std::string(host) + ":" + std::to_string(ntohs(address.sin_port));
+}
+
+int main(int argc, char* argv[])
+{
+    ServerOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        fprintf(stderr, "usage: %s [/listen addr[:port]] [/service addr[:port]] [/keys file] [/threads N]"
+            " [/outbound_limit bytes] [/log_level level]\n", argv[0]);
+        return 1;
+    }
+
+    // Каждое подключение занимает дескриптор файла.
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    AppStorage apps(options.keysPath);
+    if (!apps.Load())
+        return 1;
+    Log(eLogInformation, "%zu applications are loaded from %s", apps.Count(), options.keysPath.c_str());
+
+    // Сигналы завершения и перечитывания файла приложений обрабатывает основной поток,
+    // маска наследуется потоками соединений.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    Dispatcher dispatcher(apps);
+    std::vector<std::unique_ptr<Reactor> > reactors;
+    for (unsigned i = 0; i < options.threads; i++) {
+        reactors.emplace_back(new Reactor(apps, dispatcher, options.reactor));
+        if (!reactors.back()->Listen(options.serviceAddress, options.listenAddress)) {
+            Log(eLogCritical, "cannot listen on %s and %s: %s", FormatEndPoint(options.serviceAddress).c_str(),
+                FormatEndPoint(options.listenAddress).c_str(), strerror(errno));
+            return 1;
+        }
+        dispatcher.AddReactor(reactors.back().get());
+    }
+
+    std::vector<std::thread> threads;
+    for (std::unique_ptr<Reactor>& reactor : reactors) {
+        Reactor* r = reactor.get();
+        threads.emplace_back([r]() { r->Run(); });
+    }
+
+    Log(eLogInformation, "clients are accepted on %s, notifications on %s, %u threads",
+        FormatEndPoint(options.serviceAddress).c_str(), FormatEndPoint(options.listenAddress).c_str(), options.threads);
+
+    timespec timeout;
+    timeout.tv_sec = STATS_INTERVAL_SEC;
+    timeout.tv_nsec = 0;
+    while (true) {
+        int signal = sigtimedwait(&signals, nullptr, &timeout);
+        if (signal == SIGINT || signal == SIGTERM)
+            break;
+
+        if (signal == SIGHUP) {
+            if (apps.Load())
+                Log(eLogInformation, "%zu applications are reloaded", apps.Count());
+            continue;
+        }
+
+        if (signal < 0) {
+            size_t clients = 0;
+            for (std::unique_ptr<Reactor>& reactor : reactors)
+                clients += reactor->ClientCount();
+            Log(eLogDebug, "%zu clients are connected", clients);
+        }
+    }
+
+    Log(eLogInformation, "stopping");
+    for (std::unique_ptr<Reactor>& reactor : reactors)
+        reactor->Stop();
+    for (std::thread& thread : threads)
+        thread.join();
+    return 0;
+}
@@ -0,0 +1,83 @@
+// Проверка преобразования UTF-16 <-> UTF-8: символы вне BMP (эмодзи) кодируются одной 4-байтовой
+// последовательностью UTF-8, одиночные суррогаты заменяются символом U+FFFD.
+//
+// Запуск: pns4onescomp_tests (или ctest). Код возврата - количество непройденных проверок.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../ConversionWchar.h"
+
+static int g_failed = 0;
+
+static void Check(bool condition, const char* name)
+{
+    if (!condition) {
+        printf("FAIL %s\n", name);
+        g_failed++;
+    }
+}
+
+static std::string ToUtf8(const std::vector<WCHAR_T>& source)
+{
+    std::vector<WCHAR_T> terminated(source);
+    terminated.push_back(0);
+
+    char* utf8 = nullptr;
+    size_t size = convFromShortWcharToUtf8(&utf8, terminated.data());
+    std::string result(utf8, size);
+    delete[] utf8;
+    return result;
+}
+
+static std::vector<WCHAR_T> FromUtf8(const std::string& source)
+{
+    WCHAR_T* wchar = nullptr;
+    size_t len = convFromUtf8ToShortWchar(&wchar, source.c_str());
+    std::vector<WCHAR_T> result(wchar, wchar + len);
+    delete[] wchar;
+    return result;
+}
+
+static void TestBmp()
+{
+    // "Aд€"
+    std::vector<WCHAR_T> text = { (WCHAR_T)0x0041, (WCHAR_T)0x0434, (WCHAR_T)0x20AC };
+    Check(ToUtf8(text) == "A\xD0\xB4\xE2\x82\xAC", "bmp to utf8");
+    Check(FromUtf8("A\xD0\xB4\xE2\x82\xAC") == text, "bmp from utf8");
+}
+
+static void TestSurrogatePair()
+{
+    // U+1F600 - суррогатная пара D83D DE00, в UTF-8 - F0 9F 98 80.
+    std::vector<WCHAR_T> text = { (WCHAR_T)0x0041, (WCHAR_T)0xD83D, (WCHAR_T)0xDE00, (WCHAR_T)0x0042 };
+    Check(ToUtf8(text) == "A\xF0\x9F\x98\x80" "B", "surrogate pair to utf8");
+    Check(FromUtf8("A\xF0\x9F\x98\x80" "B") == text, "surrogate pair from utf8");
+}
+
+static void TestLoneSurrogates()
+{
+    // Старший суррогат без младшего, младший без старшего и старший в конце строки.
+    std::vector<WCHAR_T> text = { (WCHAR_T)0xD83D, (WCHAR_T)0x0041, (WCHAR_T)0xDE00, (WCHAR_T)0xD83D };
+    Check(ToUtf8(text) == "\xEF\xBF\xBD" "A" "\xEF\xBF\xBD\xEF\xBF\xBD", "lone surrogates to utf8");
+}
+
+static void TestTruncatedUtf8()
+{
+    // Неполная 4-байтовая последовательность в конце строки не читается за завершающим нулем.
+    std::vector<WCHAR_T> expected = { (WCHAR_T)0x0041, (WCHAR_T)0xFFFD };
+    Check(FromUtf8("A\xF0\x9F") == expected, "truncated utf8");
+}
+
+int main()
+{
+    TestBmp();
+    TestSurrogatePair();
+    TestLoneSurrogates();
+    TestTruncatedUtf8();
+
+    if (g_failed == 0)
+        printf("all tests passed\n");
+    return g_failed;
+}
@@ -0,0 +1,263 @@
+// Проверка кодека кадров (FrameCodec.h): запись и разбор кадров сервиса, регистрации и публикации,
+// отказ разбора усеченных кадров и кадров с размерами больше фактических данных, граница размера
+// кадра регистрации.
+//
+// Запуск: pns4onescomp_codec_tests (или ctest). Код возврата - количество непройденных проверок.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../FrameCodec.h"
+#include "../Registration.h"
+#include "../crypt.h"
+
+static int g_failed = 0;
+
+static void Check(bool condition, const char* name)
+{
+    if (!condition) {
+        printf("FAIL %s\n", name);
+        g_failed++;
+    }
+}
+
+static bool Equals(const ByteView& view, const std::string& expected)
+{
+    return view.size == expected.size() && memcmp(view.data, expected.data(), view.size) == 0;
+}
+
+static const std::string MESSAGE_ID = "message-1";
+static const std::string PAYLOAD = "0123456789abcdef";
+static const int64_t EXPIRES_AT = 1700000000123LL;
+
+// Кадр сервиса версии 2 с идентификатором сообщения и сроком жизни, вместе с полем размера кадра.
+static std::vector<unsigned char> BuildMessageFrameV2()
+{
+    size_t headerSize = FrameFieldSize(MESSAGE_ID.size()) + FrameFieldSize(FRAME_TIMESTAMP_SIZE);
+    std::vector<unsigned char> frame(MessageFrameV2Size(headerSize, PAYLOAD.size()));
+
+    FrameWriter writer(frame.data(), frame.size());
+    PutMessageFramePrefix(writer, true, headerSize, PAYLOAD.size());
+    writer.PutField(FRAME_FIELD_MESSAGE_ID, MESSAGE_ID.data(), MESSAGE_ID.size());
+    writer.PutTimestampField(FRAME_FIELD_EXPIRES_AT, EXPIRES_AT);
+    writer.PutLE32((uint32_t)PAYLOAD.size());
+    writer.PutBytes(PAYLOAD.data(), PAYLOAD.size());
+    Check(!writer.Failed() && writer.Size() == frame.size(), "v2 frame fills the buffer");
+    return frame;
+}
+
+static void TestMessageFrameV2RoundTrip()
+{
+    std::vector<unsigned char> frame = BuildMessageFrameV2();
+    Check(LoadLE32(frame.data()) == frame.size() - MESSAGE_FRAME_SIZE_BYTES, "v2 frame size");
+
+    MessageFrameView view;
+    bool parsed = ParseMessageFrame(frame.data() + MESSAGE_FRAME_SIZE_BYTES, frame.size() - MESSAGE_FRAME_SIZE_BYTES, view);
+    Check(parsed && view.hasHeader, "v2 frame parsed");
+    Check(view.decryptedSize == PAYLOAD.size() && Equals(view.payload, PAYLOAD), "v2 frame payload");
+    Check(view.body.size == DECRYPTED_SIZE_BYTES + PAYLOAD.size(), "v2 frame body");
+
+    FrameFieldReader fields(view.header);
+    unsigned char type = 0;
+    ByteView value;
+    int64_t timestamp = 0;
+    Check(fields.Next(type, value) && type == FRAME_FIELD_MESSAGE_ID && Equals(value, MESSAGE_ID), "v2 message id field");
+    Check(fields.Next(type, value) && type == FRAME_FIELD_EXPIRES_AT
+        && FrameFieldReader::ReadTimestamp(value, timestamp) && timestamp == EXPIRES_AT, "v2 expires at field");
+    Check(!fields.Next(type, value) && !fields.Failed(), "v2 header ends after the last field");
+}
+
+static void TestMessageFrameV1RoundTrip()
+{
+    std::vector<unsigned char> frame(MessageFrameV1Size(PAYLOAD.size()));
+    FrameWriter writer(frame.data(), frame.size());
+    PutMessageFramePrefix(writer, false, 0, PAYLOAD.size());
+    writer.PutLE32((uint32_t)PAYLOAD.size());
+    writer.PutBytes(PAYLOAD.data(), PAYLOAD.size());
+    Check(!writer.Failed() && writer.Size() == frame.size(), "v1 frame fills the buffer");
+
+    MessageFrameView view;
+    bool parsed = ParseMessageFrame(frame.data() + MESSAGE_FRAME_SIZE_BYTES, frame.size() - MESSAGE_FRAME_SIZE_BYTES, view);
+    Check(parsed && !view.hasHeader && view.header.size == 0, "v1 frame parsed");
+    Check(view.decryptedSize == PAYLOAD.size() && Equals(view.payload, PAYLOAD), "v1 frame payload");
+}
+
+static void TestTruncatedMessageFrame()
+{
+    std::vector<unsigned char> frame = BuildMessageFrameV2();
+    const unsigned char* data = frame.data() + MESSAGE_FRAME_SIZE_BYTES;
+    size_t size = frame.size() - MESSAGE_FRAME_SIZE_BYTES;
+    size_t payloadOffset = size - PAYLOAD.size();
+
+    // Кадр короче заголовка и размера данных не разбирается, усеченные данные попадают в представление как есть
+    // (их размер сверяется с размером расшифрованных данных при расшифровке).
+    bool truncatedRejected = true;
+    for (size_t n = 0; n < payloadOffset; n++) {
+        MessageFrameView view;
+        if (ParseMessageFrame(data, n, view))
+            truncatedRejected = false;
+    }
+    Check(truncatedRejected, "truncated v2 frame rejected");
+
+    MessageFrameView view;
+    Check(ParseMessageFrame(data, payloadOffset + 1, view) && view.payload.size == 1, "truncated v2 payload");
+
+    // Размер заголовка больше оставшихся данных.
+    std::vector<unsigned char> oversized(frame.begin() + MESSAGE_FRAME_SIZE_BYTES, frame.end());
+    StoreLE16(oversized.data() + FRAME_MARKER_SIZE, (uint16_t)FRAME_HEADER_MAX_SIZE);
+    Check(!ParseMessageFrame(oversized.data(), oversized.size(), view), "oversized v2 header rejected");
+}
+
+static void TestDamagedFields()
+{
+    unsigned char header[32];
+    FrameWriter writer(header, sizeof(header));
+    writer.PutField(FRAME_FIELD_MESSAGE_ID, "abc", 3);
+    writer.PutU8(FRAME_FIELD_TRACE_ID);
+    writer.PutLE16(10);
+    writer.PutBytes("12345", 5);
+
+    FrameFieldReader fields(ByteView(header, writer.Size()));
+    unsigned char type = 0;
+    ByteView value;
+    Check(fields.Next(type, value) && type == FRAME_FIELD_MESSAGE_ID, "field before damaged field");
+    Check(!fields.Next(type, value) && fields.Failed(), "oversized field rejected");
+
+    // Поле, усеченное внутри длины.
+    FrameFieldReader prefixOnly(ByteView(header, 2));
+    Check(!prefixOnly.Next(type, value) && prefixOnly.Failed(), "truncated field prefix rejected");
+
+    int64_t timestamp = 0;
+    unsigned char shortTimestamp[FRAME_TIMESTAMP_SIZE - 1] = { 0 };
+    Check(!FrameFieldReader::ReadTimestamp(ByteView(shortTimestamp, sizeof(shortTimestamp)), timestamp),
+        "short timestamp rejected");
+}
+
+static void TestFrameWriterOverflow()
+{
+    unsigned char buf[6];
+    FrameWriter writer(buf, sizeof(buf));
+    writer.PutLE32(1);
+    writer.PutLE32(2);
+    Check(writer.Failed() && writer.Size() == 4, "writer stops at the capacity");
+
+    writer.PutU8(3);
+    Check(writer.Reserve(1) == nullptr && writer.Size() == 4, "writer stays failed");
+}
+
+static unsigned char g_hmacKey[] = "registration key";
+
+static void TestRegistrationRoundTrip()
+{
+    const WCHAR_T userGroup[] = { 'g', 'r', 'o', 'u', 'p', 0 };
+    char* buf = nullptr;
+    size_t size = ConnectDataToSendBuf("app", "ib", "user", userGroup, g_hmacKey, sizeof(g_hmacKey) - 1, &buf);
+    Check(size > CLIENT_FRAME_SIZE_BYTES && buf != nullptr, "registration built");
+    if (buf == nullptr)
+        return;
+
+    const unsigned char* data = (const unsigned char*)buf + CLIENT_FRAME_SIZE_BYTES;
+    size_t dataSize = size - CLIENT_FRAME_SIZE_BYTES;
+    Check(LoadLE16((const unsigned char*)buf) == dataSize, "registration frame size");
+
+    RegistrationView view;
+    Check(ParseRegistration(data, dataSize, view), "registration parsed");
+    Check(Equals(view.appId, "app") && Equals(view.ibId, "ib") && Equals(view.userId, "user")
+        && Equals(view.userGroup, "group"), "registration fields");
+    Check(view.hasProtocolVersion && Equals(view.protocolVersion, "2"), "registration protocol version");
+
+    unsigned char* hash = nullptr;
+    int hashSize = 0;
+    bool signedOk = hmacsha256_sign((unsigned char*)view.signedData.data, (int)view.signedData.size,
+        g_hmacKey, sizeof(g_hmacKey) - 1, &hash, &hashSize);
+    Check(signedOk && view.signature.size == HMAC_SHA256_SIZE && hashSize == (int)HMAC_SHA256_SIZE
+        && memcmp(hash, view.signature.data, HMAC_SHA256_SIZE) == 0, "registration signature");
+    delete[] hash;
+
+    // Без версии протокола (клиент первой версии) кадр заканчивается после группы, любое другое
+    // усечение приходится на середину строки или подписи.
+    size_t v1Size = dataSize - 2;
+    bool truncatedRejected = true;
+    for (size_t n = 0; n < dataSize; n++) {
+        RegistrationView truncated;
+        if (ParseRegistration(data, n, truncated) != (n == v1Size))
+            truncatedRejected = false;
+    }
+    Check(truncatedRejected, "truncated registration rejected");
+
+    std::vector<unsigned char> damaged(data, data + dataSize);
+    StoreLE16(damaged.data(), 0);
+    Check(!ParseRegistration(damaged.data(), damaged.size(), view), "empty signature rejected");
+    StoreLE16(damaged.data(), (uint16_t)dataSize);
+    Check(!ParseRegistration(damaged.data(), damaged.size(), view), "oversized signature rejected");
+
+    delete[] buf;
+}
+
+static void TestRegistrationSizeLimit()
+{
+    // Данные кадра: подпись с длиной (2 + 32), "a", "b", пользователь, "g", версия "2", пять нулей.
+    const WCHAR_T userGroup[] = { 'g', 0 };
+    size_t maxUserIdLen = CLIENT_FRAME_MAX_SIZE - SIGNATURE_SIZE_BYTES - HMAC_SHA256_SIZE - 4 - 5;
+    std::string userId(maxUserIdLen, 'u');
+
+    char* buf = nullptr;
+    size_t size = ConnectDataToSendBuf("a", "b", userId.c_str(), userGroup, g_hmacKey, sizeof(g_hmacKey) - 1, &buf);
+    Check(size == CLIENT_FRAME_SIZE_BYTES + CLIENT_FRAME_MAX_SIZE && buf != nullptr, "registration of max size built");
+    if (buf != nullptr) {
+        Check(LoadLE16((const unsigned char*)buf) == CLIENT_FRAME_MAX_SIZE, "registration of max size frame size");
+        delete[] buf;
+    }
+
+    // При отказе указатель на буфер сбрасывается, даже если до вызова он был задан.
+    userId.push_back('u');
+    buf = (char*)&size;
+    size = ConnectDataToSendBuf("a", "b", userId.c_str(), userGroup, g_hmacKey, sizeof(g_hmacKey) - 1, &buf);
+    Check(size == 0 && buf == nullptr, "oversized registration rejected");
+}
+
+static std::vector<unsigned char> BuildPublishFrame(size_t encryptedSize)
+{
+    std::vector<unsigned char> frame(PUBLISH_FRAME_HEADER_SIZE + encryptedSize + HMAC_SHA256_SIZE);
+    FrameWriter writer(frame.data(), frame.size());
+    writer.PutU8(CONTROL_FRAME_PUBLISH);
+    writer.PutLE32(7);
+    writer.PutLE32(5);
+    memset(writer.Reserve(encryptedSize + HMAC_SHA256_SIZE), 0xAB, encryptedSize + HMAC_SHA256_SIZE);
+    Check(!writer.Failed(), "publish frame built");
+    return frame;
+}
+
+static void TestPublishFrame()
+{
+    std::vector<unsigned char> frame = BuildPublishFrame(16);
+    PublishFrameView view;
+    Check(ParsePublishFrame(frame.data(), frame.size(), view), "publish frame parsed");
+    Check(view.sequence == 7 && view.decryptedSize == 5 && view.encrypted.size == 16, "publish frame fields");
+    Check(view.signedData.size == frame.size() - HMAC_SHA256_SIZE
+        && view.signature.data == frame.data() + view.signedData.size, "publish frame signature");
+
+    std::vector<unsigned char> empty = BuildPublishFrame(0);
+    Check(ParsePublishFrame(empty.data(), empty.size(), view) && view.encrypted.size == 0, "publish frame without data");
+    Check(!ParsePublishFrame(empty.data(), empty.size() - 1, view), "truncated publish frame rejected");
+
+    frame[0] = CONTROL_FRAME_SET_TOPICS;
+    Check(!ParsePublishFrame(frame.data(), frame.size(), view), "publish frame of another type rejected");
+}
+
+int main()
+{
+    TestMessageFrameV2RoundTrip();
+    TestMessageFrameV1RoundTrip();
+    TestTruncatedMessageFrame();
+    TestDamagedFields();
+    TestFrameWriterOverflow();
+    TestRegistrationRoundTrip();
+    TestRegistrationSizeLimit();
+    TestPublishFrame();
+
+    if (g_failed == 0)
+        printf("all tests passed\n");
+    return g_failed;
+}